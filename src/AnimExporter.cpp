@@ -2,6 +2,8 @@
 #include "AnimExporter.h"
 #include "Quantize.h"
 #include "globalvars.h"
+#include "framecapture.h"
+#include "threadpool.h"
 // CxImage
 #include "CxImage/ximage.h"
 #include "CxImage/ximagif.h"
@@ -18,6 +20,7 @@ BEGIN_EVENT_TABLE(CAnimationExporter, wxFrame)
 	EVT_CHECKBOX(ID_GIFSHRINK,		CAnimationExporter::OnCheck)
 	EVT_CHECKBOX(ID_GIFGREYSCALE,	CAnimationExporter::OnCheck)
 	EVT_CHECKBOX(ID_PNGSEQ,	CAnimationExporter::OnCheck)
+	EVT_CHECKBOX(ID_GIFGLOBALPAL,	CAnimationExporter::OnCheck)
 END_EVENT_TABLE()
 
 // This creates our frame and all our objects
@@ -44,6 +47,7 @@ CAnimationExporter::CAnimationExporter(wxWindow* parent, wxWindowID id, const wx
 	cbPng = new wxCheckBox(this, ID_PNGSEQ, wxT("PNG Sequence"), wxPoint(250,65), wxDefaultSize, 0);
 	cbDither = new wxCheckBox(this, ID_GIFDIFFUSE, wxT("Error Diffusion"), wxPoint(10,85), wxDefaultSize, 0);
 	cbShrink = new wxCheckBox(this, ID_GIFSHRINK, wxT("Resize"), wxPoint(130,85), wxDefaultSize, 0);
+	cbGlobalPal = new wxCheckBox(this, ID_GIFGLOBALPAL, wxT("Global Palette"), wxPoint(250,85), wxDefaultSize, 0);
 
 	lblSize = new wxStaticText(this, wxID_ANY, wxT("Size Dimensions:"), wxPoint(10,105), wxDefaultSize);
 	txtSizeX = new wxTextCtrl(this, wxID_ANY, wxT("0"), wxPoint(100,105), wxSize(40,18));
@@ -64,6 +68,8 @@ void CAnimationExporter::Init(const wxString fn)
 		return;
 
 	m_pPal = NULL;
+	m_pImages = NULL;
+	m_pQuantizers = NULL;
 	m_fAnimSpeed = 0.0f;
 
 	m_bTransparent = false;
@@ -71,6 +77,7 @@ void CAnimationExporter::Init(const wxString fn)
 	m_bShrink = false;
 	m_bGreyscale = false;
 	m_bPng = false;
+	m_bGlobalPalette = false;
 	
 	m_iNewWidth = 0;
 	m_iNewHeight = 0;
@@ -91,6 +98,7 @@ void CAnimationExporter::Init(const wxString fn)
 	cbTrans->Enable(true);
 	cbDither->Enable(true);
 	cbShrink->Enable(true);
+	cbGlobalPal->Enable(true);
 	txtFrames->Enable(true);
 	txtSizeX->Enable(true);
 	txtSizeY->Enable(true);
@@ -99,6 +107,7 @@ void CAnimationExporter::Init(const wxString fn)
 	txtSizeX->SetValue(wxT("0"));
 	txtSizeY->SetValue(wxT("0"));
 	cbShrink->SetValue(false);
+	cbGlobalPal->SetValue(false);
 }
 
 CAnimationExporter::~CAnimationExporter()
@@ -108,6 +117,93 @@ CAnimationExporter::~CAnimationExporter()
 }
 
 
+// Runs one step of the per frame work on the shared thread pool.
+class AnimFrameJob : public ThreadJob {
+public:
+	typedef void (CAnimationExporter::*Step)(size_t frame);
+
+	AnimFrameJob(CAnimationExporter *exporter, Step step, size_t frame) : exporter(exporter), step(step), frame(frame) {}
+	virtual void Run() { (exporter->*step)(frame); }
+
+private:
+	CAnimationExporter *exporter;
+	Step step;
+	size_t frame;
+};
+
+void CAnimationExporter::QueueFrame(void (CAnimationExporter::*step)(size_t), size_t frame)
+{
+	ThreadPool::Get().Add(new AnimFrameJob(this, step, frame));
+}
+
+// Takes one captured frame (BGRA, bottom row first). PNG frames are streamed straight
+// to the writer, GIF frames are copied and colour reduced on the thread pool.
+void CAnimationExporter::AddFrame(unsigned char *buffer, size_t frame)
+{
+	if (m_bPng) {
+		m_Writer.Add(buffer);
+		return;
+	}
+
+	CxImage *newImage = new CxImage(0);
+	newImage->CreateFromArray(buffer, (DWORD)m_iWidth, (DWORD)m_iHeight, 32, (DWORD)(m_iWidth*4), false);
+	m_pImages[frame] = newImage;
+
+	if (m_bGlobalPalette) {
+		QueueFrame(&CAnimationExporter::QuantizeGifFrame, frame);
+	} else if (frame == 0) {
+		// Every frame uses the palette of the first one, so that one is made right away.
+		PrepareGifFrame(0);
+		CQuantizer q(256, 8);
+		q.ProcessImage((HANDLE)newImage->GetDIB());
+		m_pPal = (RGBQUAD*) calloc(256*sizeof(RGBQUAD), 1); //This creates our gifs optimised global colour palette
+		q.SetColorTable(m_pPal);
+		QueueFrame(&CAnimationExporter::ReduceGifFrame, 0);
+	} else {
+		QueueFrame(&CAnimationExporter::ConvertGifFrame, frame);
+	}
+}
+
+// The steps below run on the thread pool, each only touches its own frame.
+void CAnimationExporter::PrepareGifFrame(size_t frame)
+{
+	CxImage *newImage = m_pImages[frame];
+
+	#ifdef _WINDOWS
+	if (m_bGreyscale)
+		newImage->GrayScale();
+	#endif //_WINDOWS
+
+	if(m_bShrink && m_iNewWidth!=m_iWidth && m_iNewHeight!=m_iHeight)
+		newImage->Resample((long)m_iNewWidth, (long)m_iNewHeight, 2);
+}
+
+void CAnimationExporter::QuantizeGifFrame(size_t frame)
+{
+	PrepareGifFrame(frame);
+	m_pQuantizers[frame] = new CQuantizer(256, 8);
+	m_pQuantizers[frame]->ProcessImage((HANDLE)m_pImages[frame]->GetDIB());
+}
+
+void CAnimationExporter::ReduceGifFrame(size_t frame)
+{
+	CxImage *newImage = m_pImages[frame];
+
+	newImage->DecreaseBpp(8, m_bDiffuse, m_pPal, 256);
+	newImage->SetCodecOption(2); // for LZW compression
+
+	if(m_bTransparent)
+		newImage->SetTransIndex(newImage->GetPixelIndex(0,0));
+
+	newImage->SetFrameDelay((DWORD)m_iDelay);
+}
+
+void CAnimationExporter::ConvertGifFrame(size_t frame)
+{
+	PrepareGifFrame(frame);
+	ReduceGifFrame(frame);
+}
+
 // This must be called before any frame-saving is attempted.
 void CAnimationExporter::CreateGif()
 {
@@ -118,8 +214,6 @@ void CAnimationExporter::CreateGif()
 		return;
 	}
 
-	CxImage **gifImages = NULL;		// Our pointer array of images
-
 	// Reset the state of our GUI objects
 	btnStart->Enable(false);
 	btnCancel->Enable(false);
@@ -128,6 +222,7 @@ void CAnimationExporter::CreateGif()
 	cbTrans->Enable(false);
 	cbDither->Enable(false);
 	cbShrink->Enable(false);
+	cbGlobalPal->Enable(false);
 	txtFrames->Enable(false);
 	txtSizeX->Enable(false);
 	txtSizeY->Enable(false);
@@ -168,34 +263,18 @@ void CAnimationExporter::CreateGif()
 		}
 	}
 
-#ifdef _WINDOWS
-	// CREATE OUR RENDERTOTEXTURE OBJECT
-	// -------------------------------------------
-	// if either are supported use our 'RenderTexture' object.
-	if (video.supportPBO || video.supportVBO) { 
-		g_canvas->rt = new RenderTexture();
-
-		if (!g_canvas->rt) {
-			wxLogMessage(wxT("Error: RenderToTexture object is null!"));
-			this->Show(false);
-			return;
-		}
-
-		g_canvas->rt->Init((HWND)g_canvas->GetHandle(), 0, 0, video.supportFBO);
-		
-		m_iWidth = g_canvas->rt->nWidth;
-		m_iHeight = g_canvas->rt->nHeight;
-		g_canvas->rt->BeginRender();
-	} else 
-#endif
-	{
-		glReadBuffer(GL_BACK);
-		int screenSize[4];
-		glGetIntegerv(GL_VIEWPORT, (GLint*)screenSize);				// get the width/height of the canvas
-		m_iWidth = screenSize[2];
-		m_iHeight = screenSize[3];
+	// Frames are rendered offscreen at the canvas size, independent of the window system.
+	FrameCapture capture;
+	if (!capture.Begin(0, 0)) {
+		wxMessageBox(wxT("Unable to create animated GIF!"), wxT("Error"));
+		wxLogMessage(wxT("Error: Unable to set up the offscreen frame capture."));
+		g_canvas->model->animManager->SetSpeed(m_fAnimSpeed);
+		video.render = true;
+		Show(false);
 		return;
 	}
+	m_iWidth = capture.width;
+	m_iHeight = capture.height;
 	
 	// Stop our animation
 	g_canvas->model->animManager->Pause(true);
@@ -203,135 +282,82 @@ void CAnimationExporter::CreateGif()
 	g_canvas->model->animManager->AnimateParticles();
 
 	// Size of our buffer to hold the pixel data
-	m_iSize = m_iWidth*m_iHeight*4;	// (width*height*bytesPerPixel)	
+	m_iSize = capture.FrameSize();	// (width*height*bytesPerPixel)	
 
-	// Create one frame to make our optimal colour palette from.
 	unsigned char *buffer = new unsigned char[m_iSize];
-	gifImages = new CxImage*[m_iTotalFrames];
+	if (m_bPng) {
+		// written as they come in, only a few frames are held at any time
+		m_Writer.transparent = m_bTransparent;
+		m_Writer.greyscale = m_bGreyscale;
+		m_Writer.Open(m_strFilename, FRAMEWRITER_PNG, (int)m_iWidth, (int)m_iHeight);
+	} else {
+		m_pImages = new CxImage*[m_iTotalFrames];
+		memset(m_pImages, 0, m_iTotalFrames*sizeof(CxImage*));
+		if (m_bGlobalPalette) {
+			m_pQuantizers = new CQuantizer*[m_iTotalFrames];
+			memset(m_pQuantizers, 0, m_iTotalFrames*sizeof(CQuantizer*));
+		}
+	}
 
-	for(unsigned int i=0; i<m_iTotalFrames && !m_bPng; i++) {
+	// The read back of a frame finishes while the next one is being rendered, so
+	// frames are collected one step behind the capture, and then reduced or encoded
+	// on other threads while the following ones render.
+	size_t done = 0;
+	for(unsigned int i=0; i<m_iTotalFrames; i++) {
 		lblCurFrame->SetLabel(wxString::Format(wxT("Current Frame: %i"), i));
 
 		this->Refresh();
 		this->Update();
 
-		CxImage *newImage = new CxImage(0);
-
-		g_canvas->RenderToBuffer();
-
-		glReadPixels(0, 0, (GLsizei)m_iWidth, (GLsizei)m_iHeight, GL_BGRA_EXT, GL_UNSIGNED_BYTE, buffer);
-		newImage->CreateFromArray(buffer, (DWORD)m_iWidth, (DWORD)m_iHeight, 32, (DWORD)(m_iWidth*4), false);
+		capture.Capture();
 
 		// not needed due to the code just below, which fixes the issue with particles
 		//g_canvas->model->animManager->SetTimeDiff(m_iTimeStep);
 		//g_canvas->model->animManager->Tick(m_iTimeStep);
-
 		if (g_canvas->root)
 			g_canvas->root->tick((float)m_iTimeStep);
 		if (g_canvas->sky)
 			g_canvas->sky->tick((float)m_iTimeStep);
-		
-
-		#ifdef _WINDOWS
-		if (m_bGreyscale)
-			newImage->GrayScale();
-		#endif //_WINDOWS
-
-		if(m_bShrink && m_iNewWidth!=m_iWidth && m_iNewHeight!=m_iHeight)
-			newImage->Resample((long)m_iNewWidth, (long)m_iNewHeight, 2);
 
-		// if (Optimise) {
-		if (!m_pPal) {
-			CQuantizer q(256, 8);
-			q.ProcessImage((HANDLE)newImage->GetDIB());
-			m_pPal = (RGBQUAD*) calloc(256*sizeof(RGBQUAD), 1); //This creates our gifs optimised global colour palette
-			q.SetColorTable(m_pPal);
+		while (done < m_iTotalFrames && capture.Read(buffer)) {
+			AddFrame(buffer, done);
+			done++;
 		}
-
-		newImage->DecreaseBpp(8, m_bDiffuse, m_pPal, 256);
-		newImage->SetCodecOption(2); // for LZW compression
-
-		if(m_bTransparent)
-			newImage->SetTransIndex(newImage->GetPixelIndex(0,0));
-
-		newImage->SetFrameDelay((DWORD)m_iDelay);
-		
-		gifImages[i] = newImage;
-		
-		// All the memory that we allocate for newImage gets cleared at the end
 	}
+	capture.Finish();
+	while (done < m_iTotalFrames && capture.Read(buffer)) {
+		AddFrame(buffer, done);
+		done++;
+	}
+	capture.End();
+	m_iTotalFrames = done;
 
-	//PNG Sequence Exporter, use if Checkbox is true
-	for(unsigned int i=0; i<m_iTotalFrames && m_bPng; i++) {
-		lblCurFrame->SetLabel(wxString::Format(wxT("Current Frame: %i"), i));
+	wxDELETEA(buffer);
 
-		this->Refresh();
-		this->Update();
+	if (m_bPng)
+		m_Writer.Close();
 
-		CxImage *newImage = new CxImage(0);
-		CxImage *newImage2 = new CxImage(0);
-		
-		g_canvas->RenderToBuffer();
-		wxString stat;
-
-		glReadPixels(0, 0, (GLsizei)m_iWidth, (GLsizei)m_iHeight, GL_BGRA_EXT, GL_UNSIGNED_BYTE, buffer);
-
-		newImage->CreateFromArray(buffer, (DWORD)m_iWidth, (DWORD)m_iHeight, 32, (DWORD)(m_iWidth*4), false);
-
-		/*
-		 *Because Alpha Channel textures are a bit messed up in the OpenGL renders,
-		 *alpha channels will have to be 1-bit to "hide" any texture errors
-		 */
-		if (m_bTransparent){
-			newImage->AlphaSplit(newImage2); //split alpha to another cximage object
-			newImage2->Threshold(1); //convert 8bit alpha to 1bit
-			//newImage2->GrayScale(); //prepare conversion for application to alpha channel
-			newImage->AlphaSet(*newImage2); //apply mock 1-bit alpha channel
-		}else{
-			newImage->AlphaCreate();
-			newImage->IncreaseBpp(32);
-		}
+	ThreadPool &pool = ThreadPool::Get();
+	pool.Wait();
 
-		// not needed due to the code just below, which fixes the issue with particles
-		//g_canvas->model->animManager->SetTimeDiff(m_iTimeStep);
-		//g_canvas->model->animManager->Tick(m_iTimeStep);
-		if (g_canvas->root)
-			g_canvas->root->tick((float)m_iTimeStep);
-		if (g_canvas->sky)
-			g_canvas->sky->tick((float)m_iTimeStep);
-		
-
-		#ifdef _WINDOWS
-		if (m_bGreyscale)
-			newImage->GrayScale();
-		#endif //_WINDOWS
+	if (m_pQuantizers) {
+		// One palette for the whole animation. The frames are merged in order so
+		// the result doesn't depend on which thread finished first.
+		CQuantizer q(256, 8);
+		for(unsigned int i=0; i<m_iTotalFrames; i++) {
+			q.MergeColors(*m_pQuantizers[i], (UINT)m_iTotalFrames);
+			wxDELETE(m_pQuantizers[i]);
+		}
+		wxDELETEA(m_pQuantizers);
 
-		// if (Optimise) {
+		m_pPal = (RGBQUAD*) calloc(256*sizeof(RGBQUAD), 1);
+		q.SetColorTable(m_pPal);
 
-		// Append PNG extension, save out PNG file with frame number
-		wxString filen = m_strFilename;
-		filen << wxT("_") << i << wxT(".png");
-#ifndef _MINGW
-		newImage->Save(filen.mb_str(), CXIMAGE_FORMAT_PNG);
-#else
-		newImage->Save(filen.wc_str(), CXIMAGE_FORMAT_PNG);
-#endif
-		
-		//gifImages must not be empty
-		gifImages[i] = newImage;
-		// All the memory that we allocate for newImage gets cleared at the end
+		for(unsigned int i=0; i<m_iTotalFrames; i++)
+			QueueFrame(&CAnimationExporter::ReduceGifFrame, i);
+		pool.Wait();
 	}
-	wxDELETEA(buffer);
-
-#ifdef _WINDOWS
-	if (video.supportPBO || video.supportVBO) {
-		g_canvas->rt->EndRender();
 
-		// Clear RenderTexture object.
-		g_canvas->rt->Shutdown();
-		wxDELETE(g_canvas->rt);
-	}
-#endif
 	if(!m_bPng){
 	// CREATE THE ACTUAL MULTI-IMAGE GIF ANIMATION
 	// ------------------------------------------------------
@@ -362,7 +388,7 @@ void CAnimationExporter::CreateGif()
 	multiImage.SetLoops(0);		// Set the animation to loop indefinately.
 
 	// Create/Compose the animated gif
-	multiImage.Encode(hFile, gifImages, (int)m_iTotalFrames, false);
+	multiImage.Encode(hFile, m_pImages, (int)m_iTotalFrames, false);
 
 	// ALL DONE, START THE CLEAN UP
 	// --------------------------------------------------------
@@ -371,11 +397,11 @@ void CAnimationExporter::CreateGif()
 	}
 
 	// Free the memory used by all the images to create the GIF
-	for(unsigned int i=0; i<m_iTotalFrames; i++) {
-		gifImages[i]->Destroy();
-		wxDELETE(gifImages[i]);
+	for(unsigned int i=0; m_pImages && i<m_iTotalFrames; i++) {
+		m_pImages[i]->Destroy();
+		wxDELETE(m_pImages[i]);
 	}
-	wxDELETEA(gifImages);
+	wxDELETEA(m_pImages);
 
 	// Free memory used by the colour palette
 	if (m_pPal) {
@@ -429,18 +455,22 @@ void CAnimationExporter::OnCheck(wxCommandEvent &event)
 	else if (event.GetId() == ID_PNGSEQ) {
 		m_bPng = event.IsChecked();
 	}
+	else if (event.GetId() == ID_GIFGLOBALPAL) {
+		m_bGlobalPalette = event.IsChecked();
+	}
 }
 
 
-void CAnimationExporter::CreateAvi(wxString fn)
+void CAnimationExporter::CreateAvi(wxString fn, int format)
 {
-#if defined(_WINDOWS) && !defined(_MINGW)
 	if (!g_canvas || !g_canvas->model || !g_canvas->model->animManager) {
 		wxMessageBox(wxT("Unable to create AVI animation!"), wxT("Error"));
 		wxLogMessage(wxT("Error: Unable to created AVI animation.  A required object pointer was null!"));
 		return;
 	}
 
+	const int fps = 25;
+
 	// Pause rendering to canvas
 	video.render = false;
 
@@ -448,79 +478,33 @@ void CAnimationExporter::CreateAvi(wxString fn)
 	m_fAnimSpeed = g_canvas->model->animManager->GetSpeed(); 
 	g_canvas->model->animManager->SetSpeed(1.0f);	// Set it to the normal speed.
 
+	// Animation time is in milliseconds, step it by one video frame so it plays at the right speed.
 	m_iTotalAnimFrames = g_canvas->model->animManager->GetFrameCount();
-	m_iTotalFrames = (m_iTotalAnimFrames / 25);
-
-	if (video.supportPBO || video.supportVBO) { // if either are supported use our 'RenderTexture' object.
-		g_canvas->rt = new RenderTexture();
-
-		if (!g_canvas->rt) {
-			wxLogMessage(wxT("Error: RenderToTexture object is null!"));
-			Show(false);
-			return;
-		}
+	m_iTimeStep = 1000 / fps;
+	m_iTotalFrames = m_iTotalAnimFrames / m_iTimeStep;
+	if (m_iTotalFrames < 1)
+		m_iTotalFrames = 1;
 
-		g_canvas->rt->Init((HWND)g_canvas->GetHandle(), 512, 512, video.supportFBO);
-		
-		m_iWidth = g_canvas->rt->nWidth;
-		m_iHeight = g_canvas->rt->nHeight;
-
-		//canvas->rt->BeginRender();
-		//canvas->RenderToBuffer();
-		//rt->BindTexture(); 
-	} else {
-		glReadBuffer(GL_BACK);
-		int screenSize[4];
-		glGetIntegerv(GL_VIEWPORT, screenSize);				// get the width/height of the canvas
-		m_iWidth = screenSize[2];
-		m_iHeight = screenSize[3];
-	}
-
-	// will crash program - prevent this from happening
-	if (m_iTotalFrames > m_iTotalAnimFrames) {
-		wxMessageBox(wxT("Impossible to make a gif with more frames than the model animation.\nClosing gif exporter."), wxT("Error"));
-		wxLogMessage(wxT("Error: Unable to make a gif with more frames than the model animation."));
+	FrameCapture capture;
+	if (!capture.Begin(512, 512) || !m_Writer.Open(fn, format, capture.width, capture.height, fps)) {
+		wxMessageBox(wxT("Unable to create AVI animation!"), wxT("Error"));
+		g_canvas->model->animManager->SetSpeed(m_fAnimSpeed);
+		video.render = true;
 		return;
 	}
-
-	const ssize_t timeStep = (m_iTotalAnimFrames / m_iTotalFrames);
-	const ssize_t bufSize = m_iWidth*m_iHeight*3;	// (width*height*bytesPerPixel - only 3 for RGB, no alpha)	
-
-	CAVIGenerator AviGen;
-
-	BITMAPINFOHEADER bmHeader;
-	bmHeader.biWidth = (LONG)m_iWidth;
-	bmHeader.biHeight = (LONG)m_iHeight;
-	bmHeader.biSize = sizeof(BITMAPINFOHEADER);
-	bmHeader.biPlanes = 1;
-	bmHeader.biBitCount = 24;
-	bmHeader.biSizeImage = bufSize; 
-	bmHeader.biCompression = BI_RGB;		//BI_RGB means BRG in reality
-	bmHeader.biClrUsed = 0;
-	bmHeader.biClrImportant = 0;
-	bmHeader.biXPelsPerMeter = 0;
-	bmHeader.biYPelsPerMeter = 0;
-	
-	// set our avi config
-	AviGen.SetRate(25);						// set 25fps
-	AviGen.SetBitmapHeader(bmHeader);
-	AviGen.SetFileName(fn.fn_str());
-
-	AviGen.InitEngineForWrite((HWND)this->GetParent()->GetHandle());
+	m_iWidth = capture.width;
+	m_iHeight = capture.height;
 	
 	// Stop our animation
 	g_canvas->model->animManager->Pause(true);
 	g_canvas->model->animManager->Stop();
 	g_canvas->model->animManager->AnimateParticles();
 
-	// Create one frame to make our optimal colour palette from.
-	unsigned char *buffer = new unsigned char[bufSize];
+	unsigned char *buffer = new unsigned char[capture.FrameSize()];
 
-	// Iterate through the frames saving the image to a buffer then writing it to the AVI
+	// Frames are compressed and written on the writer's thread while the next ones render.
 	for(unsigned int i=0; i<m_iTotalFrames; i++) {
-		g_canvas->RenderToBuffer();
-		glReadPixels(0, 0, (GLsizei)m_iWidth, (GLsizei)m_iHeight, GL_BGR_EXT, GL_UNSIGNED_BYTE, buffer);
-		AviGen.AddFrame(buffer);
+		capture.Capture();
 
 		// not needed due to the code just below
 		//g_canvas->model->animManager->SetTimeDiff(timeStep);
@@ -531,28 +515,25 @@ void CAnimationExporter::CreateAvi(wxString fn)
 			g_canvas->root->tick((float)m_iTimeStep);
 		if (g_canvas->sky)
 			g_canvas->sky->tick((float)m_iTimeStep);
+
+		while (capture.Read(buffer))
+			m_Writer.Add(buffer);
 	}
+	capture.Finish();
+	while (capture.Read(buffer))
+		m_Writer.Add(buffer);
+	capture.End();
 
-	// Release our Avi writing object
-	AviGen.ReleaseEngine();
+	if (!m_Writer.Close())
+		wxMessageBox(wxT("Unable to write the AVI animation!"), wxT("Error"));
 
 	// Clear our pixel data buffer.
 	wxDELETEA(buffer);
 
-	// Clear the Render Texture object from memory if it exists.
-	if (g_canvas->rt) {
-		g_canvas->rt->EndRender();
-
-		// Clear RenderTexture object.
-		g_canvas->rt->Shutdown();
-		wxDELETE(g_canvas->rt);
-	}
-
 	g_canvas->model->animManager->SetSpeed(m_fAnimSpeed); // Return the animation speed back to whatever it was previously set as
 	g_canvas->model->animManager->Play();
 	video.render = true;
 	g_canvas->InitView();
-#endif
 }
 
 // --
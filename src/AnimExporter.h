@@ -7,12 +7,12 @@
 #include <wx/wx.h>
 
 #include "modelcanvas.h"
-#if defined(_WINDOWS) && !defined(_MINGW)
-#include "AVIGenerator.h"
-#endif
+#include "framewriter.h"
 
 #include "CxImage/ximage.h" // RGBQUAD
 
+class CQuantizer;
+
 // File Source Change log:
 // Version | Date     | Comments
 // -----------------------------------------------------------------------------------------------------
@@ -34,12 +34,16 @@ private:
 	size_t m_iDelay;					// Delay between frames
 
 	bool m_bTransparent, m_bDiffuse, m_bShrink, m_bGreyscale, m_bPng;	// Various options and toggles settings
+	bool m_bGlobalPalette;				// One palette made from all the frames instead of the first one
 
 	size_t m_iSize;						// Size of our data buffer to hold the pixel data
 
 	float m_fAnimSpeed;					// Animation Speed
 	ssize_t m_iTimeStep;				// frame difference between each frame
 	RGBQUAD *m_pPal;
+	CxImage **m_pImages;				// The frames being exported
+	CQuantizer **m_pQuantizers;			// Colours of each frame, for the global palette
+	FrameWriter m_Writer;				// PNG sequence and AVI output
 
 	wxString m_strFilename;				// Filename to save our animated gif into.
 
@@ -47,7 +51,15 @@ private:
 	wxStaticText *lblCurFrame, *lblFile, *lblTotalFrame, *lblSize, *lblDelay;
 	wxButton *btnStart, *btnCancel;
 	wxTextCtrl *txtFrames, *txtSizeX, *txtSizeY, *txtDelay;
-	wxCheckBox *cbTrans, *cbDither, *cbShrink, *cbGrey, *cbPng;
+	wxCheckBox *cbTrans, *cbDither, *cbShrink, *cbGrey, *cbPng, *cbGlobalPal;
+
+	// per frame work, run on the thread pool
+	void QueueFrame(void (CAnimationExporter::*step)(size_t), size_t frame);
+	void AddFrame(unsigned char *buffer, size_t frame);
+	void PrepareGifFrame(size_t frame);
+	void QuantizeGifFrame(size_t frame);
+	void ReduceGifFrame(size_t frame);
+	void ConvertGifFrame(size_t frame);
 
 public:
 	CAnimationExporter(wxWindow* parent, wxWindowID id, const wxString& title, const wxPoint& pos = wxDefaultPosition, const wxSize& size = wxDefaultSize, long style = wxDEFAULT_FRAME_STYLE|wxCAPTION|wxFRAME_NO_TASKBAR);
@@ -68,7 +80,7 @@ public:
 
 	// avi export functions
 	// ------------------------------------------
-	void CreateAvi(wxString fn);
+	void CreateAvi(wxString fn, int format = FRAMEWRITER_AVI_MJPEG);
 
 	
 };
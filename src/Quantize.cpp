@@ -11,6 +11,8 @@ CQuantizer::CQuantizer (UINT nMaxColors, UINT nColorBits)
 
 	m_pTree	= NULL;
 	m_nLeafCount = 0;
+	m_nBlockUsed = QUANTIZER_BLOCK_NODES;
+	m_pFreeNodes = NULL;
 	for	(int i=0; i<=(int) m_nColorBits; i++)
 		m_pReducibleNodes[i] = NULL;
 	m_nMaxColors = m_nOutputMaxColors = nMaxColors;
@@ -19,8 +21,10 @@ CQuantizer::CQuantizer (UINT nMaxColors, UINT nColorBits)
 /////////////////////////////////////////////////////////////////////////////
 CQuantizer::~CQuantizer	()
 {
-	if (m_pTree	!= NULL)
-		DeleteTree (&m_pTree);
+	for (size_t i=0; i<m_Blocks.size(); i++)
+		free(m_Blocks[i]);
+	m_Blocks.clear();
+	m_pTree = NULL;
 }
 /////////////////////////////////////////////////////////////////////////////
 BOOL CQuantizer::ProcessImage (HANDLE hImage)
@@ -109,9 +113,20 @@ void CQuantizer::AddColor (NODE** ppNode, BYTE r, BYTE g, BYTE b, BYTE a,
 void* CQuantizer::CreateNode (UINT nLevel, UINT	nColorBits,	UINT* pLeafCount,
 	NODE** pReducibleNodes)
 {
-	NODE* pNode = (NODE*)calloc(1,sizeof(NODE));
-
-	if (pNode== NULL) return NULL;
+	NODE* pNode;
+	if (m_pFreeNodes) {
+		pNode = m_pFreeNodes;
+		m_pFreeNodes = pNode->pNext;
+	} else {
+		if (m_nBlockUsed == QUANTIZER_BLOCK_NODES) {
+			NODE* pBlock = (NODE*)malloc(QUANTIZER_BLOCK_NODES*sizeof(NODE));
+			if (pBlock == NULL) return NULL;
+			m_Blocks.push_back(pBlock);
+			m_nBlockUsed = 0;
+		}
+		pNode = m_Blocks.back() + m_nBlockUsed++;
+	}
+	memset(pNode, 0, sizeof(NODE));
 
 	pNode->bIsLeaf = (nLevel ==	nColorBits)	? TRUE : FALSE;
 	if (pNode->bIsLeaf) (*pLeafCount)++;
@@ -145,7 +160,7 @@ void CQuantizer::ReduceTree	(UINT nColorBits, UINT*	pLeafCount, NODE** pReducibl
 			nBlueSum +=	pNode->pChild[i]->nBlueSum;
 			nAlphaSum += pNode->pChild[i]->nAlphaSum;
 			pNode->nPixelCount += pNode->pChild[i]->nPixelCount;
-			free(pNode->pChild[i]);
+			FreeNode(pNode->pChild[i]);
 			pNode->pChild[i] = NULL;
 			nChildren++;
 		}
@@ -164,10 +179,62 @@ void CQuantizer::DeleteTree	(NODE**	ppNode)
 	for	(int i=0; i<8; i++)	{
 		if ((*ppNode)->pChild[i] !=	NULL) DeleteTree (&((*ppNode)->pChild[i]));
 	}
-	free(*ppNode);
+	FreeNode(*ppNode);
 	*ppNode	= NULL;
 }
 /////////////////////////////////////////////////////////////////////////////
+void CQuantizer::FreeNode (NODE* pNode)
+{
+	// The node is kept for reuse by CreateNode, the blocks are freed by the destructor.
+	pNode->pNext = m_pFreeNodes;
+	m_pFreeNodes = pNode;
+}
+/////////////////////////////////////////////////////////////////////////////
+void CQuantizer::MergeColors (const CQuantizer& src, UINT nScale)
+{
+	if (nScale < 1) nScale = 1;
+	MergeLeaves (src.m_pTree, nScale);
+}
+/////////////////////////////////////////////////////////////////////////////
+void CQuantizer::MergeLeaves (const NODE* pNode, UINT nScale)
+{
+	if (pNode == NULL)
+		return;
+
+	if (!pNode->bIsLeaf) {
+		for	(int i=0; i<8; i++)
+			MergeLeaves (pNode->pChild[i], nScale);
+		return;
+	}
+
+	UINT nCount = pNode->nPixelCount / nScale;
+	if (nCount == 0) nCount = 1;
+
+	// The leaf's average colour picks the branch, its (scaled) sums are added at the bottom.
+	BYTE r = (BYTE)(pNode->nRedSum / pNode->nPixelCount);
+	BYTE g = (BYTE)(pNode->nGreenSum / pNode->nPixelCount);
+	BYTE b = (BYTE)(pNode->nBlueSum / pNode->nPixelCount);
+	BYTE a = (BYTE)(pNode->nAlphaSum / pNode->nPixelCount);
+
+	AddColor (&m_pTree, r, g, b, a, m_nColorBits, 0, &m_nLeafCount, m_pReducibleNodes);
+
+	// AddColor counted one pixel in the leaf it ended in, find it to add the rest.
+	NODE* pLeaf = m_pTree;
+	for (UINT nLevel=0; !pLeaf->bIsLeaf; nLevel++) {
+		int	shift =	7 -	nLevel;
+		int	nIndex = (((r >> shift) & 1) << 2) | (((g >> shift) & 1) << 1) | ((b >> shift) & 1);
+		pLeaf = pLeaf->pChild[nIndex];
+	}
+	pLeaf->nPixelCount += nCount - 1;
+	pLeaf->nRedSum += r * (nCount - 1);
+	pLeaf->nGreenSum += g * (nCount - 1);
+	pLeaf->nBlueSum += b * (nCount - 1);
+	pLeaf->nAlphaSum += a * (nCount - 1);
+
+	while (m_nLeafCount	> m_nMaxColors)
+		ReduceTree (m_nColorBits, &m_nLeafCount, m_pReducibleNodes);
+}
+/////////////////////////////////////////////////////////////////////////////
 void CQuantizer::GetPaletteColors (NODE* pTree,	RGBQUAD* prgb, UINT* pIndex, UINT* pSum)
 {
 	if (pTree){
@@ -22,11 +22,14 @@
  * ==========================================================
  */
 
+#include <vector>
+
 #ifndef _WINDOWS
 	#include "CxImage/ximage.h"
 #endif
 
-
+// Nodes are allocated from blocks of this many, instead of one calloc per node.
+#define QUANTIZER_BLOCK_NODES	512
 
 class CQuantizer
 {
@@ -47,6 +50,9 @@ protected:
     UINT m_nMaxColors;
     UINT m_nOutputMaxColors;
     UINT m_nColorBits;
+    std::vector<NODE*> m_Blocks;    // node storage, freed all at once
+    UINT m_nBlockUsed;              // nodes handed out from the last block
+    NODE* m_pFreeNodes;             // nodes released by ReduceTree, linked by pNext
 
 public:
     CQuantizer (UINT nMaxColors, UINT nColorBits);
@@ -54,6 +60,9 @@ public:
     BOOL ProcessImage (HANDLE hImage);
     UINT GetColorCount ();
     void SetColorTable (RGBQUAD* prgb);
+    // Adds the colours gathered by another quantizer (for one palette over several images).
+    // Pixel counts are divided by nScale to keep the sums from overflowing.
+    void MergeColors (const CQuantizer& src, UINT nScale);
 
 protected:
     void AddColor (NODE** ppNode, BYTE r, BYTE g, BYTE b, BYTE a, UINT nColorBits,
@@ -63,6 +72,8 @@ protected:
     void ReduceTree (UINT nColorBits, UINT* pLeafCount,
         NODE** pReducibleNodes);
     void DeleteTree (NODE** ppNode);
+    void FreeNode (NODE* pNode);
+    void MergeLeaves (const NODE* pNode, UINT nScale);
     void GetPaletteColors (NODE* pTree, RGBQUAD* prgb, UINT* pIndex, UINT* pSum);
 	BYTE GetPixelIndex(long x,long y, int nbit, long effwdt, BYTE *pimage);
 };
@@ -0,0 +1,45 @@
+#include "alphaatlas.h"
+
+#include <string.h>
+
+AlphaAtlas::AlphaAtlas() : buf(ALPHAATLAS_SIZE*ALPHAATLAS_SIZE*ALPHAATLAS_CHANNELS, 0)
+{
+}
+
+void AlphaAtlas::clear()
+{
+	memset(&buf[0], 0, buf.size());
+}
+
+void AlphaAtlas::put(int x, int y, int channel, const unsigned char *map)
+{
+	if (x < 0 || y < 0 || x >= ALPHAATLAS_CELLS || y >= ALPHAATLAS_CELLS || channel < 0 || channel >= ALPHAATLAS_CHANNELS)
+		return;
+
+	for (size_t t=0; t<ALPHAMAP_SIZE; t++) {
+		unsigned char *p = &buf[(((y*ALPHAMAP_SIZE + t) * ALPHAATLAS_SIZE) + x*ALPHAMAP_SIZE) * ALPHAATLAS_CHANNELS + channel];
+		const unsigned char *src = map + t*ALPHAMAP_SIZE;
+		for (size_t s=0; s<ALPHAMAP_SIZE; s++, p+=ALPHAATLAS_CHANNELS)
+			*p = src[s];
+	}
+}
+
+unsigned char AlphaAtlas::get(int x, int y, int channel, int s, int t) const
+{
+	return buf[(((y*ALPHAMAP_SIZE + t) * ALPHAATLAS_SIZE) + x*ALPHAMAP_SIZE + s) * ALPHAATLAS_CHANNELS + channel];
+}
+
+void AlphaAtlas::extract(int channel, std::vector<unsigned char> &out) const
+{
+	out.resize(ALPHAATLAS_SIZE*ALPHAATLAS_SIZE);
+	const unsigned char *p = &buf[channel];
+	for (size_t i=0; i<out.size(); i++, p+=ALPHAATLAS_CHANNELS)
+		out[i] = *p;
+}
+
+void AlphaAtlas::cellTransform(int x, int y, float &offsetS, float &offsetT, float &scale)
+{
+	scale = (ALPHAMAP_SIZE - 1.0f) / ALPHAATLAS_SIZE;
+	offsetS = (x*ALPHAMAP_SIZE + 0.5f) / ALPHAATLAS_SIZE;
+	offsetT = (y*ALPHAMAP_SIZE + 0.5f) / ALPHAATLAS_SIZE;
+}
@@ -0,0 +1,44 @@
+#ifndef ALPHAATLAS_H
+#define ALPHAATLAS_H
+
+// STL
+#include <vector>
+
+#define ALPHAMAP_SIZE		64	// alpha and shadow maps of a map chunk are 64x64
+#define ALPHAATLAS_CELLS	16	// chunks per tile side
+#define ALPHAATLAS_SIZE		(ALPHAMAP_SIZE*ALPHAATLAS_CELLS)
+#define ALPHAATLAS_CHANNELS	4	// three alpha layers and the shadow map
+
+// AlphaAtlas
+// Staging buffer for the alpha and shadow maps of all chunks of a map tile. Each chunk gets a
+// 64x64 cell, the channels are interleaved the way the terrain shaders read the blend texture
+// (r,g,b = alpha layers 1-3, a = shadow), so the tile can be uploaded as a single texture,
+// or one GL_ALPHA texture per channel for the fixed function path.
+// No GL calls in here, MapTile does the uploading. The buffer is kept between tiles.
+class AlphaAtlas {
+public:
+	AlphaAtlas();
+
+	// zeroes every cell, chunks without a layer or shadow map stay empty
+	void clear();
+
+	// Copies a 64x64 map into one channel of the cell of chunk x,y.
+	void put(int x, int y, int channel, const unsigned char *map);
+	unsigned char get(int x, int y, int channel, int s, int t) const;
+
+	// ALPHAATLAS_SIZE * ALPHAATLAS_SIZE * ALPHAATLAS_CHANNELS bytes
+	const unsigned char *data() const { return &buf[0]; }
+	// a single channel, ALPHAATLAS_SIZE * ALPHAATLAS_SIZE bytes
+	void extract(int channel, std::vector<unsigned char> &out) const;
+
+	// Texture matrix taking the chunk alpha texture coordinates (0-1 over a 64 texel map)
+	// into the cell of chunk x,y, atlas coordinates = offset + coordinates * scale.
+	// 0 and 1 land on the centres of the first and last texel of the cell, so linear
+	// filtering never reaches into the next cell.
+	static void cellTransform(int x, int y, float &offsetS, float &offsetT, float &scale);
+
+private:
+	std::vector<unsigned char> buf;
+};
+
+#endif
@@ -326,13 +326,6 @@ void AnimControl::UpdateWMO(WMO *w, int group)
 	wmoLabel->Show(TRUE);
 }
 
-wxString sFilterDir;
-bool filterDir(wxString fn)
-{
-	wxString tmp = fn.Lower();
-	return (tmp.StartsWith(sFilterDir) && tmp.EndsWith(wxT("blp")));
-}
-
 bool AnimControl::UpdateCreatureModel(Model *m)
 {
 	wxString fn = m->name;
@@ -394,9 +387,7 @@ bool AnimControl::UpdateCreatureModel(Model *m)
 
 	// Search the same directory for BLPs
 	std::set<FileTreeItem> filelist;
-	sFilterDir = fn.BeforeLast(SLASH)+SLASH;
-	sFilterDir.MakeLower();
-	getFileLists(filelist, filterDir);
+	getFileListsByPrefix(filelist, fn.BeforeLast(SLASH)+SLASH, wxT("blp"));
 	if (filelist.begin() != filelist.end()) {
 		TextureGroup grp;
 		grp.base = TEXTURE_GAMEOBJECT1;
@@ -468,8 +459,7 @@ bool AnimControl::UpdateItemModel(Model *m)
 
 	// Search the same directory for BLPs
 	std::set<FileTreeItem> filelist;
-	sFilterDir = m->name.BeforeLast(wxT('.')).Lower();
-	getFileLists(filelist, filterDir);
+	getFileListsByPrefix(filelist, m->name.BeforeLast(wxT('.')), wxT("blp"));
 	if (filelist.begin() != filelist.end()) {
 		TextureGroup grp;
 		grp.base = TEXTURE_ITEM;
@@ -7,6 +7,8 @@
 
 #include "UserSkins.h"
 #include "resource1.h"
+#include "threadpool.h"
+#include "texturecache.h"
 
 #ifdef _MINGW
 #include "GlobalSettings.h"
@@ -139,6 +141,8 @@ bool WowModelViewApp::OnInit()
 
 	setInterfaceLocale();
 
+	textureCache.Init(userPath+SLASH+wxT("TextureCache"), textureCacheSize);
+
 	// Now create our main frame.
     frame = new ModelViewer();
     
@@ -291,6 +295,7 @@ int WowModelViewApp::OnExit()
 	}
 //#endif
 
+	ThreadPool::CleanUp();
 	CleanUp();
 
 	//_CrtMemDumpAllObjectsSince( NULL );
@@ -313,291 +318,25 @@ void WowModelViewApp::HandleEvent(wxEvtHandler *handler, wxEventFunction func, w
 }
 */
 
-void WowModelViewApp::OnUnhandledException() 
-{ 
-    //wxMessageBox(wxT("An unhandled exception was caught, the program will now terminate."), wxT("Unhandled Exception"), wxOK | wxICON_ERROR); 
-	wxLogFatalError(wxT("An unhandled exception error has occured."));
-}
-
-namespace {
-	long traverseLocaleMPQs(const wxString locales[], size_t localeCount, const wxString localeArchives[], size_t archiveCount, const wxString& gamePath)
-	{
-		long lngID = -1;
-
-		for (size_t i = 0; i < localeCount; i++) {
-			if (locales[i].IsEmpty())
-				continue;
-			wxString localePath = gamePath;
-
-			localePath.Append(locales[i]);
-			localePath.Append(wxT("/"));
-			if (wxDir::Exists(localePath)) {
-				wxArrayString localeMpqs;
-				wxDir::GetAllFiles(localePath, &localeMpqs, wxEmptyString, wxDIR_FILES);
-
-				for (size_t j = 0; j < archiveCount; j++) {
-					for (size_t k = 0; k < localeMpqs.size(); k++) {
-						wxString baseName = wxFileName(localeMpqs[k]).GetFullName();
-						wxString neededMpq = wxString::Format(localeArchives[j], locales[i].c_str());
-
-						if(baseName.CmpNoCase(neededMpq) == 0) {
-							mpqArchives.Add(localeMpqs[k]);
-						}
-					}
-				}
-
-				lngID = (long)i;
-				return lngID;
-			}
-		}
-
-		return lngID;
-	}
-}
-
-void searchMPQs(bool firstTime)
+// The canvas only redraws when something changed or is animating. Pretty much any
+// input (menus, the control panels, keys) can change the scene, so wake it up on those.
+// wxUpdateUIEvent is a command event too, but wx sends it on every idle pass, which
+// would keep the canvas awake for good.
+int WowModelViewApp::FilterEvent(wxEvent& event)
 {
-	if (mpqArchives.GetCount() > 0)
-		return;
-
-	bool bSearchCache = false;
-	wxMessageDialog *dial = new wxMessageDialog(NULL, _("Do you want to search Cache dir?"),
-		_("Question"), wxYES_NO | wxNO_DEFAULT | wxICON_QUESTION);
-	if (wxID_YES == dial->ShowModal())
-		bSearchCache = true;
-
-	const wxString locales[] = {
-		// sets 0
-		wxT("enUS"), wxT("koKR"), wxT("frFR"), wxT("deDE"), 
-		wxT("zhCN"), wxT("zhTW"), wxT("esES"), wxT("esMX"), wxT("ruRU"),
-		wxT("jaJP"), wxT("ptBR"), wxT("itIT"), 
-		// sets 1
-		wxT("enGB"), wxEmptyString, wxEmptyString, wxEmptyString, 
-		wxT("enCN"), wxT("enTW"), wxEmptyString, wxEmptyString, wxEmptyString,
-		wxEmptyString, wxT("ptPT"), wxEmptyString
-		};
-	const int localeSets = WXSIZEOF(locales) / 2;
-	const wxString defaultArchives[] = {wxT("patch-9.MPQ"),wxT("patch-8.MPQ"),wxT("patch-7.MPQ"),wxT("patch-6.MPQ"),
-		wxT("patch-5.MPQ"),wxT("patch-4.MPQ"),wxT("patch-3.MPQ"),wxT("patch-2.MPQ"),wxT("patch.MPQ"),wxT("alternate.MPQ"),
-		wxT("expansion4.MPQ"),wxT("expansion3.MPQ"),wxT("expansion2.MPQ"),wxT("expansion1.MPQ"),wxT("lichking.MPQ"),wxT("expansion.MPQ"),
-		wxT("world.MPQ"),wxT("world2.MPQ"),wxT("sound.MPQ"),wxT("art.MPQ"),wxT("common-3.MPQ"),wxT("common-2.MPQ"), wxT("common.MPQ"),
-		wxT("interface.MPQ"),wxT("itemtexture.MPQ"),wxT("misc.MPQ"),wxT("model.MPQ"),wxT("texture.MPQ")
-		};
-	const wxString localeArchives[] = {wxT("patch-%s-9.MPQ"),wxT("patch-%s-8.MPQ"),wxT("patch-%s-7.MPQ"),
-		wxT("patch-%s-6.MPQ"),wxT("patch-%s-5.MPQ"),wxT("patch-%s-4.MPQ"),wxT("patch-%s-3.MPQ"), wxT("patch-%s-2.MPQ"), 
-		wxT("patch-%s.MPQ"), wxT("expansion3-locale-%s.MPQ"), wxT("expansion2-locale-%s.MPQ"), 
-		wxT("expansion1-locale-%s.MPQ"), wxT("lichking-locale-%s.MPQ"), wxT("expansion-locale-%s.MPQ"), 
-		wxT("locale-%s.MPQ"), wxT("base-%s.MPQ")};
-
-	// select avaiable locales, auto select user config locale
-	wxArrayString avaiLocales;
-	for (size_t i = 0; i < WXSIZEOF(locales); i++) {
-		if (locales[i].IsEmpty())
-			continue;
-		wxString localePath = gamePath + wxT("Cache") + SLASH + locales[i];
-		if (wxDir::Exists(localePath))
-			avaiLocales.Add(locales[i]);
-	}
-	if (firstTime && avaiLocales.size() == 1) // only 1 locale
-		langName = avaiLocales[0];
-	else {
-		// if user never select a locale, show all locales in data directory
-		avaiLocales.Clear();
-		for (size_t i = 0; i < WXSIZEOF(locales); i++) {
-			if (locales[i].IsEmpty())
-				continue;
-			wxString localePath = gamePath + locales[i];
-
-			if (wxDir::Exists(localePath))
-				avaiLocales.Add(locales[i]);
-		}
-		if (avaiLocales.size() == 0) // failed to find locale
-			return;
-		else if (avaiLocales.size() == 1) // only 1 locale
-			langName = avaiLocales[0];
-		else
-			langName = wxGetSingleChoice(_("Please select a Locale:"), _("Locale"), avaiLocales);
-	}
-
-	// search Partial MPQs
-	wxArrayString baseMpqs;
-	wxDir::GetAllFiles(gamePath, &baseMpqs, wxEmptyString, wxDIR_FILES);
-	for (size_t j = 0; j < baseMpqs.size(); j++) {
-		if (baseMpqs[j].Contains(wxT("oldworld")))
-			continue;
-		wxString baseName = wxFileName(baseMpqs[j]).GetFullName();
-		wxString cmpName = wxT("wow-update-");
-		if (baseName.StartsWith(cmpName) && baseName.AfterLast('.').CmpNoCase(wxT("mpq")) == 0) {
-			bool bFound = false;
-			for(size_t i = 0; i<mpqArchives.size(); i++) {
-				wxString archiveName = wxFileName(mpqArchives[i]).GetFullName();
-				if (!archiveName.AfterLast(SLASH).StartsWith(cmpName))
-					continue;
-				int ver = wxAtoi(archiveName.BeforeLast('.').AfterLast('-'));
-				int bver = wxAtoi(baseName.BeforeLast('.').AfterLast('-'));
-				if (bver > ver) {
-					mpqArchives.Insert(baseMpqs[j], i);
-					bFound = true;
-					break;
-				}		
-			}
-			if (bFound == false)
-				mpqArchives.Add(baseMpqs[j]);
-
-			wxLogMessage(wxT("- Found Partial MPQ archive: %s"), baseMpqs[j].Mid(gamePath.Len()).c_str());
-		}
-	}
-
-	// search Partial MPQs inside langName directory
-	wxDir::GetAllFiles(gamePath+langName, &baseMpqs, wxEmptyString, wxDIR_FILES);
-	for (size_t j = 0; j < baseMpqs.size(); j++) {
-		if (baseMpqs[j].Contains(wxT("oldworld")))
-			continue;
-		wxString baseName = wxFileName(baseMpqs[j]).GetFullName();
-		wxString cmpName = wxT("wow-update-")+langName;
-		if (baseName.StartsWith(cmpName) && baseName.AfterLast('.').CmpNoCase(wxT("mpq")) == 0) {
-			bool bFound = false;
-			for(size_t i = 0; i<mpqArchives.size(); i++) {
-				wxString archiveName = wxFileName(mpqArchives[i]).GetFullName();
-				if (!archiveName.StartsWith(wxT("wow-update-"))) // compare to all wow-update-
-					continue;
-				int ver = wxAtoi(archiveName.BeforeLast('.').AfterLast('-'));
-				int bver = wxAtoi(baseName.BeforeLast('.').AfterLast('-'));
-				if (bver > ver) {
-					mpqArchives.Insert(baseMpqs[j], i);
-					bFound = true;
-					break;
-				}		
-			}
-			if (bFound == false)
-				mpqArchives.Add(baseMpqs[j]);
-
-			wxLogMessage(wxT("- Found Partial MPQ archive: %s"), baseMpqs[j].Mid(gamePath.Len()).c_str());
-		}
-	}
-
-	// search patch-base MPQs
-	wxArrayString baseCacheMpqs;
-	wxDir::GetAllFiles(gamePath+wxT("Cache"), &baseCacheMpqs, wxEmptyString, wxDIR_FILES);
-	for (size_t j = 0; j < baseCacheMpqs.size(); j++) {
-		if (bSearchCache == false)
-			continue;
-		if (baseCacheMpqs[j].Contains(wxT("oldworld")))
-			continue;
-		wxString baseName = baseCacheMpqs[j];
-		wxString fullName = wxFileName(baseName).GetFullName();
-		wxString cmpName = wxT("patch-base-");
-		if (fullName.StartsWith(cmpName) && fullName.AfterLast('.').CmpNoCase(wxT("mpq")) == 0) {
-			bool bFound = false;
-			for(size_t i = 0; i<mpqArchives.size(); i++) {
-				if (!mpqArchives[i].AfterLast(SLASH).StartsWith(cmpName))
-					continue;
-				int ver = wxAtoi(mpqArchives[i].BeforeLast('.').AfterLast('-'));
-				int bver = wxAtoi(fullName.BeforeLast('.').AfterLast('-'));
-				if (bver > ver) {
-#if 1 // Use lastest archive only
-					mpqArchives[i] = baseName;
-#else
-					mpqArchives.Insert(baseName, i);
-#endif
-					bFound = true;
-					break;
-				}		
-			}
-			if (bFound == false)
-				mpqArchives.Add(baseName);
-
-			wxLogMessage(wxT("- Found Patch Base MPQ archive: %s"), baseName.Mid(gamePath.Len()).c_str());
-		}
-	}
-	baseCacheMpqs.Clear();
-
-	// search base cache locale MPQs
-	wxArrayString baseCacheLocaleMpqs;
-	wxDir::GetAllFiles(gamePath+wxT("Cache")+SLASH+langName, &baseCacheLocaleMpqs, wxEmptyString, wxDIR_FILES);
-	for (size_t j = 0; j < baseCacheLocaleMpqs.size(); j++) {
-		if (bSearchCache == false)
-			continue;
-		if (baseCacheLocaleMpqs[j].Contains(wxT("oldworld")))
-			continue;
-		wxString baseName = baseCacheLocaleMpqs[j];
-		wxString fullName = wxFileName(baseName).GetFullName();
-		wxString cmpName = wxT("patch-")+langName+wxT("-");
-		if (fullName.StartsWith(cmpName) && fullName.AfterLast('.').CmpNoCase(wxT("mpq")) == 0) {
-			bool bFound = false;
-			for(size_t i = 0; i<mpqArchives.size(); i++) {
-				if (!mpqArchives[i].AfterLast(SLASH).StartsWith(cmpName))
-					continue;
-				int ver = wxAtoi(mpqArchives[i].BeforeLast('.').AfterLast('-'));
-				int bver = wxAtoi(fullName.BeforeLast('.').AfterLast('-'));
-				if (bver > ver) {
-#if 1 // Use lastest archive only
-					mpqArchives[i] = baseName;
-#else
-					mpqArchives.Insert(baseName, i);
-#endif
-					bFound = true;
-					break;
-				}		
-			}
-			if (bFound == false)
-				mpqArchives.Add(baseName);
-
-			wxLogMessage(wxT("- Found Patch Base Locale MPQ archive: %s"), baseName.Mid(gamePath.Len()).c_str());
-		}
+	if (g_canvas) {
+		wxEventType type = event.GetEventType();
+		if ((event.IsCommandEvent() && type != wxEVT_UPDATE_UI) || type == wxEVT_KEY_DOWN || type == wxEVT_KEY_UP)
+			g_canvas->Wake();
 	}
-	baseCacheLocaleMpqs.Clear();
-
-	// default archives
-	for (size_t i = 0; i < WXSIZEOF(defaultArchives); i++) {
-		//wxLogMessage(wxT("Searching for MPQ archive %s..."), defaultArchives[i].c_str());
-
-		for (size_t j = 0; j < baseMpqs.size(); j++) {
-			wxString baseName = wxFileName(baseMpqs[j]).GetFullName();
-			if(baseName.CmpNoCase(defaultArchives[i]) == 0) {
-				mpqArchives.Add(baseMpqs[j]);
 
-				wxLogMessage(wxT("- Found MPQ archive: %s"), baseMpqs[j].Mid(gamePath.Len()).c_str());
-				if (baseName.CmpNoCase(wxT("alternate.mpq")))
-					bAlternate = true;
-			}
-		}
-	}
-
-	// add locale files
-	for (size_t i = 0; i < WXSIZEOF(locales); i++) {
-		if (locales[i] == langName) {
-			wxString localePath = gamePath;
-
-			localePath.Append(locales[i]);
-			localePath.Append(wxT("/"));
-			if (wxDir::Exists(localePath)) {
-				wxArrayString localeMpqs;
-				wxDir::GetAllFiles(localePath, &localeMpqs, wxEmptyString, wxDIR_FILES);
-
-				for (size_t j = 0; j < WXSIZEOF(localeArchives); j++) {
-					for (size_t k = 0; k < localeMpqs.size(); k++) {
-						wxString baseName = wxFileName(localeMpqs[k]).GetFullName();
-						wxString neededMpq = wxString::Format(localeArchives[j], locales[i].c_str());
-
-						if(baseName.CmpNoCase(neededMpq) == 0) {
-							mpqArchives.Add(localeMpqs[k]);
-						}
-					}
-				}
-			}
-
-			langID = i % localeSets;
-			break;
-		}
-	}
-
-	if (langID == -1) {
-		langID = traverseLocaleMPQs(locales, WXSIZEOF(locales), localeArchives, WXSIZEOF(localeArchives), gamePath);
-		if (langID != -1)
-			langID = langID % localeSets;
-	}
+	return -1;
+}
 
+void WowModelViewApp::OnUnhandledException() 
+{ 
+    //wxMessageBox(wxT("An unhandled exception was caught, the program will now terminate."), wxT("Unhandled Exception"), wxOK | wxICON_ERROR); 
+	wxLogFatalError(wxT("An unhandled exception error has occured."));
 }
 
 bool WowModelViewApp::LoadSettings()
@@ -633,6 +372,8 @@ bool WowModelViewApp::LoadSettings()
 	pConfig->Read(wxT("TOCVersion"), &gameVersion, 0);
 
 	pConfig->Read(wxT("UseLocalFiles"), &useLocalFiles, false);
+	pConfig->Read(wxT("TextureCache"), &useTextureCache, false);
+	pConfig->Read(wxT("TextureCacheSize"), &textureCacheSize, 256);
 	pConfig->Read(wxT("SSCounter"), &ssCounter, 100);
 	//pConfig->Read(wxT("AntiAlias"), &useAntiAlias, true);
 	//pConfig->Read(wxT("DisableHWAcc"), &disableHWAcc, false);
@@ -689,6 +430,8 @@ void WowModelViewApp::SaveSettings()
 	pConfig->Write(wxT("ArmoryPath"), armoryPath);
 	pConfig->Write(wxT("TOCVersion"), gameVersion);
 	pConfig->Write(wxT("UseLocalFiles"), useLocalFiles);
+	pConfig->Write(wxT("TextureCache"), useTextureCache);
+	pConfig->Write(wxT("TextureCacheSize"), textureCacheSize);
 	pConfig->Write(wxT("SSCounter"), ssCounter);
 	//pConfig->Write(wxT("AntiAlias"), useAntiAlias);
 	//pConfig->Write(wxT("DisableHWAcc"), disableHWAcc);
@@ -1960,21 +1960,7 @@ void CharTexture::compose(TextureID texID)
 			tex.getPixels(tempbuf);
 
 		// blit the texture region over the original
-		for (ssize_t y=0, dy=coords.ypos; y<coords.ysize; y++,dy++) {
-			for (ssize_t x=0, dx=coords.xpos; x<coords.xsize; x++,dx++) {
-				unsigned char *src = tempbuf + y*coords.xsize*4 + x*4;
-				unsigned char *dest = destbuf + dy*REGION_PX_WIDTH*x_scale*4 + dx*4;
-		
-				// this is slow and ugly but I don't care
-				float r = src[3] / 255.0f;
-				float ir = 1.0f - r;
-				// zomg RGBA?
-				dest[0] = (unsigned char)(dest[0]*ir + src[0]*r);
-				dest[1] = (unsigned char)(dest[1]*ir + src[1]*r);
-				dest[2] = (unsigned char)(dest[2]*ir + src[2]*r);
-				dest[3] = 255;
-			}
-		}
+		blendRegion(destbuf, REGION_PX_WIDTH*x_scale, coords, tempbuf);
 
 		free(tempbuf);
 		texturemanager.del(temptex);
@@ -1988,6 +1974,25 @@ void CharTexture::compose(TextureID texID)
 	free(destbuf);
 }
 
+void CharTexture::blendRegion(unsigned char *destbuf, size_t destWidth, const CharRegionCoords &coords, const unsigned char *pixels)
+{
+	for (ssize_t y=0, dy=coords.ypos; y<coords.ysize; y++,dy++) {
+		for (ssize_t x=0, dx=coords.xpos; x<coords.xsize; x++,dx++) {
+			const unsigned char *src = pixels + y*coords.xsize*4 + x*4;
+			unsigned char *dest = destbuf + dy*destWidth*4 + dx*4;
+	
+			// this is slow and ugly but I don't care
+			float r = src[3] / 255.0f;
+			float ir = 1.0f - r;
+			// zomg RGBA?
+			dest[0] = (unsigned char)(dest[0]*ir + src[0]*r);
+			dest[1] = (unsigned char)(dest[1]*ir + src[1]*r);
+			dest[2] = (unsigned char)(dest[2]*ir + src[2]*r);
+			dest[3] = 255;
+		}
+	}
+}
+
 void CharDetails::reset()
 {
 	skinColor = 0;
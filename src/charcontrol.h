@@ -101,6 +101,9 @@ struct CharTexture
 		components.push_back(ct);
 	}
 	void compose(TextureID texID);
+
+	// Alpha blends one RGBA component (already scaled to the region size) into the skin buffer.
+	static void blendRegion(unsigned char *destbuf, size_t destWidth, const CharRegionCoords &coords, const unsigned char *pixels);
 };
 
 struct TabardDetails
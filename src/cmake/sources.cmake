@@ -1,5 +1,5 @@
 file(GLOB WOWMV_SOURCES RELATIVE ${CMAKE_SOURCE_DIR} *.cpp)
-list(REMOVE_ITEM WOWMV_SOURCES particle_test.cpp modelexport_fbx.cpp AVIGenerator.cpp)
+list(REMOVE_ITEM WOWMV_SOURCES particle_test.cpp modelexport_fbx.cpp AVIGenerator.cpp wmvbench.cpp)
 if (USE_STORM)
     list(REMOVE_ITEM WOWMV_SOURCES mpq_libmpq.cpp)
 else ()
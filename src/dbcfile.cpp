@@ -26,7 +26,8 @@ bool DBCFile::open()
 		filename = filename.BeforeLast('.') + wxT(".db2");
 	}
 
-	g_modelViewer->SetStatusText(wxT("Initiating ")+filename+wxT(" Database..."));
+	if (g_modelViewer)
+		g_modelViewer->SetStatusText(wxT("Initiating ")+filename+wxT(" Database..."));
 	MPQFile f(filename);
 	// Need some error checking, otherwise an unhandled exception error occurs
 	// if people screw with the data path.
@@ -77,6 +77,7 @@ enum ObjectID {
 	ID_FILELIST_SAVE,
 	ID_FILELIST_EXPORT_PNG,
 	ID_FILELIST_EXPORT_TGA,
+	ID_FILELIST_FILTER_TIMER,
 
 	ID_SHOW_FILE_LIST,
 	ID_SHOW_ANIM,
@@ -159,6 +160,8 @@ enum ObjectID {
 	ID_USE_ENVMAP,
 	ID_USE_HWACC,
 	ID_SHOW_SETTINGS,
+	ID_PROFILER,
+	ID_PROFILER_SAVE,
 	//ID_RESET,
 	
 	ID_CHECKFORUPDATE,
@@ -195,6 +198,7 @@ enum ObjectID {
 	ID_SETTINGS_SHOWPARTICLE,
 	ID_SETTINGS_ZEROPARTICLE,
 	ID_SETTINGS_ALTERNATE,
+	ID_SETTINGS_TEXTURECACHE,
 	ID_SETTINGS_APPLY,
 
 	// -------------------------------------
@@ -214,6 +218,7 @@ enum ObjectID {
 	ID_GIFSHRINK,
 	ID_GIFGREYSCALE,
 	ID_PNGSEQ,
+	ID_GIFGLOBALPAL,
 
 	// ------------------------------------
 	// Anim Frame
@@ -524,6 +529,7 @@ enum {
 	CHECK_ZEROPARTICLE,
 	CHECK_LOCALFILES,
 	CHECK_ALTERNATE,
+	CHECK_TEXTURECACHE,
 
 	NUM_SETTINGS1_CHECK
 };
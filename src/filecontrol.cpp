@@ -4,8 +4,8 @@
 #include "exporters.h"
 #include "CxImage/ximage.h"
 
-typedef std::pair<wxTreeItemId, wxString> TreeStackItem;
-typedef std::vector<TreeStackItem> TreeStack;
+#define FILTER_DELAY		300		// ms without typing before the search runs
+#define FILETREE_EXPAND_MAX	1000	// search results with up to this many files are opened up
 
 IMPLEMENT_CLASS(FileControl, wxWindow)
 
@@ -14,8 +14,11 @@ BEGIN_EVENT_TABLE(FileControl, wxWindow)
 	EVT_TREE_SEL_CHANGED(ID_FILELIST, FileControl::OnTreeSelect)
 	EVT_TREE_ITEM_EXPANDED(ID_FILELIST, FileControl::OnTreeCollapsedOrExpanded)
 	EVT_TREE_ITEM_COLLAPSED(ID_FILELIST, FileControl::OnTreeCollapsedOrExpanded)
+	EVT_TREE_ITEM_EXPANDING(ID_FILELIST, FileControl::OnTreeExpanding)
 	EVT_BUTTON(ID_FILELIST_SEARCH, FileControl::OnButton)
 	EVT_TEXT_ENTER(ID_FILELIST_CONTENT, FileControl::OnButton)
+	EVT_TEXT(ID_FILELIST_CONTENT, FileControl::OnText)
+	EVT_TIMER(ID_FILELIST_FILTER_TIMER, FileControl::OnFilterTimer)
 	EVT_CHOICE(ID_FILELIST_FILTER, FileControl::OnChoice)
 	EVT_CHOICE(ID_FILELIST_FILTER_MPQ, FileControl::OnChoice)
 	EVT_TREE_ITEM_MENU(ID_FILELIST, FileControl::OnTreeMenu)
@@ -58,6 +61,7 @@ FileControl::FileControl(wxWindow* parent, wxWindowID id)
 	modelviewer = NULL;
 	filterMode = FILE_FILTER_MODEL;
 	filterModeMPQ = 0;
+	filterTimer.SetOwner(this, ID_FILELIST_FILTER_TIMER);
 
 	if (Create(parent, id, wxDefaultPosition, wxSize(170,700), 0, wxT("ModelControlFrame")) == false) {
 		wxLogMessage(wxT("GUI Error: Failed to create a window for our FileControl!"));
@@ -86,6 +90,7 @@ FileControl::FileControl(wxWindow* parent, wxWindowID id)
 
 FileControl::~FileControl()
 {
+	filterTimer.Stop();
 	if (fileTree) {
 		fileTree->Destroy();
 		fileTree = NULL;
@@ -126,141 +131,87 @@ void FileControl::Init(ModelViewer* mv)
 		modelviewer = mv;
 
 	wxLogMessage(wxT("Initializing File Controls..."));
-	// Gets the list of files that meet the filter criteria
-	// and puts them into an array to be processed into out file tree
-	content = txtContent->GetValue().Lower().Trim();
-
-	filterString = filterStrings[filterMode];
-	filterArchive = filterArchives[filterModeMPQ];
-	getFileLists(filelist, filterSearch);
-
-	// Put all the viewable files into our File Tree.
-	TreeStack stack;
-	TreeStackItem root;
-	wxTreeItemId item;
-	fileTree->DeleteAllItems();
-	fileTree->AddRoot(wxT("Root"));
-	root.first = fileTree->GetRootItem();
-	root.second = wxT("");
-	stack.push_back(root);
-
-	size_t index=0;
-
-	for (std::set<FileTreeItem>::iterator it = filelist.begin(); it != filelist.end(); ++it) {
-		const wxString &str = (*it).displayName;
-		size_t p = 0;
-		size_t i;
-
-		// find the matching place in the stack
-		for (i=1; i<stack.size(); i++) {
-			wxString &comp = stack[i].second;
-			bool match = true;
-			for (size_t j=0; j<comp.length(); j++) {
-				if (comp[j] != str[p+j]) {
-					match = false;
-					break;
-				}
-			}
-			if (match) 
-				match &= str[p+comp.length()] == '\\';
+	filterTimer.Stop();
+	Filter(false);
+}
 
-			if (!match)
-				break;
-            p += comp.length() + 1;
+void FileControl::Filter(bool narrow)
+{
+	wxString newContent = txtContent->GetValue().Lower().Trim();
+
+	if (narrow && (content.IsEmpty() || newContent.Find(content) != wxNOT_FOUND)) {
+		if (newContent == content)
+			return;
+
+		// typing more of the same search only narrows it down,
+		// the files found last time already passed the other filters
+		content = newContent;
+		std::vector<FileTreeItem> found;
+		for (size_t i=0; i<files.size(); i++) {
+			if (files[i].fileName.Lower().Find(content) != wxNOT_FOUND)
+				found.push_back(files[i]);
 		}
-		// i-1 is the index of the last matching piece in the stack
+		files.swap(found);
+	} else {
+		// Gets the list of files that meet the filter criteria
+		// and puts them into an array to be processed into out file tree
+		content = newContent;
+		filterString = filterStrings[filterMode];
+		filterArchive = filterArchives[filterModeMPQ];
+		getFileLists(filelist, filterSearch);
+		files.assign(filelist.begin(), filelist.end());
+		filelist.clear();
+	}
 
-		// delete the extra parts off the end of the stack
-		size_t numtopop = stack.size()-i;
-		for (size_t k=0; k<numtopop; k++) {
-			stack.pop_back();
-		}
-		
-		// starting at p, append extra folders
-		size_t start = p;
-		for (; p<str.length(); p++) {
-			if (str[p]=='\\') {
-				// we've hit a folder, push it onto the stack
-				TreeStackItem newItem;
-				newItem.second = str.substr(start, p-start);
-				start = p+1;
-				newItem.first = fileTree->AppendItem(stack[stack.size()-1].first, newItem.second);
-				
-				//if (colour == true) {
-                switch(it->color){
-                    case 0:
-                        fileTree->SetItemTextColour(newItem.first, *wxBLACK);				// Base Color
-                        break;
-                    case 1:
-                        fileTree->SetItemTextColour(newItem.first, *wxBLUE);				// patch.mpq & wow-update files
-                        break;
-                    case 2:
-                        fileTree->SetItemTextColour(newItem.first, *wxRED);					// patch-2.mpq & Cache patch files
-                        break;
-					case 3:
-                        fileTree->SetItemTextColour(newItem.first, wxColour(160,0,160));	// Outland Purple (First Expansion)
-                        break;
-                    case 4:
-                        fileTree->SetItemTextColour(newItem.first, wxColour(35,130,179));	// Frozen Blue (Second Expansion)
-                        break;
-                    case 5:
-                        fileTree->SetItemTextColour(newItem.first, wxColour(233,109,17));	// Destruction Orange (Third Expansion)
-                        break;
-                    case 6:
-                        fileTree->SetItemTextColour(newItem.first, wxColour(0,207,107));	// Bamboo Green (Fourth Expansion)
-                        break;
-                    case 7:
-                        fileTree->SetItemTextColour(newItem.first, *wxCYAN);				// Reserved
-                        break;
-                    default:
-                        fileTree->SetItemTextColour(newItem.first, *wxLIGHT_GREY);
-                }
-				//} else {
-				//	colour = true;
-				//}
-				//fileTree->SetItemBackgroundColour(newItem.first, wxColour(237,243,254));
-
-				stack.push_back(newItem);
-			}
-		}
-		// now start was at the character after the last \\, so we append a filename
-		wxString fileName = str.substr(start);
-
-		item = fileTree->AppendItem(stack[stack.size()-1].first, fileName, -1, -1, new FileTreeData(str));
-        switch(it->color){
-            case 0:
-                fileTree->SetItemTextColour(item, *wxBLACK);				// Base Color
-                break;
-            case 1:
-                fileTree->SetItemTextColour(item, *wxBLUE);					// patch.mpq & wow-update files
-                break;
-            case 2:
-                fileTree->SetItemTextColour(item, *wxRED);					// patch-2.mpq & Cache patch files
-                break;
-            case 3:
-				fileTree->SetItemTextColour(item, wxColour(160,0,160));		// Outland Purple (First Expansion)
-                break;
-            case 4:
-                fileTree->SetItemTextColour(item, wxColour(35,130,179));	// Frozen Blue (Second Expansion)
-                break;
-            case 5:
-                fileTree->SetItemTextColour(item, wxColour(233,109,17));	// Destruction Orange (Third Expansion)
-                break;
-            case 6:
-                fileTree->SetItemTextColour(item, wxColour(0,207,107));		// Bamboo Green (Fourth Expansion)
-                break;
-            case 7:
-                fileTree->SetItemTextColour(item, *wxCYAN);					// Reserved
-                break;
-            default:
-                fileTree->SetItemTextColour(item, *wxLIGHT_GREY);
-        }
-		index++;
+	UpdateTree();
+}
 
+static void setItemColour(wxTreeCtrl *tree, wxTreeItemId item, int color)
+{
+	switch(color){
+		case 0:
+			tree->SetItemTextColour(item, *wxBLACK);				// Base Color
+			break;
+		case 1:
+			tree->SetItemTextColour(item, *wxBLUE);					// patch.mpq & wow-update files
+			break;
+		case 2:
+			tree->SetItemTextColour(item, *wxRED);					// patch-2.mpq & Cache patch files
+			break;
+		case 3:
+			tree->SetItemTextColour(item, wxColour(160,0,160));		// Outland Purple (First Expansion)
+			break;
+		case 4:
+			tree->SetItemTextColour(item, wxColour(35,130,179));	// Frozen Blue (Second Expansion)
+			break;
+		case 5:
+			tree->SetItemTextColour(item, wxColour(233,109,17));	// Destruction Orange (Third Expansion)
+			break;
+		case 6:
+			tree->SetItemTextColour(item, wxColour(0,207,107));		// Bamboo Green (Fourth Expansion)
+			break;
+		case 7:
+			tree->SetItemTextColour(item, *wxCYAN);					// Reserved
+			break;
+		default:
+			tree->SetItemTextColour(item, *wxLIGHT_GREY);
 	}
+}
+
+void FileControl::UpdateTree()
+{
+	// Put the top level of the viewable files into our File Tree,
+	// the rest is added a folder at a time as they are expanded.
+	folders.clear();
+	fileTree->Freeze();
+	fileTree->DeleteAllItems();
+	wxTreeItemId root = fileTree->AddRoot(wxT("Root"));
+	AddChildren(root, 0, files.size(), 0);
 
-	if (content != wxEmptyString)
-		fileTree->ExpandAll();
+	// open up what a search found, unless it found too much to add all at once
+	if (content != wxEmptyString && files.size() <= FILETREE_EXPAND_MAX)
+		ExpandFolders(root);
+	fileTree->Thaw();
 
 	// bg recolor
 	wxTreeItemId h;
@@ -271,8 +222,58 @@ void FileControl::Init(ModelViewer* mv)
 		else
 			fileTree->SetItemBackgroundColour(h, *wxWHITE);
 	}
+}
 
-	filelist.clear();
+// Adds the files and folders directly under parent, files[first,last) all start with its path.
+void FileControl::AddChildren(wxTreeItemId parent, size_t first, size_t last, size_t offset)
+{
+	size_t i = first;
+	while (i < last) {
+		const wxString &str = files[i].displayName;
+		size_t p = str.find(wxT('\\'), offset);
+		if (p == wxString::npos) {
+			wxTreeItemId item = fileTree->AppendItem(parent, str.substr(offset), -1, -1, new FileTreeData(str));
+			setItemColour(fileTree, item, files[i].color);
+			i++;
+			continue;
+		}
+
+		// the list is sorted, so everything in this folder comes next
+		wxString path = str.substr(0, p+1);
+		size_t end = i+1;
+		while (end < last && files[end].displayName.StartsWith(path))
+			end++;
+
+		wxTreeItemId item = fileTree->AppendItem(parent, str.substr(offset, p-offset));
+		setItemColour(fileTree, item, files[i].color);
+		fileTree->SetItemHasChildren(item, true);
+		TreeFolder folder = { i, end, p+1 };
+		folders[item.GetID()] = folder;
+		i = end;
+	}
+}
+
+void FileControl::PopulateFolder(wxTreeItemId item)
+{
+	std::map<wxTreeItemIdValue, TreeFolder>::iterator it = folders.find(item.GetID());
+	if (it == folders.end())
+		return;
+
+	TreeFolder folder = it->second;
+	folders.erase(it);
+	AddChildren(item, folder.first, folder.last, folder.offset);
+}
+
+void FileControl::ExpandFolders(wxTreeItemId parent)
+{
+	wxTreeItemIdValue cookie;
+	for (wxTreeItemId item = fileTree->GetFirstChild(parent, cookie); item.IsOk(); item = fileTree->GetNextChild(parent, cookie)) {
+		if (!fileTree->ItemHasChildren(item))
+			continue;
+		PopulateFolder(item);
+		fileTree->Expand(item);
+		ExpandFolders(item);
+	}
 }
 
 void FileControl::OnChoice(wxCommandEvent &event)
@@ -437,6 +438,11 @@ void FileControl::OnTreeMenu(wxTreeEvent &event)
 	infoMenu.Append(ID_FILELIST, archive, archive);
 	wxString size = wxString::Format(wxT("Size: %d"), MPQFile::getSize(tdata->fn));
 	infoMenu.Append(ID_FILELIST, size, size);
+	BLPInfo blp;
+	if (temp.EndsWith(wxT("blp")) && BLPInfo::probe(tdata->fn, blp)) {
+		wxString info = blp.describe();
+		infoMenu.Append(ID_FILELIST, info, info);
+	}
 	infoMenu.Connect(wxEVT_COMMAND_MENU_SELECTED, (wxObjectEventFunction)&FileControl::OnPopupClick, NULL, this);
 	PopupMenu(&infoMenu);
 }
@@ -732,6 +738,23 @@ void FileControl::OnTreeCollapsedOrExpanded(wxTreeEvent &event)
 	}
 }
 
+void FileControl::OnTreeExpanding(wxTreeEvent &event)
+{
+	PopulateFolder(event.GetItem());
+}
+
+// Waits for a pause in typing, every key starts the wait over
+// so searches for text that has already changed again never run.
+void FileControl::OnText(wxCommandEvent &event)
+{
+	filterTimer.Start(FILTER_DELAY, wxTIMER_ONE_SHOT);
+}
+
+void FileControl::OnFilterTimer(wxTimerEvent &event)
+{
+	Filter(true);
+}
+
 void FileControl::OnButton(wxCommandEvent &event)
 {
 	int id = event.GetId();
@@ -7,6 +7,16 @@ class FileControl: public wxWindow
 	DECLARE_EVENT_TABLE()
 
 	std::set<FileTreeItem> filelist;
+
+	// files passing the current filter, sorted so a folder's files sit next to each other
+	std::vector<FileTreeItem> files;
+	// folder nodes that haven't been expanded yet, their children are added on the first expand
+	struct TreeFolder {
+		size_t first, last;	// range in files
+		size_t offset;		// length of the folder's path, where its children's names start
+	};
+	std::map<wxTreeItemIdValue, TreeFolder> folders;
+	wxTimer filterTimer;
 public:
 	// Constructor + Deconstructor
 	FileControl(wxWindow* parent, wxWindowID id);
@@ -15,8 +25,11 @@ public:
 	void Init(ModelViewer* mv=NULL);
 	void OnTreeSelect(wxTreeEvent &event);
 	void OnTreeCollapsedOrExpanded(wxTreeEvent &event);
+	void OnTreeExpanding(wxTreeEvent &event);
 	void OnButton(wxCommandEvent &event);
 	void OnChoice(wxCommandEvent &event);
+	void OnText(wxCommandEvent &event);
+	void OnFilterTimer(wxTimerEvent &event);
 	void OnTreeMenu(wxTreeEvent &event);
 	void OnPopupClick(wxCommandEvent &evt);
 	void Export(wxString val, int select);
@@ -39,6 +52,11 @@ public:
 
 private:
 	void ClearCanvas();
+	void Filter(bool narrow);
+	void UpdateTree();
+	void AddChildren(wxTreeItemId parent, size_t first, size_t last, size_t offset);
+	void PopulateFolder(wxTreeItemId item);
+	void ExpandFolders(wxTreeItemId parent);
 };
 
 class FileTreeData:public wxTreeItemData
@@ -0,0 +1,208 @@
+#include "framecapture.h"
+#include "modelcanvas.h"
+#include "video.h"
+#include "globalvars.h"
+
+#include <string.h>
+
+FrameCapture *FrameCapture::current = NULL;
+
+FrameCapture::FrameCapture()
+{
+	width = height = 0;
+	useFBO = usePBO = finishing = active = false;
+	frameBuffer = colorBuffer = depthBuffer = 0;
+	for (size_t i=0; i<FRAMECAPTURE_QUEUE; i++)
+		packBuffers[i] = 0;
+	queued = first = 0;
+	pixels = NULL;
+}
+
+FrameCapture::~FrameCapture()
+{
+	End();
+}
+
+bool FrameCapture::Begin(int w, int h)
+{
+	if (!g_canvas)
+		return false;
+
+	End();
+	g_canvas->SetCurrent();
+	// from here on End() cleans up whatever got created
+	active = true;
+	usePBO = false;
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	if (w <= 0 || h <= 0) {
+		w = viewport[2];
+		h = viewport[3];
+	}
+
+	useFBO = video.supportFBO;
+	if (useFBO) {
+		GLint maxSize = 0;
+		glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE_EXT, &maxSize);
+		if (maxSize > 0) {
+			if (w > maxSize) w = maxSize;
+			if (h > maxSize) h = maxSize;
+		}
+
+		glGenFramebuffersEXT(1, &frameBuffer);
+		glGenRenderbuffersEXT(1, &colorBuffer);
+		glGenRenderbuffersEXT(1, &depthBuffer);
+
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, frameBuffer);
+		glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, colorBuffer);
+		glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_RGBA8, w, h);
+		glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_RENDERBUFFER_EXT, colorBuffer);
+		glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, depthBuffer);
+		glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT24, w, h);
+		glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, depthBuffer);
+		glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, 0);
+
+		if (glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT) != GL_FRAMEBUFFER_COMPLETE_EXT) {
+			wxLogMessage(wxT("OGL Error: Capture framebuffer incomplete, reading from the back buffer instead."));
+			glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+			glDeleteFramebuffersEXT(1, &frameBuffer);
+			glDeleteRenderbuffersEXT(1, &colorBuffer);
+			glDeleteRenderbuffersEXT(1, &depthBuffer);
+			frameBuffer = colorBuffer = depthBuffer = 0;
+			useFBO = false;
+		}
+	}
+
+	if (!useFBO) {
+		// the back buffer can't be bigger than the window
+		if (w > viewport[2]) w = viewport[2];
+		if (h > viewport[3]) h = viewport[3];
+		glReadBuffer(GL_BACK);
+	}
+
+	width = w;
+	height = h;
+	if (width <= 0 || height <= 0) {
+		End();
+		return false;
+	}
+
+	usePBO = glewIsSupported("GL_ARB_pixel_buffer_object") == GL_TRUE;
+	if (usePBO) {
+		glGenBuffersARB(FRAMECAPTURE_QUEUE, packBuffers);
+		for (size_t i=0; i<FRAMECAPTURE_QUEUE; i++) {
+			glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, packBuffers[i]);
+			glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, FrameSize(), NULL, GL_STREAM_READ_ARB);
+		}
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+	} else {
+		pixels = new unsigned char[FrameSize()];
+	}
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	queued = first = 0;
+	finishing = false;
+	current = this;
+
+	wxLogMessage(wxT("Info: Capturing %ix%i frames (%s, %s)."), width, height, useFBO ? wxT("framebuffer object") : wxT("back buffer"), usePBO ? wxT("queued read back") : wxT("direct read back"));
+	return true;
+}
+
+void FrameCapture::End()
+{
+	if (!active)
+		return;
+
+	if (usePBO) {
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+		glDeleteBuffersARB(FRAMECAPTURE_QUEUE, packBuffers);
+		for (size_t i=0; i<FRAMECAPTURE_QUEUE; i++)
+			packBuffers[i] = 0;
+	}
+	wxDELETEA(pixels);
+
+	if (useFBO) {
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+		glDeleteFramebuffersEXT(1, &frameBuffer);
+		glDeleteRenderbuffersEXT(1, &colorBuffer);
+		glDeleteRenderbuffersEXT(1, &depthBuffer);
+		frameBuffer = colorBuffer = depthBuffer = 0;
+	}
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	if (current == this)
+		current = NULL;
+	active = false;
+	queued = 0;
+}
+
+void FrameCapture::Render()
+{
+	if (useFBO)
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, frameBuffer);
+
+	g_canvas->RenderToBuffer();
+
+	if (useFBO)
+		glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+}
+
+void FrameCapture::Capture()
+{
+	if (!active)
+		return;
+
+	// The caller should have emptied the queue with Read(), drop the oldest frame if not.
+	if (queued == FRAMECAPTURE_QUEUE) {
+		first = (first + 1) % FRAMECAPTURE_QUEUE;
+		queued--;
+	}
+
+	Render();
+
+	if (usePBO) {
+		// Starts an asynchronous copy into the pixel buffer, collected by Read()
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, packBuffers[(first + queued) % FRAMECAPTURE_QUEUE]);
+		glReadPixels(0, 0, width, height, GL_BGRA_EXT, GL_UNSIGNED_BYTE, GL_BUFFER_OFFSET(0));
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+		queued++;
+	} else {
+		glReadPixels(0, 0, width, height, GL_BGRA_EXT, GL_UNSIGNED_BYTE, pixels);
+		queued = 1;
+	}
+
+	if (useFBO)
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+}
+
+bool FrameCapture::Read(unsigned char *dest)
+{
+	if (!active || queued == 0)
+		return false;
+
+	// Leave the newest frame in flight until the next one has been started.
+	if (usePBO && queued < FRAMECAPTURE_QUEUE && !finishing)
+		return false;
+
+	if (usePBO) {
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, packBuffers[first]);
+		void *data = glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+		if (data) {
+			memcpy(dest, data, FrameSize());
+			glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+		} else {
+			memset(dest, 0, FrameSize());
+			wxLogMessage(wxT("OGL Error: Could not map the capture read back buffer."));
+		}
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+		first = (first + 1) % FRAMECAPTURE_QUEUE;
+	} else {
+		memcpy(dest, pixels, FrameSize());
+	}
+
+	queued--;
+	return true;
+}
@@ -0,0 +1,60 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include "OpenGLHeaders.h"
+
+// Frames kept in flight between being rendered and read back.
+#define FRAMECAPTURE_QUEUE	2
+
+// FrameCapture
+// Offscreen capture for the animation exporters and screenshots. Frames are rendered into a
+// framebuffer object of the requested size on the canvas' own GL context, so the textures,
+// VBOs and display lists that are already loaded are used as they are, and nothing depends
+// on the window being visible, its size or any platform specific (WGL) extension. It works
+// the same on a software GL implementation (Mesa llvmpipe under Xvfb on a machine with no GPU).
+//
+// When pixel buffer objects are supported the read back of a frame is queued and only
+// collected a frame later, so the GPU (or the software rasteriser) works on the next frame
+// while the previous one is copied out. Without FBO support it falls back to the back buffer.
+//
+// Usage:
+//	FrameCapture capture;
+//	capture.Begin(w, h);
+//	for each frame { capture.Capture(); advance the animation; while (capture.Read(buf)) use(buf); }
+//	capture.Finish(); while (capture.Read(buf)) use(buf);
+//	capture.End();
+class FrameCapture {
+public:
+	FrameCapture();
+	~FrameCapture();
+
+	// Sets up the offscreen target, width or height of 0 use the canvas viewport size.
+	bool Begin(int width, int height);
+	void End();
+
+	// Renders the current state of the canvas and queues it for reading.
+	void Capture();
+	// No more frames will be captured, lets Read() empty the queue.
+	void Finish() { finishing = true; }
+	// Copies the oldest finished frame into dest as 32bit BGRA, bottom row first
+	// (the layout CxImage::CreateFromArray expects). Returns false if there's none ready.
+	bool Read(unsigned char *dest);
+
+	size_t FrameSize() const { return (size_t)width * height * 4; }
+
+	int width, height;
+
+	// The capture being rendered into, ModelCanvas::RenderToBuffer() sizes its view for it.
+	static FrameCapture *current;
+
+private:
+	void Render();
+
+	bool useFBO, usePBO, finishing, active;
+	GLuint frameBuffer, colorBuffer, depthBuffer;
+	GLuint packBuffers[FRAMECAPTURE_QUEUE];
+	size_t queued, first;
+	unsigned char *pixels;	// the last frame when not using pixel buffer objects
+};
+
+#endif
@@ -0,0 +1,415 @@
+#include "framewriter.h"
+
+// wxWidgets
+#include <wx/log.h>
+
+// CxImage
+#include "CxImage/ximage.h"
+#include "CxImage/xmemfile.h"
+
+#include <string.h>
+
+// AVI 1.0 offsets are 32bit, stay clear of signed overflow in ftell/fseek too.
+#define AVI_MAX_SIZE	0x7F000000L
+
+#define AVIF_HASINDEX	0x00000010L
+#define AVIIF_KEYFRAME	0x00000010L
+
+static void PutLE16(FILE *f, unsigned int v)
+{
+	fputc(v & 0xFF, f);
+	fputc((v >> 8) & 0xFF, f);
+}
+
+static void PutLE32(FILE *f, unsigned long v)
+{
+	fputc(v & 0xFF, f);
+	fputc((v >> 8) & 0xFF, f);
+	fputc((v >> 16) & 0xFF, f);
+	fputc((v >> 24) & 0xFF, f);
+}
+
+static void PutFourCC(FILE *f, const char *id)
+{
+	fwrite(id, 1, 4, f);
+}
+
+// Overwrites a 32bit value written earlier, leaving the file position at the end.
+static void PatchLE32(FILE *f, long pos, unsigned long v)
+{
+	fseek(f, pos, SEEK_SET);
+	PutLE32(f, v);
+	fseek(f, 0, SEEK_END);
+}
+
+FrameWriter::FrameWriter() :
+	transparent(false),
+	greyscale(false),
+	format(FRAMEWRITER_PNG),
+	width(0),
+	height(0),
+	fps(25),
+	frameCount(0),
+	encoder(NULL),
+	frameReady(mutex),
+	slotFree(mutex),
+	closing(false),
+	failed(false),
+	file(NULL),
+	riffSize(0),
+	totalFrames(0),
+	avihBufferSize(0),
+	strhLength(0),
+	strhBufferSize(0),
+	moviSize(0),
+	moviStart(0),
+	maxChunk(0)
+{
+}
+
+FrameWriter::~FrameWriter()
+{
+	Close();
+}
+
+bool FrameWriter::Open(const wxString &fn, int fmt, int w, int h, int rate)
+{
+	Close();
+
+	if (w <= 0 || h <= 0)
+		return false;
+
+	filename = fn;
+	format = fmt;
+	width = w;
+	height = h;
+	fps = (rate > 0) ? rate : 25;
+	frameCount = 0;
+	closing = failed = false;
+	maxChunk = 0;
+	index.clear();
+
+	if (format != FRAMEWRITER_PNG) {
+		file = fopen(filename.mb_str(), "wb");
+		if (!file) {
+			wxLogMessage(wxT("Error: Could not open %s for writing."), filename.c_str());
+			return false;
+		}
+		rowBuffer.resize((((size_t)width * 3 + 3) & ~3) * height);
+		WriteAVIHeader();
+	}
+
+	for (size_t i=0; i<FRAMEWRITER_QUEUE; i++) {
+		slots.push_back(new unsigned char[FrameSize()]);
+		freeSlots.push_back(slots.back());
+	}
+
+	encoder = new Encoder(this);
+	if (encoder->Create() != wxTHREAD_NO_ERROR || encoder->Run() != wxTHREAD_NO_ERROR) {
+		// no thread, Add() does the encoding itself
+		wxDELETE(encoder);
+	}
+
+	return true;
+}
+
+bool FrameWriter::Add(const unsigned char *frame)
+{
+	if (slots.empty())
+		return false;
+
+	if (!encoder) {
+		if (failed)
+			return false;
+		memcpy(slots[0], frame, FrameSize());
+		bool ok = (format == FRAMEWRITER_PNG) ? WritePNG(slots[0]) : WriteAVIFrame(slots[0]);
+		failed = !ok;
+		return ok;
+	}
+
+	mutex.Lock();
+	while (freeSlots.empty() && !failed)
+		slotFree.Wait();
+	if (failed) {
+		mutex.Unlock();
+		return false;
+	}
+	unsigned char *slot = freeSlots.front();
+	freeSlots.pop_front();
+	mutex.Unlock();
+
+	memcpy(slot, frame, FrameSize());
+
+	wxMutexLocker lock(mutex);
+	readySlots.push_back(slot);
+	frameReady.Signal();
+	return true;
+}
+
+bool FrameWriter::Close()
+{
+	if (slots.empty() && !file)
+		return !failed;
+
+	if (encoder) {
+		{
+			wxMutexLocker lock(mutex);
+			closing = true;
+			frameReady.Broadcast();
+		}
+		encoder->Wait();
+		wxDELETE(encoder);
+	}
+
+	if (file) {
+		if (!failed && !FinishAVI())
+			failed = true;
+		fclose(file);
+		file = NULL;
+		if (index.size() / 2 < frameCount)
+			wxLogMessage(wxT("Error: %s reached the AVI size limit, %u frames were left out."), filename.c_str(), (unsigned int)(frameCount - index.size() / 2));
+	}
+
+	for (size_t i=0; i<slots.size(); i++)
+		delete [] slots[i];
+	slots.clear();
+	freeSlots.clear();
+	readySlots.clear();
+	rowBuffer.clear();
+
+	if (failed)
+		wxLogMessage(wxT("Error: Writing %s failed."), filename.c_str());
+	else
+		wxLogMessage(wxT("Info: Wrote %u frames to %s."), (unsigned int)frameCount, filename.c_str());
+	return !failed;
+}
+
+unsigned char *FrameWriter::NextFrame()
+{
+	wxMutexLocker lock(mutex);
+	while (readySlots.empty() && !closing)
+		frameReady.Wait();
+	if (readySlots.empty())
+		return NULL;
+
+	unsigned char *frame = readySlots.front();
+	readySlots.pop_front();
+	return frame;
+}
+
+void FrameWriter::FrameDone(unsigned char *frame, bool ok)
+{
+	wxMutexLocker lock(mutex);
+	if (!ok)
+		failed = true;
+	freeSlots.push_back(frame);
+	slotFree.Signal();
+}
+
+wxThread::ExitCode FrameWriter::Encoder::Entry()
+{
+	// Once something has failed the rest of the frames are only handed back.
+	bool ok = true;
+	unsigned char *frame;
+	while ((frame = writer->NextFrame()) != NULL) {
+		if (ok)
+			ok = (writer->format == FRAMEWRITER_PNG) ? writer->WritePNG(frame) : writer->WriteAVIFrame(frame);
+		writer->FrameDone(frame, ok);
+	}
+	return 0;
+}
+
+bool FrameWriter::WritePNG(unsigned char *frame)
+{
+	CxImage image(0);
+	image.CreateFromArray(frame, (DWORD)width, (DWORD)height, 32, (DWORD)(width*4), false);
+
+	/*
+	 *Because Alpha Channel textures are a bit messed up in the OpenGL renders,
+	 *alpha channels will have to be 1-bit to "hide" any texture errors
+	 */
+	if (transparent) {
+		CxImage alpha(0);
+		image.AlphaSplit(&alpha); //split alpha to another cximage object
+		alpha.Threshold(1); //convert 8bit alpha to 1bit
+		image.AlphaSet(alpha); //apply mock 1-bit alpha channel
+	} else {
+		image.AlphaCreate();
+		image.IncreaseBpp(32);
+	}
+
+	#ifdef _WINDOWS
+	if (greyscale)
+		image.GrayScale();
+	#endif //_WINDOWS
+
+	wxString fn = wxString::Format(wxT("%s_%u.png"), filename.c_str(), (unsigned int)frameCount++);
+#ifndef _MINGW
+	return image.Save(fn.mb_str(), CXIMAGE_FORMAT_PNG);
+#else
+	return image.Save(fn.wc_str(), CXIMAGE_FORMAT_PNG);
+#endif
+}
+
+void FrameWriter::WriteAVIHeader()
+{
+	const bool mjpeg = (format == FRAMEWRITER_AVI_MJPEG);
+	const unsigned long imageSize = (unsigned long)rowBuffer.size();
+
+	PutFourCC(file, "RIFF");
+	riffSize = ftell(file);
+	PutLE32(file, 0);
+	PutFourCC(file, "AVI ");
+
+	PutFourCC(file, "LIST");
+	PutLE32(file, 4 + (8 + 56) + (12 + (8 + 56) + (8 + 40)));
+	PutFourCC(file, "hdrl");
+
+	// MainAVIHeader
+	PutFourCC(file, "avih");
+	PutLE32(file, 56);
+	PutLE32(file, 1000000 / fps);	// dwMicroSecPerFrame
+	PutLE32(file, 0);				// dwMaxBytesPerSec
+	PutLE32(file, 0);				// dwPaddingGranularity
+	PutLE32(file, AVIF_HASINDEX);	// dwFlags
+	totalFrames = ftell(file);
+	PutLE32(file, 0);				// dwTotalFrames
+	PutLE32(file, 0);				// dwInitialFrames
+	PutLE32(file, 1);				// dwStreams
+	avihBufferSize = ftell(file);
+	PutLE32(file, 0);				// dwSuggestedBufferSize
+	PutLE32(file, width);
+	PutLE32(file, height);
+	for (int i=0; i<4; i++)
+		PutLE32(file, 0);			// dwReserved
+
+	PutFourCC(file, "LIST");
+	PutLE32(file, 4 + (8 + 56) + (8 + 40));
+	PutFourCC(file, "strl");
+
+	// AVIStreamHeader
+	PutFourCC(file, "strh");
+	PutLE32(file, 56);
+	PutFourCC(file, "vids");
+	PutFourCC(file, mjpeg ? "MJPG" : "DIB ");
+	PutLE32(file, 0);				// dwFlags
+	PutLE16(file, 0);				// wPriority
+	PutLE16(file, 0);				// wLanguage
+	PutLE32(file, 0);				// dwInitialFrames
+	PutLE32(file, 1);				// dwScale
+	PutLE32(file, fps);				// dwRate
+	PutLE32(file, 0);				// dwStart
+	strhLength = ftell(file);
+	PutLE32(file, 0);				// dwLength
+	strhBufferSize = ftell(file);
+	PutLE32(file, 0);				// dwSuggestedBufferSize
+	PutLE32(file, 0xFFFFFFFFUL);	// dwQuality
+	PutLE32(file, 0);				// dwSampleSize
+	PutLE16(file, 0);				// rcFrame
+	PutLE16(file, 0);
+	PutLE16(file, width);
+	PutLE16(file, height);
+
+	// BITMAPINFOHEADER
+	PutFourCC(file, "strf");
+	PutLE32(file, 40);
+	PutLE32(file, 40);				// biSize
+	PutLE32(file, width);
+	PutLE32(file, height);			// bottom up, same as the captured frames
+	PutLE16(file, 1);				// biPlanes
+	PutLE16(file, 24);				// biBitCount
+	if (mjpeg)
+		PutFourCC(file, "MJPG");	// biCompression
+	else
+		PutLE32(file, 0);			// BI_RGB
+	PutLE32(file, imageSize);		// biSizeImage
+	PutLE32(file, 0);
+	PutLE32(file, 0);
+	PutLE32(file, 0);
+	PutLE32(file, 0);
+
+	PutFourCC(file, "LIST");
+	moviSize = ftell(file);
+	PutLE32(file, 0);
+	moviStart = ftell(file);
+	PutFourCC(file, "movi");
+}
+
+bool FrameWriter::WriteAVIFrame(unsigned char *frame)
+{
+	frameCount++;
+
+	// BGRA to BGR, rows padded to 4 bytes like a DIB
+	const size_t stride = ((size_t)width * 3 + 3) & ~3;
+	for (int y=0; y<height; y++) {
+		const unsigned char *src = frame + (size_t)y * width * 4;
+		unsigned char *dst = &rowBuffer[(size_t)y * stride];
+		for (int x=0; x<width; x++, src+=4, dst+=3) {
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
+		}
+	}
+
+	if (format == FRAMEWRITER_AVI_RAW)
+		return WriteAVIChunk("00db", &rowBuffer[0], rowBuffer.size());
+
+	CxImage image(0);
+	image.CreateFromArray(&rowBuffer[0], (DWORD)width, (DWORD)height, 24, (DWORD)stride, false);
+	image.SetJpegQuality(90);
+
+	CxMemFile mem;
+	mem.Open();
+	if (!image.Encode(&mem, CXIMAGE_FORMAT_JPG))
+		return false;
+	return WriteAVIChunk("00dc", mem.GetBuffer(false), (size_t)mem.Size());
+}
+
+bool FrameWriter::WriteAVIChunk(const char *id, const unsigned char *data, size_t size)
+{
+	const long pos = ftell(file);
+	// leave room for this chunk and the index
+	if (pos + (long)size + 8 + (long)(index.size() + 2) * 8 + 8 > AVI_MAX_SIZE)
+		return true;
+
+	PutFourCC(file, id);
+	PutLE32(file, (unsigned long)size);
+	fwrite(data, 1, size, file);
+	if (size & 1)
+		fputc(0, file);
+
+	if (ferror(file))
+		return false;
+
+	index.push_back((unsigned long)(pos - moviStart));
+	index.push_back((unsigned long)size);
+	if (size > maxChunk)
+		maxChunk = size;
+	return true;
+}
+
+bool FrameWriter::FinishAVI()
+{
+	const char *id = (format == FRAMEWRITER_AVI_MJPEG) ? "00dc" : "00db";
+	const unsigned long frames = (unsigned long)(index.size() / 2);
+
+	const long indexStart = ftell(file);
+	PutFourCC(file, "idx1");
+	PutLE32(file, frames * 16);
+	for (size_t i=0; i<index.size(); i+=2) {
+		PutFourCC(file, id);
+		PutLE32(file, AVIIF_KEYFRAME);
+		PutLE32(file, index[i]);
+		PutLE32(file, index[i+1]);
+	}
+
+	const long end = ftell(file);
+	PatchLE32(file, riffSize, end - 8);
+	PatchLE32(file, moviSize, indexStart - moviStart);
+	PatchLE32(file, totalFrames, frames);
+	PatchLE32(file, strhLength, frames);
+	PatchLE32(file, avihBufferSize, (unsigned long)maxChunk + 8);
+	PatchLE32(file, strhBufferSize, (unsigned long)maxChunk + 8);
+
+	return ferror(file) == 0;
+}
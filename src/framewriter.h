@@ -0,0 +1,94 @@
+#ifndef FRAMEWRITER_H
+#define FRAMEWRITER_H
+
+// wxWidgets
+#include <wx/string.h>
+#include <wx/thread.h>
+
+// STL
+#include <deque>
+#include <vector>
+
+#include <stdio.h>
+
+// Frames waiting to be encoded. Add() only blocks once they're all in use, this is
+// what bounds the memory used no matter how long the animation is.
+#define FRAMEWRITER_QUEUE	8
+
+enum FrameWriterFormat {
+	FRAMEWRITER_PNG,		// name_0.png, name_1.png, ...
+	FRAMEWRITER_AVI_RAW,	// uncompressed 24bit AVI
+	FRAMEWRITER_AVI_MJPEG	// Motion JPEG AVI
+};
+
+// FrameWriter
+// Streams captured frames (32bit BGRA, bottom row first, as read back by FrameCapture) to disk
+// as they come in. Compressing and writing is done on a thread of its own, so the capture
+// carries on rendering while the previous frames are encoded.
+//
+// The AVI files are written directly (RIFF/AVI 1.0 with an idx1 index), they don't need any
+// system codec and play in anything that handles AVI. Like any AVI 1.0 file they are limited
+// to 2GB, frames past that are dropped with an error in the log.
+class FrameWriter {
+public:
+	FrameWriter();
+	~FrameWriter();
+
+	// For the PNG sequence filename is the name without the frame number and extension.
+	bool Open(const wxString &filename, int format, int width, int height, int fps = 25);
+	// Queues a copy of the frame, returns false if writing has failed.
+	bool Add(const unsigned char *frame);
+	// Writes out the remaining frames and finishes the file.
+	bool Close();
+
+	size_t FrameSize() const { return (size_t)width * height * 4; }
+
+	// PNG sequence options
+	bool transparent;	// keep the alpha channel (cut to 1bit)
+	bool greyscale;
+
+private:
+	class Encoder : public wxThread {
+	public:
+		Encoder(FrameWriter *writer) : wxThread(wxTHREAD_JOINABLE), writer(writer) {}
+		virtual ExitCode Entry();
+	private:
+		FrameWriter *writer;
+	};
+	friend class Encoder;
+
+	// disable copying
+	FrameWriter(const FrameWriter &);
+	void operator=(const FrameWriter &);
+
+	unsigned char *NextFrame();
+	void FrameDone(unsigned char *frame, bool ok);
+
+	bool WritePNG(unsigned char *frame);
+	bool WriteAVIFrame(unsigned char *frame);
+	bool WriteAVIChunk(const char *id, const unsigned char *data, size_t size);
+	void WriteAVIHeader();
+	bool FinishAVI();
+
+	int format, width, height, fps;
+	wxString filename;
+	size_t frameCount;
+
+	Encoder *encoder;
+	wxMutex mutex;
+	wxCondition frameReady;
+	wxCondition slotFree;
+	std::vector<unsigned char*> slots;
+	std::deque<unsigned char*> freeSlots;
+	std::deque<unsigned char*> readySlots;
+	bool closing, failed;
+
+	// AVI state, only used by the encoder thread after Open()
+	FILE *file;
+	long riffSize, totalFrames, avihBufferSize, strhLength, strhBufferSize, moviSize, moviStart;
+	size_t maxChunk;
+	std::vector<unsigned long> index;	// offset and size of each frame, for idx1
+	std::vector<unsigned char> rowBuffer;
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include "frustum.h"
+#include "video.h"
+
+void Frustum::retrieve()
+{
+	float proj[16], modelview[16];
+	glGetFloatv(GL_PROJECTION_MATRIX, proj);
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+	set(proj, modelview);
+}
+
+void Frustum::set(const float *proj, const float *modelview)
+{
+	// clip = proj * modelview, both column major
+	float clip[16];
+	for (size_t c=0; c<4; c++) {
+		for (size_t r=0; r<4; r++) {
+			clip[c*4+r] = proj[r]*modelview[c*4] + proj[4+r]*modelview[c*4+1] +
+				proj[8+r]*modelview[c*4+2] + proj[12+r]*modelview[c*4+3];
+		}
+	}
+
+	// each plane is the last row of the clip matrix plus or minus one of the others
+	static const int rows[6] = { 0, 0, 1, 1, 2, 2 };
+	static const float signs[6] = { 1, -1, 1, -1, 1, -1 };
+
+	planes.clear();
+	for (size_t i=0; i<6; i++) {
+		int r = rows[i];
+		float s = signs[i];
+		Vec3D n(clip[3] + s*clip[r], clip[7] + s*clip[4+r], clip[11] + s*clip[8+r]);
+		float d = clip[15] + s*clip[12+r];
+		float len = n.length();
+		if (len > 0)
+			planes.push_back(Plane(n / len, d / len));
+	}
+
+	// the eye is what the modelview matrix takes to the origin. It is only rotated, moved
+	// and scaled the same along every axis, so its inverse is the transpose over the scale squared.
+	Vec3D t(modelview[12], modelview[13], modelview[14]);
+	float s2 = modelview[0]*modelview[0] + modelview[1]*modelview[1] + modelview[2]*modelview[2];
+	if (s2 <= 0)
+		s2 = 1.0f;
+	eye = Vec3D(-(modelview[0]*t.x + modelview[1]*t.y + modelview[2]*t.z),
+				-(modelview[4]*t.x + modelview[5]*t.y + modelview[6]*t.z),
+				-(modelview[8]*t.x + modelview[9]*t.y + modelview[10]*t.z)) / s2;
+}
+
+void Frustum::clip(const Vec3D &eye, const Vec3D *poly, size_t n)
+{
+	if (n < 3)
+		return;
+
+	Vec3D center;
+	for (size_t i=0; i<n; i++)
+		center += poly[i];
+	center *= 1.0f / n;
+
+	for (size_t i=0; i<n; i++) {
+		const Vec3D &a = poly[i];
+		const Vec3D &b = poly[(i+1)%n];
+		Vec3D normal = (a - eye) % (b - eye);
+		float len = normal.length();
+		if (len < 0.0001f)
+			continue;
+		normal *= 1.0f / len;
+
+		// face the middle of the polygon, the winding of portals isn't consistent
+		Plane p(normal, -(normal * eye));
+		if (p.distance(center) < 0) {
+			p.normal *= -1.0f;
+			p.d = -p.d;
+		}
+		planes.push_back(p);
+	}
+}
+
+bool Frustum::contains(const Vec3D &v) const
+{
+	for (size_t i=0; i<planes.size(); i++) {
+		if (planes[i].distance(v) < 0)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::intersectsBox(const Vec3D &vmin, const Vec3D &vmax) const
+{
+	for (size_t i=0; i<planes.size(); i++) {
+		const Plane &p = planes[i];
+		// the corner furthest along the normal
+		Vec3D v(p.normal.x > 0 ? vmax.x : vmin.x,
+				p.normal.y > 0 ? vmax.y : vmin.y,
+				p.normal.z > 0 ? vmax.z : vmin.z);
+		if (p.distance(v) < 0)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::intersectsSphere(const Vec3D &v, float rad) const
+{
+	for (size_t i=0; i<planes.size(); i++) {
+		if (planes[i].distance(v) < -rad)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::intersectsPolygon(const Vec3D *poly, size_t n) const
+{
+	for (size_t i=0; i<planes.size(); i++) {
+		size_t j;
+		for (j=0; j<n; j++) {
+			if (planes[i].distance(poly[j]) >= 0)
+				break;
+		}
+		if (j == n)
+			return false;
+	}
+	return true;
+}
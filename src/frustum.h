@@ -0,0 +1,48 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+// STL
+#include <vector>
+
+#include "vec3d.h"
+
+struct Plane {
+	Vec3D normal;
+	float d;
+
+	Plane() : d(0) {}
+	Plane(const Vec3D &normal, float d) : normal(normal), d(d) {}
+
+	// > 0 in front of the plane, which is the inside of a Frustum
+	float distance(const Vec3D &v) const {
+		return normal * v + d;
+	}
+};
+
+// Frustum
+// A convex volume made of planes facing inwards. It starts out as the view frustum and can be
+// narrowed down to what is seen through a portal, so it isn't limited to six planes.
+// The tests are conservative, something that is near a corner of the volume may still pass.
+class Frustum {
+public:
+	// Builds the view frustum from the current GL_PROJECTION and GL_MODELVIEW matrices, the
+	// planes and the eye position end up in the space the modelview matrix maps from.
+	void retrieve();
+	// Same from matrices in GL (column major) order.
+	void set(const float *proj, const float *modelview);
+
+	// Adds the planes through eye and each edge of the convex polygon, what is left is the
+	// part of the volume seen through it.
+	void clip(const Vec3D &eye, const Vec3D *poly, size_t n);
+
+	bool contains(const Vec3D &v) const;
+	bool intersectsBox(const Vec3D &vmin, const Vec3D &vmax) const;
+	bool intersectsSphere(const Vec3D &v, float rad) const;
+	bool intersectsPolygon(const Vec3D *poly, size_t n) const;
+
+	// camera position, taken from the modelview matrix
+	Vec3D eye;
+	std::vector<Plane> planes;
+};
+
+#endif
@@ -5,6 +5,7 @@
 #include "vec3d.h"
 //#include "video.h"
 #include "shaders.h"
+#include "vertexcache.h"
 #include <cassert>
 #include <algorithm>
 using namespace std;
@@ -226,6 +227,14 @@ struct MH2O_Information {
 
 int gdetailtexcoords, galphatexcoords;
 
+// the chunks of a tile put their alpha and shadow maps in here while loading,
+// it is uploaded once they are all done and reused by the next tile
+static AlphaAtlas alphaStaging;
+static std::vector<unsigned char> alphaPlane;
+
+// triangles of a chunk without holes, the same for every chunk
+static std::vector<unsigned short> gmaptris;
+
 void initGlobalVBOs()
 {
 	if (gdetailtexcoords==0 && galphatexcoords==0) {
@@ -296,16 +305,54 @@ void MapTile::initDisplay()
 	//mapstrip2 = new short[stripsize2];
 	stripify2<short>(defstrip, mapstrip2);
 	delete[] defstrip;
+
+	// drawn as a list ordered for the vertex cache rather than the strip itself
+	if (gmaptris.empty()) {
+		StripToTriangles(mapstrip2, stripsize2, gmaptris);
+		OptimizeVertexCache(&gmaptris[0], gmaptris.size(), &gmaptris[0]);
+	}
 	
 	initGlobalVBOs();
 }
 
+static GLuint uploadAlphaAtlas(GLint internalFormat, GLenum format, const unsigned char *data)
+{
+	GLuint tex;
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, ALPHAATLAS_SIZE, ALPHAATLAS_SIZE, 0, format, GL_UNSIGNED_BYTE, data);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	return tex;
+}
+
+// One upload for the whole tile with shaders, four without, instead of up to four per chunk.
+void MapTile::initAlphaAtlas()
+{
+	if (video.supportShaders) {
+		blendAtlas = uploadAlphaAtlas(GL_RGBA8, GL_RGBA, alphaStaging.data());
+		return;
+	}
+
+	for (size_t i=0; i<3; i++) {
+		alphaStaging.extract((int)i, alphaPlane);
+		alphaAtlas[i] = uploadAlphaAtlas(GL_ALPHA, GL_ALPHA, &alphaPlane[0]);
+	}
+	alphaStaging.extract(3, alphaPlane);
+	shadowAtlas = uploadAlphaAtlas(GL_ALPHA, GL_ALPHA, &alphaPlane[0]);
+}
+
 /*
 MapTile is ADT
 http://madx.dk/wowdev/wiki/index.php?title=ADT
 */
-MapTile::MapTile(wxString filename): nWMO(0), nMDX(0), topnode(0,0,16)
+MapTile::MapTile(wxString filename): nWMO(0), nMDX(0), topnode(0,0,16), blendAtlas(0), shadowAtlas(0)
 {
+	for (size_t i=0; i<3; i++)
+		alphaAtlas[i] = 0;
+
 	x = atoi((char *)filename.Mid(filename.Len()-9, 2).c_str());
 	z = atoi((char *)filename.Mid(filename.Len()-6, 2).c_str());
 	xbase = x * TILESIZE;
@@ -741,15 +788,17 @@ MapTile::MapTile(wxString filename): nWMO(0), nMDX(0), topnode(0,0,16)
 	}
 
 	// read individual map chunks
+	alphaStaging.clear();
 	for (ssize_t j=0; j<CHUNKS_IN_TILE; j++) {
 		for (size_t i=0; i<CHUNKS_IN_TILE; i++) {
 			if (mcnk_offsets[j*CHUNKS_IN_TILE+i] == 0 || mcnk_sizes[j*CHUNKS_IN_TILE+i] == 0) {
 				continue;
 			}
 			f.seek((int)mcnk_offsets[j*16+i]);
-			chunks[j][i].init(this, f, mBigAlpha);
+			chunks[j][i].init(this, f, mBigAlpha, (int)i, (int)j);
 		}
 	}
+	initAlphaAtlas();
 
 	// init quadtree
 	topnode.setup(this);
@@ -775,6 +824,15 @@ MapTile::~MapTile()
 		texturemanager.delbyname(textures[j]);
 	}
 
+	if (blendAtlas)
+		glDeleteTextures(1, &blendAtlas);
+	for (size_t i=0; i<3; i++) {
+		if (alphaAtlas[i])
+			glDeleteTextures(1, &alphaAtlas[i]);
+	}
+	if (shadowAtlas)
+		glDeleteTextures(1, &shadowAtlas);
+
 	/*
 	// TODO
 	for (vector<string>::iterator it = wmos.begin(); it != wmos.end(); ++it) {
@@ -856,6 +914,12 @@ void MapTile::draw()
 
 	topnode.draw();
 
+	// the chunks leave their atlas cell in the texture matrix
+	glActiveTextureARB(GL_TEXTURE1_ARB);
+	glMatrixMode(GL_TEXTURE);
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glActiveTextureARB(GL_TEXTURE0_ARB);
 }
 
 void MapTile::drawWater()
@@ -983,13 +1047,14 @@ void MapChunk::initTextures(wxString basename, int first, int last)
 	}
 }
 
-static unsigned char blendbuf[64*64*4]; // make unstable when new/delete, just make it global
 static unsigned char amap[64*64];
-void MapChunk::init(MapTile* mt, MPQFile &f, bool bigAlpha)
+void MapChunk::init(MapTile* mt, MPQFile &f, bool bigAlpha, int x, int y)
 {
 	//Vec3D tn[mapbufsize], tv[mapbufsize];
 	
 	maptile = mt;
+	cellX = x;
+	cellY = y;
 
 	char fcc[5];
 	uint32 size;
@@ -1078,12 +1143,6 @@ void MapChunk::init(MapTile* mt, MPQFile &f, bool bigAlpha)
 	vmin = Vec3D( 9999999.0f, 9999999.0f, 9999999.0f);
 	vmax = Vec3D(-9999999.0f,-9999999.0f,-9999999.0f);
 
-	//unsigned char *blendbuf;
-	if (video.supportShaders) {
-		//blendbuf = new unsigned char[64*64*4];
-		memset(blendbuf, 0, 64*64*4);
-	}
-
 	while (f.getPos() < lastpos) {
 		memset(fcc, 0, 4);
 		size = 0;
@@ -1322,7 +1381,6 @@ void MapChunk::init(MapTile* mt, MPQFile &f, bool bigAlpha)
 			// alpha maps  64 x 64 = 4096
 			unsigned char *data = f.getPointer();
 			if (nTextures>0 && data) {
-				glGenTextures(nTextures-1, alphamaps);
 				/*
 				gLog("MCAL %d,%d,%d,%d %d,%d,%d,%d %d,%d,%d,%d %d,%d,%d,%d - %d\n", 
 				mcly[0].flags&MCLY_USE_ALPHAMAP, 
@@ -1343,7 +1401,6 @@ void MapChunk::init(MapTile* mt, MPQFile &f, bool bigAlpha)
 					// Alfred, error check
 					if ((mcly[i].flags & MCLY_USE_ALPHAMAP) == 0)
 						continue;
-					glBindTexture(GL_TEXTURE_2D, alphamaps[i-1]);
 
 					unsigned char *abuf = data + mcly[i].offsetInMCAL;
 					if (mcly[i].flags&MCLY_ALPHAMAP_COMPRESS) { // compressed
@@ -1403,17 +1460,7 @@ void MapChunk::init(MapTile* mt, MPQFile &f, bool bigAlpha)
 						memcpy(amap+63*64,amap+62*64,64);
 						//f.seekRelative(64*32);
 					}
-					glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, 64, 64, 0, GL_ALPHA, GL_UNSIGNED_BYTE, amap);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-					if (video.supportShaders) {
-						for (ssize_t p=0; p<64*64; p++) {
-							blendbuf[p*4+i-1] = amap[p];
-						}
-					}
+					alphaStaging.put(cellX, cellY, (int)i-1, amap);
 				}
 
 			}
@@ -1436,19 +1483,7 @@ void MapChunk::init(MapTile* mt, MPQFile &f, bool bigAlpha)
 					}
 				}
 			}
-			glGenTextures(1, &shadow);
-			glBindTexture(GL_TEXTURE_2D, shadow);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, 64, 64, 0, GL_ALPHA, GL_UNSIGNED_BYTE, sbuf);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-			if (video.supportShaders) {
-				for (ssize_t p=0; p<64*64; p++) {
-					blendbuf[p*4+3] = sbuf[p];
-				}
-			}
+			alphaStaging.put(cellX, cellY, 3, sbuf);
 		}
 		else if (strncmp(fcc,"MCLQ", 4) == 0) {
 			/*
@@ -1537,7 +1572,7 @@ void MapChunk::init(MapTile* mt, MPQFile &f, bool bigAlpha)
 	glBufferDataARB(GL_ARRAY_BUFFER_ARB, mapbufsize*3*sizeof(float), tn, GL_STATIC_DRAW_ARB);
 
 	if (hasholes)
-		initStrip(holes);
+		initIndices(holes);
 	/*
 	else {
 		strip = maptile->mapstrip2;
@@ -1549,17 +1584,6 @@ void MapChunk::init(MapTile* mt, MPQFile &f, bool bigAlpha)
 
 	vcenter = (vmin + vmax) * 0.5f;
 
-	if (video.supportShaders) {
-		glGenTextures(1, &blend);
-		glBindTexture(GL_TEXTURE_2D, blend);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 64, 64, 0, GL_RGBA, GL_UNSIGNED_BYTE, blendbuf);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		//delete[] blendbuf;
-	}
-
 #if 0
 	deleted=false;
 	nameID=addNameMapChunk(this);
@@ -1628,9 +1652,9 @@ void MapChunk::init(MapTile* mt, MPQFile &f, bool bigAlpha)
 }
 
 
-void MapChunk::initStrip(int holes)
+void MapChunk::initIndices(int holes)
 {
-	strip = new short[256]; // TODO: figure out exact length of strip needed
+	short strip[256]; // TODO: figure out exact length of strip needed
 	short *s = strip;
 	bool first = true;
 	for (ssize_t y=0; y<4; y++) {
@@ -1653,22 +1677,24 @@ void MapChunk::initStrip(int holes)
 			}
 		}
 	}
-	striplen = (int)(s - strip);
+
+	std::vector<unsigned short> tris;
+	StripToTriangles(strip, s - strip, tris);
+	if (!tris.empty())
+		OptimizeVertexCache(&tris[0], tris.size(), &tris[0]);
+	nIndices = (int)tris.size();
+	indices = new unsigned short[nIndices];
+	std::copy(tris.begin(), tris.end(), indices);
 }
 
 
 void MapChunk::destroy()
 {
-	// unload alpha maps
-	glDeleteTextures(nTextures-1, alphamaps);
-	// shadow maps, too
-	glDeleteTextures(1, &shadow);
-
 	// delete VBOs
 	glDeleteBuffersARB(1, &vertices);
 	glDeleteBuffersARB(1, &normals);
 
-	if (hasholes) delete[] strip;
+	if (hasholes) delete[] indices;
 
 	if (haswater) delete lq;
 }
@@ -1694,7 +1720,7 @@ void MapChunk::drawPass(int anim)
 		glTranslatef(f*fdx,f*fdy,0);
 	}
 
-	glDrawElements(GL_TRIANGLE_STRIP, striplen, GL_UNSIGNED_SHORT, strip);
+	glDrawElements(GL_TRIANGLES, nIndices, GL_UNSIGNED_SHORT, indices);
 
 	if (anim) {
 		glPopMatrix();
@@ -1719,8 +1745,8 @@ void MapChunk::draw()
 	if (nTextures==0) return;
 
 	if (!hasholes) {
-		strip = maptile->mapstrip2;
-		striplen = stripsize2;
+		indices = &gmaptris[0];
+		nIndices = (int)gmaptris.size();
 	}
 	/*
 	// TODO
@@ -1746,6 +1772,16 @@ void MapChunk::draw()
 	glNormalPointer(GL_FLOAT, 0, 0);
 	// ASSUME: texture coordinates set up already
 
+	// alpha texture coordinates into this chunk's cell of the atlas
+	float offsetS, offsetT, scale;
+	AlphaAtlas::cellTransform(cellX, cellY, offsetS, offsetT, scale);
+	glActiveTextureARB(GL_TEXTURE1_ARB);
+	glMatrixMode(GL_TEXTURE);
+	glLoadIdentity();
+	glTranslatef(offsetS, offsetT, 0);
+	glScalef(scale, scale, 1);
+	glMatrixMode(GL_MODELVIEW);
+
 	if (video.supportShaders) {
 		// SHADER-BASED
 
@@ -1766,7 +1802,7 @@ void MapChunk::draw()
 		// shadow map
 		// TODO: handle case when there is no shadowmap?
 		glActiveTextureARB(GL_TEXTURE1_ARB);
-		glBindTexture(GL_TEXTURE_2D, blend);
+		glBindTexture(GL_TEXTURE_2D, maptile->blendAtlas);
 		// blended layers
 		for (ssize_t i=1; i<nTextures; i++) {
 			int tex = GL_TEXTURE2_ARB + i - 1;
@@ -1781,7 +1817,7 @@ void MapChunk::draw()
 		//glProgramLocalParameter4fARB(GL_FRAGMENT_PROGRAM_ARB, 0, shc.x,shc.y,shc.z,1);
 		glProgramLocalParameter4fARB(GL_FRAGMENT_PROGRAM_ARB, 0, 0.09f, 0.07f, 0.05f, 0.9f);
 		//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		glDrawElements(GL_TRIANGLE_STRIP, striplen, GL_UNSIGNED_SHORT, strip);
+		glDrawElements(GL_TRIANGLES, nIndices, GL_UNSIGNED_SHORT, indices);
 
 		terrainShaders[nTextures-1]->unbind();
 	} else {
@@ -1812,7 +1848,7 @@ void MapChunk::draw()
 			// this time, use blending:
 			glActiveTextureARB(GL_TEXTURE1_ARB);
 			glEnable(GL_TEXTURE_2D);
-			glBindTexture(GL_TEXTURE_2D, alphamaps[i]);
+			glBindTexture(GL_TEXTURE_2D, maptile->alphaAtlas[i]);
 
 			// if we loaded a texture with specular maps, setup the texenv
 			// to replace our alpha channel instead of modulating it
@@ -1838,7 +1874,7 @@ void MapChunk::draw()
 		//glColor4f(shc.x,shc.y,shc.z,1);
 
 		glActiveTextureARB(GL_TEXTURE1_ARB);
-		glBindTexture(GL_TEXTURE_2D, shadow);
+		glBindTexture(GL_TEXTURE_2D, maptile->shadowAtlas);
 		glEnable(GL_TEXTURE_2D);
 
 		drawPass(0);
@@ -1896,7 +1932,7 @@ void MapChunk::drawNoDetail()
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB, vertices);
 	glVertexPointer(3, GL_FLOAT, 0, 0);
 	glDisableClientState(GL_NORMAL_ARRAY);
-	glDrawElements(GL_TRIANGLE_STRIP, striplen, GL_UNSIGNED_SHORT, strip);
+	glDrawElements(GL_TRIANGLES, nIndices, GL_UNSIGNED_SHORT, indices);
 	glEnableClientState(GL_NORMAL_ARRAY);
 
 	glColor4f(1,1,1,1);
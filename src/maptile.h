@@ -13,6 +13,7 @@
 #include "wmo.h"
 #include "model.h"
 #include "liquid.h"
+#include "alphaatlas.h"
 #include <vector>
 #include <string>
 
@@ -131,35 +132,33 @@ public:
 	float waterlevel[2];
 
 	TextureID textures[4];
-	TextureID alphamaps[3];
-	TextureID shadow, blend;
+	// cell of the alpha maps and shadow map in the tile's atlas
+	int cellX, cellY;
 
 	int animated[4];
 
 	GLuint vertices, normals;
 
-	short *strip;
-	int striplen;
+	// triangle list, the tile's shared one unless the chunk has holes
+	unsigned short *indices;
+	int nIndices;
 
 	Liquid *lq;
 
 	MapChunk():MapNode(0,0,0),nTextures(0),xbase(0),ybase(0),zbase(0),r(0),areaID(-1),
-		haswater(false),visible(false),hasholes(false),shadow(0),blend(0),
-		vertices(0),normals(0),strip(0),striplen(0),lq(0)
+		haswater(false),visible(false),hasholes(false),cellX(0),cellY(0),
+		vertices(0),normals(0),indices(0),nIndices(0),lq(0)
 	{
 		waterlevel[0] = 0;
 		waterlevel[1] = 0;
 		for(int i=0; i<4; i++) {
 			textures[i] = 0;
 		}
-		for(int i=0; i<3; i++) {
-			alphamaps[i] = 0;
-		}
 	}
 	
-	void init(MapTile* mt, MPQFile &f, bool bigAlpha);
+	void init(MapTile* mt, MPQFile &f, bool bigAlpha, int x, int y);
 	void destroy();
-	void initStrip(int holes);
+	void initIndices(int holes);
 
 	void draw();
 	void drawNoDetail();
@@ -199,6 +198,12 @@ public:
 
 	MapNode topnode;
 
+	// alpha maps and shadow maps of all chunks, one RGBA texture with shaders,
+	// otherwise one GL_ALPHA texture per alpha layer and one for the shadows
+	TextureID blendAtlas;
+	TextureID alphaAtlas[3];
+	TextureID shadowAtlas;
+
 	MapTile(wxString filename);
 	~MapTile();
 
@@ -213,6 +218,7 @@ public:
 	MapChunk *getChunk(unsigned int x, unsigned int z);
 
 	void initDisplay();
+	void initAlphaAtlas();
 	short mapstrip2[stripsize2];
 };
 
@@ -2,6 +2,8 @@
 #include "modelviewer.h"
 #include "model.h"
 #include "mpq.h"
+#include "profiler.h"
+#include "vertexcache.h"
 
 #include <cassert>
 #include <algorithm>
@@ -343,6 +345,12 @@ Model::Model(wxString name, bool forceAnim) : ManagedItem(name), forceAnim(force
 	normals = 0;
 	texCoords = 0;
 	indices = 0;
+	nIndices = 0;
+	IndiceToVerts = 0;
+
+	mesh = 0;
+	meshId = -1;
+	ownIndices = false;
 	
 	animtime = 0;
 	anim = 0;
@@ -433,6 +441,10 @@ Model::Model(wxString name, bool forceAnim) : ManagedItem(name), forceAnim(force
 		wxLogMessage(wxT("Error: Unable to load the Model \"%s\", appears to be corrupted."), tempname.c_str());
 	}
 	
+	// the .skin, .anim and texture files are read in parallel while this one is parsed
+	MPQPrefetch prefetch;
+	prefetchFiles(f, prefetch);
+
 	if (header.nGlobalSequences) {
 		globalSequences = new uint32[header.nGlobalSequences];
 		memcpy(globalSequences, (f.getBuffer() + header.ofsGlobalSequences), header.nGlobalSequences * sizeof(uint32));
@@ -486,46 +498,41 @@ Model::~Model()
 
 		wxDELETEA(globalSequences);
 
-		wxDELETEA(bounds);
-		wxDELETEA(boundTris);
 		wxDELETEA(showGeosets);
 
 		wxDELETE(animManager);
 
 		if (animated) {
 			// unload all sorts of crap
-			// Need this if statement because VBO supported
-			// cards have already deleted it.
-			if(video.supportVBO) {
-				glDeleteBuffersARB(1, &nbuf);
-				glDeleteBuffersARB(1, &vbuf);
-				glDeleteBuffersARB(1, &tbuf);
-
-				vertices = NULL;
+			// Only skinned vertices are this model's own, the rest belongs to the mesh.
+			if (animGeometry) {
+				if (video.supportVBO) {
+					glDeleteBuffersARB(1, &vbuf);
+				} else {
+					wxDELETEA(normals);
+					wxDELETEA(vertices);
+				}
 			}
 
-			wxDELETEA(normals);
-			wxDELETEA(vertices);
-			wxDELETEA(texCoords);
-
-			wxDELETEA(indices);
 			wxDELETEA(anims);
 			wxDELETEA(animLookups);
-			wxDELETEA(origVertices);
 
 			wxDELETEA(bones);
 			wxDELETEA(texAnims);
-			wxDELETEA(colors);
-			wxDELETEA(transparency);
 			wxDELETEA(lights);
 			wxDELETEA(events);
 			wxDELETEA(particleSystems);
 			wxDELETEA(ribbons);
-			wxDELETEA(IndiceToVerts);
-
-		} else {
-			glDeleteLists(dlist, 1);
 		}
+
+		wxDELETEA(colors);
+		wxDELETEA(transparency);
+
+		if (ownIndices)
+			wxDELETEA(indices);
+
+		if (mesh)
+			modelmeshmanager.del(meshId);
 		if (g_modelViewer)
 			g_modelViewer->modelOpened->Clear();
 	}
@@ -698,46 +705,93 @@ Quaternion fixCoordSystemQuat(Quaternion v)
 }
 
 
-void Model::initCommon(MPQFile &f)
+// Queues the files the rest of the loading opens one after the other, as far as the header
+// tells: the first LOD's .skin, the .anim files and the textures named in the model.
+void Model::prefetchFiles(MPQFile &f, MPQPrefetch &prefetch)
 {
-	// assume: origVertices already set
+	if (gameVersion >= VERSION_WOTLK) {
+		wxString base = modelname.BeforeLast(wxT('.'));
+#ifdef WotLK
+		if (header.nViews)
+			prefetch.add(base + wxT("00.skin"));
+#endif
 
-	// This data is needed for both VBO and non-VBO cards.
-	vertices = new Vec3D[header.nVertices];
-	normals = new Vec3D[header.nVertices];
+		// same names as initAnimated
+		if (animated && header.ofsAnimations + header.nAnimations*sizeof(ModelAnimationWotLK) <= f.getSize()) {
+			ModelAnimationWotLK *a = (ModelAnimationWotLK*)(f.getBuffer() + header.ofsAnimations);
+			for (size_t i=0; i<header.nAnimations; i++)
+				prefetch.add(base + wxString::Format(wxT("%04d-%02d.anim"), a[i].animID, a[i].subAnimID));
+		}
+	}
 
-	// Correct the data from the model, so that its using the Y-Up axis mode.
-	for (size_t i=0; i<header.nVertices; i++) {
-		origVertices[i].pos = fixCoordSystem(origVertices[i].pos);
-		origVertices[i].normal = fixCoordSystem(origVertices[i].normal);
+	ModelTextureDef *texdef = (ModelTextureDef*)(f.getBuffer() + header.ofsTextures);
+	for (size_t i=0; i<header.nTextures && i<TEXTURE_MAX; i++) {
+		if (texdef[i].type != TEXTURE_FILENAME || texdef[i].nameOfs >= f.getSize())
+			continue;
 
-		// Set the data for our vertices, normals from the model data
-		//if (!animGeometry || !supportVBO) {
-			vertices[i] = origVertices[i].pos;
-			normals[i] = origVertices[i].normal.normalize();
-		//}
+		wxString texname((char*)(f.getBuffer()+texdef[i].nameOfs), wxConvUTF8);
+		// already loaded ones aren't read again
+		if (texturemanager.names.find(texname) == texturemanager.names.end())
+			prefetch.add(texname);
+	}
+}
 
-		float len = origVertices[i].pos.lengthSquared();
-		if (len > rad){ 
-			rad = len;
+void Model::initCommon(MPQFile &f)
+{
+	// The geometry is loaded once and shared by every model of the same file. Static models
+	// are compiled into a display list, so they can't share with the animated ones.
+	wxString meshName = name.BeforeLast(wxT('.')).Lower() + (animated ? wxT(".m2|animated") : wxT(".m2|static"));
+	meshId = modelmeshmanager.add(meshName);
+	mesh = modelmeshmanager.mesh(meshId);
+
+	if (!mesh->ok) {
+		mesh->nVertices = header.nVertices;
+		mesh->origVertices = new ModelVertex[header.nVertices];
+		memcpy(mesh->origVertices, f.getBuffer() + header.ofsVertices, header.nVertices * sizeof(ModelVertex));
+
+		// This data is needed for both VBO and non-VBO cards.
+		mesh->vertices = new Vec3D[header.nVertices];
+		mesh->normals = new Vec3D[header.nVertices];
+
+		// Correct the data from the model, so that its using the Y-Up axis mode.
+		ModelVertex *ov = mesh->origVertices;
+		for (size_t i=0; i<header.nVertices; i++) {
+			ov[i].pos = fixCoordSystem(ov[i].pos);
+			ov[i].normal = fixCoordSystem(ov[i].normal);
+
+			// Set the data for our vertices, normals from the model data
+			mesh->vertices[i] = ov[i].pos;
+			mesh->normals[i] = ov[i].normal.normalize();
+
+			float len = ov[i].pos.lengthSquared();
+			if (len > mesh->rad){ 
+				mesh->rad = len;
+			}
 		}
-	}
 
-	// model vertex radius
-	rad = sqrtf(rad);
+		// model vertex radius
+		mesh->rad = sqrtf(mesh->rad);
 
-	// bounds
-	if (header.nBoundingVertices > 0) {
-		bounds = new Vec3D[header.nBoundingVertices];
-		Vec3D *b = (Vec3D*)(f.getBuffer() + header.ofsBoundingVertices);
-		for (size_t i=0; i<header.nBoundingVertices; i++) {
-			bounds[i] = fixCoordSystem(b[i]);
+		// bounds
+		if (header.nBoundingVertices > 0) {
+			mesh->bounds = new Vec3D[header.nBoundingVertices];
+			Vec3D *b = (Vec3D*)(f.getBuffer() + header.ofsBoundingVertices);
+			for (size_t i=0; i<header.nBoundingVertices; i++) {
+				mesh->bounds[i] = fixCoordSystem(b[i]);
+			}
+		}
+		if (header.nBoundingTriangles > 0) {
+			mesh->boundTris = new uint16[header.nBoundingTriangles];
+			memcpy(mesh->boundTris, f.getBuffer() + header.ofsBoundingTriangles, header.nBoundingTriangles*sizeof(uint16));
 		}
 	}
-	if (header.nBoundingTriangles > 0) {
-		boundTris = new uint16[header.nBoundingTriangles];
-		memcpy(boundTris, f.getBuffer() + header.ofsBoundingTriangles, header.nBoundingTriangles*sizeof(uint16));
-	}
+
+	origVertices = mesh->origVertices;
+	vertices = mesh->vertices;
+	normals = mesh->normals;
+	bounds = mesh->bounds;
+	boundTris = mesh->boundTris;
+	rad = mesh->rad;
 
 	// textures
 	ModelTextureDef *texdef = (ModelTextureDef*)(f.getBuffer() + header.ofsTextures);
@@ -932,54 +986,61 @@ void Model::initCommon(MPQFile &f)
 		setLOD(f, 0); // Set the default Level of Detail to the best possible. 
 	}
 
-	// build indice to vert array.
-	if (nIndices) {
-		IndiceToVerts = new size_t[nIndices+2];
-		for (size_t i=0;i<nIndices;i++){
-			size_t a = indices[i];
-			for (size_t j=0;j<header.nVertices;j++){
-				if (a < header.nVertices && origVertices[a].pos == origVertices[j].pos){
-					IndiceToVerts[i] = j;
-					break;
+	if (!mesh->ok) {
+		// the first LOD is shared
+		mesh->indices = indices;
+		mesh->nIndices = nIndices;
+
+		// build indice to vert array.
+		if (nIndices) {
+			mesh->IndiceToVerts = new size_t[nIndices+2];
+			for (size_t i=0;i<nIndices;i++){
+				size_t a = indices[i];
+				for (size_t j=0;j<header.nVertices;j++){
+					if (a < header.nVertices && origVertices[a].pos == origVertices[j].pos){
+						mesh->IndiceToVerts[i] = j;
+						break;
+					}
 				}
 			}
 		}
+	} else if (ownIndices) {
+		wxDELETEA(indices);
 	}
+	indices = mesh->indices;
+	nIndices = mesh->nIndices;
+	ownIndices = false;
+	IndiceToVerts = mesh->IndiceToVerts;
 	// zomg done
 }
 
 void Model::initStatic(MPQFile &f)
 {
-	origVertices = (ModelVertex*)(f.getBuffer() + header.ofsVertices);
-
 	initCommon(f);
 
-	dlist = glGenLists(1);
-	glNewList(dlist, GL_COMPILE);
+	if (!mesh->ok) {
+		mesh->dlist = glGenLists(1);
+		glNewList(mesh->dlist, GL_COMPILE);
 
-    drawModel();
+		drawModel();
 
-	glEndList();
+		glEndList();
 
-	// clean up vertices, indices etc
-	wxDELETEA(vertices);
-	wxDELETEA(normals);
-	wxDELETEA(indices);
+		// clean up vertices, normals etc
+		wxDELETEA(mesh->vertices);
+		wxDELETEA(mesh->normals);
+		mesh->ok = true;
+	}
+	dlist = mesh->dlist;
+	vertices = NULL;
+	normals = NULL;
 
-	wxDELETEA(colors);
-	wxDELETEA(transparency);
+	// colors and transparency are kept for WMOGroup::initDoodadBatches(), which sets up the
+	// render passes again when it merges copies of the model
 }
 
 void Model::initAnimated(MPQFile &f)
 {
-	if (origVertices) {
-		delete [] origVertices;
-		origVertices = NULL;
-	}
-
-	origVertices = new ModelVertex[header.nVertices];
-	memcpy(origVertices, f.getBuffer() + header.ofsVertices, header.nVertices * sizeof(ModelVertex));
-
 	initCommon(f);
 
 	if (header.nAnimations > 0) {
@@ -1063,31 +1124,60 @@ void Model::initAnimated(MPQFile &f)
 	const size_t size = (header.nVertices * sizeof(float));
 	vbufsize = (3 * size); // we multiple by 3 for the x, y, z positions of the vertex
 
-	texCoords = new Vec2D[header.nVertices];
-	for (size_t i=0; i<header.nVertices; i++) 
-		texCoords[i] = origVertices[i].texcoords;
+	if (!mesh->ok) {
+		mesh->texCoords = new Vec2D[header.nVertices];
+		for (size_t i=0; i<header.nVertices; i++) 
+			mesh->texCoords[i] = origVertices[i].texcoords;
+
+		if (video.supportVBO) {
+			// Skinned models animate into a vertex buffer of their own, see below.
+			if (!animGeometry) {
+				// Vert buffer
+				glGenBuffersARB(1,&mesh->vbuf);
+				glBindBufferARB(GL_ARRAY_BUFFER_ARB, mesh->vbuf);
+				glBufferDataARB(GL_ARRAY_BUFFER_ARB, vbufsize, mesh->vertices, GL_STATIC_DRAW_ARB);
+
+				// normals buffer
+				glGenBuffersARB(1,&mesh->nbuf);
+				glBindBufferARB(GL_ARRAY_BUFFER_ARB, mesh->nbuf);
+				glBufferDataARB(GL_ARRAY_BUFFER_ARB, vbufsize, mesh->normals, GL_STATIC_DRAW_ARB);
+			}
+			wxDELETEA(mesh->vertices);
+			wxDELETEA(mesh->normals);
 
-	if (video.supportVBO) {
-		// Vert buffer
-		glGenBuffersARB(1,&vbuf);
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, vbuf);
-		glBufferDataARB(GL_ARRAY_BUFFER_ARB, vbufsize, vertices, GL_STATIC_DRAW_ARB);
-		wxDELETEA(vertices);
-		
-		// Texture buffer
-		glGenBuffersARB(1,&tbuf);
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, tbuf);
-		glBufferDataARB(GL_ARRAY_BUFFER_ARB, 2*size, texCoords, GL_STATIC_DRAW_ARB);
-		wxDELETEA(texCoords);
-		
-		// normals buffer
-		glGenBuffersARB(1,&nbuf);
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, nbuf);
-		glBufferDataARB(GL_ARRAY_BUFFER_ARB, vbufsize, normals, GL_STATIC_DRAW_ARB);
-		wxDELETEA(normals);
-		
-		// clean bind
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+			// Texture buffer
+			glGenBuffersARB(1,&mesh->tbuf);
+			glBindBufferARB(GL_ARRAY_BUFFER_ARB, mesh->tbuf);
+			glBufferDataARB(GL_ARRAY_BUFFER_ARB, 2*size, mesh->texCoords, GL_STATIC_DRAW_ARB);
+			wxDELETEA(mesh->texCoords);
+
+			// clean bind
+			glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+		}
+		mesh->ok = true;
+	}
+
+	texCoords = mesh->texCoords;
+	tbuf = mesh->tbuf;
+	nbuf = mesh->nbuf;
+	vbuf = mesh->vbuf;
+
+	if (animGeometry) {
+		// skinned by animate() every frame, so each model needs its own
+		if (video.supportVBO) {
+			glGenBuffersARB(1,&vbuf);
+			glBindBufferARB(GL_ARRAY_BUFFER_ARB, vbuf);
+			glBufferDataARB(GL_ARRAY_BUFFER_ARB, 2*vbufsize, NULL, GL_STREAM_DRAW_ARB);
+			glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+		} else {
+			vertices = new Vec3D[header.nVertices];
+			normals = new Vec3D[header.nVertices];
+			memcpy(vertices, mesh->vertices, header.nVertices * sizeof(Vec3D));
+			memcpy(normals, mesh->normals, header.nVertices * sizeof(Vec3D));
+		}
+	} else {
+		vertices = mesh->vertices;
+		normals = mesh->normals;
 	}
 
 	if (animTextures) {
@@ -1174,6 +1264,9 @@ void Model::initAnimated(MPQFile &f)
 
 void Model::setLOD(MPQFile &f, int index)
 {
+	// while loading, initCommon swaps the first LOD for the mesh's one if that is already there
+	bool sharedLOD = (index == 0 && !indices && mesh && mesh->ok);
+
 	// Texture definitions
 	ModelTextureDef *texdef = (ModelTextureDef*)(f.getBuffer() + header.ofsTextures);
 
@@ -1205,8 +1298,11 @@ void Model::setLOD(MPQFile &f, int index)
 	uint16 *indexLookup = (uint16*)(g.getBuffer() + view->ofsIndex);
 	uint16 *triangles = (uint16*)(g.getBuffer() + view->ofsTris);
 	nIndices = view->nTris;
-	wxDELETEA(indices);
+	// the first LOD's indices belong to the mesh, any other is this model's own
+	if (ownIndices)
+		wxDELETEA(indices);
 	indices = new uint16[nIndices];
+	ownIndices = true;
 	for (size_t i = 0; i<nIndices; i++) {
         indices[i] = indexLookup[triangles[i]];
 	}
@@ -1221,8 +1317,10 @@ void Model::setLOD(MPQFile &f, int index)
 	uint16 *indexLookup = (uint16*)(f.getBuffer() + view->ofsIndex);
 	uint16 *triangles = (uint16*)(f.getBuffer() + view->ofsTris);
 	nIndices = view->nTris;
-	wxDELETE(indices);
+	if (ownIndices)
+		wxDELETEA(indices);
 	indices = new uint16[nIndices];
+	ownIndices = true;
 	for (size_t i = 0; i<nIndices; i++) {
         indices[i] = indexLookup[triangles[i]];
 	}
@@ -1350,6 +1448,9 @@ void Model::setLOD(MPQFile &f, int index)
 		passes.push_back(pass);
 	}
 
+	if (!sharedLOD)
+		optimizeIndices(ops, view->nSub);
+
 #ifdef WotLK
 	g.close();
 #endif
@@ -1357,6 +1458,26 @@ void Model::setLOD(MPQFile &f, int index)
 	//std::sort(passes.begin(), passes.end());
 }
 
+// Reorders the triangles of each geoset for the vertex cache, the .skin files have them in
+// whatever order they were exported in. Geosets drawn blended keep that order, it can matter
+// for how their triangles overlap.
+void Model::optimizeIndices(ModelGeoset *ops, size_t nOps)
+{
+	PROFILE_SCOPE("Model::optimizeIndices");
+
+	std::vector<bool> keepOrder(nOps, false);
+	for (size_t i=0; i<passes.size(); i++) {
+		if (passes[i].blendmode > BM_TRANSPARENT && passes[i].geoset >= 0 && (size_t)passes[i].geoset < nOps)
+			keepOrder[passes[i].geoset] = true;
+	}
+
+	for (size_t i=0; i<nOps; i++) {
+		if (keepOrder[i] || ops[i].icount < 6 || (size_t)ops[i].istart + ops[i].icount > nIndices)
+			continue;
+		OptimizeVertexCache(indices + ops[i].istart, ops[i].icount, indices + ops[i].istart);
+	}
+}
+
 void Model::calcBones(ssize_t anim, size_t time)
 {
 	// Reset all bones to 'false' which means they haven't been animated yet.
@@ -1507,6 +1628,8 @@ void Model::calcBones(ssize_t anim, size_t time)
 
 void Model::animate(ssize_t anim)
 {
+	PROFILE_SCOPE("Model::animate");
+
 	size_t t=0;
 	
 	ModelAnimation &a = anims[anim];
@@ -1543,25 +1666,10 @@ void Model::animate(ssize_t anim)
 		}
 
 		// transform vertices
-		ModelVertex *ov = origVertices;
-		for (size_t i=0; i<header.nVertices; ++i,++ov) { //,k=0
-			Vec3D v(0,0,0), n(0,0,0);
-
-			for (size_t b=0; b<4; b++) {
-				if (ov->weights[b]>0) {
-					Vec3D tv = bones[ov->bones[b]].mat * ov->pos;
-					Vec3D tn = bones[ov->bones[b]].mrot * ov->normal;
-					v += tv * ((float)ov->weights[b] / 255.0f);
-					n += tn * ((float)ov->weights[b] / 255.0f);
-				}
-			}
-
-			vertices[i] = v;
-			if (video.supportVBO)
-				vertices[header.nVertices + i] = n.normalize(); // shouldn't these be normal by default?
-			else
-				normals[i] = n;
-		}
+		if (video.supportVBO)
+			skinVertices(origVertices, header.nVertices, bones, vertices, vertices + header.nVertices, true); // shouldn't these be normal by default?
+		else
+			skinVertices(origVertices, header.nVertices, bones, vertices, normals, false);
 
 		// clear bind
         if (video.supportVBO) {
@@ -1594,6 +1702,29 @@ void Model::animate(ssize_t anim)
 }
 
 
+void Model::skinVertices(const ModelVertex *ov, size_t count, Bone *bones, Vec3D *outVertices, Vec3D *outNormals, bool normalize)
+{
+	for (size_t i=0; i<count; ++i,++ov) {
+		Vec3D v(0,0,0), n(0,0,0);
+
+		for (size_t b=0; b<4; b++) {
+			if (ov->weights[b]>0) {
+				Vec3D tv = bones[ov->bones[b]].mat * ov->pos;
+				Vec3D tn = bones[ov->bones[b]].mrot * ov->normal;
+				v += tv * ((float)ov->weights[b] / 255.0f);
+				n += tn * ((float)ov->weights[b] / 255.0f);
+			}
+		}
+
+		outVertices[i] = v;
+		if (normalize)
+			outNormals[i] = n.normalize();
+		else
+			outNormals[i] = n;
+	}
+}
+
+
 bool ModelRenderPass::init(Model *m)
 {
 	// May aswell check that we're going to render the geoset before doing all this crap.
@@ -2431,6 +2562,63 @@ int ModelManager::add(wxString name)
     return id;
 }
 
+ModelMeshManager modelmeshmanager;
+
+ModelMesh::ModelMesh(wxString name) : ManagedItem(name)
+{
+	ok = false;
+	nVertices = 0;
+	origVertices = 0;
+	vertices = 0;
+	normals = 0;
+	texCoords = 0;
+	indices = 0;
+	nIndices = 0;
+	IndiceToVerts = 0;
+	bounds = 0;
+	boundTris = 0;
+	rad = 1.0f;
+	vbuf = nbuf = tbuf = 0;
+	dlist = 0;
+}
+
+ModelMesh::~ModelMesh()
+{
+	if (vbuf)
+		glDeleteBuffersARB(1, &vbuf);
+	if (nbuf)
+		glDeleteBuffersARB(1, &nbuf);
+	if (tbuf)
+		glDeleteBuffersARB(1, &tbuf);
+	if (dlist)
+		glDeleteLists(dlist, 1);
+
+	wxDELETEA(origVertices);
+	wxDELETEA(vertices);
+	wxDELETEA(normals);
+	wxDELETEA(texCoords);
+	wxDELETEA(indices);
+	wxDELETEA(IndiceToVerts);
+	wxDELETEA(bounds);
+	wxDELETEA(boundTris);
+}
+
+// Shared geometry for models, see ModelMesh
+int ModelMeshManager::add(wxString name)
+{
+	int id;
+	if (names.find(name) != names.end()) {
+		id = names[name];
+		items[id]->addref();
+		return id;
+	}
+
+	ModelMesh *mesh = new ModelMesh(name);
+	id = nextID();
+	do_add(name, id, mesh);
+	return id;
+}
+
 // Resets the animation back to default.
 void ModelManager::resetAnim()
 {
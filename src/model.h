@@ -267,6 +267,46 @@ public:
 	}
 };
 
+// ModelMesh
+// The geometry of a model that never changes once it's loaded: the vertices from the file, the
+// bind pose, texture coordinates, the first LOD's indices and the buffers or display list they
+// are uploaded to. Every Model loaded from the same file shares one through modelmeshmanager,
+// so a doodad used all over a WMO or an item attached more than once only has its geometry in
+// memory (and on the card) once. What changes per instance, skinned vertices, bones, animation,
+// particles and replaced textures, stays in the Model.
+class ModelMesh : public ManagedItem {
+public:
+	ModelMesh(wxString name);
+	~ModelMesh();
+
+	bool ok;	// filled in by the first model loaded from the file
+
+	size_t nVertices;
+	ModelVertex *origVertices;	// in the Y-Up coordinate system
+	Vec3D *vertices, *normals;	// bind pose, freed once uploaded to vbuf/nbuf
+	Vec2D *texCoords;
+	uint16 *indices;
+	uint32 nIndices;
+	size_t *IndiceToVerts;
+	Vec3D *bounds;
+	uint16 *boundTris;
+	float rad;
+
+	// VBO Data
+	GLuint vbuf, nbuf, tbuf;
+	// Static models
+	GLuint dlist;
+};
+
+class ModelMeshManager: public SimpleManager {
+public:
+	int add(wxString name);
+
+	ModelMesh *mesh(int id) { return (ModelMesh*)items[id]; }
+};
+
+extern ModelMeshManager modelmeshmanager;
+
 class Model: public ManagedItem, public Displayable
 {
 	// VBO Data
@@ -277,6 +317,12 @@ class Model: public ManagedItem, public Displayable
 	GLuint dlist;
 	bool forceAnim;
 
+	// Shared geometry, vbuf (VBO) or vertices and normals (no VBO) are this model's own
+	// when it is skinned, and indices when another LOD has been selected.
+	ModelMesh *mesh;
+	int meshId;
+	bool ownIndices;
+
 	void init(MPQFile &f);
 	void displayHeader(ModelHeader & a_header);
 
@@ -285,6 +331,8 @@ class Model: public ManagedItem, public Displayable
 	bool isAnimated(MPQFile &f);
 	void initAnimated(MPQFile &f);
 	void initStatic(MPQFile &f);
+	void optimizeIndices(ModelGeoset *ops, size_t nOps);
+	void prefetchFiles(MPQFile &f, MPQPrefetch &prefetch);
 
 	void animate(ssize_t anim);
 	void calcBones(ssize_t anim, size_t time);
@@ -412,6 +460,9 @@ public:
 	void updateEmitters(float dt);
 	void setLOD(MPQFile &f, int index);
 
+	// Vertex skinning used by animate(), kept free of GL so it can be timed on its own.
+	static void skinVertices(const ModelVertex *ov, size_t count, Bone *bones, Vec3D *outVertices, Vec3D *outNormals, bool normalize);
+
 	void setupAtt(int id);
 	void setupAtt2(int id);
 
@@ -4,6 +4,8 @@
 #include "shaders.h"
 
 #include "globalvars.h"
+#include "profiler.h"
+#include "framecapture.h"
 #include "CxImage/ximage.h"
 
 static const float defaultMatrix[] = {1.000000,0.000000,0.000000,0.000000,0.000000,1.000000,0.000000,0.000000,0.000000,0.000000,1.000000,0.000000,0.000000,0.000000,0.000000,1.000000};
@@ -70,6 +72,8 @@ ModelCanvas::ModelCanvas(wxWindow *parent, VideoCaps *caps)
 	srand(timeGetTime());
 	time = 0;
 	lastTime = timeGetTime();
+	lastChange = lastTime;
+	dirty = true;
 
 	// Set all our pointers to null
 	model =	0;			// Main model.
@@ -130,7 +134,7 @@ ModelCanvas::ModelCanvas(wxWindow *parent, VideoCaps *caps)
 
 		// Initiate the timer that handles our animation and setting the canvas to redraw
 		timer.SetOwner(this, ID_TIMER);
-		timer.Start(TIME_STEP);
+		timer.Start(FRAME_STEP);
 
 		// Initiate our default OpenGL settings
 		wxLogMessage(wxT("Initiating OpenGL..."));
@@ -149,6 +153,11 @@ ModelCanvas::ModelCanvas(wxWindow *parent, VideoCaps *caps)
 
 ModelCanvas::~ModelCanvas()
 {
+	// stop WowModelViewApp::FilterEvent from waking us up
+	if (g_canvas == this)
+		g_canvas = NULL;
+	timer.Stop();
+
 	// Release our avi engine
 #if defined(_WINDOWS) && !defined(_MINGW)
 	cAvi.ReleaseEngine();
@@ -187,6 +196,8 @@ void ModelCanvas::OnSize(wxSizeEvent& event)
 
 	if (init) 
 		InitView();
+
+	Wake();
 }
 
 void ModelCanvas::InitView()
@@ -341,6 +352,7 @@ Attachment* ModelCanvas::LoadModel(wxString fn)
 	curAtt = root;
 
 	ResetView();
+	Wake();
 
 	return root;
 }
@@ -361,6 +373,7 @@ Attachment* ModelCanvas::LoadCharModel(wxString fn)
 	}
 	
 	ResetView();
+	Wake();
 
 	Attachment *att = root->addChild(model, 0, -1);
 	curAtt = att;
@@ -386,6 +399,7 @@ void ModelCanvas::LoadADT(wxString fn)
 		} else
 			wxDELETE(adt);
 	}
+	Wake();
 }
 
 void ModelCanvas::LoadWMO(wxString fn)
@@ -394,6 +408,7 @@ void ModelCanvas::LoadWMO(wxString fn)
 		wmo = new WMO(fn);
 		root->model = wmo;
 	}
+	Wake();
 }
 
 
@@ -411,6 +426,10 @@ void ModelCanvas::OnMouse(wxMouseEvent& event)
 	if (!model && !wmo && !adt)
 		return;
 
+	// plain mouse movement doesn't change the view
+	if (!event.Moving())
+		Wake();
+
 	if (event.Button(wxMOUSE_BTN_ANY) == true)
 		SetFocus();
 
@@ -1027,6 +1046,8 @@ inline void ModelCanvas::RenderBackground()
 
 void ModelCanvas::Render()
 {
+	PROFILE_SCOPE("ModelCanvas::Render");
+
 	// Sets the "clear" colour.  Without this you get the "ghosting" effecting 
 	// as the buffer doesn't get set/cleared.
 	if (video.useMasking)
@@ -1575,8 +1596,12 @@ void ModelCanvas::RenderToBuffer()
 		glPushAttrib(GL_VIEWPORT_BIT);
 		glViewport(0, 0, rt->nWidth, rt->nHeight);
 		video.ResizeGLScene(rt->nWidth, rt->nHeight);
-	}
+	} else
 #endif	
+	if (FrameCapture::current) {
+		glPushAttrib(GL_VIEWPORT_BIT);
+		video.ResizeGLScene(FrameCapture::current->width, FrameCapture::current->height);
+	}
 
 	// Sets the "clear" colour.  Without this you get the "ghosting" effecting 
 	// as the buffer doesn't get set/cleared.
@@ -1687,7 +1712,10 @@ void ModelCanvas::RenderToBuffer()
 #ifdef _WINDOWS
 	if (rt)
 		glPopAttrib();
+	else
 #endif
+	if (FrameCapture::current)
+		glPopAttrib();
 }
 
 inline void Attachment::draw(ModelCanvas *c)
@@ -1844,15 +1872,103 @@ void Attachment::tick(float dt)
 
 void ModelCanvas::OnTimer(wxTimerEvent& event)
 {
-	if (video.render && init) {
-		CheckMovement();
+	if (!video.render || !init) {
+		// rendering is off (exporting, image view), don't let it resume with that gap
+		lastTime = timeGetTime();
+		return;
+	}
+
+	// a held movement key counts as a change
+	if (CheckMovement())
+		dirty = true;
+
+	DWORD now = timeGetTime();
+	if (dirty || IsAnimating()) {
+		dirty = false;
+		lastChange = now;
 		tick();
 		Refresh(false);
+	} else {
+		// Skipped frame, nothing should catch up on the time spent idle once
+		// something changes again.
+		lastTime = now;
+		if (now - lastChange > (DWORD)IDLE_DELAY) {
+			// Nothing moves and nothing changed, stop burning cpu until something
+			// asks for a redraw (see WowModelViewApp::FilterEvent).
+			timer.Stop();
+		}
+	}
+}
+
+void ModelCanvas::Wake()
+{
+	dirty = true;
+	// the timer only ever stops once we're initialised
+	if (init && !timer.IsRunning()) {
+		// The scene was static while we slept, so don't hand that time to the animations.
+		lastTime = timeGetTime();
+		lastChange = lastTime;
+		timer.Start(FRAME_STEP);
+	}
+}
+
+// Anything that changes from one frame to the next on its own (bone or particle
+// animation, global sequences, the sky box, animated WMO doodads).
+bool ModelCanvas::IsAnimating()
+{
+	if (drawSky && sky && skyModel)
+		return true;
+
+	if (wmo) {
+		for (std::map<int, ManagedItem*>::iterator it = wmo->loadedModels.items.begin(); it != wmo->loadedModels.items.end(); ++it) {
+			Model *m = static_cast<Model*>(it->second);
+			if (m && m->animated)
+				return true;
+		}
+		return false;
 	}
+
+	if (!model || adt)
+		return false;
+
+	// tick() hands 0 to the models while paused, unless the particles are stepped.
+	// Global sequences would still move, but a paused view is meant to hold still.
+	if (model->animManager && model->animManager->IsPaused() && model->animManager->IsParticlePaused())
+		return false;
+
+	return IsAnimating(root);
+}
+
+bool ModelCanvas::IsAnimating(Attachment *att)
+{
+	if (att->model) {
+		Model *m = static_cast<Model*>(att->model);
+		if (m->header.nGlobalSequences > 0 || m->animated || m->hasParticles)
+			return true;
+	}
+
+	for (size_t i=0; i<att->children.size(); i++) {
+		if (IsAnimating(att->children[i]))
+			return true;
+	}
+	return false;
 }
 
 void ModelCanvas::tick()
 {
+	if (Profiler::enabled) {
+		Profiler::NextFrame();
+
+		// refresh the breakdown in the status bar twice a second
+		static double lastSummary = 0;
+		double now = Profiler::Now();
+		if (now - lastSummary > 500000.0 && g_modelViewer) {
+			g_modelViewer->SetStatusText(Profiler::GetFrameSummary());
+			lastSummary = now;
+		}
+	}
+	PROFILE_SCOPE("ModelCanvas::tick");
+
 	size_t ddt = 0;
 
 	// Time stuff
@@ -2086,38 +2202,53 @@ void ModelCanvas::OnKey(wxKeyEvent &event)
 	// }
 }
 
-void ModelCanvas::CheckMovement()
+bool ModelCanvas::CheckMovement()
 {
 	// Make sure its the canvas that has focus before continuing
 	wxWindow *win = wxWindow::FindFocus();
 	if(!win)
-		return;
+		return false;
 
 	// Its no longer an opengl canvas window, its now just a standard window.
 	// wxWindow *gl = wxDynamicCast(win, wxGLCanvas);
 	wxWindow *wintest = wxDynamicCast(win, wxWindow);
 	if(!wintest)
-		return;
+		return false;
 
+	bool moved = false;
 	
-	if (wxGetKeyState(WXK_NUMPAD8))	// Move forward
+	if (wxGetKeyState(WXK_NUMPAD8)) {	// Move forward
 		camera.MoveForward(-0.1f);
-	if (wxGetKeyState(WXK_NUMPAD2))	// Move Backwards
+		moved = true;
+	}
+	if (wxGetKeyState(WXK_NUMPAD2)) {	// Move Backwards
 		camera.MoveForward(0.1f);
-	if (wxGetKeyState(WXK_NUMPAD7))	// Rotate left
+		moved = true;
+	}
+	if (wxGetKeyState(WXK_NUMPAD7)) {	// Rotate left
 		camera.RotateY(1.0f);
-	if (wxGetKeyState(WXK_NUMPAD9))	// Rotate right
+		moved = true;
+	}
+	if (wxGetKeyState(WXK_NUMPAD9)) {	// Rotate right
 		camera.RotateY(-1.0f);
-	if (wxGetKeyState(WXK_NUMPAD5))	// Reset Camera
+		moved = true;
+	}
+	if (wxGetKeyState(WXK_NUMPAD5)) {	// Reset Camera
 		camera.Reset();
-	if (wxGetKeyState(WXK_NUMPAD4))	// Straff Left
+		moved = true;
+	}
+	if (wxGetKeyState(WXK_NUMPAD4)) {	// Straff Left
 		camera.Strafe(-0.05f);
-	if (wxGetKeyState(WXK_NUMPAD6))	// Straff Right
+		moved = true;
+	}
+	if (wxGetKeyState(WXK_NUMPAD6)) {	// Straff Right
 		camera.Strafe(0.05f);
+		moved = true;
+	}
 
 	// M2 Model only stuff below here
 	if (!model || !model->animManager)
-		return;
+		return moved;
 
 	float speed = 1.0f;
 
@@ -2132,12 +2263,14 @@ void ModelCanvas::CheckMovement()
 	// Turning
 	if (wxGetKeyState(WXK_LEFT)) {
 		model->rot.y += speed;
+		moved = true;
 
 		if (model->rot.y > 360) model->rot.y -= 360;
 		if (model->rot.y < 0) model->rot.y += 360;
 		
 	} else if (wxGetKeyState(WXK_RIGHT)) {
 		model->rot.y -= speed;
+		moved = true;
 
 		if (model->rot.y > 360) model->rot.y -= 360;
 		if (model->rot.y < 0) model->rot.y += 360;
@@ -2151,11 +2284,16 @@ void ModelCanvas::CheckMovement()
 	//else
 	//	speed *= 0.05f;
 
-	if (wxGetKeyState(WXK_UP))
+	if (wxGetKeyState(WXK_UP)) {
 		Zoom(speed, true);
-	else if (wxGetKeyState(WXK_DOWN))
+		moved = true;
+	} else if (wxGetKeyState(WXK_DOWN)) {
 		Zoom(-speed, true);
+		moved = true;
+	}
 	// --
+
+	return moved;
 }
 
 // Our screenshot function which supports both PBO and FBO aswell as traditional older cards, eventually.
@@ -45,8 +45,10 @@ class LightControl;
 class ModelViewer;
 class ModelCanvas;
 
-// 100 fps?
-const int TIME_STEP = 10; // 10 millisecs between each frame
+// Frame pacing. While something is animating the canvas is redrawn at most every FRAME_STEP
+// millisecs, when nothing has changed for IDLE_DELAY millisecs the timer is stopped until Wake().
+const int FRAME_STEP = 16; // ~60 fps
+const int IDLE_DELAY = 500;
 
 
 struct SceneState {
@@ -106,6 +108,8 @@ class ModelCanvas:
 	
 	float time, modelsize;
 	DWORD lastTime;
+	DWORD lastChange;	// last time something was drawn because it changed
+	bool dirty;			// the scene changed since the last frame
 	//DWORD pauseTime;
 	SceneState sceneState[4]; // 4 scene states for F1-F4
 
@@ -157,6 +161,11 @@ public:
 	void tick();
 	wxTimer timer;
 
+	// Asks for a redraw, restarting the frame timer if the canvas went idle.
+	void Wake();
+	bool IsAnimating();
+	bool IsAnimating(Attachment *att);
+
 	// OGL related functions
 	void InitGL();
 	void InitView();
@@ -195,7 +204,7 @@ public:
 	wxCoord mx, my;
 
 	void Zoom(float f, bool rel = false); // f = amount to zoom, rel = relative to model or not
-	void CheckMovement();	// move the character
+	bool CheckMovement();	// move the character, returns true if a movement key is held
 	
 	Attachment* LoadModel(wxString fn);
 	Attachment* LoadCharModel(wxString fn);
@@ -608,10 +608,10 @@ void ModelOpened::OnCheck(wxCommandEvent &event)
 
 void ModelOpened::Add(wxString str)
 {
-	MPQFile f(str);
-	if (f.isEof() == true)
+	// only whether the file is there, no need to read all of it
+	unsigned char first;
+	if (MPQFile::readRange(str, 0, &first, 1) == 0)
 		return;
-	f.close();
 	if (opened_files.Index(str, false) == wxNOT_FOUND) {
 		opened_files.Add(str);
 		openedList->Append(str);
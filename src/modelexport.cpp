@@ -5,16 +5,145 @@
 #include "modelexport.h"
 #include "modelcanvas.h"
 
+#include "threadpool.h"
+
 #include "CxImage/ximage.h"
 
 // 2 methods to go, just export the entire m2 model.
 // or use our "drawing" routine to export only whats being drawn.
 
+// Write an image as png or tga, depending on the file name.
+static void SaveTextureImage(CxImage &image, wxString fn, bool fixTGAHeader)
+{
+	if (fn.Last() == 'g')
+#ifndef _MINGW
+		image.Save(fn.mb_str(), CXIMAGE_FORMAT_PNG);
+#else
+		image.Save(fn.wc_str(), CXIMAGE_FORMAT_PNG);
+#endif
+	else
+#ifndef _MINGW
+		image.Save(fn.mb_str(), CXIMAGE_FORMAT_TGA);
+#else
+		image.Save(fn.wc_str(), CXIMAGE_FORMAT_TGA);
+#endif
+
+	// tga files, starcraft II needs 17th bytes as 8
+	// (plain stdio, wxFFile logs when the open fails and this runs on the export threads)
+	if (fixTGAHeader && fn.Last() == 'a') {
+		FILE *f = wxFopen(fn, wxT("r+b"));
+		if (f) {
+			fseek(f, 17, SEEK_SET);
+			char c=8;
+			fwrite(&c, sizeof(char), 1, f);
+			fclose(f);
+		}
+	}
+}
+
+// Texture export jobs
+// Textures that came from a BLP file are converted from their file data on the
+// shared thread pool, so exporting them needs no GL context and no glGetTexImage.
+// The file data itself is read on the calling thread, as MPQFile isn't thread safe.
+
+// What the jobs couldn't decode, logged by WaitForTextureExports since the
+// workers mustn't log themselves.
+static wxMutex textureExportErrorsMutex;
+static std::vector<std::pair<wxString, std::string> > textureExportErrors;
+
+class TextureExportJob : public ThreadJob {
+public:
+	// wxString isn't thread safe, so keep private copies of the names
+	TextureExportJob(wxString texName, wxString outFile, bool fixTGAHeader) :
+		texName(texName.c_str()), outFile(outFile.c_str()), fixTGAHeader(fixTGAHeader) {}
+
+	// read the source BLP, returns false when it can't be found
+	bool Load()
+	{
+		MPQFile f(texName);
+		if (f.isEof())
+			return false;
+		data.assign(f.getBuffer(), f.getBuffer() + f.getSize());
+		f.close();
+		return true;
+	}
+
+	virtual void Run()
+	{
+		BLPImage blp;
+		bool ok = false;
+
+		if (useLocalFiles) {
+			CxImage *image = NULL;
+			if ((TryLoadLocalTexture(texName, CXIMAGE_FORMAT_PNG, &image) ||
+				 TryLoadLocalTexture(texName, CXIMAGE_FORMAT_TGA, &image))
+				 && image) {
+				ok = blp.decodeImage(image, true);
+				wxDELETE(image);
+			}
+		}
+		if (!ok)
+			ok = blp.decode(&data[0], data.size(), false, 1);
+		if (!ok || blp.mips.empty()) {
+			if (!blp.error.empty()) {
+				wxMutexLocker lock(textureExportErrorsMutex);
+				textureExportErrors.push_back(std::make_pair(wxString(texName.c_str()), blp.error));
+			}
+			return;
+		}
+
+		int width = blp.mips[0].w;
+		int height = blp.mips[0].h;
+		std::vector<unsigned char> pixels(width * height * 4);
+		blp.getPixels(&pixels[0], true);
+
+		CxImage newImage(0);
+		newImage.CreateFromArray(&pixels[0], width, height, 32, (width*4), true);
+		SaveTextureImage(newImage, outFile, fixTGAHeader);
+	}
+
+private:
+	wxString texName;
+	wxString outFile;
+	bool fixTGAHeader;
+	std::vector<unsigned char> data;
+};
+
+static bool QueueTextureExport(wxString texName, wxString fn, bool fixTGAHeader)
+{
+	TextureExportJob *job = new TextureExportJob(texName, fn, fixTGAHeader);
+	if (!job->Load()) {
+		wxDELETE(job);
+		return false;
+	}
+	ThreadPool::Get().Add(job);
+	return true;
+}
+
+// Wait until all queued texture exports have been written.
+void WaitForTextureExports()
+{
+	ThreadPool::Get().Wait();
+
+	wxMutexLocker lock(textureExportErrorsMutex);
+	for (size_t i=0; i<textureExportErrors.size(); i++)
+		wxLogMessage(wxT("Error: Could not decode the texture '%s': %s"), textureExportErrors[i].first.c_str(), wxString(textureExportErrors[i].second.c_str(), wxConvUTF8).c_str());
+	textureExportErrors.clear();
+}
+
 // SaveTexture
 // Used to save composite textures, such as a character's face & body.
 void SaveTexture(wxString fn)
 {
 	fn = fixMPQPath(fn);
+
+	// Textures known to the texture manager came from a BLP, export those from the file data.
+	GLint boundTex = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &boundTex);
+	std::map<GLuint, ManagedItem*>::iterator it = texturemanager.items.find((GLuint)boundTex);
+	if (it != texturemanager.items.end() && QueueTextureExport(it->second->name, fn, true))
+		return;
+
 	unsigned char *pixels = NULL;
 
 	GLint width, height;
@@ -28,34 +157,11 @@ void SaveTexture(wxString fn)
 	CxImage *newImage = new CxImage(0);
 	newImage->CreateFromArray(pixels, width, height, 32, (width*4), true);
 
-	if (fn.Last() == 'g')
-#ifndef _MINGW
-		newImage->Save(fn.mb_str(), CXIMAGE_FORMAT_PNG);
-#else
-		newImage->Save(fn.wc_str(), CXIMAGE_FORMAT_PNG);
-#endif
-	else
-#ifndef _MINGW
-		newImage->Save(fn.mb_str(), CXIMAGE_FORMAT_TGA);
-#else
-		newImage->Save(fn.wc_str(), CXIMAGE_FORMAT_TGA);
-#endif
+	SaveTextureImage(*newImage, fn, true);
 
 	//newImage->Destroy();
 	wxDELETE(newImage);
 	wxDELETEA(pixels);
-
-	// tga files, starcraft II needs 17th bytes as 8
-	if (fn.Last() == 'a') {
-		wxFFile f;
-		f.Open(fn, wxT("r+b"));
-		if (f.IsOpened()) {
-			f.Seek(17, wxFromStart);
-			char c=8;
-			f.Write(&c, sizeof(char));
-			f.Close();
-		}
-	}
 }
 
 // SaveTexture2 Function
@@ -81,23 +187,8 @@ void SaveTexture2(wxString file, wxString outdir, wxString ExportID = wxEmptyStr
 		wxLogMessage(wxT("SaveTexture2 Error: Wrong Extension Found: %s"),fn.GetExt().Lower());
 		return;
 	}
-	TextureID temptex = texturemanager.add(file);
-	Texture &tex = *((Texture*)texturemanager.items[temptex]);
-	if (tex.w == 0 || tex.h == 0){
-		wxLogMessage(wxT("SaveTexture2 Error: Tex Width or Height == 0. W:%i, H:%i"),tex.w, tex.h);
-		return;
-	}
-
 	wxString temp;
 
-	unsigned char *tempbuf = (unsigned char*)malloc(tex.w*tex.h*4);
-	tex.getPixels(tempbuf, GL_BGRA_EXT);
-
-	CxImage *newImage = new CxImage(0);
-	newImage->AlphaCreate();	// Create the alpha layer
-	newImage->IncreaseBpp(32);	// set image to 32bit 
-	newImage->CreateFromArray(tempbuf, tex.w, tex.h, 32, (tex.w*4), true);
-
 	wxString ImgName = file.AfterLast(SLASH).BeforeLast('.');
 	wxString ImgPath = file.BeforeLast(SLASH);
 	//wxLogMessage(wxT("ImgName: %s, ImgPath: %s"),ImgName,ImgPath);
@@ -134,24 +225,9 @@ void SaveTexture2(wxString file, wxString outdir, wxString ExportID = wxEmptyStr
 
 	//wxLogMessage(wxT("Info: Exporting texture to %s..."), temp.c_str());
 
-	// Save image!
-	if (suffix == wxT("tga"))
-#ifndef _MINGW
-		newImage->Save(temp.mb_str(), CXIMAGE_FORMAT_TGA);
-#else
-		newImage->Save(temp.wc_str(), CXIMAGE_FORMAT_TGA);
-#endif
-	else
-#ifndef _MINGW
-		newImage->Save(temp.mb_str(), CXIMAGE_FORMAT_PNG);
-#else
-		newImage->Save(temp.wc_str(), CXIMAGE_FORMAT_PNG);
-#endif
-
-	// Clear data we don't need anymore
-	free(tempbuf);
-	//newImage->Destroy();
-	wxDELETE(newImage);
+	// Save image! Decoding and writing happen on the thread pool.
+	if (!QueueTextureExport(file, temp, false))
+		wxLogMessage(wxT("SaveTexture2 Error: Could not load the texture %s"), file.c_str());
 }
 
 // Alter a Vert by a Quaternion
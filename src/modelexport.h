@@ -139,6 +139,7 @@ static wxString Bone_Names[] = { // enum KeyBoneTable
 void LogExportData(wxString ExporterExtention, wxString ModelName, wxString Destination);
 void SaveTexture(wxString fn);
 void SaveTexture2(wxString file, wxString outdir, wxString ExportID, wxString suffix);
+void WaitForTextureExports();
 Vec3D QuaternionToXYZ(Vec3D Dir, float W);
 void InitCommon(Attachment *att, bool init, ModelData *&verts, GroupData *&groups, unsigned short &numVerts, unsigned short &numGroups, unsigned short &numFaces);
 wxString GetM2TextureName(Model *m, ModelRenderPass p, size_t PassNumber);
@@ -172,10 +173,10 @@ void ExportCOLLADA_M2(Attachment *att, Model *m, const char *fn, bool init);
 void ExportCOLLADA_WMO(WMO *m, const char *fn);
 
 // X3D
-void ExportX3D_M2(Model *m, const char *fn, bool init);
+void ExportX3D_M2(Model *m, wxString fn, bool init);
 
 //XHTML
-void ExportXHTML_M2(Model *m, const char *fn, bool init);
+void ExportXHTML_M2(Model *m, wxString fn, bool init);
 
 // Ogre XML
 void ExportOgreXML_M2(Model *m, const char *fn, bool init);
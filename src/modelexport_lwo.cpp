@@ -6,7 +6,8 @@
 //---------------------------------------------
 
 // Write Lightwave Object data to a file.
-size_t WriteLWObject(wxString filename, LWObject Object) {
+// Every chunk is written straight from the gathered data, nothing in Object is copied.
+size_t WriteLWObject(wxString filename, const LWObject &Object) {
 	g_modelViewer->SetStatusText(wxT("Writing Lightwave Object..."));
 	/* LightWave object files use the IFF syntax described in the EA-IFF85 document. Data is stored in a collection of chunks. 
 	Each chunk begins with a 4-byte chunk ID and the size of the chunk in bytes, and this is followed by the chunk contents.
@@ -266,13 +267,14 @@ size_t WriteLWObject(wxString filename, LWObject Object) {
 	// -------------------------------------------------
 	for (size_t l=0;l<Object.Layers.size();l++){
 		g_modelViewer->SetStatusText(wxString::Format(wxT("LWO Export: Writing Layer %i data..."), l));
-		LWLayer cLyr = Object.Layers[l];
+		const LWLayer &cLyr = Object.Layers[l];
 		// Define a Layer & It's data
-		if (cLyr.Name.length() > 0)
-			cLyr.Name.Append(wxT('\0'));
-		if (fmod((float)cLyr.Name.length(), 2.0f) > 0)
-			cLyr.Name.Append(wxT('\0'));
-		uint16 LayerNameSize = (uint16)cLyr.Name.length();
+		wxString LayerName = cLyr.Name;
+		if (LayerName.length() > 0)
+			LayerName.Append(wxT('\0'));
+		if (fmod((float)LayerName.length(), 2.0f) > 0)
+			LayerName.Append(wxT('\0'));
+		uint16 LayerNameSize = (uint16)LayerName.length();
 		uint32 LayerSize = 16+LayerNameSize;
 		if ((cLyr.ParentLayer)&&(cLyr.ParentLayer>-1))
 			LayerSize += 2;
@@ -292,7 +294,7 @@ size_t WriteLWObject(wxString filename, LWObject Object) {
 		f.Write(reinterpret_cast<char *>(&zero), 4);
 		// Name
 		if (LayerNameSize>0){
-			f.Write(cLyr.Name, LayerNameSize);
+			f.Write(LayerName, LayerNameSize);
 		}
 		// Parent
 		if ((cLyr.ParentLayer)&&(cLyr.ParentLayer>-1)){
@@ -506,7 +508,7 @@ size_t WriteLWObject(wxString filename, LWObject Object) {
 			f.Write("FACE", 4);
 
 			for (size_t x=0;x<cLyr.Polys.size();x++){
-				PolyChunk PolyData = cLyr.Polys[x].PolyData;
+				const PolyChunk &PolyData = cLyr.Polys[x].PolyData;
 				uint16 nverts = MSB2(PolyData.numVerts);
 				polySize += 2;
 				f.Write(reinterpret_cast<char *>(&nverts),2);
@@ -540,7 +542,7 @@ size_t WriteLWObject(wxString filename, LWObject Object) {
 				f.Write(wxT("PART"), 4);
 
 				for (size_t x=0;x<cLyr.Polys.size();x++){
-					LWPoly Poly = cLyr.Polys[x];
+					const LWPoly &Poly = cLyr.Polys[x];
 					LW_WriteVX(f,x,ptagSize);
 
 					u16 = MSB2((uint16)Poly.PartTagID);
@@ -568,7 +570,7 @@ size_t WriteLWObject(wxString filename, LWObject Object) {
 				f.Write(wxT("SURF"), 4);
 
 				for (size_t x=0;x<cLyr.Polys.size();x++){
-					LWPoly Poly = cLyr.Polys[x];
+					const LWPoly &Poly = cLyr.Polys[x];
 					LW_WriteVX(f,x,ptagSize);
 
 					u16 = MSB2((uint16)Poly.SurfTagID);
@@ -619,7 +621,7 @@ size_t WriteLWObject(wxString filename, LWObject Object) {
 				vmadSize += (uint32)NormMapName.length();
 
 				for (size_t x=0;x<cLyr.Polys.size();x++){
-					PolyNormal cNorm = cLyr.Polys[x].Normals;
+					const PolyNormal &cNorm = cLyr.Polys[x].Normals;
 					for (size_t n=0;n<3;n++){
 						LW_WriteVX(f,cNorm.indice[n],vmadSize);
 						LW_WriteVX(f,cNorm.polygon,vmadSize);
@@ -648,7 +650,7 @@ size_t WriteLWObject(wxString filename, LWObject Object) {
 	if (Object.Images.size() > 0){
 		g_modelViewer->SetStatusText(wxT("LWO Export: Writing Image file data..."));
 		for (size_t x=0;x<Object.Images.size();x++){
-			LWClip cImg = Object.Images[x];
+			const LWClip &cImg = Object.Images[x];
 
 			int clipSize = 0;
 			f.Write("CLIP", 4);
@@ -667,7 +669,7 @@ size_t WriteLWObject(wxString filename, LWObject Object) {
 				ImgName += wxT("Images") + SLASH;
 			}
 			if (modelExport_PreserveDir == true){
-				ImgPath = cImg.Source.Append(SLASH);
+				ImgPath = cImg.Source + SLASH;
 			}
 			ImgName += wxString(ImgPath + cImg.Filename + wxString(wxT(".tga")));
 			ImgName += wxT('\0');
@@ -696,7 +698,7 @@ size_t WriteLWObject(wxString filename, LWObject Object) {
 	if (Object.Surfaces.size() > 0){
 		g_modelViewer->SetStatusText(wxT("LWO Export: Writing Surface/Material data..."));
 		for (size_t x=0;x<Object.Surfaces.size();x++){
-			LWSurface cSurf = Object.Surfaces[x];
+			const LWSurface &cSurf = Object.Surfaces[x];
 
 			// Temp Values
 			Vec4D Color = Vec4D(1,1,1,1);
@@ -1500,13 +1502,11 @@ size_t WriteLWScene(LWScene *SceneData){
 //---------------------------------------------
 
 // Gather M2 Data
-LWObject GatherM2forLWO(Attachment *att, Model *m, bool init, wxString fn, LWScene &scene, bool announce){
+// The data is gathered straight into Object, which should be empty.
+void GatherM2forLWO(LWObject &Object, Attachment *att, Model *m, bool init, wxString fn, LWScene &scene, bool announce){
 	g_modelViewer->SetStatusText(wxT("Gathering M2 Data for Lightwave Exporter..."));
-	LWObject Object;
-	if (!m){
-		return Object;
-		Object.~LWObject();
-	}
+	if (!m)
+		return;
 
 	wxString filename = fn;
 	wxString scfilename = fn.BeforeLast('.') + wxT(".lws");
@@ -1551,8 +1551,9 @@ LWObject GatherM2forLWO(Attachment *att, Model *m, bool init, wxString fn, LWSce
 		cFrame = m->animManager->GetFrame();
 	}
 
-	// Main Object
-	LWLayer Layer;
+	// Main Object, gathered in place so the finished layer doesn't have to be copied.
+	Object.Layers.push_back(LWLayer());
+	LWLayer &Layer = Object.Layers.back();
 	Layer.Name = m->name.AfterLast(MPQ_SLASH).BeforeLast('.');
 	Layer.ParentLayer = -1;
 	std::vector<wxString> surfnamearray;
@@ -2219,8 +2220,6 @@ LWObject GatherM2forLWO(Attachment *att, Model *m, bool init, wxString fn, LWSce
 		}
 	}
 
-	// Push the finished layer into the objects.
-	Object.Layers.push_back(Layer);
 
 	// --== Scene Data ==--
 	g_modelViewer->SetStatusText(wxT("Gathering Scene Data..."));
@@ -2557,22 +2556,16 @@ LWObject GatherM2forLWO(Attachment *att, Model *m, bool init, wxString fn, LWSce
 	}
 	
 	g_modelViewer->SetStatusText(wxT("Finished Gathering M2 Data!"));
-	return Object;
-	Object.~LWObject();
 }
 
 // Gather WMO Data
-LWObject GatherWMOforLWO(WMO *m, const char *fn, LWScene &scene){
+void GatherWMOforLWO(LWObject &Object, WMO *m, const char *fn, LWScene &scene){
 	g_modelViewer->SetStatusText(wxT("Gathering WMO Data for Lightwave Exporter..."));
 	wxString RootDir(fn, wxConvUTF8);
 	wxString FileName(fn, wxConvUTF8);
 
-	LWObject Object;
-
-	if (!m){
-		return Object;
-		Object.~LWObject();
-	}
+	if (!m)
+		return;
 
 	if (modelExport_LW_PreserveDir == true){
 		wxString Path, Name;
@@ -2597,8 +2590,9 @@ LWObject GatherWMOforLWO(WMO *m, const char *fn, LWScene &scene){
 	Object.SourceType = wxT("WMO");
 	LogExportData(wxT("LWO"),m->name,FileName);
 
-	// Main Object
-	LWLayer Layer;
+	// Main Object, gathered in place so the finished layer doesn't have to be copied.
+	Object.Layers.push_back(LWLayer());
+	LWLayer &Layer = Object.Layers.back();
 	Layer.Name = m->name.AfterLast(MPQ_SLASH).BeforeLast('.');
 	Layer.ParentLayer = -1;
 
@@ -2608,6 +2602,20 @@ LWObject GatherWMOforLWO(WMO *m, const char *fn, LWScene &scene){
 
 	uint32 SurfCounter = 0;
 
+	// Size the layer up front, big WMOs otherwise spend a lot of time regrowing it.
+	size_t numPoints = 0, numPolys = 0;
+	for (size_t g=0;g<m->nGroups; g++) {
+		for (size_t b=0; b<m->groups[g].nBatches; b++){
+			numPoints += m->groups[g].batches[b].vertexEnd - m->groups[g].batches[b].vertexStart + 1;
+			numPolys += m->groups[g].batches[b].indexCount / 3;
+		}
+	}
+	Layer.Points.reserve(numPoints);
+	Layer.Polys.reserve(numPolys);
+
+	// Shared by every poly, rather than a copy of the string each.
+	wxString NormalMapName = Layer.Name + wxString(wxT("_NormalMap"));
+
 	// Process Groups
 	g_modelViewer->SetStatusText(wxString::Format(wxT("Processing %i Groups..."), m->nGroups));
 	for (size_t g=0;g<m->nGroups; g++) {
@@ -2746,7 +2754,7 @@ LWObject GatherWMOforLWO(WMO *m, const char *fn, LWScene &scene){
 				Poly.PartTagID = g;
 				Poly.SurfTagID = m->nGroups + SurfCounter;
 				Poly.Normals.polygon = Layer.Polys.size();
-				Poly.NormalMapName = Layer.Name + wxString(wxT("_NormalMap"));
+				Poly.NormalMapName = NormalMapName;
 				//wxLogMessage(wxT("Normal Data: Poly %i, i1:%i, i2:%i, i3:%i\nND	VectorDir i1: X:%f, Y:%f, Z:%f\nND	VectorDir i2: X:%f, Y:%f, Z:%f\nND	VectorDir i3: X:%f, Y:%f, Z:%f"),Layer.Polys.size(),Poly.Normals.indice[0],Poly.Normals.indice[1],Poly.Normals.indice[2],Poly.Normals.direction[0].x,Poly.Normals.direction[0].y,Poly.Normals.direction[0].z,Poly.Normals.direction[1].x,Poly.Normals.direction[1].y,Poly.Normals.direction[1].z,Poly.Normals.direction[2].x,Poly.Normals.direction[2].y,Poly.Normals.direction[2].z);
 				Layer.Polys.push_back(Poly);
 			}
@@ -2760,7 +2768,6 @@ LWObject GatherWMOforLWO(WMO *m, const char *fn, LWScene &scene){
 			Object.Surfaces[i].hasVertColors = true;
 		}
 	}
-	Object.Layers.push_back(Layer);
 	wxLogMessage(wxT("Completed WMO Gathering. Building Basic Scene Data..."));
 
 	// Scene Data
@@ -2990,7 +2997,8 @@ LWObject GatherWMOforLWO(WMO *m, const char *fn, LWScene &scene){
 						// Must gather before paths, else it generates files in the wrong place.
 						LWScene empty_scene;
 						wxLogMessage(wxT("Gathering Doodad Model..."));
-						LWObject DDObject = GatherM2forLWO(NULL,ddm,true,fname,empty_scene,false);
+						LWObject DDObject;
+						GatherM2forLWO(DDObject,NULL,ddm,true,fname,empty_scene,false);
 						if (modelExport_LW_PreserveDir == true){
 							wxString Path, Name;
 
@@ -3042,7 +3050,8 @@ LWObject GatherWMOforLWO(WMO *m, const char *fn, LWScene &scene){
 
 					wxLogMessage(wxT("Doodad Instance is Animated: %s"),(ddinstance->model->animated?wxT("true"):wxT("false")));
 
-					LWObject Doodad = GatherM2forLWO(NULL,ddinstance->model,true,FileName,LWScene(),false);
+					LWObject Doodad;
+					GatherM2forLWO(Doodad,NULL,ddinstance->model,true,FileName,LWScene(),false);
 
 					// --== Model Debugger ==--
 					// Exports the model immediately after gathering, to help determine if a problem is with the gathering function or the doodad-placement functions.
@@ -3115,7 +3124,7 @@ LWObject GatherWMOforLWO(WMO *m, const char *fn, LWScene &scene){
 					//wxLogMessage(wxT("Doodad Prefix: %s"),ddPrefix);
 					Object.Plus(Doodad,ds+1,ddPrefix);
 					doodadAdded = true;
-					Doodad.~LWObject();
+					Doodad.Clear();
 
 					uint32 ddID = (uint32)scene.Objects.size();
 
@@ -3187,20 +3196,15 @@ LWObject GatherWMOforLWO(WMO *m, const char *fn, LWScene &scene){
 	m->showDoodadSet(currset);
 
 	g_modelViewer->SetStatusText(wxT("Finished Gathering WMO Data!"));
-	return Object;
-	Object.~LWObject();
 }
 
 // Gather ADT Data
-LWObject GatherADTforLWO(MapTile *m, const char *fn, LWScene &scene){
+void GatherADTforLWO(LWObject &Object, MapTile *m, const char *fn, LWScene &scene){
 	g_modelViewer->SetStatusText(wxT("Gathering ADT Data for Lightwave Exporter..."));
 	wxString FileName(fn, wxConvUTF8);
-	LWObject Object;
 
-	if (!m){
-		return Object;
-		Object.~LWObject();
-	}
+	if (!m)
+		return;
 
 	if (modelExport_LW_PreserveDir == true){
 		wxString Path, Name;
@@ -3225,8 +3229,9 @@ LWObject GatherADTforLWO(MapTile *m, const char *fn, LWScene &scene){
 	Object.SourceType = wxT("ADT");
 	LogExportData(wxT("LWO"),m->name,FileName);
 
-	// Main Object
-	LWLayer Layer;
+	// Main Object, gathered in place so the finished layer doesn't have to be copied.
+	Object.Layers.push_back(LWLayer());
+	LWLayer &Layer = Object.Layers.back();
 	Layer.Name = m->name.AfterLast(MPQ_SLASH).BeforeLast('.');
 	Layer.ParentLayer = -1;
 
@@ -3236,6 +3241,7 @@ LWObject GatherADTforLWO(MapTile *m, const char *fn, LWScene &scene){
 
 	// Process Chunks
 	g_modelViewer->SetStatusText(wxT("Processing Chunk Data..."));
+	Layer.Points.reserve(16*16*145);
 	for (ssize_t c1=0;c1<16;c1++){
 		for (ssize_t c2=0;c2<16;c2++){
 			MapChunk *chunk = &m->chunks[c1][c2];
@@ -3246,11 +3252,8 @@ LWObject GatherADTforLWO(MapTile *m, const char *fn, LWScene &scene){
 			}
 		}
 	}
-	Object.Layers.push_back(Layer);
 
 	g_modelViewer->SetStatusText(wxT("Finished Gathering ADT Data!"));
-	return Object;
-	Object.~LWObject();
 }
 
 //---------------------------------------------
@@ -3316,7 +3319,8 @@ size_t ExportLWO_M2(Attachment *att, Model *m, const char *fn, bool init){
 
 	// Object Data
 	g_modelViewer->SetStatusText(wxT("Gathering object data..."));
-	LWObject Object = GatherM2forLWO(att,m,init,wxString(fn, wxConvUTF8),Scene);
+	LWObject Object;
+	GatherM2forLWO(Object,att,m,init,wxString(fn, wxConvUTF8),Scene);
 	if (Object.SourceType == wxEmptyString){
 		wxMessageBox(wxT("Error gathering information for export."),wxT("Export Error"));
 		wxLogMessage(wxT("Failure gathering information for export."));
@@ -3346,7 +3350,7 @@ size_t ExportLWO_M2(Attachment *att, Model *m, const char *fn, bool init){
 		wxLogMessage(wxT("LWO Object \"%s\" Writing Complete."),filename.c_str());
 		g_modelViewer->SetStatusText(wxT("M2 Object File successfully written."));
 	}
-	Object.~LWObject();
+	Object.Clear();
 
 	// Scene Data
 	// Export only if the Object file was successfully written.
@@ -3442,7 +3446,8 @@ size_t ExportLWO_WMO(WMO *m, const char *fn){
 
 	// Object Data
 	g_modelViewer->SetStatusText(wxT("Requesting WMO Data..."));
-	LWObject Object = GatherWMOforLWO(m, fn, Scene);
+	LWObject Object;
+	GatherWMOforLWO(Object, m, fn, Scene);
 	if (Object.SourceType == wxEmptyString){
 		wxMessageBox(wxT("Error gathering information for export."),wxT("Export Error"));
 		wxLogMessage(wxT("Failure gathering information for export."));
@@ -3473,7 +3478,7 @@ size_t ExportLWO_WMO(WMO *m, const char *fn){
 	}else{
 		wxLogMessage(wxT("LWO Object Writing Complete."));
 	}
-	Object.~LWObject();
+	Object.Clear();
 
 	// Scene Data
 	g_modelViewer->SetStatusText(wxT("Preparing WMO Scene data..."));
@@ -3567,7 +3572,8 @@ size_t ExportLWO_ADT(MapTile *m, const char *fn){
 	LWScene Scene(scfilename.AfterLast(SLASH),scfilename.BeforeLast(SLASH));
 
 	// Object Data
-	LWObject Object = GatherADTforLWO(m,fn,Scene);
+	LWObject Object;
+	GatherADTforLWO(Object,m,fn,Scene);
 	if (Object.SourceType == wxEmptyString){
 		wxMessageBox(wxT("Error gathering information for export."),wxT("Export Error"));
 		wxLogMessage(wxT("Failure gathering information for export."));
@@ -3598,7 +3604,7 @@ size_t ExportLWO_ADT(MapTile *m, const char *fn){
 	}else{
 		wxLogMessage(wxT("LWO Object Writing Complete."));
 	}
-	Object.~LWObject();
+	Object.Clear();
 
 	// Scene file writing not yet ready...
 	Scene.~LWScene();
@@ -485,7 +485,7 @@ struct LWObject {
 		SourceType = wxEmptyString;
 	}
 
-	void Plus(LWObject o, ssize_t LayerNum=0,wxString PartNamePrefix = wxT("")){
+	void Plus(const LWObject &o, ssize_t LayerNum=0,wxString PartNamePrefix = wxT("")){
 		//wxLogMessage(wxT("Running LW Plus Function, Num Layers: %i, into Layer %i."),o.Layers.size(),LayerNum);
 		// Add layers if nessicary...
 		while (Layers.size() < (size_t)LayerNum+1){
@@ -529,7 +529,7 @@ struct LWObject {
 		}
 		// Proccess New Layers
 		for (size_t i=0;i<o.Layers.size();i++){
-			LWLayer a = o.Layers[i];
+			const LWLayer &a = o.Layers[i];
 
 			// Vector Colors
 			if (a.HasVectorColors == true)
@@ -550,21 +550,21 @@ struct LWObject {
 				Layers[LayerNum].BoundingBox2.z = a.BoundingBox2.z;
 
 			// Points
-			for (size_t x=0;x<a.Points.size();x++){
-				Layers[LayerNum].Points.push_back(a.Points[x]);
-			}
+			Layers[LayerNum].Points.insert(Layers[LayerNum].Points.end(), a.Points.begin(), a.Points.end());
 			// Polys
+			Layers[LayerNum].Polys.reserve(Layers[LayerNum].Polys.size() + a.Polys.size());
 			for (size_t x=0;x<a.Polys.size();x++){
-				for (uint16 j=0;j<a.Polys[x].PolyData.numVerts;j++){
-					a.Polys[x].PolyData.indice[j] += OldPointNum[LayerNum];
-				}
-				a.Polys[x].PartTagID += OldPartNum;
-				a.Polys[x].SurfTagID += OldTagNum;
 				Layers[LayerNum].Polys.push_back(a.Polys[x]);
+				LWPoly &p = Layers[LayerNum].Polys.back();
+				for (uint16 j=0;j<p.PolyData.numVerts;j++){
+					p.PolyData.indice[j] += OldPointNum[LayerNum];
+				}
+				p.PartTagID += OldPartNum;
+				p.SurfTagID += OldTagNum;
 			}
 		}
 	}
-	LWObject operator= (const LWObject o){
+	LWObject& operator= (const LWObject &o){
 		PartNames = o.PartNames;
 		Layers = o.Layers;
 		Images = o.Images;
@@ -572,9 +572,16 @@ struct LWObject {
 
 		SourceType = o.SourceType;
 
-		// return new LWObject
 		return *this;
 	}
+	// Frees all the gathered data, once it's been written.
+	void Clear(){
+		PartNames.Clear();
+		std::vector<LWLayer>().swap(Layers);
+		std::vector<LWClip>().swap(Images);
+		std::vector<LWSurface>().swap(Surfaces);
+		SourceType.Clear();
+	}
 	~LWObject(){
 		if (PartNames.size() > 0)
 			PartNames.Clear();
@@ -684,9 +691,10 @@ void LW_WriteMotionArray(wxTextOutputStream &fs,AnimationData AnimData, size_t N
 }
 
 // Gather Functions
-LWObject GatherM2forLWO(Attachment *att, Model *m, bool init, wxString fn, LWScene &scene, bool announce = true);
-LWObject GatherWMOforLWO(WMO *m, const char *fn, LWScene &scene);
-LWObject GatherADTforLWO(MapTile *m, const char *fn, LWScene &scene);
+// These fill in the passed Object, which is then handed to WriteLWObject by reference.
+void GatherM2forLWO(LWObject &Object, Attachment *att, Model *m, bool init, wxString fn, LWScene &scene, bool announce = true);
+void GatherWMOforLWO(LWObject &Object, WMO *m, const char *fn, LWScene &scene);
+void GatherADTforLWO(LWObject &Object, MapTile *m, const char *fn, LWScene &scene);
 
 AnimVec3D animValue0 = AnimVec3D(AnimVector(0,0),AnimVector(0,0),AnimVector(0,0));
 AnimVec3D animValue1 = AnimVec3D(AnimVector(1,0),AnimVector(1,0),AnimVector(1,0));
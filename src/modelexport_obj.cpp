@@ -1,9 +1,8 @@
-#include <wx/wfstream.h>
-#include <wx/txtstrm.h>
 #include <math.h>
 
 #include "globalvars.h"
 #include "modelexport.h"
+#include "modelexport_writer.h"
 #include "modelcanvas.h"
 
 //#include "CxImage/ximage.h"
@@ -24,13 +23,13 @@ void ExportOBJ_M2(Attachment *att, Model *m, wxString fn, bool init)
 			filename << Path1 << SLASH << Path2 << SLASH << Name;
 		}
 	}
-	wxFFileOutputStream fs (filename);
+	ExportTextWriter f (filename);
 
-	if (!fs.IsOk()) {
+	if (!f.IsOk()) {
 		wxLogMessage(wxT("Error: Unable to open file '%s'. Could not export model."), filename.c_str());
 		return;
 	}
-	wxTextOutputStream f (fs);
+	f.SetFloatFormat(ExportTextWriter::FLOAT_FIXED, 6);
 
 	LogExportData(wxT("OBJ"), m->modelname, fn);
 
@@ -55,12 +54,12 @@ void ExportOBJ_M2(Attachment *att, Model *m, wxString fn, bool init)
 	matName = matName.BeforeLast('.');
 	matName << wxT(".mtl");
 
-	wxFFileOutputStream ms (matName);
-	if (!ms.IsOk()) {
+	ExportTextWriter fm (matName);
+	if (!fm.IsOk()) {
 		wxLogMessage(wxT("Error: Unable to open file '%s'. Could not export materials."), matName.c_str());
 		return;
 	}
-	wxTextOutputStream fm (ms);
+	fm.SetFloatFormat(ExportTextWriter::FLOAT_FIXED, 6);
 	matName = matName.AfterLast(SLASH);
 
 
@@ -118,11 +117,11 @@ void ExportOBJ_M2(Attachment *att, Model *m, wxString fn, bool init)
 
 			fm << wxT("newmtl ") << material << endl;
 			fm << wxT("illum 2") << endl;
-			fm << wxString::Format(wxT("Kd %.06f %.06f %.06f"), diff.x, diff.y, diff.z) << endl;
-			fm << wxString::Format(wxT("Ka %.06f %.06f %.06f"), amb, amb, amb) << endl;
-			fm << wxString::Format(wxT("Ks %.06f %.06f %.06f"), p.ecol.x, p.ecol.y, p.ecol.z) << endl;
+			fm << "Kd " << diff.x << ' ' << diff.y << ' ' << diff.z << endl;
+			fm << "Ka " << amb << ' ' << amb << ' ' << amb << endl;
+			fm << "Ks " << p.ecol.x << ' ' << p.ecol.y << ' ' << p.ecol.z << endl;
 			fm << wxT("Ke 0.000000 0.000000 0.000000") << endl;
-			fm << wxString::Format(wxT("Ns %0.6f"), 0.0f) << endl;
+			fm << "Ns " << 0.0f << endl;
 			//fm << "Ka " << 0.7f << " " << 0.7f << " " << 0.7f << endl;
 			//fm << "Kd " << p.ocol.x << " " << p.ocol.y << " " << p.ocol.z << endl;
 			//fm << "Ks " << p.ecol.x << " " << p.ecol.y << " " << p.ecol.z << endl;
@@ -185,11 +184,11 @@ void ExportOBJ_M2(Attachment *att, Model *m, wxString fn, bool init)
 							fm << wxT("newmtl ") << material << endl;
 							texName << wxT(".tga");
 							fm << wxT("illum 2") << endl;
-							fm << wxString::Format(wxT("Kd %.06f %.06f %.06f"), p.ocol.x, p.ocol.y, p.ocol.z) << endl;
-							fm << wxString::Format(wxT("Ka %.06f %.06f %.06f"), 0.7f, 0.7f, 0.7f) << endl;
-							fm << wxString::Format(wxT("Ks %.06f %.06f %.06f"), p.ecol.x, p.ecol.y, p.ecol.z) << endl;
+							fm << "Kd " << p.ocol.x << ' ' << p.ocol.y << ' ' << p.ocol.z << endl;
+							fm << "Ka " << 0.7f << ' ' << 0.7f << ' ' << 0.7f << endl;
+							fm << "Ks " << p.ecol.x << ' ' << p.ecol.y << ' ' << p.ecol.z << endl;
 							fm << wxT("Ke 0.000000 0.000000 0.000000") << endl;
-							fm << wxString::Format(wxT("Ns %0.6f"), 0.0f) << endl;
+							fm << "Ns " << 0.0f << endl;
 							fm << wxT("map_Kd ") << TexturePath << SLASH << texName << wxT(".tga") << endl << endl;
 
 							wxLogMessage(wxT("Exporting Image: %s"),ExportName.c_str());
@@ -201,7 +200,7 @@ void ExportOBJ_M2(Attachment *att, Model *m, wxString fn, bool init)
 		}
 	}
 
-	ms.Close();
+	fm.Close();
 
 	f << wxT("# Wavefront OBJ exported by WoW Model Viewer ") << APP_VERSION << endl << endl;
 	f << wxT("mtllib ") << matName << endl << endl;
@@ -233,7 +232,7 @@ void ExportOBJ_M2(Attachment *att, Model *m, wxString fn, bool init)
 				}
 				MakeModelFaceForwards(vert,false);
 				vert *= (modelExport_ScaleToRealWorld == true?REALWORLD_SCALE:1.0);
-				f << wxString::Format(wxT("v %.06f %.06f %.06f"), vert.x, vert.y, vert.z) << endl;
+				f << "v " << vert.x << ' ' << vert.y << ' ' << vert.z << endl;
 
 				vertics ++;
 			}
@@ -322,7 +321,7 @@ void ExportOBJ_M2(Attachment *att, Model *m, wxString fn, bool init)
 								MakeModelFaceForwards(mVert,false);
 
 								mVert *= (modelExport_ScaleToRealWorld == true?REALWORLD_SCALE:1.0);
-								f << wxString::Format(wxT("v %.06f %.06f %.06f"), mVert.x, mVert.y, mVert.z) << endl;
+								f << "v " << mVert.x << ' ' << mVert.y << ' ' << mVert.z << endl;
 								vertics++;
 							}
 						}
@@ -342,7 +341,7 @@ void ExportOBJ_M2(Attachment *att, Model *m, wxString fn, bool init)
 			for (size_t k=0, b=p.indexStart; k<p.indexCount; k++,b++) {
 				uint16 a = m->indices[b];
 				Vec2D tc =  m->origVertices[a].texcoords;
-				f << wxString::Format(wxT("vt %.06f %.06f"), tc.x, 1-tc.y) << endl;
+				f << "vt " << tc.x << ' ' << 1-tc.y << endl;
 				//f << "vt " << m->origVertices[a].texcoords.x << " " << (1 - m->origVertices[a].texcoords.y) << endl;
 				textures ++;
 			}
@@ -363,7 +362,7 @@ void ExportOBJ_M2(Attachment *att, Model *m, wxString fn, bool init)
 							for (size_t k=0, b=p.indexStart; k<p.indexCount; k++,b++) {
 								uint16 a = mAttChild->indices[b];
 								Vec2D tc =  mAttChild->origVertices[a].texcoords;
-								f << wxString::Format(wxT("vt %.06f %.06f"), tc.x, 1-tc.y) << endl;
+								f << "vt " << tc.x << ' ' << 1-tc.y << endl;
 								textures ++;
 							}
 						}
@@ -382,7 +381,7 @@ void ExportOBJ_M2(Attachment *att, Model *m, wxString fn, bool init)
 			for (size_t k=0, b=p.indexStart; k<p.indexCount; k++,b++) {
 				uint16 a = m->indices[b];
 				Vec3D n = m->origVertices[a].normal;
-				f << wxString::Format(wxT("vn %.06f %.06f %.06f"), n.x, n.y, n.z) << endl;
+				f << "vn " << n.x << ' ' << n.y << ' ' << n.z << endl;
 				//f << "vn " << m->origVertices[a].normal.x << " " << m->origVertices[a].normal.y << " " << m->origVertices[a].normal.z << endl;
 				normals ++;
 			}
@@ -403,7 +402,7 @@ void ExportOBJ_M2(Attachment *att, Model *m, wxString fn, bool init)
 							for (size_t k=0, b=p.indexStart; k<p.indexCount; k++,b++) {
 								uint16 a = mAttChild->indices[b];
 								Vec3D n = mAttChild->origVertices[a].normal;
-								f << wxString::Format(wxT("vn %.06f %.06f %.06f"), n.x, n.y, n.z) << endl;
+								f << "vn " << n.x << ' ' << n.y << ' ' << n.z << endl;
 								//f << "vn " << m->origVertices[a].normal.x << " " << m->origVertices[a].normal.y << " " << m->origVertices[a].normal.z << endl;
 								normals ++;
 							}
@@ -468,12 +467,12 @@ void ExportOBJ_M2(Attachment *att, Model *m, wxString fn, bool init)
 			f << wxT("s 1") << endl;
 			int triangles = 0;
 			for (size_t k=0; k<p.indexCount; k+=3) {
-				f << wxT("f ");
-				f << counter << wxT("/") << counter << wxT("/") << counter << wxT(" ");
+				f << "f ";
+				f << counter << '/' << counter << '/' << counter << ' ';
 				counter ++;
-				f << counter << wxT("/") << counter << wxT("/") << counter << wxT(" ");
+				f << counter << '/' << counter << '/' << counter << ' ';
 				counter ++;
-				f << counter << wxT("/") << counter << wxT("/") << counter << endl;
+				f << counter << '/' << counter << '/' << counter << endl;
 				counter ++;
 				triangles ++;
 			}
@@ -513,12 +512,12 @@ void ExportOBJ_M2(Attachment *att, Model *m, wxString fn, bool init)
 							f << wxT("s 1") << endl;
 							int triangles = 0;
 							for (size_t k=0; k<p.indexCount; k+=3) {
-								f << wxT("f ");
-								f << counter << wxT("/") << counter << wxT("/") << counter << wxT(" ");
+								f << "f ";
+								f << counter << '/' << counter << '/' << counter << ' ';
 								counter ++;
-								f << counter << wxT("/") << counter << wxT("/") << counter << wxT(" ");
+								f << counter << '/' << counter << '/' << counter << ' ';
 								counter ++;
-								f << counter << wxT("/") << counter << wxT("/") << counter << endl;
+								f << counter << '/' << counter << '/' << counter << endl;
 								counter ++;
 								triangles ++;
 							}
@@ -533,7 +532,7 @@ void ExportOBJ_M2(Attachment *att, Model *m, wxString fn, bool init)
 	f << wxT("# ") << triangles_total << wxT(" triangles total") << endl << endl;
 	
 	// Close file
-	fs.Close();
+	f.Close();
 }
 
 void ExportOBJ_WMO(WMO *m, wxString file)
@@ -551,13 +550,8 @@ void ExportOBJ_WMO(WMO *m, wxString file)
 		file << Path1 << SLASH << Path2 << SLASH << Name;
 	}
 
-	// FIXME: ofstream is not compitable with multibyte path name
-#ifndef _MINGW
-	ofstream f(file.fn_str(), ios_base::out | ios_base::trunc);
-#else
-	ofstream f(file.char_str(), ios_base::out | ios_base::trunc);
-#endif
-	if (!f.is_open()) {
+	ExportTextWriter f(file, wxConvLibc);
+	if (!f.IsOk()) {
 		wxLogMessage(wxT("Error: Unable to open file '%s'. Could not export model."), file.c_str());
 		return;
 	}
@@ -567,16 +561,11 @@ void ExportOBJ_WMO(WMO *m, wxString file)
 	mtlName = mtlName.BeforeLast('.');
 	mtlName << wxT(".mtl");
 
-	// FIXME: ofstream is not compitable with multibyte path name
-#ifndef _MINGW
-	ofstream fm(mtlName.fn_str(), ios_base::out | ios_base::trunc);
-#else
-	ofstream fm(mtlName.char_str(), ios_base::out | ios_base::trunc);
-#endif
+	ExportTextWriter fm(mtlName, wxConvLibc);
 	mtlName = mtlName.AfterLast(SLASH);
 
 	fm << "#" << endl;
-	fm << "# " << mtlName.mb_str() << endl;
+	fm << "# " << mtlName << endl;
 	fm << "#" << endl;
 	fm <<  endl;
 
@@ -657,10 +646,10 @@ void ExportOBJ_WMO(WMO *m, wxString file)
 			SaveTexture(texFilename);
 		}
 	}
-	fm.close();
+	fm.Close();
 
 	f << "# Wavefront OBJ exported by WoW Model Viewer " << APP_VERSION << endl << endl;
-	f << "mtllib " << mtlName.mb_str() << endl << endl;
+	f << "mtllib " << mtlName << endl << endl;
 
 	// geometric vertices (v)
 	// v x y z weight
@@ -739,6 +728,6 @@ void ExportOBJ_WMO(WMO *m, wxString file)
 	}
 
 	// Close file
-	f.close();
+	f.Close();
 	wxDELETEA(texarray);
 }
@@ -1,6 +1,7 @@
 
 #include "modelcanvas.h"
 #include "modelexport.h"
+#include "modelexport_writer.h"
 #include "database.h"
 
 #include <fstream>
@@ -16,7 +17,7 @@ class tabbed_ostream
 private:
     size_t tabc_;
     std::string tab_;
-    std::ostream& stream_;
+    ExportTextWriter& stream_;
     bool on_;
 
     void mtab() 
@@ -27,10 +28,9 @@ private:
     };
 
 public:
-    tabbed_ostream(std::ostream& stream) : tabc_(0), tab_(""), stream_(stream), on_(true) 
+    tabbed_ostream(ExportTextWriter& stream) : tabc_(0), tab_(""), stream_(stream), on_(true) 
     { 
-        stream_.setf(std::ios::fixed);
-        stream_.precision(6);
+        stream_.SetFloatFormat(ExportTextWriter::FLOAT_FIXED, 6);
     }
 
     void toggle() { on_ = !on_; }
@@ -38,10 +38,10 @@ public:
     void rtab() { tabc_--; mtab(); }
 
     template<typename T>
-    std::ostream& operator << (T c)
+    ExportTextWriter& operator << (T c)
     {
         if (on_)
-            stream_ << tab_.c_str();
+            stream_ << tab_;
         stream_ << c;
         return stream_;
     }
@@ -189,13 +189,8 @@ void write(ofstream &f, const T &t) {
 
 static void WriteMesh(const ExportData &data, wxString filename) 
 {
-	// FIXME: ofstream is not compitable with multibyte path name
-#ifndef _MINGW
-	ofstream f(filename.fn_str(), ios::trunc);
-#else
-	ofstream f(filename.char_str(), ios::trunc);
-#endif
-	if (!f.good())
+	ExportTextWriter f(filename, wxConvLibc);
+	if (!f.IsOk())
 		return;
 
 	tabbed_ostream s(f);
@@ -256,18 +251,13 @@ static void WriteMesh(const ExportData &data, wxString filename)
 
 	s << lt << "</mesh>" << endl;
 
-	f.close();
+	f.Close();
 }
 
 static void WriteMaterial(const ExportData &data, wxString filename) 
 {
-	// FIXME: ofstream is not compitable with multibyte path name
-#ifndef _MINGW
-	ofstream f(filename.fn_str(), ios::trunc);
-#else
-	ofstream f(filename.char_str(), ios::trunc);
-#endif
-	if (!f.good())
+	ExportTextWriter f(filename, wxConvLibc);
+	if (!f.IsOk())
 		return;
 
 	tabbed_ostream s(f);
@@ -300,18 +290,13 @@ static void WriteMaterial(const ExportData &data, wxString filename)
 		}
 	}
 	
-	f.close();
+	f.Close();
 }
 
 static void WriteSkeleton(const ExportData &data, wxString filename) 
 {
-	// FIXME: ofstream is not compitable with multibyte path name
-#ifndef _MINGW
-	ofstream f(filename.fn_str(), ios::trunc);
-#else
-	ofstream f(filename.char_str(), ios::trunc);
-#endif
-	if (!f.good())
+	ExportTextWriter f(filename, wxConvLibc);
+	if (!f.IsOk())
 		return;
 
 	tabbed_ostream s(f);
@@ -423,5 +408,5 @@ static void WriteSkeleton(const ExportData &data, wxString filename)
 
 	s << lt << "</skeleton>" << endl;
 
-	f.close();
+	f.Close();
 }
@@ -0,0 +1,283 @@
+#include "modelexport_writer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef std::ostream &(*OstreamManip)(std::ostream &);
+
+// Powers of ten for the fixed point fast path.
+static const double pow10Table[] = {
+	1.0, 10.0, 100.0, 1000.0, 10000.0, 100000.0, 1000000.0, 10000000.0, 100000000.0, 1000000000.0
+};
+
+// Largest integer a double can hold without losing precision (2^53).
+static const double maxExactDouble = 9007199254740992.0;
+
+static inline bool signBit(double v)
+{
+	unsigned long long bits;
+	memcpy(&bits, &v, sizeof(bits));
+	return (bits >> 63) != 0;
+}
+
+ExportTextWriter::ExportTextWriter(wxString filename, const wxMBConv &conv, size_t bufferSize) :
+	conv(conv),
+	buffer(0),
+	bufferSize(bufferSize),
+	pos(0),
+	error(false),
+	floatFormat(FLOAT_GENERAL),
+	floatPrecision(6)
+{
+	if (this->bufferSize < 64)
+		this->bufferSize = 64;
+	if (file.Open(filename, wxT("wb")))
+		buffer = new char[this->bufferSize];
+}
+
+ExportTextWriter::~ExportTextWriter()
+{
+	Close();
+}
+
+void ExportTextWriter::Flush()
+{
+	if (pos == 0)
+		return;
+	if (file.IsOpened() && file.Write(buffer, pos) != pos)
+		error = true;
+	pos = 0;
+}
+
+void ExportTextWriter::Close()
+{
+	if (!file.IsOpened())
+		return;
+	Flush();
+	file.Close();
+	wxDELETEA(buffer);
+}
+
+void ExportTextWriter::SetFloatFormat(FloatFormat format, int precision)
+{
+	floatFormat = format;
+	if (precision < 0)
+		precision = 0;
+	if (precision > 17)
+		precision = 17;
+	floatPrecision = precision;
+}
+
+void ExportTextWriter::Reserve(size_t len)
+{
+	if (pos + len > bufferSize)
+		Flush();
+}
+
+void ExportTextWriter::WriteRaw(const char *s, size_t len)
+{
+	if (!buffer)
+		return;
+	if (len >= bufferSize) {
+		Flush();
+		if (file.Write(s, len) != len)
+			error = true;
+		return;
+	}
+	Reserve(len);
+	memcpy(buffer + pos, s, len);
+	pos += len;
+}
+
+// Same end of line translation as a text mode stream.
+void ExportTextWriter::Write(const char *s, size_t len)
+{
+#ifdef _WINDOWS
+	const char *end = s + len;
+	while (s < end) {
+		const char *nl = (const char *)memchr(s, '\n', end - s);
+		if (!nl) {
+			WriteRaw(s, end - s);
+			break;
+		}
+		WriteRaw(s, nl - s);
+		WriteRaw("\r\n", 2);
+		s = nl + 1;
+	}
+#else
+	WriteRaw(s, len);
+#endif
+}
+
+void ExportTextWriter::WriteUnsigned(unsigned long long v, bool negative)
+{
+	char tmp[24];
+	char *end = tmp + sizeof(tmp);
+	char *p = end;
+	do {
+		*--p = (char)('0' + (v % 10));
+		v /= 10;
+	} while (v);
+	if (negative)
+		*--p = '-';
+	WriteRaw(p, end - p);
+}
+
+// printf("%.*f") compatible output.
+// A float scaled by 10^precision (precision <= 9) is still exact in a double, so the
+// result can be rounded half to even exactly like the C library does, without going
+// through printf at all. Everything else falls back to printf.
+void ExportTextWriter::WriteFixed(double v, int precision)
+{
+	if (precision >= 0 && precision <= 9 && (double)(float)v == v) {
+		double scaled = fabs(v) * pow10Table[precision];
+		if (scaled < maxExactDouble) {
+			double whole = floor(scaled);
+			double frac = scaled - whole;
+			unsigned long long n = (unsigned long long)whole;
+			if (frac > 0.5 || (frac == 0.5 && (n & 1)))
+				n++;
+
+			char tmp[48];
+			char *end = tmp + sizeof(tmp);
+			char *p = end;
+			for (int i=0; i<precision; i++) {
+				*--p = (char)('0' + (n % 10));
+				n /= 10;
+			}
+			if (precision > 0)
+				*--p = '.';
+			do {
+				*--p = (char)('0' + (n % 10));
+				n /= 10;
+			} while (n);
+			if (signBit(v))
+				*--p = '-';
+			WriteRaw(p, end - p);
+			return;
+		}
+	}
+
+	char tmp[512];
+	int len = sprintf(tmp, "%.*f", precision, v);
+	if (len > 0)
+		WriteRaw(tmp, len);
+}
+
+// printf("%.*g") compatible output, as used by a default std::ostream.
+void ExportTextWriter::WriteGeneral(double v, int precision)
+{
+	char tmp[64];
+	int len = sprintf(tmp, "%.*g", precision, v);
+	if (len > 0)
+		WriteRaw(tmp, len);
+}
+
+ExportTextWriter &ExportTextWriter::operator<<(const char *s)
+{
+	if (s)
+		Write(s, strlen(s));
+	return *this;
+}
+
+ExportTextWriter &ExportTextWriter::operator<<(const std::string &s)
+{
+	Write(s.c_str(), s.length());
+	return *this;
+}
+
+ExportTextWriter &ExportTextWriter::operator<<(const wxString &s)
+{
+	const wxWX2MBbuf buf = s.mb_str(conv);
+	const char *data = buf;
+	if (data)
+		Write(data, strlen(data));
+	return *this;
+}
+
+ExportTextWriter &ExportTextWriter::operator<<(char c)
+{
+	Write(&c, 1);
+	return *this;
+}
+
+ExportTextWriter &ExportTextWriter::operator<<(unsigned char c)
+{
+	char ch = (char)c;
+	Write(&ch, 1);
+	return *this;
+}
+
+#if wxUSE_UNICODE
+ExportTextWriter &ExportTextWriter::operator<<(const wchar_t *s)
+{
+	if (s)
+		*this << wxString(s);
+	return *this;
+}
+
+ExportTextWriter &ExportTextWriter::operator<<(wchar_t c)
+{
+	return *this << wxString(c, 1);
+}
+#endif
+
+ExportTextWriter &ExportTextWriter::operator<<(int v)
+{
+	WriteUnsigned(v < 0 ? 0 - (unsigned long long)v : (unsigned long long)v, v < 0);
+	return *this;
+}
+
+ExportTextWriter &ExportTextWriter::operator<<(unsigned int v)
+{
+	WriteUnsigned(v, false);
+	return *this;
+}
+
+ExportTextWriter &ExportTextWriter::operator<<(long v)
+{
+	WriteUnsigned(v < 0 ? 0 - (unsigned long long)v : (unsigned long long)v, v < 0);
+	return *this;
+}
+
+ExportTextWriter &ExportTextWriter::operator<<(unsigned long v)
+{
+	WriteUnsigned(v, false);
+	return *this;
+}
+
+ExportTextWriter &ExportTextWriter::operator<<(long long v)
+{
+	WriteUnsigned(v < 0 ? 0 - (unsigned long long)v : (unsigned long long)v, v < 0);
+	return *this;
+}
+
+ExportTextWriter &ExportTextWriter::operator<<(unsigned long long v)
+{
+	WriteUnsigned(v, false);
+	return *this;
+}
+
+ExportTextWriter &ExportTextWriter::operator<<(float v)
+{
+	return *this << (double)v;
+}
+
+ExportTextWriter &ExportTextWriter::operator<<(double v)
+{
+	if (floatFormat == FLOAT_FIXED)
+		WriteFixed(v, floatPrecision);
+	else
+		WriteGeneral(v, floatPrecision);
+	return *this;
+}
+
+ExportTextWriter &ExportTextWriter::operator<<(std::ostream &(*manip)(std::ostream &))
+{
+	if (manip == static_cast<OstreamManip>(std::endl))
+		Write("\n", 1);
+	else if (manip == static_cast<OstreamManip>(std::flush))
+		Flush();
+	return *this;
+}
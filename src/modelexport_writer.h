@@ -0,0 +1,83 @@
+#ifndef MODELEXPORT_WRITER_H
+#define MODELEXPORT_WRITER_H
+
+#include <wx/ffile.h>
+#include <wx/string.h>
+#include <wx/strconv.h>
+
+#include <iostream>
+#include <string>
+
+// Size of the block handed to the OS in one write. Big enough that a full city WMO
+// goes out in a few dozen writes instead of one per formatted value.
+#define EXPORT_WRITER_BUFFER_SIZE	(1024*1024)
+
+// ExportTextWriter
+// Block buffered text output for the text based exporters (OBJ, X3D, Ogre XML).
+// It takes the place of wxTextOutputStream and ofstream, formats numbers straight into
+// its own buffer and produces the same bytes those streams did:
+//  - FLOAT_FIXED matches printf("%.*f") (and ostream with std::ios::fixed),
+//  - FLOAT_GENERAL matches printf("%.*g") (the default ostream float output),
+//  - '\n' is written as the native end of line, like a text mode stream does.
+class ExportTextWriter
+{
+public:
+	enum FloatFormat {
+		FLOAT_GENERAL = 0,
+		FLOAT_FIXED
+	};
+
+	ExportTextWriter(wxString filename, const wxMBConv &conv = wxConvUTF8, size_t bufferSize = EXPORT_WRITER_BUFFER_SIZE);
+	~ExportTextWriter();
+
+	bool IsOk() const { return file.IsOpened() && !error; }
+	void Flush();
+	void Close();
+
+	void SetFloatFormat(FloatFormat format, int precision = 6);
+
+	void Write(const char *s, size_t len);
+	void WriteFixed(double v, int precision);
+	void WriteGeneral(double v, int precision);
+
+	ExportTextWriter &operator<<(const char *s);
+	ExportTextWriter &operator<<(const std::string &s);
+	ExportTextWriter &operator<<(const wxString &s);
+	ExportTextWriter &operator<<(char c);
+	ExportTextWriter &operator<<(unsigned char c);
+#if wxUSE_UNICODE
+	ExportTextWriter &operator<<(const wchar_t *s);
+	ExportTextWriter &operator<<(wchar_t c);
+#endif
+	ExportTextWriter &operator<<(int v);
+	ExportTextWriter &operator<<(unsigned int v);
+	ExportTextWriter &operator<<(long v);
+	ExportTextWriter &operator<<(unsigned long v);
+	ExportTextWriter &operator<<(long long v);
+	ExportTextWriter &operator<<(unsigned long long v);
+	ExportTextWriter &operator<<(float v);
+	ExportTextWriter &operator<<(double v);
+
+	// Accepts std::endl, so existing "<< endl" code keeps working.
+	ExportTextWriter &operator<<(std::ostream &(*manip)(std::ostream &));
+
+private:
+	// disable copying
+	ExportTextWriter(const ExportTextWriter &);
+	void operator=(const ExportTextWriter &);
+
+	void WriteUnsigned(unsigned long long v, bool negative);
+	void WriteRaw(const char *s, size_t len);
+	void Reserve(size_t len);
+
+	wxFFile file;
+	const wxMBConv &conv;
+	char *buffer;
+	size_t bufferSize;
+	size_t pos;
+	bool error;
+	FloatFormat floatFormat;
+	int floatPrecision;
+};
+
+#endif
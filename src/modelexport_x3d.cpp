@@ -5,10 +5,10 @@
  *
  */
 
-#include <wx/wfstream.h>
 #include <math.h>
 
 #include "modelexport.h"
+#include "modelexport_writer.h"
 #include "modelcanvas.h"
 
 //#include "CxImage/ximage.h"
@@ -20,7 +20,7 @@ class tabbed_ostream
 private:
     size_t tabc_;
     std::string tab_;
-    std::ostream& stream_;
+    ExportTextWriter& stream_;
     bool on_;
 
     void mtab() 
@@ -31,10 +31,9 @@ private:
     };
 
 public:
-    tabbed_ostream(std::ostream& stream) : tabc_(0), tab_(""), stream_(stream), on_(true) 
+    tabbed_ostream(ExportTextWriter& stream) : tabc_(0), tab_(""), stream_(stream), on_(true) 
     { 
-        stream_.setf(std::ios::fixed);
-        stream_.precision(6);
+        stream_.SetFloatFormat(ExportTextWriter::FLOAT_FIXED, 6);
     }
 
     void toggle() { on_ = !on_; }
@@ -42,10 +41,10 @@ public:
     void rtab() { tabc_--; mtab(); }
 
     template<typename T>
-    std::ostream& operator << (T c)
+    ExportTextWriter& operator << (T c)
     {
         if (on_)
-            stream_ << tab_.c_str();
+            stream_ << tab_;
         stream_ << c;
         return stream_;
     }
@@ -249,9 +248,9 @@ void M2toX3DAnim(tabbed_ostream s, Model* m)
     m->animManager->SetFrame(currentFrame);
 }
 
-void M2toX3D(tabbed_ostream s, Model *m, bool init, const char* fn, bool xhtml)
+void M2toX3D(tabbed_ostream s, Model *m, bool init, wxString fn, bool xhtml)
 {
-	LogExportData(wxT("X3D"),m->modelname,wxString(fn, wxConvUTF8));
+	LogExportData(wxT("X3D"),m->modelname,fn);
     s << "<!-- Exported with WoWModelViewer -->" << std::endl;
 
     s.tab();
@@ -270,8 +269,8 @@ void M2toX3D(tabbed_ostream s, Model *m, bool init, const char* fn, bool xhtml)
     typedef std::map<int, wxString> texMap;
     texMap textures;
 
-    if (!fn)
-        fn = "texture";
+    if (fn.IsEmpty())
+        fn = wxT("texture");
 
     size_t num_rot = 0;
     if (modelExport_X3D_CenterModel)
@@ -350,11 +349,11 @@ void M2toX3D(tabbed_ostream s, Model *m, bool init, const char* fn, bool xhtml)
             // yes: reuse the previously defined texture
             if (!textures.count(p.tex))
             {
-                wxString texName(fn, wxConvUTF8);
+                wxString texName(fn);
                 texName = texName.AfterLast(SLASH).BeforeLast('.');
                 texName << wxT("_") << p.tex;
 
-                wxString texFilename(fn, wxConvUTF8);
+                wxString texFilename(fn);
                 texFilename = texFilename.BeforeLast(SLASH);
                 texFilename += SLASH;
                 texFilename += texName;
@@ -465,12 +464,11 @@ void M2toX3D(tabbed_ostream s, Model *m, bool init, const char* fn, bool xhtml)
     s.rtab();
 }
 
-void ExportX3D_M2(Model *m, const char *fn, bool init)
+void ExportX3D_M2(Model *m, wxString fn, bool init)
 {
-	// FIXME: ofstream is not compitable with multibyte path name
-    ofstream f(fn, ios_base::out | ios_base::trunc);
+    ExportTextWriter f(fn, wxConvLibc);
 
-    if (f.good())
+    if (f.IsOk())
     {
         f << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << std::endl;
         f << "<!DOCTYPE X3D PUBLIC \"ISO//Web3D//DTD X3D 3.0//EN\" \"http://www.web3d.org/specifications/x3d-3.0.dtd\">" << std::endl;
@@ -479,15 +477,14 @@ void ExportX3D_M2(Model *m, const char *fn, bool init)
         f << "</X3D>" << std::endl;
     }
 
-    f.close();
+    f.Close();
 }
 
-void ExportXHTML_M2(Model *m, const char *fn, bool init)
+void ExportXHTML_M2(Model *m, wxString fn, bool init)
 {
-	// FIXME: ofstream is not compitable with multibyte path name
-    ofstream f(fn, ios_base::out | ios_base::trunc);
+    ExportTextWriter f(fn, wxConvLibc);
 
-    if (f.good())
+    if (f.IsOk())
     {
         // write xhtml stuff for WebGL
         f << "<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.0 Strict//EN\" \"http://www.w3.org/TR/xhtml1/DTD/xhtml1-strict.dtd\">" << std::endl;
@@ -511,5 +508,5 @@ void ExportXHTML_M2(Model *m, const char *fn, bool init)
         f << "</html>" << std::endl;
     }
 
-    f.close();
+    f.Close();
 }
@@ -13,6 +13,7 @@
 #include "UserSkins.h"
 #include "util.h"
 #include "app.h"
+#include "profiler.h"
 
 #ifdef _MINGW
 #include "GlobalSettings.h"
@@ -143,6 +144,8 @@ BEGIN_EVENT_TABLE(ModelViewer, wxFrame)
 	EVT_MENU(ID_USE_HWACC, ModelViewer::OnToggleCommand)
 	EVT_MENU(ID_USE_ENVMAP, ModelViewer::OnToggleCommand)
 	EVT_MENU(ID_SHOW_SETTINGS, ModelViewer::OnToggleDock)
+	EVT_MENU(ID_PROFILER, ModelViewer::OnToggleCommand)
+	EVT_MENU(ID_PROFILER_SAVE, ModelViewer::OnToggleCommand)
 
 	// char controls:
 	EVT_MENU(ID_SAVE_EQUIPMENT, ModelViewer::OnSetEquipment)
@@ -519,6 +522,9 @@ void ModelViewer::InitMenu()
 		optMenu->AppendSeparator();
 		optMenu->Append(ID_MODELEXPORT_OPTIONS, _("Export Options..."));
 		optMenu->Append(ID_SHOW_SETTINGS, _("Settings..."));
+		optMenu->AppendSeparator();
+		optMenu->AppendCheckItem(ID_PROFILER, _("Show Profiler"));
+		optMenu->Append(ID_PROFILER_SAVE, _("Save Profiler Trace..."));
 
 
 		wxMenu *aboutMenu = new wxMenu;
@@ -1029,6 +1035,10 @@ void ModelViewer::LoadModel(const wxString fn)
 	if (!canvas || fn.IsEmpty())
 		return;
 
+	// the trace covers this load and the frames after it
+	Profiler::ResetTrace();
+	PROFILE_SCOPE_DETAIL("ModelViewer::LoadModel", fn);
+
 	isModel = true;
 
 	// check if this is a character model
@@ -1419,25 +1429,18 @@ wxString ModelViewer::InitMPQArchives()
 	wxString path;
 
 	archives.clear();
-	for (size_t i=0; i<mpqArchives.GetCount(); i++) {
-		if (wxFileName::FileExists(mpqArchives[i])) {
-			archives.push_back(new MPQArchive(mpqArchives[i]));
-		}
-	}
+	MPQArchive::openArchives(mpqArchives, archives);
+	BLPInfo::clearCache();
 
 	// Checks and logs the "TOC" version of the interface files that were loaded
-	MPQFile f(wxT("Interface\\FrameXML\\FrameXML.TOC"));
-	if (f.isEof()) {
-		f.close();
+	unsigned char toc[6];
+	memset(toc,'\0', 6);
+	// offset to "## Interface: "
+	if (MPQFile::readRange(wxT("Interface\\FrameXML\\FrameXML.TOC"), 51, toc, 5) == 0) {
 		wxLogMessage(wxT("Unable to gather TOC data."));
 		SetStatusText(wxT("Unable to gather TOC data."));
 		return wxT("Could not read data from MPQ files.\nPlease make sure World of Warcraft is not running.");
 	}
-	f.seek(51); // offset to "## Interface: "
-	unsigned char toc[6];
-	memset(toc,'\0', 6);
-	f.read(toc, 5);
-	f.close();
 	SetStatusText(wxString((char *)toc, wxConvUTF8), 1);
 	wxLogMessage(wxT("Loaded Content TOC: v%c.%c%c.%c%c"), toc[0], toc[1], toc[2], toc[3], toc[4]);
 	if (wxString((char *)toc, wxConvUTF8) > wxT("99999")) {		// The 99999 should be updated if the TOC ever gets that high.
@@ -1609,6 +1612,22 @@ void ModelViewer::OnToggleCommand(wxCommandEvent &event)
 		canvas->useCamera = event.IsChecked();
 		break;
 
+	case ID_PROFILER:
+		Profiler::Enable(event.IsChecked());
+		if (!event.IsChecked())
+			SetStatusText(wxEmptyString);
+		break;
+
+	case ID_PROFILER_SAVE:
+		{
+			wxFileDialog saveDialog(this, _("Save profiler trace"), wxEmptyString, wxT("wmvtrace.json"), wxT("Chrome trace (*.json)|*.json"), wxFD_SAVE|wxFD_OVERWRITE_PROMPT);
+			if (saveDialog.ShowModal()==wxID_OK) {
+				if (!Profiler::SaveChromeTrace(saveDialog.GetPath()))
+					wxMessageBox(_("Could not write the profiler trace."), _("Error"));
+			}
+		}
+		break;
+
 	case ID_DEFAULT_DOODADS:
 		// if we have a model...
 		if (canvas->wmo) {
@@ -2131,11 +2150,6 @@ void ModelViewer::OnSave(wxCommandEvent &event)
 		if (!canvas->model)
 			return;
 
-		if (!video.supportFBO && !video.supportPBO) {
-			wxMessageBox(wxT("This function is currently disabled for video cards that don't\nsupport the FrameBufferObject or PixelBufferObject OpenGL extensions"), wxT("Error"));
-			return;
-		}
-		
 		wxFileDialog dialog(this, wxT("Save Animation"), dir.GetPath(wxPATH_GET_VOLUME), wxT("filename"), wxT("Animation"), wxFD_SAVE|wxFD_OVERWRITE_PROMPT, wxDefaultPosition);
 		
 		if (dialog.ShowModal()==wxID_OK) {
@@ -2151,15 +2165,10 @@ void ModelViewer::OnSave(wxCommandEvent &event)
 		if (canvas->wmo && !canvas->model)
 			return;
 
-		if (!video.supportFBO && !video.supportPBO) {
-			wxMessageBox(wxT("This function is currently disabled for video cards that don't\nsupport the FrameBufferObject or PixelBufferObject OpenGL extensions"), wxT("Error"));
-			return;
-		}
-		
-		wxFileDialog dialog(this, wxT("Save AVI"), dir.GetPath(wxPATH_GET_VOLUME), wxT("animation.avi"), wxT("animation (*.avi)|*.avi"), wxFD_SAVE|wxFD_OVERWRITE_PROMPT, wxDefaultPosition);
+		wxFileDialog dialog(this, wxT("Save AVI"), dir.GetPath(wxPATH_GET_VOLUME), wxT("animation.avi"), wxT("Motion JPEG AVI (*.avi)|*.avi|Uncompressed AVI (*.avi)|*.avi"), wxFD_SAVE|wxFD_OVERWRITE_PROMPT, wxDefaultPosition);
 		
 		if (dialog.ShowModal()==wxID_OK) {
-			animExporter->CreateAvi(dialog.GetPath());
+			animExporter->CreateAvi(dialog.GetPath(), dialog.GetFilterIndex() == 1 ? FRAMEWRITER_AVI_RAW : FRAMEWRITER_AVI_MJPEG);
 		}
 
 	} else if (event.GetId() == ID_FILE_SCREENSHOTCONFIG) {
@@ -3256,11 +3265,7 @@ void ModelViewer::OnExport(wxCommandEvent &event)
 			wxFileDialog dialog(this, wxT("Export Model..."), wxEmptyString, newfilename, wxT("X3D (*.x3d)|*.x3d"), wxFD_SAVE|wxFD_OVERWRITE_PROMPT);
 			if (dialog.ShowModal()==wxID_OK) {
 				wxLogMessage(wxT("Info: Exporting model to %s..."), wxString(dialog.GetPath().fn_str(), wxConvUTF8).c_str());
-#ifndef _MINGW
-				ExportX3D_M2(canvas->model, dialog.GetPath().fn_str(), init);
-#else
-				ExportX3D_M2(canvas->model, dialog.GetPath().char_str(), init);
-#endif
+				ExportX3D_M2(canvas->model, dialog.GetPath(), init);
 			}else{
 				returncode = EXPORT_ERROR_BAD_FILENAME;
 			}
@@ -3271,11 +3276,7 @@ void ModelViewer::OnExport(wxCommandEvent &event)
 			wxFileDialog dialog(this, wxT("Export Model..."), wxEmptyString, newfilename, wxT("Embedded X3D in XHTML (*.xhtml)|*.xhtml"), wxFD_SAVE|wxFD_OVERWRITE_PROMPT);
 			if (dialog.ShowModal()==wxID_OK) {
 				wxLogMessage(wxT("Info: Exporting model to %s..."), wxString(dialog.GetPath().fn_str(), wxConvUTF8).c_str());
-#ifndef _MINGW
-				ExportXHTML_M2(canvas->model, dialog.GetPath().fn_str(), init);
-#else
-				ExportXHTML_M2(canvas->model, dialog.GetPath().char_str(), init);
-#endif
+				ExportXHTML_M2(canvas->model, dialog.GetPath(), init);
 			}else{
 				returncode = EXPORT_ERROR_BAD_FILENAME;
 			}
@@ -3334,6 +3335,9 @@ void ModelViewer::OnExport(wxCommandEvent &event)
 #endif
 	}
 
+	// Textures are written in the background, make sure they're all on disk.
+	WaitForTextureExports();
+
 	if ((init == false)&&(g_canvas->model)&&(g_selModel->animated)) {
 		if (isPaused == false) {
 			g_selModel->animManager->Play();
@@ -3609,3 +3613,284 @@ void ModelViewer::ImportArmoury(wxString strURL)
 		wxMessageBox(wxT("There was an error when gathering the Armory data.\nPlease try again later."),wxT("Armory Error"));
 	}
 }
+
+namespace {
+	long traverseLocaleMPQs(const wxString locales[], size_t localeCount, const wxString localeArchives[], size_t archiveCount, const wxString& gamePath)
+	{
+		long lngID = -1;
+
+		for (size_t i = 0; i < localeCount; i++) {
+			if (locales[i].IsEmpty())
+				continue;
+			wxString localePath = gamePath;
+
+			localePath.Append(locales[i]);
+			localePath.Append(wxT("/"));
+			if (wxDir::Exists(localePath)) {
+				wxArrayString localeMpqs;
+				wxDir::GetAllFiles(localePath, &localeMpqs, wxEmptyString, wxDIR_FILES);
+
+				for (size_t j = 0; j < archiveCount; j++) {
+					for (size_t k = 0; k < localeMpqs.size(); k++) {
+						wxString baseName = wxFileName(localeMpqs[k]).GetFullName();
+						wxString neededMpq = wxString::Format(localeArchives[j], locales[i].c_str());
+
+						if(baseName.CmpNoCase(neededMpq) == 0) {
+							mpqArchives.Add(localeMpqs[k]);
+						}
+					}
+				}
+
+				lngID = (long)i;
+				return lngID;
+			}
+		}
+
+		return lngID;
+	}
+}
+
+void searchMPQs(bool firstTime)
+{
+	if (mpqArchives.GetCount() > 0)
+		return;
+
+	bool bSearchCache = false;
+	wxMessageDialog *dial = new wxMessageDialog(NULL, _("Do you want to search Cache dir?"),
+		_("Question"), wxYES_NO | wxNO_DEFAULT | wxICON_QUESTION);
+	if (wxID_YES == dial->ShowModal())
+		bSearchCache = true;
+
+	const wxString locales[] = {
+		// sets 0
+		wxT("enUS"), wxT("koKR"), wxT("frFR"), wxT("deDE"), 
+		wxT("zhCN"), wxT("zhTW"), wxT("esES"), wxT("esMX"), wxT("ruRU"),
+		wxT("jaJP"), wxT("ptBR"), wxT("itIT"), 
+		// sets 1
+		wxT("enGB"), wxEmptyString, wxEmptyString, wxEmptyString, 
+		wxT("enCN"), wxT("enTW"), wxEmptyString, wxEmptyString, wxEmptyString,
+		wxEmptyString, wxT("ptPT"), wxEmptyString
+		};
+	const int localeSets = WXSIZEOF(locales) / 2;
+	const wxString defaultArchives[] = {wxT("patch-9.MPQ"),wxT("patch-8.MPQ"),wxT("patch-7.MPQ"),wxT("patch-6.MPQ"),
+		wxT("patch-5.MPQ"),wxT("patch-4.MPQ"),wxT("patch-3.MPQ"),wxT("patch-2.MPQ"),wxT("patch.MPQ"),wxT("alternate.MPQ"),
+		wxT("expansion4.MPQ"),wxT("expansion3.MPQ"),wxT("expansion2.MPQ"),wxT("expansion1.MPQ"),wxT("lichking.MPQ"),wxT("expansion.MPQ"),
+		wxT("world.MPQ"),wxT("world2.MPQ"),wxT("sound.MPQ"),wxT("art.MPQ"),wxT("common-3.MPQ"),wxT("common-2.MPQ"), wxT("common.MPQ"),
+		wxT("interface.MPQ"),wxT("itemtexture.MPQ"),wxT("misc.MPQ"),wxT("model.MPQ"),wxT("texture.MPQ")
+		};
+	const wxString localeArchives[] = {wxT("patch-%s-9.MPQ"),wxT("patch-%s-8.MPQ"),wxT("patch-%s-7.MPQ"),
+		wxT("patch-%s-6.MPQ"),wxT("patch-%s-5.MPQ"),wxT("patch-%s-4.MPQ"),wxT("patch-%s-3.MPQ"), wxT("patch-%s-2.MPQ"), 
+		wxT("patch-%s.MPQ"), wxT("expansion3-locale-%s.MPQ"), wxT("expansion2-locale-%s.MPQ"), 
+		wxT("expansion1-locale-%s.MPQ"), wxT("lichking-locale-%s.MPQ"), wxT("expansion-locale-%s.MPQ"), 
+		wxT("locale-%s.MPQ"), wxT("base-%s.MPQ")};
+
+	// select avaiable locales, auto select user config locale
+	wxArrayString avaiLocales;
+	for (size_t i = 0; i < WXSIZEOF(locales); i++) {
+		if (locales[i].IsEmpty())
+			continue;
+		wxString localePath = gamePath + wxT("Cache") + SLASH + locales[i];
+		if (wxDir::Exists(localePath))
+			avaiLocales.Add(locales[i]);
+	}
+	if (firstTime && avaiLocales.size() == 1) // only 1 locale
+		langName = avaiLocales[0];
+	else {
+		// if user never select a locale, show all locales in data directory
+		avaiLocales.Clear();
+		for (size_t i = 0; i < WXSIZEOF(locales); i++) {
+			if (locales[i].IsEmpty())
+				continue;
+			wxString localePath = gamePath + locales[i];
+
+			if (wxDir::Exists(localePath))
+				avaiLocales.Add(locales[i]);
+		}
+		if (avaiLocales.size() == 0) // failed to find locale
+			return;
+		else if (avaiLocales.size() == 1) // only 1 locale
+			langName = avaiLocales[0];
+		else
+			langName = wxGetSingleChoice(_("Please select a Locale:"), _("Locale"), avaiLocales);
+	}
+
+	// search Partial MPQs
+	wxArrayString baseMpqs;
+	wxDir::GetAllFiles(gamePath, &baseMpqs, wxEmptyString, wxDIR_FILES);
+	for (size_t j = 0; j < baseMpqs.size(); j++) {
+		if (baseMpqs[j].Contains(wxT("oldworld")))
+			continue;
+		wxString baseName = wxFileName(baseMpqs[j]).GetFullName();
+		wxString cmpName = wxT("wow-update-");
+		if (baseName.StartsWith(cmpName) && baseName.AfterLast('.').CmpNoCase(wxT("mpq")) == 0) {
+			bool bFound = false;
+			for(size_t i = 0; i<mpqArchives.size(); i++) {
+				wxString archiveName = wxFileName(mpqArchives[i]).GetFullName();
+				if (!archiveName.AfterLast(SLASH).StartsWith(cmpName))
+					continue;
+				int ver = wxAtoi(archiveName.BeforeLast('.').AfterLast('-'));
+				int bver = wxAtoi(baseName.BeforeLast('.').AfterLast('-'));
+				if (bver > ver) {
+					mpqArchives.Insert(baseMpqs[j], i);
+					bFound = true;
+					break;
+				}		
+			}
+			if (bFound == false)
+				mpqArchives.Add(baseMpqs[j]);
+
+			wxLogMessage(wxT("- Found Partial MPQ archive: %s"), baseMpqs[j].Mid(gamePath.Len()).c_str());
+		}
+	}
+
+	// search Partial MPQs inside langName directory
+	wxDir::GetAllFiles(gamePath+langName, &baseMpqs, wxEmptyString, wxDIR_FILES);
+	for (size_t j = 0; j < baseMpqs.size(); j++) {
+		if (baseMpqs[j].Contains(wxT("oldworld")))
+			continue;
+		wxString baseName = wxFileName(baseMpqs[j]).GetFullName();
+		wxString cmpName = wxT("wow-update-")+langName;
+		if (baseName.StartsWith(cmpName) && baseName.AfterLast('.').CmpNoCase(wxT("mpq")) == 0) {
+			bool bFound = false;
+			for(size_t i = 0; i<mpqArchives.size(); i++) {
+				wxString archiveName = wxFileName(mpqArchives[i]).GetFullName();
+				if (!archiveName.StartsWith(wxT("wow-update-"))) // compare to all wow-update-
+					continue;
+				int ver = wxAtoi(archiveName.BeforeLast('.').AfterLast('-'));
+				int bver = wxAtoi(baseName.BeforeLast('.').AfterLast('-'));
+				if (bver > ver) {
+					mpqArchives.Insert(baseMpqs[j], i);
+					bFound = true;
+					break;
+				}		
+			}
+			if (bFound == false)
+				mpqArchives.Add(baseMpqs[j]);
+
+			wxLogMessage(wxT("- Found Partial MPQ archive: %s"), baseMpqs[j].Mid(gamePath.Len()).c_str());
+		}
+	}
+
+	// search patch-base MPQs
+	wxArrayString baseCacheMpqs;
+	wxDir::GetAllFiles(gamePath+wxT("Cache"), &baseCacheMpqs, wxEmptyString, wxDIR_FILES);
+	for (size_t j = 0; j < baseCacheMpqs.size(); j++) {
+		if (bSearchCache == false)
+			continue;
+		if (baseCacheMpqs[j].Contains(wxT("oldworld")))
+			continue;
+		wxString baseName = baseCacheMpqs[j];
+		wxString fullName = wxFileName(baseName).GetFullName();
+		wxString cmpName = wxT("patch-base-");
+		if (fullName.StartsWith(cmpName) && fullName.AfterLast('.').CmpNoCase(wxT("mpq")) == 0) {
+			bool bFound = false;
+			for(size_t i = 0; i<mpqArchives.size(); i++) {
+				if (!mpqArchives[i].AfterLast(SLASH).StartsWith(cmpName))
+					continue;
+				int ver = wxAtoi(mpqArchives[i].BeforeLast('.').AfterLast('-'));
+				int bver = wxAtoi(fullName.BeforeLast('.').AfterLast('-'));
+				if (bver > ver) {
+#if 1 // Use lastest archive only
+					mpqArchives[i] = baseName;
+#else
+					mpqArchives.Insert(baseName, i);
+#endif
+					bFound = true;
+					break;
+				}		
+			}
+			if (bFound == false)
+				mpqArchives.Add(baseName);
+
+			wxLogMessage(wxT("- Found Patch Base MPQ archive: %s"), baseName.Mid(gamePath.Len()).c_str());
+		}
+	}
+	baseCacheMpqs.Clear();
+
+	// search base cache locale MPQs
+	wxArrayString baseCacheLocaleMpqs;
+	wxDir::GetAllFiles(gamePath+wxT("Cache")+SLASH+langName, &baseCacheLocaleMpqs, wxEmptyString, wxDIR_FILES);
+	for (size_t j = 0; j < baseCacheLocaleMpqs.size(); j++) {
+		if (bSearchCache == false)
+			continue;
+		if (baseCacheLocaleMpqs[j].Contains(wxT("oldworld")))
+			continue;
+		wxString baseName = baseCacheLocaleMpqs[j];
+		wxString fullName = wxFileName(baseName).GetFullName();
+		wxString cmpName = wxT("patch-")+langName+wxT("-");
+		if (fullName.StartsWith(cmpName) && fullName.AfterLast('.').CmpNoCase(wxT("mpq")) == 0) {
+			bool bFound = false;
+			for(size_t i = 0; i<mpqArchives.size(); i++) {
+				if (!mpqArchives[i].AfterLast(SLASH).StartsWith(cmpName))
+					continue;
+				int ver = wxAtoi(mpqArchives[i].BeforeLast('.').AfterLast('-'));
+				int bver = wxAtoi(fullName.BeforeLast('.').AfterLast('-'));
+				if (bver > ver) {
+#if 1 // Use lastest archive only
+					mpqArchives[i] = baseName;
+#else
+					mpqArchives.Insert(baseName, i);
+#endif
+					bFound = true;
+					break;
+				}		
+			}
+			if (bFound == false)
+				mpqArchives.Add(baseName);
+
+			wxLogMessage(wxT("- Found Patch Base Locale MPQ archive: %s"), baseName.Mid(gamePath.Len()).c_str());
+		}
+	}
+	baseCacheLocaleMpqs.Clear();
+
+	// default archives
+	for (size_t i = 0; i < WXSIZEOF(defaultArchives); i++) {
+		//wxLogMessage(wxT("Searching for MPQ archive %s..."), defaultArchives[i].c_str());
+
+		for (size_t j = 0; j < baseMpqs.size(); j++) {
+			wxString baseName = wxFileName(baseMpqs[j]).GetFullName();
+			if(baseName.CmpNoCase(defaultArchives[i]) == 0) {
+				mpqArchives.Add(baseMpqs[j]);
+
+				wxLogMessage(wxT("- Found MPQ archive: %s"), baseMpqs[j].Mid(gamePath.Len()).c_str());
+				if (baseName.CmpNoCase(wxT("alternate.mpq")))
+					bAlternate = true;
+			}
+		}
+	}
+
+	// add locale files
+	for (size_t i = 0; i < WXSIZEOF(locales); i++) {
+		if (locales[i] == langName) {
+			wxString localePath = gamePath;
+
+			localePath.Append(locales[i]);
+			localePath.Append(wxT("/"));
+			if (wxDir::Exists(localePath)) {
+				wxArrayString localeMpqs;
+				wxDir::GetAllFiles(localePath, &localeMpqs, wxEmptyString, wxDIR_FILES);
+
+				for (size_t j = 0; j < WXSIZEOF(localeArchives); j++) {
+					for (size_t k = 0; k < localeMpqs.size(); k++) {
+						wxString baseName = wxFileName(localeMpqs[k]).GetFullName();
+						wxString neededMpq = wxString::Format(localeArchives[j], locales[i].c_str());
+
+						if(baseName.CmpNoCase(neededMpq) == 0) {
+							mpqArchives.Add(localeMpqs[k]);
+						}
+					}
+				}
+			}
+
+			langID = i % localeSets;
+			break;
+		}
+	}
+
+	if (langID == -1) {
+		langID = traverseLocaleMPQs(locales, WXSIZEOF(locales), localeArchives, WXSIZEOF(localeArchives), gamePath);
+		if (langID != -1)
+			langID = langID % localeSets;
+	}
+
+}
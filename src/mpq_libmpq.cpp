@@ -2,11 +2,13 @@
 
 #include <wx/log.h>
 #include <wx/file.h>
+#include <wx/filename.h>
 
 #include <vector>
 #include <algorithm>
 
 #include "util.h"
+#include "profiler.h"
 
 typedef std::vector<mpq_archive*> ArchiveSet;
 static ArchiveSet gOpenArchives;
@@ -25,6 +27,14 @@ MPQArchive::MPQArchive(wxString filename) : ok(false)
 	gOpenArchives.push_back(&mpq_a);
 }
 
+void MPQArchive::openArchives(const wxArrayString &filenames, std::vector<MPQArchive*> &archives)
+{
+	for (size_t i=0; i<filenames.GetCount(); i++) {
+		if (wxFileName::FileExists(filenames[i]))
+			archives.push_back(new MPQArchive(filenames[i]));
+	}
+}
+
 MPQArchive::~MPQArchive()
 {
 	/*
@@ -58,6 +68,8 @@ void MPQArchive::close()
 void
 MPQFile::openFile(const char* filename)
 {
+	PROFILE_SCOPE("MPQFile::openFile");
+
 	eof = false;
 	buffer = 0;
 	pointer = 0;
@@ -283,6 +295,41 @@ wxString MPQFile::getArchive(wxString filename)
 	return _T("unknown");
 }
 
+size_t MPQFile::readRange(wxString filename, size_t offset, void *dest, size_t bytes)
+{
+	MPQFile f(filename.mb_str());
+	if (f.isEof() || offset >= f.getSize()) {
+		f.close();
+		return 0;
+	}
+
+	f.seek((int)offset);
+	size_t read = f.read(dest, bytes);
+	f.close();
+	return read;
+}
+
+wxString MPQFile::getEntryKey(wxString filename)
+{
+	// a local file overrides the archives
+	wxString archive = getArchive(filename);
+
+	for(ArchiveSet::iterator i=gOpenArchives.begin(); i!=gOpenArchives.end();++i)
+	{
+		mpq_archive &mpq_a = **i;
+		int fileno = libmpq_file_number(&mpq_a, filename.mb_str());
+		if (fileno != LIBMPQ_EFILE_NOT_FOUND) {
+			if (archive != wxString(mpq_a.filename, wxConvUTF8))
+				return wxEmptyString;
+			return wxString::Format(_T("%s|%s|%i|%i|%i"), archive.c_str(), filename.Lower().c_str(), fileno,
+				libmpq_file_info(&mpq_a, LIBMPQ_FILE_UNCOMPRESSED_SIZE, fileno),
+				libmpq_file_info(&mpq_a, LIBMPQ_FILE_COMPRESSED_SIZE, fileno));
+		}
+	}
+
+	return wxEmptyString;
+}
+
 size_t MPQFile::getPos()
 {
 	return pointer;
@@ -371,3 +418,17 @@ void getFileLists(std::set<FileTreeItem> &dest, bool filterfunc(wxString))
 	}
 }
 
+// libmpq has no index, this goes through every listfile like getFileLists
+static wxString gPrefixFilter, gExtFilter;
+static bool filterPrefix(wxString fn)
+{
+	wxString tmp = fn.Lower();
+	return tmp.StartsWith(gPrefixFilter) && tmp.EndsWith(gExtFilter);
+}
+
+void getFileListsByPrefix(std::set<FileTreeItem> &dest, const wxString &prefix, const wxString &ext)
+{
+	gPrefixFilter = prefix.Lower();
+	gExtFilter = ext.Lower();
+	getFileLists(dest, filterPrefix);
+}
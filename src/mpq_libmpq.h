@@ -33,6 +33,9 @@ public:
 	MPQArchive(wxString filename);
 	~MPQArchive();
 
+	// Opens those of the archives that exist and adds them to archives, in the given order
+	static void openArchives(const wxArrayString &filenames, std::vector<MPQArchive*> &archives);
+
 	void close();
 };
 
@@ -67,6 +70,18 @@ public:
 	static bool exists(const char* filename);
 	static int getSize(const char* filename); // Used to do a quick check to see if a file is corrupted
 	static wxString getArchive(wxString filename);
+	// Reads bytes from offset of the file into dest, returns the number of bytes read.
+	// libmpq has no sector access, the whole file is read.
+	static size_t readRange(wxString filename, size_t offset, void *dest, size_t bytes);
+	static wxString getEntryKey(wxString filename);
+	// local files are looked for on disk every time, nothing to refresh
+	static void refreshLocalFiles() {}
+};
+
+// libmpq can't be read from several threads, so nothing is read ahead here.
+class MPQPrefetch {
+public:
+	void add(const wxString &) {}
 };
 
 inline void flipcc(char *fcc)
@@ -82,6 +97,7 @@ inline void flipcc(char *fcc)
 
 inline bool defaultFilterFunc(wxString) { return true; }
 void getFileLists(std::set<FileTreeItem> &dest, bool filterfunc(wxString) = defaultFilterFunc);
+void getFileListsByPrefix(std::set<FileTreeItem> &dest, const wxString &prefix, const wxString &ext = wxEmptyString);
 
 
 #endif
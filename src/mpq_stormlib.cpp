@@ -2,32 +2,647 @@
 
 #include <wx/log.h>
 #include <wx/file.h>
+#include <wx/filename.h>
+#include <wx/dir.h>
 
 #include <vector>
 #include <string>
+#include <map>
+#include <algorithm>
 #include "util.h"
 #include "globalvars.h"
+#include "profiler.h"
+#include "threadpool.h"
 
 using namespace std;
 
 typedef vector< pair< wxString, HANDLE* > > ArchiveSet;
 static ArchiveSet gOpenArchives;
+// guards gOpenArchives against archives being opened or closed while files are read
+static wxMutex gOpenArchivesMutex;
+// changes whenever an archive is opened or closed, for what is built from all of them
+static unsigned int gArchivesGeneration = 0;
+
+// The handles of the open archives, in search order. StormLib reads archives with
+// positional I/O, so files can be opened and read from the same handles on several
+// threads at once, only the list itself needs the lock.
+static void getArchiveHandles(vector<HANDLE> &handles)
+{
+	wxMutexLocker lock(gOpenArchivesMutex);
+	handles.clear();
+	handles.reserve(gOpenArchives.size());
+	for(ArchiveSet::iterator i=gOpenArchives.begin(); i!=gOpenArchives.end(); ++i)
+		handles.push_back(*i->second);
+}
 
-MPQArchive::MPQArchive(wxString filename) : ok(false)
+// Same with the archives' file names, deep copies that can go to another thread
+static void getArchives(vector< pair<wxString, HANDLE> > &archives)
+{
+	wxMutexLocker lock(gOpenArchivesMutex);
+	archives.clear();
+	for(ArchiveSet::iterator i=gOpenArchives.begin(); i!=gOpenArchives.end(); ++i)
+		archives.push_back(make_pair(wxString(i->first.c_str()), *i->second));
+}
+
+static unsigned int getArchivesGeneration()
+{
+	wxMutexLocker lock(gOpenArchivesMutex);
+	return gArchivesGeneration;
+}
+
+// Reads of compressed files with at least this many sectors (4KB each in WoW's archives)
+// have their sectors decompressed on the shared ThreadPool.
+#define MPQ_PARALLEL_MIN_SECTORS	64
+// sectors a thread takes at a time
+#define MPQ_PARALLEL_BATCH			8
+
+// Calls of func for the indices 0 to count-1, handed out in batches to the pool's threads
+// and the calling thread itself. The caller only waits for the batches still running, never
+// for the whole pool, so other queued jobs don't hold it up and it works from any thread,
+// also from a pool job. Jobs that start after the work is over find nothing left to do and
+// just drop their reference.
+class ParallelWork {
+public:
+	ParallelWork(SFILE_WORK_CALLBACK func, void *context, DWORD count, DWORD batch, int refs) :
+		func(func), context(context), count(count), batch(batch), next(0), finished(0), refs(refs), done(mutex) {}
+
+	void Run()
+	{
+		for (;;) {
+			DWORD start, end;
+			{
+				wxMutexLocker lock(mutex);
+				if (next >= count)
+					return;
+				start = next;
+				end = wxMin(start + batch, count);
+				next = end;
+			}
+
+			for (DWORD i=start; i<end; i++)
+				func(context, i);
+
+			wxMutexLocker lock(mutex);
+			finished += end - start;
+			if (finished == count)
+				done.Broadcast();
+		}
+	}
+
+	void WaitFinished()
+	{
+		wxMutexLocker lock(mutex);
+		while (finished < count)
+			done.Wait();
+	}
+
+	void Release()
+	{
+		bool last;
+		{
+			wxMutexLocker lock(mutex);
+			last = (--refs == 0);
+		}
+		if (last)
+			delete this;
+	}
+
+private:
+	SFILE_WORK_CALLBACK func;
+	void *context;
+	DWORD count, batch, next, finished;
+	int refs;
+	wxMutex mutex;
+	wxCondition done;
+};
+
+class ParallelJob : public ThreadJob {
+public:
+	ParallelJob(ParallelWork *work) : work(work) {}
+	virtual void Run()
+	{
+		work->Run();
+		work->Release();
+	}
+private:
+	ParallelWork *work;
+};
+
+static void parallelFor(SFILE_WORK_CALLBACK func, void *context, DWORD count, DWORD batch)
+{
+	ThreadPool &pool = ThreadPool::Get();
+	size_t jobs = wxMin(pool.GetThreadCount(), (size_t)(count / batch));
+
+	ParallelWork *work = new ParallelWork(func, context, count, batch, (int)jobs + 1);
+	for (size_t i=0; i<jobs; i++)
+		pool.Add(new ParallelJob(work));
+
+	work->Run();
+	work->WaitFinished();
+	work->Release();
+}
+
+static void WINAPI ParallelSectors(SFILE_WORK_CALLBACK func, void *context, DWORD count)
+{
+	PROFILE_SCOPE("MPQ parallel sectors");
+	parallelFor(func, context, count, MPQ_PARALLEL_BATCH);
+}
+
+static void setParallelCallback()
+{
+	static bool parallelSectors = false;
+	if (!parallelSectors) {
+		SFileSetParallelCallback(ParallelSectors, MPQ_PARALLEL_MIN_SECTORS);
+		parallelSectors = true;
+	}
+}
+
+// Memory kept for the contents of patched files, least recently used go first
+#define MPQ_PATCH_CACHE_SIZE		(64*1024*1024)
+
+// PatchedFileCache
+// Contents of files that StormLib had to put together from a chain of wow-update patches.
+// Opening those means applying every BSD0 patch in the chain again, so DBCs and models
+// opened over and over are kept here. Unpatched files are cheap to read again and aren't
+// cached. Keys are plain std::strings, wxString can't be shared between threads.
+class PatchedFileCache {
+public:
+	PatchedFileCache() : used(0), useCount(0) {}
+
+	// Gives a copy the caller owns (delete[])
+	bool get(const std::string &name, unsigned char *&buffer, size_t &size)
+	{
+		wxMutexLocker lock(mutex);
+		EntryMap::iterator it = entries.find(name);
+		if (it == entries.end())
+			return false;
+
+		it->second.lastUse = ++useCount;
+		size = it->second.data.size();
+		buffer = new unsigned char[size];
+		memcpy(buffer, &it->second.data[0], size);
+		return true;
+	}
+
+	// Copies up to bytes from offset into dest, read is how many there were
+	bool getRange(const std::string &name, size_t offset, void *dest, size_t bytes, size_t &read)
+	{
+		wxMutexLocker lock(mutex);
+		EntryMap::iterator it = entries.find(name);
+		if (it == entries.end())
+			return false;
+
+		it->second.lastUse = ++useCount;
+		size_t size = it->second.data.size();
+		read = (offset < size) ? wxMin(bytes, size - offset) : 0;
+		if (read > 0)
+			memcpy(dest, &it->second.data[offset], read);
+		return true;
+	}
+
+	void put(const std::string &name, const unsigned char *buffer, size_t size)
+	{
+		// one file shouldn't push out everything else
+		if (size == 0 || size > MPQ_PATCH_CACHE_SIZE / 4)
+			return;
+
+		wxMutexLocker lock(mutex);
+		if (entries.find(name) != entries.end())
+			return;
+
+		while (used + size > MPQ_PATCH_CACHE_SIZE && !entries.empty()) {
+			EntryMap::iterator oldest = entries.begin();
+			for (EntryMap::iterator it=entries.begin(); it!=entries.end(); ++it) {
+				if (it->second.lastUse < oldest->second.lastUse)
+					oldest = it;
+			}
+			used -= oldest->second.data.size();
+			entries.erase(oldest);
+		}
+
+		Entry &e = entries[name];
+		e.data.assign(buffer, buffer + size);
+		e.lastUse = ++useCount;
+		used += size;
+	}
+
+	// the archives changed
+	void clear()
+	{
+		wxMutexLocker lock(mutex);
+		entries.clear();
+		used = 0;
+	}
+
+private:
+	struct Entry {
+		std::vector<unsigned char> data;
+		unsigned long lastUse;
+	};
+	typedef std::map<std::string, Entry> EntryMap;
+
+	EntryMap entries;
+	size_t used;
+	unsigned long useCount;
+	wxMutex mutex;
+};
+
+static PatchedFileCache gPatchedFiles;
+
+// True if the file is put together from more than one archive
+static bool isPatchedFile(HANDLE fh)
+{
+	DWORD needed = 0;
+	SFileGetFileInfo(fh, SFILE_INFO_PATCH_CHAIN, NULL, 0, &needed);
+	if (needed == 0)
+		return false;
+
+	vector<TCHAR> chain(needed / sizeof(TCHAR) + 1, 0);
+	if (!SFileGetFileInfo(fh, SFILE_INFO_PATCH_CHAIN, &chain[0], needed, &needed))
+		return false;
+
+	// multi-string, one archive name after the other
+	size_t count = 0;
+	for (const TCHAR *p=&chain[0]; *p; p+=_tcslen(p)+1)
+		count++;
+	return count > 1;
+}
+
+// LocalFileIndex
+// The loose files that take the place of the archives' with useLocalFiles. Import\ and the
+// game's data directory are listed once, on the first lookup, so opening a file doesn't cost
+// three stat calls before the archives are even looked at. Listed again after refresh() or
+// when the working directory or game path changed. Keys are lower case paths relative to the
+// directory, with backslashes like in the archives, the full paths are kept as std::strings
+// so lookups can come from any thread.
+class LocalFileIndex {
+public:
+	LocalFileIndex() : listed(false) {}
+
+	// The file on disk the name resolves to, empty if there is none. Looked for in the same
+	// order as always, Import\path\name, Import\name and the data directory.
+	wxString find(const wxString &filename)
+	{
+		wxString importDir = wxGetCwd()+SLASH+wxT("Import")+SLASH;
+		// deep copy, wxString's reference count isn't safe to share between threads
+		wxString gameDir(gamePath.c_str());
+		std::string importRoot(importDir.mb_str()), gameRoot(gameDir.mb_str());
+		std::string key = localKey(filename);
+		std::string name = key.substr(key.find_last_of('\\') + 1);
+
+		wxMutexLocker lock(mutex);
+		if (!listed || importRoot != listedImport || gameRoot != listedGame) {
+			list(importFiles, importDir);
+			list(gameFiles, gameDir);
+			listedImport = importRoot;
+			listedGame = gameRoot;
+			listed = true;
+		}
+
+		FileMap::iterator it;
+		if ((it = importFiles.find(key)) != importFiles.end() ||
+			(it = importFiles.find(name)) != importFiles.end() ||
+			(it = gameFiles.find(key)) != gameFiles.end())
+			return wxString(it->second.c_str(), wxConvLocal);
+		return wxEmptyString;
+	}
+
+	// the files on disk changed
+	void refresh()
+	{
+		wxMutexLocker lock(mutex);
+		listed = false;
+	}
+
+private:
+	typedef std::map<std::string, std::string> FileMap;
+
+	static std::string localKey(const wxString &path)
+	{
+		wxString key = path.Lower();
+		key.Replace(wxT("/"), wxT("\\"));
+		return std::string(key.mb_str());
+	}
+
+	static void list(FileMap &files, const wxString &dir)
+	{
+		PROFILE_SCOPE_DETAIL("LocalFileIndex::list", dir);
+
+		files.clear();
+		if (dir.IsEmpty() || !wxDir::Exists(dir))
+			return;
+
+		wxArrayString found;
+		wxDir::GetAllFiles(dir, &found);
+		for (size_t i=0; i<found.GetCount(); i++)
+			files[localKey(found[i].Mid(dir.Len()))] = std::string(found[i].mb_str());
+	}
+
+	bool listed;
+	std::string listedImport, listedGame;
+	FileMap importFiles, gameFiles;
+	wxMutex mutex;
+};
+
+static LocalFileIndex gLocalFiles;
+
+// Prefetched files, by prefetchKey()
+class PrefetchStore {
+public:
+	PrefetchStore() : reading(0), ready(mutex) {}
+
+	// false if the file has been asked for already
+	bool request(const std::string &key)
+	{
+		wxMutexLocker lock(mutex);
+		if (entries.find(key) != entries.end())
+			return false;
+		Entry &e = entries[key];
+		e.file = NULL;
+		e.state = QUEUED;
+		return true;
+	}
+
+	// A job is about to read the file, false if it was opened or dropped in the meantime.
+	bool start(const std::string &key)
+	{
+		wxMutexLocker lock(mutex);
+		EntryMap::iterator it = entries.find(key);
+		if (it == entries.end() || it->second.state != QUEUED)
+			return false;
+		it->second.state = READING;
+		reading++;
+		return true;
+	}
+
+	// Called once for every start() that returned true.
+	void finish(const std::string &key, MPQFile *file)
+	{
+		wxMutexLocker lock(mutex);
+		reading--;
+		ready.Broadcast();
+
+		EntryMap::iterator it = entries.find(key);
+		if (it == entries.end() || it->second.state != READING) {
+			delete file;
+			return;
+		}
+		it->second.file = file;
+		it->second.state = READY;
+	}
+
+	// The prefetched file, waits if it's being read. NULL if the file wasn't asked for,
+	// or its read hasn't started, then no job will read it anymore and the caller has to.
+	MPQFile *take(const std::string &key)
+	{
+		wxMutexLocker lock(mutex);
+		EntryMap::iterator it = entries.find(key);
+		if (it == entries.end())
+			return NULL;
+
+		if (it->second.state == QUEUED) {
+			entries.erase(it);
+			return NULL;
+		}
+
+		while ((it = entries.find(key)) != entries.end() && it->second.state == READING)
+			ready.Wait();
+		if (it == entries.end())
+			return NULL;
+
+		MPQFile *file = it->second.file;
+		entries.erase(it);
+		return file;
+	}
+
+	// Size of the prefetched file, if it's been or is being read, leaving it in place
+	bool peekSize(const std::string &key, size_t &size)
+	{
+		wxMutexLocker lock(mutex);
+		EntryMap::iterator it;
+		while ((it = entries.find(key)) != entries.end() && it->second.state == READING)
+			ready.Wait();
+		if (it == entries.end() || it->second.state != READY)
+			return false;
+
+		size = it->second.file->getSize();
+		return true;
+	}
+
+	// Copies part of a prefetched file that has been read, leaving it in place for the
+	// MPQFile that opens it later. False if it isn't ready, the caller reads it itself then.
+	bool peekRange(const std::string &key, size_t offset, void *dest, size_t bytes, size_t &read)
+	{
+		wxMutexLocker lock(mutex);
+		EntryMap::iterator it = entries.find(key);
+		if (it == entries.end() || it->second.state != READY || it->second.file->getSize() == 0)
+			return false;
+
+		MPQFile *file = it->second.file;
+		read = 0;
+		if (offset < file->getSize()) {
+			read = wxMin(bytes, file->getSize() - offset);
+			memcpy(dest, file->getBuffer() + offset, read);
+		}
+		return true;
+	}
+
+	void drop(const std::string &key)
+	{
+		wxMutexLocker lock(mutex);
+		EntryMap::iterator it = entries.find(key);
+		if (it == entries.end())
+			return;
+		delete it->second.file;
+		entries.erase(it);
+	}
+
+	// Drops every prefetch and waits for the reads that already started. The jobs read
+	// through copies of the archive handles, so this has to run before one is closed.
+	void cancelAll()
+	{
+		wxMutexLocker lock(mutex);
+		// queued jobs find their entry gone and don't start, the counter also
+		// covers reads whose entry was dropped already
+		for (EntryMap::iterator it = entries.begin(); it != entries.end(); ) {
+			if (it->second.state == QUEUED)
+				entries.erase(it++);
+			else
+				++it;
+		}
+		while (reading > 0)
+			ready.Wait();
+
+		for (EntryMap::iterator it = entries.begin(); it != entries.end(); ++it)
+			delete it->second.file;
+		entries.clear();
+	}
+
+private:
+	enum State { QUEUED, READING, READY };
+	struct Entry {
+		MPQFile *file;
+		State state;
+	};
+	typedef std::map<std::string, Entry> EntryMap;
+
+	EntryMap entries;
+	size_t reading;
+	wxMutex mutex;
+	wxCondition ready;
+};
+
+static PrefetchStore gPrefetched;
+
+static std::string prefetchKey(const wxString &filename)
+{
+	wxString name = filename.Lower();
+	name.Replace(wxT("/"), wxT("\\"));
+	return std::string(name.mb_str());
+}
+
+class PrefetchJob : public ThreadJob {
+public:
+	// deep copy, the job's name is used on another thread
+	PrefetchJob(const std::string &key, const wxString &filename) : key(key), filename(filename.c_str()) {}
+
+	virtual void Run()
+	{
+		if (!gPrefetched.start(key))
+			return;
+
+		MPQFile *file = new MPQFile();
+		file->readFile(filename);
+		gPrefetched.finish(key, file);
+	}
+
+private:
+	std::string key;
+	wxString filename;
+};
+
+MPQPrefetch::~MPQPrefetch()
+{
+	for (size_t i=0; i<keys.size(); i++)
+		gPrefetched.drop(keys[i]);
+}
+
+void MPQPrefetch::add(const wxString &filename)
+{
+	std::string key = prefetchKey(filename);
+	if (!gPrefetched.request(key))
+		return;
+
+	keys.push_back(key);
+	ThreadPool::Get().Add(new PrefetchJob(key, filename));
+}
+
+// The handle of an open archive, NULL if it isn't open
+static HANDLE findArchive(const wxString &filename)
+{
+	wxMutexLocker lock(gOpenArchivesMutex);
+	for(ArchiveSet::iterator i=gOpenArchives.begin(); i!=gOpenArchives.end(); ++i) {
+		if (i->first == filename)
+			return *i->second;
+	}
+	return NULL;
+}
+
+// Adds a wow-update archive to the patches of mpq. If the update archive is open as an
+// archive of its own, the patch shares its tables instead of loading them once more for
+// every archive and locale prefix it patches.
+static void addPatchArchive(HANDLE mpq, const wxString &patch, const wxString &prefix)
+{
+	HANDLE shared = findArchive(patch);
+#ifndef _MINGW
+	if (shared && SFileAddPatchArchive(mpq, shared, prefix.fn_str(), 0))
+		return;
+	SFileOpenPatchArchive(mpq, patch.fn_str(), prefix.fn_str(), 0);
+#else
+	if (shared && SFileAddPatchArchive(mpq, shared, prefix.char_str(), 0))
+		return;
+	SFileOpenPatchArchive(mpq, patch.char_str(), prefix.char_str(), 0);
+#endif
+}
+
+MPQArchive::MPQArchive(wxString filename) : mpq_a(0), ok(false), error(0), filename(filename)
+{
+	setParallelCallback();
+	open();
+	registerArchive();
+	addPatches();
+}
+
+void MPQArchive::openArchives(const wxArrayString &filenames, std::vector<MPQArchive*> &archives)
+{
+	PROFILE_SCOPE("MPQArchive::openArchives");
+	setParallelCallback();
+
+	vector<MPQArchive*> opening;
+	for (size_t i=0; i<filenames.GetCount(); i++) {
+		if (wxFileName::FileExists(filenames[i])) {
+			MPQArchive *mpq = new MPQArchive();
+			// deep copy, the name is used on a pool thread
+			mpq->filename = wxString(filenames[i].c_str());
+			opening.push_back(mpq);
+		}
+	}
+	if (opening.empty())
+		return;
+
+	// StormLib sets up its crypt tables on the first open, the others can run in parallel
+	opening[0]->open();
+	if (opening.size() > 1)
+		parallelFor(openWork, &opening[1], (DWORD)opening.size() - 1, 1);
+
+	// Logging and patching stay on this thread, in the order the archives are searched.
+	// All archives are registered first, so the update archives can be shared.
+	for (size_t i=0; i<opening.size(); i++)
+		opening[i]->registerArchive();
+	for (size_t i=0; i<opening.size(); i++)
+		opening[i]->addPatches();
+
+	archives.insert(archives.end(), opening.begin(), opening.end());
+}
+
+void WINAPI MPQArchive::openWork(void *context, DWORD index)
+{
+	((MPQArchive **)context)[index]->open();
+}
+
+void MPQArchive::open()
 {
-	wxLogMessage(wxT("Opening %s %s"), filename.Mid(gamePath.Len()).c_str(), isPartialMPQ(filename) ? "(Partial)" : "");
-	g_modelViewer->SetStatusText(wxT("Initiating "+filename+wxT(" Archive")));
 #ifndef _MINGW
 	if (!SFileOpenArchive(filename.fn_str(), 0, MPQ_OPEN_FORCE_MPQ_V1|MPQ_OPEN_READ_ONLY, &mpq_a )) {
 #else
 	if (!SFileOpenArchive(filename.char_str(), 0, MPQ_OPEN_FORCE_MPQ_V1|MPQ_OPEN_READ_ONLY, &mpq_a )) {
 #endif
-		int nError = GetLastError();
-		wxLogMessage(wxT("Error opening archive %s, error #: 0x%X"), filename.Mid(gamePath.Len()).c_str(), nError);
+		error = GetLastError();
 		return;
 	}
+	ok = true;
+}
+
+void MPQArchive::registerArchive()
+{
+	wxLogMessage(wxT("Opening %s %s"), filename.Mid(gamePath.Len()).c_str(), isPartialMPQ(filename) ? "(Partial)" : "");
+	if (g_modelViewer)
+		g_modelViewer->SetStatusText(wxT("Initiating "+filename+wxT(" Archive")));
+	if (!ok) {
+		wxLogMessage(wxT("Error opening archive %s, error #: 0x%X"), filename.Mid(gamePath.Len()).c_str(), error);
+		return;
+	}
+
+	wxMutexLocker lock(gOpenArchivesMutex);
+	gOpenArchives.push_back( make_pair( filename, &mpq_a ) );
+	gArchivesGeneration++;
+}
+
+void MPQArchive::addPatches()
+{
+	if (!ok)
+		return;
 
-	
 	// do patch, but skip cache\ directory
 	if (!(filename.BeforeLast(SLASH).Lower().Contains(wxT("cache")) && 
 		filename.AfterLast(SLASH).Lower().StartsWith(wxT("patch"))) &&
@@ -37,28 +652,18 @@ MPQArchive::MPQArchive(wxString filename) : ok(false)
 			if (!mpqArchives[j].AfterLast(SLASH).StartsWith(wxT("wow-update-")))
 				continue;
 			if (mpqArchives[j].AfterLast(SLASH).Len() == strlen("wow-update-xxxxx.mpq")) {
-#ifndef _MINGW
-				SFileOpenPatchArchive(mpq_a, mpqArchives[j].fn_str(), "base", 0);
-				SFileOpenPatchArchive(mpq_a, mpqArchives[j].fn_str(), langName.fn_str(), 0);
-#else
-				SFileOpenPatchArchive(mpq_a, mpqArchives[j].char_str(), "base", 0);
-				SFileOpenPatchArchive(mpq_a, mpqArchives[j].char_str(), langName.char_str(), 0);
-#endif
+				addPatchArchive(mpq_a, mpqArchives[j], wxT("base"));
+				addPatchArchive(mpq_a, mpqArchives[j], langName);
 				// too many for ptr client, just comment it
 				// wxLogMessage(wxT("Appending base & %s patch %s"), langName.c_str(), mpqArchives[j].Mid(gamePath.Len()).c_str());
 			} else if (mpqArchives[j].BeforeLast(SLASH) == filename.BeforeLast(SLASH)) { // same directory only
-#ifndef _MINGW
-				SFileOpenPatchArchive(mpq_a, mpqArchives[j].fn_str(), "", 0);
-#else
-				SFileOpenPatchArchive(mpq_a, mpqArchives[j].char_str(), "", 0);
-#endif
+				addPatchArchive(mpq_a, mpqArchives[j], wxT(""));
 				// wxLogMessage(wxT("Appending patch %s"), mpqArchives[j].Mid(gamePath.Len()).c_str());
 			}
 		}
 	}
 
-	ok = true;
-	gOpenArchives.push_back( make_pair( filename, &mpq_a ) );
+	gPatchedFiles.clear();
 }
 
 MPQArchive::~MPQArchive()
@@ -85,7 +690,13 @@ void MPQArchive::close()
 {
 	if (ok == false)
 		return;
+	// not under gOpenArchivesMutex, the reads it waits for take it too
+	gPrefetched.cancelAll();
+
+	wxMutexLocker lock(gOpenArchivesMutex);
 	SFileCloseArchive(mpq_a);
+	gPatchedFiles.clear();
+	gArchivesGeneration++;
 	for(ArchiveSet::iterator it=gOpenArchives.begin(); it!=gOpenArchives.end();++it)
 	{
 		HANDLE &mpq_b = *it->second;
@@ -107,91 +718,83 @@ bool MPQFile::isPartialMPQ(wxString filename)
 
 void
 MPQFile::openFile(wxString filename)
+{
+	PROFILE_SCOPE_DETAIL("MPQFile::openFile", filename);
+
+	MPQFile *prefetched = gPrefetched.take(prefetchKey(filename));
+	if (prefetched) {
+		eof = prefetched->eof;
+		buffer = prefetched->buffer;
+		pointer = 0;
+		size = prefetched->size;
+		prefetched->buffer = 0;
+		delete prefetched;
+		return;
+	}
+
+	readFile(filename);
+}
+
+void MPQFile::readFile(wxString filename)
 {
 	eof = false;
 	buffer = 0;
 	pointer = 0;
 	size = 0;
 	if( useLocalFiles ) {
-		wxString fn1 = wxGetCwd()+SLASH+wxT("Import")+SLASH;
-		wxString fn2 = fn1;
-		wxString fn3 = gamePath;
-		fn1.Append(filename);
-		fn2.Append(filename.AfterLast(SLASH));
-		fn3.Append(filename);
-
-		wxString fns[] = { fn1, fn2, fn3 };
-		for(size_t i=0; i<WXSIZEOF(fns); i++) {
-			wxString fn = fns[i];
-			if (wxFile::Exists(fn)) {
-				// success
-				wxFile file;
-				// if successfully opened
-				if (file.Open(fn, wxFile::read)) {
-					size = file.Length();
-					if (size > 0) {
-						buffer = new unsigned char[size];
-						// if successfully read data
-						if (file.Read(buffer, size) > 0) {
-							eof = false;
-							file.Close();
-							return;
-						} else {
-							wxDELETEA(buffer);
-							eof = true;
-							size = 0;
-						}
-					}
+		wxString fn = gLocalFiles.find(filename);
+		wxFile file;
+		// if successfully opened
+		if (!fn.IsEmpty() && file.Open(fn, wxFile::read)) {
+			size = file.Length();
+			if (size > 0) {
+				buffer = new unsigned char[size];
+				// if successfully read data
+				if (file.Read(buffer, size) > 0) {
+					eof = false;
 					file.Close();
+					return;
+				} else {
+					wxDELETEA(buffer);
+					eof = true;
 				}
 			}
+			size = 0;
+			file.Close();
 		}
 	}
 
 	// zhCN alternate file mode
 	if (bAlternate && !filename.Lower().StartsWith(wxT("alternate"))) {
 		wxString alterName = wxT("alternate")+SLASH+filename;
+		if (openFromArchives(alterName))
+			return;
+	}
 
-		for(ArchiveSet::iterator i=gOpenArchives.begin(); i!=gOpenArchives.end(); ++i)
-		{
-			HANDLE &mpq_a = *i->second;
-
-			HANDLE fh;
-#ifndef _MINGW
-			if( !SFileOpenFileEx( mpq_a, alterName.fn_str(), SFILE_OPEN_PATCHED_FILE, &fh ) )
-#else
-			if( !SFileOpenFileEx( mpq_a, alterName.char_str(), SFILE_OPEN_PATCHED_FILE, &fh ) )
-#endif
-				continue;
-
-			// Found!
-			DWORD filesize = SFileGetFileSize( fh );
-			size = filesize;
-
-			// HACK: in patch.mpq some files don't want to open and give 1 for filesize
-			if (size<=1) {
-				eof = true;
-				buffer = 0;
-				return;
-			}
+	if (openFromArchives(filename))
+		return;
 
-			buffer = new unsigned char[size];
-			SFileReadFile( fh, buffer, (DWORD)size );
-			SFileCloseFile( fh );
+	eof = true;
+	buffer = 0;
+}
 
-			return;
-		}
-	}
+bool MPQFile::openFromArchives(const wxString &name)
+{
+	std::string key(name.Lower().mb_str());
+	if (gPatchedFiles.get(key, buffer, size))
+		return true;
 
-	for(ArchiveSet::iterator i=gOpenArchives.begin(); i!=gOpenArchives.end(); ++i)
+	vector<HANDLE> handles;
+	getArchiveHandles(handles);
+	for(size_t i=0; i<handles.size(); i++)
 	{
-		HANDLE &mpq_a = *i->second;
+		HANDLE mpq_a = handles[i];
 
 		HANDLE fh;
 #ifndef _MINGW
-		if( !SFileOpenFileEx( mpq_a, filename.fn_str(), SFILE_OPEN_PATCHED_FILE, &fh ) )
+		if( !SFileOpenFileEx( mpq_a, name.fn_str(), SFILE_OPEN_PATCHED_FILE, &fh ) )
 #else
-		if( !SFileOpenFileEx( mpq_a, filename.char_str(), SFILE_OPEN_PATCHED_FILE, &fh ) )
+		if( !SFileOpenFileEx( mpq_a, name.char_str(), SFILE_OPEN_PATCHED_FILE, &fh ) )
 #endif
 			continue;
 
@@ -201,20 +804,90 @@ MPQFile::openFile(wxString filename)
 
 		// HACK: in patch.mpq some files don't want to open and give 1 for filesize
 		if (size<=1) {
+			SFileCloseFile( fh );
 			eof = true;
 			buffer = 0;
-			return;
+			return true;
 		}
 
 		buffer = new unsigned char[size];
-		SFileReadFile( fh, buffer, (DWORD)size );
+		DWORD bytesRead = 0;
+		SFileReadFile( fh, buffer, (DWORD)size, &bytesRead );
+		if (bytesRead == size && isPatchedFile(fh))
+			gPatchedFiles.put(key, buffer, size);
 		SFileCloseFile( fh );
 
-		return;
+		return true;
 	}
 
-	eof = true;
-	buffer = 0;
+	return false;
+}
+
+// readRange() from the first archive that has the file, false if none has
+static bool readRangeFromArchives(const wxString &name, size_t offset, void *dest, size_t bytes, size_t &read)
+{
+	read = 0;
+	std::string key(name.Lower().mb_str());
+	if (gPatchedFiles.getRange(key, offset, dest, bytes, read))
+		return true;
+
+	vector<HANDLE> handles;
+	getArchiveHandles(handles);
+	for(size_t i=0; i<handles.size(); i++)
+	{
+		HANDLE fh;
+#ifndef _MINGW
+		if( !SFileOpenFileEx( handles[i], name.fn_str(), SFILE_OPEN_PATCHED_FILE, &fh ) )
+#else
+		if( !SFileOpenFileEx( handles[i], name.char_str(), SFILE_OPEN_PATCHED_FILE, &fh ) )
+#endif
+			continue;
+
+		// same as openFile(), files that give 1 for their size can't be read
+		DWORD filesize = SFileGetFileSize( fh );
+		if (filesize > 1 && offset < filesize) {
+			DWORD bytesRead = 0;
+			SFileSetFilePointer( fh, (LONG)offset, NULL, FILE_BEGIN );
+			SFileReadFile( fh, dest, (DWORD)wxMin(bytes, filesize - offset), &bytesRead );
+			read = bytesRead;
+		}
+		SFileCloseFile( fh );
+		return true;
+	}
+
+	return false;
+}
+
+size_t MPQFile::readRange(wxString filename, size_t offset, void *dest, size_t bytes)
+{
+	PROFILE_SCOPE_DETAIL("MPQFile::readRange", filename);
+
+	// a file being prefetched has come from the same place openFile() would take it from
+	size_t read = 0;
+	if (gPrefetched.peekRange(prefetchKey(filename), offset, dest, bytes, read))
+		return read;
+
+	if( useLocalFiles ) {
+		wxString fn = gLocalFiles.find(filename);
+		wxFile file;
+		// empty local files are skipped by openFile() too
+		if (!fn.IsEmpty() && file.Open(fn, wxFile::read) && file.Length() > 0) {
+			if (file.Seek(offset) == wxInvalidOffset)
+				return 0;
+			ssize_t read = file.Read(dest, bytes);
+			return (read > 0) ? (size_t)read : 0;
+		}
+	}
+
+	// zhCN alternate file mode
+	if (bAlternate && !filename.Lower().StartsWith(wxT("alternate"))) {
+		wxString alterName = wxT("alternate")+SLASH+filename;
+		if (readRangeFromArchives(alterName, offset, dest, bytes, read))
+			return read;
+	}
+
+	readRangeFromArchives(filename, offset, dest, bytes, read);
+	return read;
 }
 
 MPQFile::MPQFile(wxString filename):
@@ -233,21 +906,8 @@ MPQFile::~MPQFile()
 
 bool MPQFile::exists(wxString filename)
 {
-	if( useLocalFiles ) {
-		wxString fn1 = wxGetCwd()+SLASH+wxT("Import")+SLASH;
-		wxString fn2 = fn1;
-		wxString fn3 = gamePath;
-		fn1.Append(filename);
-		fn2.Append(filename.AfterLast(SLASH));
-		fn3.Append(filename);
-
-		wxString fns[] = { fn1, fn2, fn3 };
-		for(size_t i=0; i<WXSIZEOF(fns); i++) {
-			wxString fn = fns[i];
-			if (wxFile::Exists(fn))
-				return true;
-		}
-	}
+	if( useLocalFiles && !gLocalFiles.find(filename).IsEmpty() )
+		return true;
 
 	for(ArchiveSet::iterator i=gOpenArchives.begin(); i!=gOpenArchives.end();++i)
 	{
@@ -318,21 +978,15 @@ size_t MPQFile::getSize()
 
 int MPQFile::getSize(wxString filename)
 {
+	size_t prefetchedSize;
+	if (gPrefetched.peekSize(prefetchKey(filename), prefetchedSize))
+		return (int)prefetchedSize;
+
 	if( useLocalFiles ) {
-		wxString fn1 = wxGetCwd()+SLASH+wxT("Import")+SLASH;
-		wxString fn2 = fn1;
-		wxString fn3 = gamePath;
-		fn1.Append(filename);
-		fn2.Append(filename.AfterLast(SLASH));
-		fn3.Append(filename);
-
-		wxString fns[] = { fn1, fn2, fn3 };
-		for(size_t i=0; i<WXSIZEOF(fns); i++) {
-			wxString fn = fns[i];
-			if (wxFile::Exists(fn)) {
-				wxFile file(fn);
-				return file.Length();
-			}
+		wxString fn = gLocalFiles.find(filename);
+		if (!fn.IsEmpty()) {
+			wxFile file(fn);
+			return file.Length();
 		}
 	}
 
@@ -358,20 +1012,9 @@ int MPQFile::getSize(wxString filename)
 wxString MPQFile::getArchive(wxString filename)
 {
 	if( useLocalFiles ) {
-		wxString fn1 = wxGetCwd()+SLASH+wxT("Import")+SLASH;
-		wxString fn2 = fn1;
-		wxString fn3 = gamePath;
-		fn1.Append(filename);
-		fn2.Append(filename.AfterLast(SLASH));
-		fn3.Append(filename);
-
-		wxString fns[] = { fn1, fn2, fn3 };
-		for(size_t i=0; i<WXSIZEOF(fns); i++) {
-			wxString fn = fns[i];
-			if (wxFile::Exists(fn)) {
-				return fn;
-			}
-		}
+		wxString fn = gLocalFiles.find(filename);
+		if (!fn.IsEmpty())
+			return fn;
 	}
 
 	for(ArchiveSet::iterator i=gOpenArchives.begin(); i!=gOpenArchives.end();++i)
@@ -391,6 +1034,81 @@ wxString MPQFile::getArchive(wxString filename)
 	return wxT("unknown");
 }
 
+void MPQFile::refreshLocalFiles()
+{
+	gLocalFiles.refresh();
+}
+
+// Size and modification time of every archive that is open, so anything keyed on it goes
+// stale when the game is patched or a different install is loaded.
+static wxString getArchivesSignature()
+{
+	static wxString signature;
+	static unsigned int generation = 0;
+
+	// Every open or close bumps the generation, so swapping in a different
+	// set of the same size still rebuilds the signature.
+	unsigned int current = getArchivesGeneration();
+	if (generation != current || signature.IsEmpty()) {
+		signature = wxString::Format(wxT("%u"), (unsigned int)mpqArchives.GetCount());
+		for(size_t i=0; i<mpqArchives.GetCount(); i++) {
+			wxFileName fn(mpqArchives[i]);
+			wxULongLong size = fn.GetSize();
+			time_t mtime = wxFileModificationTime(mpqArchives[i]);
+			signature += wxString::Format(wxT(":%s:%s-%lx"), fn.GetFullName().c_str(), size.ToString().c_str(), (unsigned long)mtime);
+		}
+		generation = current;
+	}
+	return signature;
+}
+
+wxString MPQFile::getEntryKey(wxString filename)
+{
+	if( useLocalFiles && !gLocalFiles.find(filename).IsEmpty() )
+		return wxEmptyString;
+
+	wxString names[2];
+	size_t count = 0;
+	// same lookup order as openFile()
+	if (bAlternate && !filename.Lower().StartsWith(wxT("alternate")))
+		names[count++] = wxT("alternate")+SLASH+filename;
+	names[count++] = filename;
+
+	for(size_t n=0; n<count; n++) {
+		for(ArchiveSet::iterator i=gOpenArchives.begin(); i!=gOpenArchives.end();++i)
+		{
+			HANDLE &mpq_a = *i->second;
+			HANDLE fh;
+#ifndef _MINGW
+			if( !SFileOpenFileEx( mpq_a, names[n].fn_str(), SFILE_OPEN_PATCHED_FILE, &fh ) )
+#else
+			if( !SFileOpenFileEx( mpq_a, names[n].char_str(), SFILE_OPEN_PATCHED_FILE, &fh ) )
+#endif
+				continue;
+
+			DWORD name1 = 0, name2 = 0, fileSize = 0, compressedSize = 0;
+			ULONGLONG position = 0;
+			SFileGetFileInfo(fh, SFILE_INFO_CODENAME1, &name1, sizeof(name1));
+			SFileGetFileInfo(fh, SFILE_INFO_CODENAME2, &name2, sizeof(name2));
+			SFileGetFileInfo(fh, SFILE_INFO_FILE_SIZE, &fileSize, sizeof(fileSize));
+			SFileGetFileInfo(fh, SFILE_INFO_COMPRESSED_SIZE, &compressedSize, sizeof(compressedSize));
+			SFileGetFileInfo(fh, SFILE_INFO_POSITION, &position, sizeof(position));
+			DWORD patchedSize = SFileGetFileSize(fh);
+			SFileCloseFile(fh);
+
+			// openFile() treats these as missing
+			if (patchedSize <= 1)
+				return wxEmptyString;
+
+			return wxString::Format(wxT("%s|%s|%08x%08x|%u|%u|%s|%u|%s"), i->first.c_str(), names[n].Lower().c_str(),
+				(unsigned int)name1, (unsigned int)name2, (unsigned int)fileSize, (unsigned int)compressedSize,
+				wxULongLong(position).ToString().c_str(), (unsigned int)patchedSize, getArchivesSignature().c_str());
+		}
+	}
+
+	return wxEmptyString;
+}
+
 size_t MPQFile::getPos()
 {
 	return pointer;
@@ -409,99 +1127,251 @@ unsigned char* MPQFile::getPointer()
 
 #include <wx/tokenzr.h>
 
-void getFileLists(std::set<FileTreeItem> &dest, bool filterfunc(wxString))
+// Colour of an archive's files in the file list
+static int archiveColor(const wxString &archive)
 {
-	for(ArchiveSet::iterator i=gOpenArchives.begin(); i!=gOpenArchives.end();++i)
+	wxString temp(archive);
+	temp.MakeLower();
+	int col = 0; // Black
+
+	if ((temp.Find(wxT("wow-update-")) > -1) || (temp.Find(wxT("patch.mpq")) > -1))
+		col = 1; // Blue
+	else if (temp.Find(wxT("cache")) > -1 || temp.Find(wxT("patch-2.mpq")) > -1)
+		col = 2; // Red
+	else if(temp.Find(wxT("expansion1.mpq")) > -1 || temp.Find(wxT("expansion.mpq")) > -1)
+		col = 3; // Outlands Purple
+	else if (temp.Find(wxT("expansion2.mpq")) > -1 || temp.Find(wxT("lichking.mpq")) > -1)
+		col = 4; // Frozen Blue
+	else if (temp.Find(wxT("expansion3.mpq")) > -1)
+		col = 5; // Destruction Orange
+	else if (temp.Find(wxT("expansion4.mpq")) > -1 || temp.Find(wxT("patch-3.mpq")) > -1)
+		col = 6; // Bamboo Green
+	else if (temp.Find(wxT("alternate.mpq")) > -1)
+		col = 7; // Cyan
+	return col;
+}
+
+static void addFileTreeItem(std::set<FileTreeItem> &dest, wxString line, int col)
+{
+	// This is just to help cleanup Duplicates
+	// Ideally I should tokenise the string and clean it up automatically
+	FileTreeItem tmp;
+
+	if (line.IsEmpty())
+		return;
+	tmp.fileName = line;
+	line.MakeLower();
+	line[0] = toupper(line.GetChar(0));
+	int ret = line.Find('\\');
+	if (ret>-1)
+		line[ret+1] = toupper(line.GetChar(ret+1));
+
+	tmp.displayName = line;
+	tmp.color = col;
+	dest.insert(tmp);
+}
+
+// Compares listfile paths, not case sensitive
+static int comparePaths(const char *a, size_t alen, const char *b, size_t blen)
+{
+	size_t len = wxMin(alen, blen);
+	for (size_t i=0; i<len; i++) {
+		int ca = tolower((unsigned char)a[i]), cb = tolower((unsigned char)b[i]);
+		if (ca != cb)
+			return ca - cb;
+	}
+	return (alen < blen) ? -1 : ((alen > blen) ? 1 : 0);
+}
+
+// ListfileIndex
+// The (listfile)s of all open archives merged into one list, sorted by path without regard
+// to case and with the entries later archives have again left out. The files of a directory
+// are next to each other, so "everything in this folder" is a binary search and a walk over
+// just those files instead of parsing every listfile. Built on first use and again after
+// archives were opened or closed. The paths, a few hundred thousand of them, share one
+// UTF-8 buffer.
+class ListfileIndex {
+public:
+	ListfileIndex() : generation(0), built(false) {}
+
+	void getAll(std::set<FileTreeItem> &dest, bool filterfunc(wxString))
 	{
-		HANDLE &mpq_a = *i->second;
+		wxMutexLocker lock(mutex);
+		update();
+		for (size_t i=0; i<entries.size(); i++) {
+			wxString line = getName(entries[i]);
+			if (filterfunc(line))
+				addFileTreeItem(dest, line, entries[i].color);
+		}
+	}
+
+	void getByPrefix(std::set<FileTreeItem> &dest, const wxString &prefix, const wxString &ext)
+	{
+		std::string key(prefix.Lower().mb_str(wxConvUTF8));
+		std::string ending(ext.Lower().mb_str(wxConvUTF8));
+
+		wxMutexLocker lock(mutex);
+		update();
+		std::vector<Entry>::iterator it = std::lower_bound(entries.begin(), entries.end(), key, EntryLess(names));
+		for (; it!=entries.end() && startsWith(*it, key); ++it) {
+			if (endsWith(*it, ending))
+				addFileTreeItem(dest, getName(*it), it->color);
+		}
+	}
+
+private:
+	struct Entry {
+		size_t offset;
+		size_t length;
+		int color;
+	};
+
+	struct EntryLess {
+		const std::vector<char> &names;
+		EntryLess(const std::vector<char> &names) : names(names) {}
+		bool operator()(const Entry &a, const Entry &b) const
+		{
+			return comparePaths(&names[a.offset], a.length, &names[b.offset], b.length) < 0;
+		}
+		// key is lower case already
+		bool operator()(const Entry &a, const std::string &key) const
+		{
+			return comparePaths(&names[a.offset], a.length, key.c_str(), key.length()) < 0;
+		}
+		bool operator()(const std::string &key, const Entry &a) const
+		{
+			return comparePaths(key.c_str(), key.length(), &names[a.offset], a.length) < 0;
+		}
+	};
+
+	struct EntryEqual {
+		const std::vector<char> &names;
+		EntryEqual(const std::vector<char> &names) : names(names) {}
+		bool operator()(const Entry &a, const Entry &b) const
+		{
+			return comparePaths(&names[a.offset], a.length, &names[b.offset], b.length) == 0;
+		}
+	};
+
+	bool startsWith(const Entry &e, const std::string &key) const
+	{
+		return e.length >= key.length() && comparePaths(&names[e.offset], key.length(), key.c_str(), key.length()) == 0;
+	}
+
+	bool endsWith(const Entry &e, const std::string &ending) const
+	{
+		if (ending.empty())
+			return true;
+		return e.length >= ending.length() &&
+			comparePaths(&names[e.offset + e.length - ending.length()], ending.length(), ending.c_str(), ending.length()) == 0;
+	}
+
+	wxString getName(const Entry &e) const
+	{
+		return wxString(&names[e.offset], wxConvUTF8, e.length);
+	}
+
+	void update()
+	{
+		unsigned int current = getArchivesGeneration();
+		if (built && generation == current)
+			return;
+
+		PROFILE_SCOPE("ListfileIndex::update");
+		names.clear();
+		entries.clear();
+
+		vector< pair<wxString, HANDLE> > archives;
+		getArchives(archives);
+		std::string lang(langName.mb_str(wxConvUTF8));
+		for (size_t i=0; i<archives.size(); i++)
+			addListfile(archives[i].first, archives[i].second, lang);
+
+		// stable, so of the same file in several archives the first archive's stays
+		std::stable_sort(entries.begin(), entries.end(), EntryLess(names));
+		entries.erase(std::unique(entries.begin(), entries.end(), EntryEqual(names)), entries.end());
+
+		generation = current;
+		built = true;
+	}
+
+	void addListfile(const wxString &archive, HANDLE mpq_a, const std::string &lang)
+	{
+		wxString archiveName = archive.AfterLast(SLASH);
 		bool isPartial = false;
-		if (i->first.AfterLast(SLASH).StartsWith(wxT("wow-update-base")))
+		if (archiveName.StartsWith(wxT("wow-update-base")))
 			isPartial = false;
-		else if (i->first.AfterLast(SLASH).StartsWith(wxT("wow-update-")+langName))
+		else if (archiveName.StartsWith(wxT("wow-update-")+langName))
 			isPartial = false;
-		else if (i->first.AfterLast(SLASH).StartsWith(wxT("wow-update-")))
+		else if (archiveName.StartsWith(wxT("wow-update-")))
 			isPartial = true;
 
 		HANDLE fh;
-		if( SFileOpenFileEx( mpq_a, "(listfile)", 0, &fh ) )
-		{
-			// Found!
-			DWORD filesize = SFileGetFileSize( fh );
-			size_t size = filesize;
-
-			wxString temp(i->first);
-			temp.MakeLower();
-			int col = 0; // Black
-
-			if ((temp.Find(wxT("wow-update-")) > -1) || (temp.Find(wxT("patch.mpq")) > -1))
-				col = 1; // Blue
-			else if (temp.Find(wxT("cache")) > -1 || temp.Find(wxT("patch-2.mpq")) > -1)
-				col = 2; // Red
-			else if(temp.Find(wxT("expansion1.mpq")) > -1 || temp.Find(wxT("expansion.mpq")) > -1)
-				col = 3; // Outlands Purple
-			else if (temp.Find(wxT("expansion2.mpq")) > -1 || temp.Find(wxT("lichking.mpq")) > -1)
-				col = 4; // Frozen Blue
-			else if (temp.Find(wxT("expansion3.mpq")) > -1)
-				col = 5; // Destruction Orange
-			else if (temp.Find(wxT("expansion4.mpq")) > -1 || temp.Find(wxT("patch-3.mpq")) > -1)
-				col = 6; // Bamboo Green
-			else if (temp.Find(wxT("alternate.mpq")) > -1)
-				col = 7; // Cyan
-
-			if (size > 0 ) {
-				unsigned char *buffer = new unsigned char[size];
-				SFileReadFile( fh, buffer, (DWORD)size );
-				unsigned char *p = buffer, *end = buffer + size;
-
-				while (p < end) { // if p = end here, no need to go into next loop !
-					unsigned char *q=p;
-					do {
-						if (*q=='\r' || *q=='\n') // carriage return or new line
-							break;
-					} while (q++<=end);
-
-					wxString line(reinterpret_cast<char *>(p), wxConvUTF8, q-p);
-					if (line.Length()==0) 
-						break;
-					p = q;
-					if (*p == '\r')
-						p++;
-					if (*p == '\n')
-						p++;
-					//line = line.Trim(); // delete \r\n
-					if (isPartial) {
-						if (line.Lower().StartsWith(wxT("base\\"))) // strip "base\\"
-							line = line.Mid(5);
-						else if (line.StartsWith(langName)) // strip "enus\\"
-							line = line.Mid(5);
-						else
-							continue;
-					}
-
-					if (filterfunc(wxString(line.mb_str(), wxConvUTF8))) {
-						// This is just to help cleanup Duplicates
-						// Ideally I should tokenise the string and clean it up automatically
-						FileTreeItem tmp;
-
-						tmp.fileName = line;
-						line.MakeLower();
-						line[0] = toupper(line.GetChar(0));
-						int ret = line.Find('\\');
-						if (ret>-1)
-							line[ret+1] = toupper(line.GetChar(ret+1));
-
-						tmp.displayName = line;
-						tmp.color = col;
-						dest.insert(tmp);
-					}
+		if( !SFileOpenFileEx( mpq_a, "(listfile)", 0, &fh ) )
+			return;
+
+		size_t size = SFileGetFileSize( fh );
+		int col = archiveColor(archive);
+		if (size > 0 && size != SFILE_INVALID_SIZE) {
+			vector<char> buffer(size);
+			DWORD bytesRead = 0;
+			SFileReadFile( fh, &buffer[0], (DWORD)size, &bytesRead );
+			const char *p = &buffer[0], *end = p + bytesRead;
+
+			while (p < end) {
+				const char *q = p;
+				while (q < end && *q != '\r' && *q != '\n')
+					q++;
+
+				const char *line = p;
+				size_t length = q - p;
+				// the list ends at the first empty line
+				if (length == 0)
+					break;
+				p = q;
+				if (p < end && *p == '\r')
+					p++;
+				if (p < end && *p == '\n')
+					p++;
+
+				if (isPartial) {
+					if (length > 5 && comparePaths(line, 5, "base\\", 5) == 0) { // strip "base\\"
+						line += 5;
+						length -= 5;
+					} else if (length > 5 && !lang.empty() && strncmp(line, lang.c_str(), lang.length()) == 0) { // strip "enus\\"
+						line += 5;
+						length -= 5;
+					} else
+						continue;
 				}
 
-				wxDELETEA(buffer);
-				p = NULL;
-				end = NULL;
+				Entry e;
+				e.offset = names.size();
+				e.length = length;
+				e.color = col;
+				names.insert(names.end(), line, line + length);
+				entries.push_back(e);
 			}
-
-			SFileCloseFile( fh );
 		}
+
+		SFileCloseFile( fh );
 	}
+
+	unsigned int generation;
+	bool built;
+	std::vector<char> names;
+	std::vector<Entry> entries;
+	wxMutex mutex;
+};
+
+static ListfileIndex gListfiles;
+
+void getFileLists(std::set<FileTreeItem> &dest, bool filterfunc(wxString))
+{
+	gListfiles.getAll(dest, filterfunc);
+}
+
+void getFileListsByPrefix(std::set<FileTreeItem> &dest, const wxString &prefix, const wxString &ext)
+{
+	gListfiles.getByPrefix(dest, prefix, ext);
 }
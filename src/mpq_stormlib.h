@@ -30,11 +30,28 @@ class MPQArchive
 	//MPQHANDLE handle;
 	HANDLE mpq_a;
 	bool ok;
+	int error;
+	wxString filename;
+
+	MPQArchive() : mpq_a(0), ok(false), error(0) {}
+	// Opening is split in steps so openArchives() can run the slow part for all archives
+	// at once. open() only does the StormLib part and is safe to run on a pool thread,
+	// the others log, touch the GUI and look at the other archives.
+	void open();
+	void registerArchive();
+	void addPatches();
+	static void WINAPI openWork(void *context, DWORD index);
+
 public:
 	MPQArchive(wxString filename);
 	~MPQArchive();
 	bool isPartialMPQ(wxString filename);
 
+	// Opens those of the archives that exist and adds them to archives, in the given order.
+	// The archives are read in parallel on the ThreadPool, each wow-update archive is
+	// loaded once and shared by the patch chains of all archives it applies to.
+	static void openArchives(const wxArrayString &filenames, std::vector<MPQArchive*> &archives);
+
 	void close();
 };
 
@@ -50,9 +67,16 @@ class MPQFile
 	MPQFile(const MPQFile &f) {}
 	void operator=(const MPQFile &f) {}
 
+	// Reads name from the first archive that has it, true if one did.
+	bool openFromArchives(const wxString &name);
+	// openFile() without looking at prefetched files, what the prefetch jobs use
+	void readFile(wxString filename);
+	friend class PrefetchJob;
+
 public:
 	MPQFile():eof(false),buffer(0),pointer(0),size(0) {}
 	MPQFile(wxString filename);	// filenames are not case sensitive
+	// Safe to call from several threads at once, also for the same archive.
 	void openFile(wxString filename);
 	~MPQFile();
 	size_t read(void* dest, size_t bytes);
@@ -69,9 +93,36 @@ public:
 	static bool exists(wxString filename);
 	static int getSize(wxString filename); // Used to do a quick check to see if a file is corrupted
 	static wxString getArchive(wxString filename);
+	// Reads bytes from offset of the file into dest without reading the whole file, for
+	// headers and other small parts. Only the sectors holding the range are read and
+	// decompressed, files put together from wow-update patches are still read whole.
+	// Returns the number of bytes read, fewer at the end of the file and 0 if it's missing.
+	static size_t readRange(wxString filename, size_t offset, void *dest, size_t bytes);
+	// Identifies the data a filename currently resolves to (archive, block table entry and
+	// patched size), for caching things decoded from it. Empty for local and missing files.
+	static wxString getEntryKey(wxString filename);
+	// With useLocalFiles, the loose files in Import\ and the data directory are listed once
+	// and looked up from memory. Lists them again, for files added or removed since.
+	static void refreshLocalFiles();
 	bool isPartialMPQ(wxString filename);
 };
 
+// MPQPrefetch
+// Reads files on the ThreadPool ahead of them being opened, for the files a model is known
+// to need before it gets to them (.skin, .anim, textures). MPQFile::openFile and getSize
+// take the prefetched data instead of reading the file again. If a read hasn't started yet
+// when the file is opened, it's read on the spot as usual. Whatever wasn't opened by the
+// time the MPQPrefetch goes out of scope is dropped.
+class MPQPrefetch {
+public:
+	~MPQPrefetch();
+
+	void add(const wxString &filename);
+
+private:
+	std::vector<std::string> keys;
+};
+
 inline void flipcc(char *fcc)
 {
 	char t;
@@ -85,6 +136,9 @@ inline void flipcc(char *fcc)
 
 inline bool defaultFilterFunc(wxString) { return true; }
 void getFileLists(std::set<FileTreeItem> &dest, bool filterfunc(wxString) = defaultFilterFunc);
+// The files whose path starts with prefix and ends with ext, neither case sensitive, e.g.
+// all BLPs of a folder. Only goes through the files that match, not the whole listfile.
+void getFileListsByPrefix(std::set<FileTreeItem> &dest, const wxString &prefix, const wxString &ext = wxEmptyString);
 
 
 #endif
@@ -1,5 +1,6 @@
 #include "particle.h"
 #include "util.h"
+#include "profiler.h"
 
 #define MAX_PARTICLES 10000
 
@@ -22,6 +23,12 @@ T lifeRamp(float life, float mid, const T &a, const T &b, const T &c)
 }
 
 void ParticleSystem::init(MPQFile &f, ModelParticleEmitterDef &mta, uint32 *globals)
+{
+	init(f, mta, globals, model->bones + mta.bone, model->textures[mta.texture]);
+}
+
+// Same as above, but doesn't need the owning model to be loaded.
+void ParticleSystem::init(MPQFile &f, ModelParticleEmitterDef &mta, uint32 *globals, Bone *parentBone, GLuint tex)
 {
 	speed.init (mta.EmissionSpeed, f, globals);
 	variation.init (mta.SpeedVariation, f, globals);
@@ -55,7 +62,7 @@ void ParticleSystem::init(MPQFile &f, ModelParticleEmitterDef &mta, uint32 *glob
 	slowdown = mta.p.slowdown;
 	rotation = mta.p.rotation;
 	pos = fixCoordSystem(mta.pos);
-	texture = model->textures[mta.texture];
+	texture = tex;
 	blend = mta.blend;
 	rows = mta.rows;
 	if (rows == 0)
@@ -66,7 +73,7 @@ void ParticleSystem::init(MPQFile &f, ModelParticleEmitterDef &mta, uint32 *glob
 	ParticleType = mta.ParticleType;
 	//order = mta.s2;
 	order = mta.ParticleType>0 ? -1 : 0;
-	parent = model->bones + mta.bone;
+	parent = parentBone;
 
 	//transform = mta.flags & 1024;
 
@@ -139,6 +146,8 @@ void ParticleSystem::initTile(Vec2D *tc, int num)
 
 void ParticleSystem::update(float dt)
 {
+	PROFILE_SCOPE("ParticleSystem::update");
+
 	size_t l_manim = manim;
 	if (bZeroParticle)
 		l_manim = 0;
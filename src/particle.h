@@ -97,6 +97,7 @@ public:
 	~ParticleSystem() { delete emitter; }
 
 	void init(MPQFile &f, ModelParticleEmitterDef &mta, uint32 *globals);
+	void init(MPQFile &f, ModelParticleEmitterDef &mta, uint32 *globals, Bone *parentBone, GLuint tex);
 	void update(float dt);
 
 	void setup(size_t anim, size_t time);
@@ -0,0 +1,215 @@
+#include "profiler.h"
+
+#include <wx/log.h>
+#include <wx/filefn.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WINDOWS
+	#include <windows.h>
+#else
+	#include <sys/time.h>
+#endif
+
+bool Profiler::enabled = false;
+
+wxMutex Profiler::mutex;
+std::vector<Profiler::Event> Profiler::events;
+size_t Profiler::droppedEvents = 0;
+
+const char *Profiler::slotNames[PROFILER_MAX_SLOTS];
+size_t Profiler::numSlots = 0;
+double Profiler::frameTimes[PROFILER_MAX_SLOTS];
+double Profiler::history[PROFILER_FRAME_WINDOW][PROFILER_MAX_SLOTS];
+double Profiler::historyFrame[PROFILER_FRAME_WINDOW];
+size_t Profiler::historyPos = 0;
+size_t Profiler::historyCount = 0;
+double Profiler::frameStart = -1.0;
+
+void Profiler::Enable(bool enable)
+{
+	wxMutexLocker lock(mutex);
+	if (enable == enabled)
+		return;
+
+	Now(); // sets the time base
+	enabled = enable;
+	numSlots = 0;
+	historyPos = historyCount = 0;
+	frameStart = -1.0;
+	if (enable) {
+		events.clear();
+		droppedEvents = 0;
+	}
+}
+
+double Profiler::Now()
+{
+#ifdef _WINDOWS
+	static LARGE_INTEGER freq, base;
+	if (freq.QuadPart == 0) {
+		QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&base);
+	}
+	LARGE_INTEGER count;
+	QueryPerformanceCounter(&count);
+	return (double)(count.QuadPart - base.QuadPart) * 1000000.0 / (double)freq.QuadPart;
+#else
+	static struct timeval base;
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	if (base.tv_sec == 0 && base.tv_usec == 0)
+		base = t;
+	return (t.tv_sec - base.tv_sec) * 1000000.0 + (t.tv_usec - base.tv_usec);
+#endif
+}
+
+// Only called with the mutex held.
+size_t Profiler::GetSlot(const char *name)
+{
+	for (size_t i=0; i<numSlots; i++) {
+		if (slotNames[i] == name)
+			return i;
+	}
+	if (numSlots == PROFILER_MAX_SLOTS)
+		return PROFILER_MAX_SLOTS;
+
+	slotNames[numSlots] = name;
+	frameTimes[numSlots] = 0;
+	for (size_t i=0; i<PROFILER_FRAME_WINDOW; i++)
+		history[i][numSlots] = 0;
+	return numSlots++;
+}
+
+void Profiler::Record(const char *name, const std::string &detail, double start, double end)
+{
+	wxMutexLocker lock(mutex);
+	if (!enabled)
+		return;
+
+	size_t slot = GetSlot(name);
+	if (slot < PROFILER_MAX_SLOTS)
+		frameTimes[slot] += end - start;
+
+	if (events.size() < PROFILER_MAX_EVENTS) {
+		Event e;
+		e.name = name;
+		e.detail = detail;
+		e.thread = wxThread::GetCurrentId();
+		e.start = start;
+		e.duration = end - start;
+		events.push_back(e);
+	} else {
+		droppedEvents++;
+	}
+}
+
+void Profiler::NextFrame()
+{
+	if (!enabled)
+		return;
+
+	double now = Now();
+	wxMutexLocker lock(mutex);
+
+	if (frameStart >= 0) {
+		for (size_t i=0; i<numSlots; i++) {
+			history[historyPos][i] = frameTimes[i];
+			frameTimes[i] = 0;
+		}
+		historyFrame[historyPos] = now - frameStart;
+		historyPos = (historyPos + 1) % PROFILER_FRAME_WINDOW;
+		if (historyCount < PROFILER_FRAME_WINDOW)
+			historyCount++;
+	} else {
+		for (size_t i=0; i<numSlots; i++)
+			frameTimes[i] = 0;
+	}
+	frameStart = now;
+}
+
+wxString Profiler::GetFrameSummary()
+{
+	wxMutexLocker lock(mutex);
+	if (historyCount == 0)
+		return wxEmptyString;
+
+	double frame = 0;
+	for (size_t f=0; f<historyCount; f++)
+		frame += historyFrame[f];
+
+	wxString summary = wxString::Format(wxT("Frame %.2fms"), frame / historyCount / 1000.0);
+	for (size_t i=0; i<numSlots; i++) {
+		double total = 0;
+		for (size_t f=0; f<historyCount; f++)
+			total += history[f][i];
+		summary += wxString::Format(wxT(" | %s %.2f"), wxString(slotNames[i], wxConvUTF8).c_str(), total / historyCount / 1000.0);
+	}
+	return summary;
+}
+
+void Profiler::ResetTrace()
+{
+	wxMutexLocker lock(mutex);
+	events.clear();
+	droppedEvents = 0;
+}
+
+static void WriteJSONString(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for (; *s; s++) {
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+bool Profiler::SaveChromeTrace(wxString filename)
+{
+	wxMutexLocker lock(mutex);
+
+	// wxFopen takes the name the way the platform wants it, wide on Windows
+	FILE *f = wxFopen(filename, wxT("w"));
+	if (!f)
+		return false;
+
+	fprintf(f, "{\"traceEvents\":[\n");
+	for (size_t i=0; i<events.size(); i++) {
+		const Event &e = events[i];
+		fprintf(f, "{\"name\":");
+		WriteJSONString(f, e.name);
+		fprintf(f, ",\"cat\":\"wmv\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.1f,\"dur\":%.1f", e.thread, e.start, e.duration);
+		if (!e.detail.empty()) {
+			fprintf(f, ",\"args\":{\"file\":");
+			WriteJSONString(f, e.detail.c_str());
+			fprintf(f, "}");
+		}
+		fprintf(f, "}%s\n", (i+1 < events.size()) ? "," : "");
+	}
+	fprintf(f, "],\n\"displayTimeUnit\":\"ms\",\n\"otherData\":{\"droppedEvents\":%u}}\n", (unsigned int)droppedEvents);
+
+	bool ok = (ferror(f) == 0);
+	fclose(f);
+
+	wxLogMessage(wxT("Profiler: wrote %u events to %s (%u dropped)"), (unsigned int)events.size(), filename.c_str(), (unsigned int)droppedEvents);
+	return ok;
+}
+
+void ProfileScope::End()
+{
+	double end = Profiler::Now();
+	std::string file;
+	if (detail) {
+		const wxCharBuffer buf = detail->mb_str(wxConvUTF8);
+		if (buf.data())
+			file = buf.data();
+	}
+	Profiler::Record(name, file, start, end);
+}
@@ -0,0 +1,97 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// wxWidgets
+#include <wx/string.h>
+#include <wx/thread.h>
+
+// STL
+#include <string>
+#include <vector>
+
+// Max number of distinct scope names shown in the per frame breakdown.
+#define PROFILER_MAX_SLOTS		24
+// Number of frames the breakdown is averaged over.
+#define PROFILER_FRAME_WINDOW	60
+// Trace events kept for the Chrome trace dump, anything after that is dropped.
+#define PROFILER_MAX_EVENTS		250000
+
+// Profiler
+// Collects timings from ProfileScope objects placed in the per frame and load time hot
+// spots (ModelCanvas::tick, Model::animate, TextureManager::add, MPQFile::openFile, ...).
+// While disabled a scope costs a single test of Profiler::enabled.
+//
+// Two views of the same data:
+//  - a rolling per frame breakdown (average over the last PROFILER_FRAME_WINDOW frames),
+//  - a trace of individual scopes since the last ResetTrace() (done on every model load),
+//    which can be saved in the Chrome trace format (open it with chrome://tracing).
+class Profiler {
+public:
+	static bool enabled;
+
+	static void Enable(bool enable);
+
+	// Microseconds since the profiler was first used.
+	static double Now();
+
+	static void Record(const char *name, const std::string &detail, double start, double end);
+
+	// Marks the start of a new frame, closing off the previous one.
+	static void NextFrame();
+	// Average time per frame of each scope, in milliseconds, for the status bar.
+	static wxString GetFrameSummary();
+
+	// Forget the recorded trace, used at the start of a load.
+	static void ResetTrace();
+	static bool SaveChromeTrace(wxString filename);
+
+private:
+	struct Event {
+		const char *name;
+		std::string detail;
+		unsigned long thread;
+		double start, duration;
+	};
+
+	static size_t GetSlot(const char *name);
+
+	static wxMutex mutex;
+	static std::vector<Event> events;
+	static size_t droppedEvents;
+
+	static const char *slotNames[PROFILER_MAX_SLOTS];
+	static size_t numSlots;
+	static double frameTimes[PROFILER_MAX_SLOTS];
+	static double history[PROFILER_FRAME_WINDOW][PROFILER_MAX_SLOTS];
+	static double historyFrame[PROFILER_FRAME_WINDOW];
+	static size_t historyPos, historyCount;
+	static double frameStart;
+};
+
+// Times the enclosing block while the profiler is enabled.
+// name must be a string literal (it's compared and stored by pointer).
+class ProfileScope {
+public:
+	ProfileScope(const char *name) : name(name), detail(0), start(Profiler::enabled ? Profiler::Now() : -1.0) {}
+	ProfileScope(const char *name, const wxString &detail) : name(name), detail(&detail), start(Profiler::enabled ? Profiler::Now() : -1.0) {}
+
+	~ProfileScope()
+	{
+		if (start >= 0)
+			End();
+	}
+
+private:
+	void End();
+
+	const char *name;
+	const wxString *detail;
+	double start;
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_SCOPE_DETAIL(name, detail) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name, detail)
+
+#endif
@@ -22,6 +22,7 @@ BEGIN_EVENT_TABLE(Settings_Page1, wxWindow)
 	EVT_CHECKBOX(ID_SETTINGS_ZEROPARTICLE, Settings_Page1::OnCheck)
 	EVT_CHECKBOX(ID_SETTINGS_LOCALFILES, Settings_Page1::OnCheck)
 	EVT_CHECKBOX(ID_SETTINGS_ALTERNATE, Settings_Page1::OnCheck)
+	EVT_CHECKBOX(ID_SETTINGS_TEXTURECACHE, Settings_Page1::OnCheck)
 END_EVENT_TABLE()
 
 
@@ -48,6 +49,7 @@ Settings_Page1::Settings_Page1(wxWindow* parent, wxWindowID id)
 	chkbox[CHECK_LOCALFILES] = new wxCheckBox(this, ID_SETTINGS_LOCALFILES, _("Use Local Files"), wxPoint(5,100), wxDefaultSize, 0);
 	chkbox[CHECK_RANDOMSKIN] = new wxCheckBox(this, ID_SETTINGS_RANDOMSKIN, _("Random Skins"), wxPoint(150,50), wxDefaultSize, 0);
 	chkbox[CHECK_HIDEHELMET] = new wxCheckBox(this, ID_SETTINGS_HIDEHELMET, _("Hide Helmet"), wxPoint(150,75), wxDefaultSize, 0);
+	chkbox[CHECK_TEXTURECACHE] = new wxCheckBox(this, ID_SETTINGS_TEXTURECACHE, _("Texture Cache"), wxPoint(150,100), wxDefaultSize, 0);
 
 	lbl2 = new wxStaticText(this, wxID_ANY, _("MPQ Archives order and files to load"), wxPoint(0,140), wxDefaultSize, 0);
 	mpqList = new wxListBox(this, wxID_ANY, wxPoint(0,160), wxSize(380, 190), mpqArchives, wxLB_SINGLE|wxLB_HSCROLL, wxDefaultValidator);
@@ -125,6 +127,10 @@ void Settings_Page1::OnCheck(wxCommandEvent &event)
 		useRandomLooks = event.IsChecked();
 	} else if (id==ID_SETTINGS_LOCALFILES) {
 		useLocalFiles = event.IsChecked();
+		// pick up files put into Import\ since they were last listed
+		if (useLocalFiles)
+			MPQFile::refreshLocalFiles();
+		BLPInfo::clearCache();
 	} else if (id==ID_SETTINGS_HIDEHELMET) {
 		bHideHelmet = event.IsChecked();
 	} else if (id==ID_SETTINGS_SHOWPARTICLE) {
@@ -133,6 +139,8 @@ void Settings_Page1::OnCheck(wxCommandEvent &event)
 		bZeroParticle = event.IsChecked();
 	} else if (id==ID_SETTINGS_ALTERNATE) {
 		bAlternate = event.IsChecked();
+	} else if (id==ID_SETTINGS_TEXTURECACHE) {
+		useTextureCache = event.IsChecked();
 	}
 }
 
@@ -144,6 +152,7 @@ void Settings_Page1::Update()
 	chkbox[CHECK_SHOWPARTICLE]->SetValue(bShowParticle);
 	chkbox[CHECK_ZEROPARTICLE]->SetValue(bZeroParticle);
 	chkbox[CHECK_ALTERNATE]->SetValue(bAlternate);
+	chkbox[CHECK_TEXTURECACHE]->SetValue(useTextureCache);
 
 	mpqList->Set(mpqArchives);
 }
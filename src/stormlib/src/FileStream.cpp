@@ -98,7 +98,12 @@ static bool IsPartHeader(PPART_FILE_HEADER pPartHdr)
 // Non-Windows support for LastError
 
 #ifndef PLATFORM_WINDOWS
+// Kept per thread, like the Windows one, as archives can be read from several threads
+#if defined(__GNUC__)
+static __thread int nLastError = ERROR_SUCCESS;
+#else
 static int nLastError = ERROR_SUCCESS;
+#endif
 
 int GetLastError()
 {
@@ -448,24 +453,26 @@ static bool File_Read(
     if(pByteOffset == NULL)
         pByteOffset = &pStream->RawFilePos;
 
+    // All reads are positional, they don't depend on the file pointer of the handle.
+    // That way several threads can read the same archive at once.
+
 #ifdef PLATFORM_WINDOWS
     {
-        // If the byte offset is different from the current file position,
-        // we have to update the file position
-        if(*pByteOffset != pStream->RawFilePos)
-        {
-            LONG ByteOffsetHi = (LONG)(*pByteOffset >> 32);
-            LONG ByteOffsetLo = (LONG)(*pByteOffset);
-
-            SetFilePointer(pStream->hFile, ByteOffsetLo, &ByteOffsetHi, FILE_BEGIN);
-            pStream->RawFilePos = *pByteOffset;
-        }
-
-        // Read the data
+        // Read the data. On a handle opened for synchronous I/O,
+        // the OVERLAPPED structure only gives the position to read from.
         if(dwBytesToRead != 0)
         {
-            if(!ReadFile(pStream->hFile, pvBuffer, dwBytesToRead, &dwBytesRead, NULL))
-                return false;
+            OVERLAPPED Overlapped;
+
+            memset(&Overlapped, 0, sizeof(OVERLAPPED));
+            Overlapped.Offset = (DWORD)(*pByteOffset);
+            Overlapped.OffsetHigh = (DWORD)(*pByteOffset >> 32);
+            if(!ReadFile(pStream->hFile, pvBuffer, dwBytesToRead, &dwBytesRead, &Overlapped))
+            {
+                if(GetLastError() != ERROR_HANDLE_EOF)
+                    return false;
+                dwBytesRead = 0;
+            }
         }
     }
 #endif
@@ -476,18 +483,10 @@ static bool File_Read(
         ByteCount nBytesRead = 0;
         OSErr theErr;
 
-        // If the byte offset is different from the current file position,
-        // we have to update the file position
-        if(*pByteOffset != pStream->RawFilePos)
-        {
-            FSSetForkPosition((short)(long)pStream->hFile, fsFromStart, (SInt64)(*pByteOffset));
-            pStream->RawFilePos = *pByteOffset;
-        }
-
         // Read the data
         if(nBytesToRead != 0)
         {
-            theErr = FSReadFork((short)(long)pStream->hFile, fsAtMark, 0, nBytesToRead, pvBuffer, &nBytesRead);
+            theErr = FSReadFork((short)(long)pStream->hFile, fsFromStart, (SInt64)(*pByteOffset), nBytesToRead, pvBuffer, &nBytesRead);
             if (theErr != noErr && theErr != eofErr)
             {
                 nLastError = theErr;
@@ -502,32 +501,31 @@ static bool File_Read(
     {
         ssize_t bytes_read;
 
-        // If the byte offset is different from the current file position,
-        // we have to update the file position
-        if(*pByteOffset != pStream->RawFilePos)
-        {
-            lseek64((intptr_t)pStream->hFile, (off64_t)(*pByteOffset), SEEK_SET);
-            pStream->RawFilePos = *pByteOffset;
-        }
-
-        // Perform the read operation
-        if(dwBytesToRead != 0)
+        // Perform the read operation. pread() may return less than asked for
+        // without being at the end of the file, so keep going until it does.
+        while(dwBytesRead < dwBytesToRead)
         {
-            bytes_read = read((intptr_t)pStream->hFile, pvBuffer, (size_t)dwBytesToRead);
+            bytes_read = pread64((intptr_t)pStream->hFile, (LPBYTE)pvBuffer + dwBytesRead, (size_t)(dwBytesToRead - dwBytesRead), (off64_t)(*pByteOffset + dwBytesRead));
             if(bytes_read == -1)
             {
+                if(errno == EINTR)
+                    continue;
                 nLastError = errno;
                 return false;
             }
+            if(bytes_read == 0)
+                break;
 
-            dwBytesRead = (DWORD)(size_t)bytes_read;
+            dwBytesRead += (DWORD)(size_t)bytes_read;
         }
     }
 #endif                    
 
-    // Increment the current file position by number of bytes read
+    // Increment the current file position by number of bytes read, if the read was from there.
+    // Reads at a given offset leave it alone, other threads may be reading the same stream.
     // If the number of bytes read doesn't match to required amount, return false
-    pStream->RawFilePos = *pByteOffset + dwBytesRead;
+    if(pByteOffset == &pStream->RawFilePos)
+        pStream->RawFilePos += dwBytesRead;
     if(dwBytesRead != dwBytesToRead)
         SetLastError(ERROR_HANDLE_EOF);
     return (dwBytesRead == dwBytesToRead);
@@ -548,21 +546,17 @@ static bool File_Write(TFileStream * pStream, ULONGLONG * pByteOffset, const voi
     if(pByteOffset == NULL)
         pByteOffset = &pStream->RawFilePos;
 
+    // Positional like File_Read, which doesn't move the file pointer of the handle
+
 #ifdef PLATFORM_WINDOWS
     {
-        // If the byte offset is different from the current file position,
-        // we have to update the file position
-        if(*pByteOffset != pStream->RawFilePos)
-        {
-            LONG ByteOffsetHi = (LONG)(*pByteOffset >> 32);
-            LONG ByteOffsetLo = (LONG)(*pByteOffset);
-
-            SetFilePointer(pStream->hFile, ByteOffsetLo, &ByteOffsetHi, FILE_BEGIN);
-            pStream->RawFilePos = *pByteOffset;
-        }
+        OVERLAPPED Overlapped;
 
-        // Read the data
-        if(!WriteFile(pStream->hFile, pvBuffer, dwBytesToWrite, &dwBytesWritten, NULL))
+        // Write the data
+        memset(&Overlapped, 0, sizeof(OVERLAPPED));
+        Overlapped.Offset = (DWORD)(*pByteOffset);
+        Overlapped.OffsetHigh = (DWORD)(*pByteOffset >> 32);
+        if(!WriteFile(pStream->hFile, pvBuffer, dwBytesToWrite, &dwBytesWritten, &Overlapped))
             return false;
     }
 #endif
@@ -573,15 +567,7 @@ static bool File_Write(TFileStream * pStream, ULONGLONG * pByteOffset, const voi
         ByteCount nBytesWritten = 0;
         OSErr theErr;
 
-        // If the byte offset is different from the current file position,
-        // we have to update the file position
-        if(*pByteOffset != pStream->RawFilePos)
-        {
-            FSSetForkPosition((short)(long)pStream->hFile, fsFromStart, (SInt64)(*pByteOffset));
-            pStream->RawFilePos = *pByteOffset;
-        }
-
-        theErr = FSWriteFork((short)(long)pStream->hFile, fsAtMark, 0, nBytesToWrite, pvBuffer, &nBytesWritten);
+        theErr = FSWriteFork((short)(long)pStream->hFile, fsFromStart, (SInt64)(*pByteOffset), nBytesToWrite, pvBuffer, &nBytesWritten);
         if (theErr != noErr)
         {
             nLastError = theErr;
@@ -595,16 +581,8 @@ static bool File_Write(TFileStream * pStream, ULONGLONG * pByteOffset, const voi
     {
         ssize_t bytes_written;
 
-        // If the byte offset is different from the current file position,
-        // we have to update the file position
-        if(*pByteOffset != pStream->RawFilePos)
-        {
-            lseek64((intptr_t)pStream->hFile, (off64_t)(*pByteOffset), SEEK_SET);
-            pStream->RawFilePos = *pByteOffset;
-        }
-
-        // Perform the read operation
-        bytes_written = write((intptr_t)pStream->hFile, pvBuffer, (size_t)dwBytesToWrite);
+        // Perform the write operation
+        bytes_written = pwrite64((intptr_t)pStream->hFile, pvBuffer, (size_t)dwBytesToWrite, (off64_t)(*pByteOffset));
         if(bytes_written == -1)
         {
             nLastError = errno;
@@ -833,8 +811,9 @@ static bool PartFile_Read(TPartFileStream * pStream, ULONGLONG * pByteOffset, vo
         dwPartIndex++;
     }
 
-    // Move the file position by the number of bytes read
-    pStream->VirtualPos = *pByteOffset + dwBytesRead;
+    // Move the file position by the number of bytes read, if the read was from there
+    if(pByteOffset == &pStream->VirtualPos)
+        pStream->VirtualPos += dwBytesRead;
     if(dwBytesRead != dwBytesToRead)
         SetLastError(nFailReason);
     return (dwBytesRead == dwBytesToRead);
@@ -1105,6 +1084,10 @@ static bool EncryptedFile_Read(
             // Copy the decrypted data
             memcpy(pvBuffer, pbMpqData + dwOffsetInCache, dwBytesToRead);
             bResult = true;
+
+            // File_Read was given an offset, so the position is moved here
+            if(pByteOffset == NULL)
+                pStream->RawFilePos = ByteOffset + dwBytesToRead;
         }
         else
         {
@@ -1305,8 +1288,9 @@ TFileStream * FileStream_OpenFile(const TCHAR * szFileName, bool bWriteAccess)
                 memset(pPartStream, 0, nStructLength);
                 memcpy(pPartStream, pStream, sizeof(TFileStream));
 
-                // Load the block map
-                if(!FileStream_Read(pPartStream, NULL, pPartStream->PartMap, BlockCount * sizeof(PART_FILE_MAP_ENTRY)))
+                // Load the block map, it follows the header
+                ByteOffset = sizeof(PART_FILE_HEADER);
+                if(!FileStream_Read(pPartStream, &ByteOffset, pPartStream->PartMap, BlockCount * sizeof(PART_FILE_MAP_ENTRY)))
                 {
                     FileStream_Close(pStream);
                     STORM_FREE(pPartStream);
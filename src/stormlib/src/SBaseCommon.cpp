@@ -1345,10 +1345,10 @@ int WriteMpqDataMD5(
         dwRawDataSize -= dwToRead;
     }
 
-    // Write the array od MD5's to the file
+    // Write the array od MD5's to the file, right after the data
     if(nError == ERROR_SUCCESS)
     {
-        if(!FileStream_Write(pStream, NULL, md5_array, dwMd5ArraySize))
+        if(!FileStream_Write(pStream, &RawDataOffs, md5_array, dwMd5ArraySize))
             nError = GetLastError();
     }
 
@@ -1391,10 +1391,28 @@ void FreeMPQArchive(TMPQArchive *& ha)
 {
     if(ha != NULL)
     {
+        // An archive shared by patch chains stays until it's been closed
+        // and every patch chain using it is freed
+        if(ha->dwShareCount > 0)
+        {
+            ha->dwShareCount--;
+            ha = NULL;
+            return;
+        }
+
         // First of all, free the patch archive, if any
         if(ha->haPatch != NULL)
             FreeMPQArchive(ha->haPatch);
 
+        // A shared patch archive only owns its copy of the archive structure
+        if(ha->haShared != NULL)
+        {
+            FreeMPQArchive(ha->haShared);
+            STORM_FREE(ha);
+            ha = NULL;
+            return;
+        }
+
         // Free the file names from the file table
         if(ha->pFileTable != NULL)
         {
@@ -1455,23 +1455,27 @@ TFileEntry * GetFileEntryByIndex(TMPQArchive * ha, DWORD dwIndex)
 
 void AllocateFileName(TFileEntry * pFileEntry, const char * szFileName)
 {
+    char * szOldName;
+
     // Sanity check
     assert(pFileEntry != NULL);
+    szOldName = pFileEntry->szFileName;
 
-    // If the file name is pseudo file name, free it at this point
-    if(IsPseudoFileName(pFileEntry->szFileName, NULL))
+    // Only allocate new file name if it's not there yet, or if it's a pseudo file name.
+    // Files of the same archive can be opened on several threads at once,
+    // so the name is only replaced if no other thread did it in the meantime.
+    // A name that has been set is never freed here, other threads may still be reading it.
+    // A replaced pseudo name is left allocated, that only happens once per file entry.
+    if(szOldName == NULL || IsPseudoFileName(szOldName, NULL))
     {
-        if(pFileEntry->szFileName != NULL)
-            STORM_FREE(pFileEntry->szFileName);
-        pFileEntry->szFileName = NULL;
-    }
+        char * szNewName = STORM_ALLOC(char, strlen(szFileName) + 1);
 
-    // Only allocate new file name if it's not there yet
-    if(pFileEntry->szFileName == NULL)
-    {
-        pFileEntry->szFileName = STORM_ALLOC(char, strlen(szFileName) + 1);
-        if(pFileEntry->szFileName != NULL)
-            strcpy(pFileEntry->szFileName, szFileName);
+        if(szNewName != NULL)
+        {
+            strcpy(szNewName, szFileName);
+            if(!STORM_CAS_POINTER(pFileEntry->szFileName, szOldName, szNewName))
+                STORM_FREE(szNewName);
+        }
     }
 }
 
@@ -277,7 +277,9 @@ static int CopyMpqFileSectors(
         dwCrcLength = hf->SectorOffsets[hf->dwSectorCount + 1] - hf->SectorOffsets[hf->dwSectorCount];
         if(dwCrcLength != 0)
         {
-            if(!FileStream_Read(ha->pStream, NULL, hf->SectorChksums, dwCrcLength))
+            // They follow the last sector
+            CalculateRawSectorOffset(RawFilePos, hf, hf->SectorOffsets[hf->dwSectorCount]);
+            if(!FileStream_Read(ha->pStream, &RawFilePos, hf->SectorChksums, dwCrcLength))
                 nError = GetLastError();
 
             if(!FileStream_Write(pNewStream, NULL, hf->SectorChksums, dwCrcLength))
@@ -437,6 +437,42 @@ static int ApplyMpqPatch(
     return nError;
 }
 
+// Saves the prefix for patch file names.
+// Make sure that there is backslash after it
+static void SetPatchPrefix(TMPQArchive * haPatch, const char * szPatchPathPrefix, size_t nLength)
+{
+    if(nLength > 0)
+    {
+        strcpy(haPatch->szPatchPrefix, szPatchPathPrefix);
+        if(haPatch->szPatchPrefix[nLength - 1] != '\\')
+        {
+            haPatch->szPatchPrefix[nLength++] = '\\';
+            haPatch->szPatchPrefix[nLength] = 0;
+        }
+        haPatch->cchPatchPrefix = nLength;
+    }
+}
+
+// Adds the patch archive to the end of the list of patches to the original MPQ
+static int AppendPatchArchive(TMPQArchive * ha, TMPQArchive * haPatch)
+{
+    while(ha != NULL)
+    {
+        if(ha->haPatch == NULL)
+        {
+            haPatch->haBase = ha;
+            ha->haPatch = haPatch;
+            return ERROR_SUCCESS;
+        }
+
+        // Move to the next archive
+        ha = ha->haPatch;
+    }
+
+    // Should never happen
+    return ERROR_CAN_NOT_COMPLETE;
+}
+
 //-----------------------------------------------------------------------------
 // Public functions (StormLib internals)
 
@@ -577,35 +613,103 @@ bool WINAPI SFileOpenPatchArchive(
             return false;
         haPatch = (TMPQArchive *)hPatchMpq;
 
-        // Save the prefix for patch file names.
-        // Make sure that there is backslash after it
-        if(nLength > 0)
-        {
-            strcpy(haPatch->szPatchPrefix, szPatchPathPrefix);
-            if(haPatch->szPatchPrefix[nLength - 1] != '\\')
-            {
-                haPatch->szPatchPrefix[nLength++] = '\\';
-                haPatch->szPatchPrefix[nLength] = 0;
-            }
-            haPatch->cchPatchPrefix = nLength;
-        }
+        // Save the prefix for patch file names and add the patch archive
+        // to the list of patches to the original MPQ
+        SetPatchPrefix(haPatch, szPatchPathPrefix, nLength);
+        nError = AppendPatchArchive(ha, haPatch);
+        if(nError == ERROR_SUCCESS)
+            return true;
+    }
 
-        // Now add the patch archive to the list of patches to the original MPQ
-        while(ha != NULL)
-        {
-            if(ha->haPatch == NULL)
-            {
-                haPatch->haBase = ha;
-                ha->haPatch = haPatch;
-                return true;
-            }
+    SetLastError(nError);
+    return false;
+}
 
-            // Move to the next archive
-            ha = ha->haPatch;
-        }
+//-----------------------------------------------------------------------------
+// SFileAddPatchArchive
+//
+// Same as SFileOpenPatchArchive, but the patch MPQ is an archive that is open
+// already. The patch uses the archive's stream and tables, so a patch MPQ that
+// applies to many base MPQs is only loaded once. The archive's structures stay
+// until it is closed and all MPQs it has been added to are closed too.
+//
+
+bool WINAPI SFileAddPatchArchive(
+    HANDLE hMpq,
+    HANDLE hPatchMpq,
+    const char * szPatchPathPrefix,
+    DWORD dwFlags)
+{
+    TMPQArchive * haShared = (TMPQArchive *)hPatchMpq;
+    TMPQArchive * haPatch;
+    TMPQArchive * ha = (TMPQArchive *)hMpq;
+    size_t nLength = 0;
+    char szPatchPrefixBuff[MPQ_PATCH_PREFIX_LEN];
+    int nError = ERROR_SUCCESS;
 
-        // Should never happen
-        nError = ERROR_CAN_NOT_COMPLETE;
+    // Keep compiler happy
+    dwFlags = dwFlags;
+
+    // Verify input parameters
+    if(!IsValidMpqHandle(ha) || !IsValidMpqHandle(haShared))
+    {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return false;
+    }
+
+    // Another patch that shares an archive, use that archive
+    if(haShared->haShared != NULL)
+        haShared = haShared->haShared;
+
+    // If the user didn't give the patch prefix, get default one
+    if(szPatchPathPrefix == NULL)
+    {
+        GetDefaultPatchPrefix(ha->pStream->szFileName, haShared->pStream->szFileName, szPatchPrefixBuff);
+        szPatchPathPrefix = szPatchPrefixBuff;
+    }
+
+    // Save length of the patch prefix
+    nLength = strlen(szPatchPathPrefix);
+    if(nLength > MPQ_PATCH_PREFIX_LEN - 2)
+        nError = ERROR_INVALID_PARAMETER;
+
+    // Neither of the archives may be open for write,
+    // see SFileOpenPatchArchive
+    if(nError == ERROR_SUCCESS)
+    {
+        if((ha->pStream->StreamFlags & STREAM_FLAG_READ_ONLY) == 0 || (haShared->pStream->StreamFlags & STREAM_FLAG_READ_ONLY) == 0)
+            nError = ERROR_ACCESS_DENIED;
+    }
+
+    if(nError == ERROR_SUCCESS)
+    {
+        haPatch = STORM_ALLOC(TMPQArchive, 1);
+        if(haPatch == NULL)
+            nError = ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    if(nError == ERROR_SUCCESS)
+    {
+        // Copy of the archive structure with its own place in the patch chain.
+        // The pointers to the stream and the tables stay the same.
+        memcpy(haPatch, haShared, sizeof(TMPQArchive));
+        haPatch->pHeader = (TMPQHeader *)haPatch->HeaderData;
+        if(haShared->pUserData != NULL)
+            haPatch->pUserData = &haPatch->UserData;
+        haPatch->haPatch = NULL;
+        haPatch->haBase = NULL;
+        haPatch->haShared = haShared;
+        haPatch->dwShareCount = 0;
+        haPatch->szPatchPrefix[0] = 0;
+        haPatch->cchPatchPrefix = 0;
+        haShared->dwShareCount++;
+
+        SetPatchPrefix(haPatch, szPatchPathPrefix, nLength);
+        nError = AppendPatchArchive(ha, haPatch);
+        if(nError == ERROR_SUCCESS)
+            return true;
+
+        FreeMPQArchive(haPatch);
     }
 
     SetLastError(nError);
@@ -25,6 +25,28 @@ struct TFileHeader2Ext
     const char * szExt;                 // Supplied extension, if the condition is true
 };
 
+struct TMPQSector
+{
+    LPBYTE pbInSector;                  // Raw (compressed/encrypted) sector data
+    LPBYTE pbOutSector;                 // Where the decompressed sector goes
+    DWORD dwRawBytes;                   // Raw size of the sector
+    DWORD dwBytes;                      // Decompressed size of the sector
+    DWORD dwIndex;                      // Index of the sector in the file
+    int nError;                         // Result of processing the sector
+};
+
+struct TMPQSectorWork
+{
+    TMPQFile * hf;                      // File the sectors belong to
+    TMPQSector * pSectors;              // Sectors handed to the parallel callback
+};
+
+//-----------------------------------------------------------------------------
+// Local variables
+
+static SFILE_PARALLEL_CALLBACK ParallelCallback = NULL;
+static DWORD dwParallelMinSectors = 0;
+
 //-----------------------------------------------------------------------------
 // Local functions
 
@@ -116,6 +138,91 @@ static bool GetFilePatchChain(TMPQFile * hf, void * pvFileInfo, DWORD cbFileInfo
     return true;
 }
 
+//  hf            - MPQ File handle.
+//  pSector       - The sector's place in the raw and the target buffer.
+//                  The result is also stored in pSector->nError.
+//  Does not modify the file handle except for detecting its key, so sectors
+//  of the same file with a known key can be processed on several threads.
+static int ReadMpqSector(TMPQFile * hf, TMPQSector * pSector)
+{
+    TFileEntry * pFileEntry = hf->pFileEntry;
+    LPBYTE pbInSector = pSector->pbInSector;
+    LPBYTE pbOutSector = pSector->pbOutSector;
+    DWORD dwRawBytesInThisSector = pSector->dwRawBytes;
+    DWORD dwBytesInThisSector = pSector->dwBytes;
+    DWORD dwIndex = pSector->dwIndex;
+    int nError = ERROR_SUCCESS;
+
+    // If the file is encrypted, we have to decrypt the sector
+    if(pFileEntry->dwFlags & MPQ_FILE_ENCRYPTED)
+    {
+        BSWAP_ARRAY32_UNSIGNED(pbInSector, dwRawBytesInThisSector);
+
+        // If we don't know the key, try to detect it by file content
+        if(hf->dwFileKey == 0)
+        {
+            hf->dwFileKey = DetectFileKeyByContent(pbInSector, dwBytesInThisSector);
+            if(hf->dwFileKey == 0)
+                return pSector->nError = ERROR_UNKNOWN_FILE_KEY;
+        }
+
+        DecryptMpqBlock(pbInSector, dwRawBytesInThisSector, hf->dwFileKey + dwIndex);
+        BSWAP_ARRAY32_UNSIGNED(pbInSector, dwRawBytesInThisSector);
+    }
+
+    // If the file has sector CRC check turned on, perform it
+    if(hf->bCheckSectorCRCs && hf->SectorChksums != NULL)
+    {
+        DWORD dwAdlerExpected = hf->SectorChksums[dwIndex];
+        DWORD dwAdlerValue = 0;
+
+        // We can only check sector CRC when it's not zero
+        // Neither can we check it if it's 0xFFFFFFFF.
+        if(dwAdlerExpected != 0 && dwAdlerExpected != 0xFFFFFFFF)
+        {
+            dwAdlerValue = adler32(0, pbInSector, dwRawBytesInThisSector);
+            if(dwAdlerValue != dwAdlerExpected)
+                return pSector->nError = ERROR_CHECKSUM_ERROR;
+        }
+    }
+
+    // If the sector is really compressed, decompress it.
+    // WARNING : Some sectors may not be compressed, it can be determined only
+    // by comparing uncompressed and compressed size !!!
+    if(dwRawBytesInThisSector < dwBytesInThisSector)
+    {
+        int cbOutSector = dwBytesInThisSector;
+        int cbInSector = dwRawBytesInThisSector;
+        int nResult = 0;
+
+        // Is the file compressed by PKWARE Data Compression Library ?
+        if(pFileEntry->dwFlags & MPQ_FILE_IMPLODE)
+            nResult = SCompExplode((char *)pbOutSector, &cbOutSector, (char *)pbInSector, cbInSector);
+
+        // Is the file compressed by Blizzard's multiple compression ?
+        if(pFileEntry->dwFlags & MPQ_FILE_COMPRESS)
+            nResult = SCompDecompress((char *)pbOutSector, &cbOutSector, (char *)pbInSector, cbInSector);
+
+        // Did the decompression fail ?
+        if(nResult == 0)
+            nError = ERROR_FILE_CORRUPT;
+    }
+    else
+    {
+        if(pbOutSector != pbInSector)
+            memcpy(pbOutSector, pbInSector, dwBytesInThisSector);
+    }
+
+    return pSector->nError = nError;
+}
+
+static void WINAPI ReadMpqSectorWork(void * pvWorkContext, DWORD dwIndex)
+{
+    TMPQSectorWork * pWork = (TMPQSectorWork *)pvWorkContext;
+
+    ReadMpqSector(pWork->hf, &pWork->pSectors[dwIndex]);
+}
+
 //  hf            - MPQ File handle.
 //  pbBuffer      - Pointer to target buffer to store sectors.
 //  dwByteOffset  - Position of sector in the file (relative to file begin)
@@ -135,6 +242,7 @@ static int ReadMpqSectors(TMPQFile * hf, LPBYTE pbBuffer, DWORD dwByteOffset, DW
     DWORD dwSectorIndex = dwByteOffset / ha->dwSectorSize;
     DWORD dwSectorsDone = 0;
     DWORD dwBytesRead = 0;
+    TMPQSector * pSectors;
     int nError = ERROR_SUCCESS;
 
     // Note that dwByteOffset must be aligned to size of one sector
@@ -199,7 +307,15 @@ static int ReadMpqSectors(TMPQFile * hf, LPBYTE pbBuffer, DWORD dwByteOffset, DW
         return GetLastError();
     dwBytesRead = 0;
 
-    // Now we have to decrypt and decompress all file sectors that have been loaded
+    // Lay out where every sector is in the raw and in the target buffer
+    pSectors = STORM_ALLOC(TMPQSector, dwSectorsToRead);
+    if(pSectors == NULL && dwSectorsToRead != 0)
+    {
+        if(pbRawSector != NULL)
+            STORM_FREE(pbRawSector);
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
     for(DWORD i = 0; i < dwSectorsToRead; i++)
     {
         DWORD dwRawBytesInThisSector = ha->dwSectorSize;
@@ -217,88 +333,71 @@ static int ReadMpqSectors(TMPQFile * hf, LPBYTE pbBuffer, DWORD dwByteOffset, DW
         if(pFileEntry->dwFlags & MPQ_FILE_COMPRESSED)
             dwRawBytesInThisSector = hf->SectorOffsets[dwIndex + 1] - hf->SectorOffsets[dwIndex];
 
-        // If the file is encrypted, we have to decrypt the sector
-        if(pFileEntry->dwFlags & MPQ_FILE_ENCRYPTED)
-        {
-            BSWAP_ARRAY32_UNSIGNED(pbInSector, dwRawBytesInThisSector);
+        pSectors[i].pbInSector = pbInSector;
+        pSectors[i].pbOutSector = pbOutSector;
+        pSectors[i].dwRawBytes = dwRawBytesInThisSector;
+        pSectors[i].dwBytes = dwBytesInThisSector;
+        pSectors[i].dwIndex = dwIndex;
+        pSectors[i].nError = ERROR_SUCCESS;
 
-            // If we don't know the key, try to detect it by file content
-            if(hf->dwFileKey == 0)
-            {
-                hf->dwFileKey = DetectFileKeyByContent(pbInSector, dwBytesInThisSector);
-                if(hf->dwFileKey == 0)
-                {
-                    nError = ERROR_UNKNOWN_FILE_KEY;
-                    break;
-                }
-            }
+        // Move pointers
+        dwBytesToRead -= dwBytesInThisSector;
+        pbOutSector += dwBytesInThisSector;
+        pbInSector += dwRawBytesInThisSector;
+    }
 
-            DecryptMpqBlock(pbInSector, dwRawBytesInThisSector, hf->dwFileKey + dwIndex);
-            BSWAP_ARRAY32_UNSIGNED(pbInSector, dwRawBytesInThisSector);
-        }
+    // If the file is encrypted and we don't know the key, try to detect it by content
+    // of the first sector. The other sectors can't be decrypted before that.
+    if(dwSectorsToRead > 0 && (pFileEntry->dwFlags & MPQ_FILE_ENCRYPTED) && hf->dwFileKey == 0)
+    {
+        ReadMpqSector(hf, &pSectors[0]);
+        dwSectorsDone = 1;
+    }
 
-        // If the file has sector CRC check turned on, perform it
-        if(hf->bCheckSectorCRCs && hf->SectorChksums != NULL)
-        {
-            DWORD dwAdlerExpected = hf->SectorChksums[dwIndex];
-            DWORD dwAdlerValue = 0;
+    // Now we have to decrypt and decompress all file sectors that have been loaded.
+    // The sectors don't depend on each other, so big compressed reads can be spread
+    // over the threads of the parallel callback.
+    if(dwSectorsToRead > dwSectorsDone && pSectors[0].nError == ERROR_SUCCESS)
+    {
+        TMPQSectorWork Work;
+
+        Work.hf = hf;
+        Work.pSectors = pSectors + dwSectorsDone;
 
-            // We can only check sector CRC when it's not zero
-            // Neither can we check it if it's 0xFFFFFFFF.
-            if(dwAdlerExpected != 0 && dwAdlerExpected != 0xFFFFFFFF)
+        if(ParallelCallback != NULL && (pFileEntry->dwFlags & MPQ_FILE_COMPRESSED) && (dwSectorsToRead - dwSectorsDone) >= dwParallelMinSectors)
+        {
+            ParallelCallback(ReadMpqSectorWork, &Work, dwSectorsToRead - dwSectorsDone);
+        }
+        else
+        {
+            for(DWORD i = dwSectorsDone; i < dwSectorsToRead; i++)
             {
-                dwAdlerValue = adler32(0, pbInSector, dwRawBytesInThisSector);
-                if(dwAdlerValue != dwAdlerExpected)
-                {
-                    nError = ERROR_CHECKSUM_ERROR;
+                if(ReadMpqSector(hf, &pSectors[i]) != ERROR_SUCCESS)
                     break;
-                }
             }
         }
+    }
 
-        // If the sector is really compressed, decompress it.
-        // WARNING : Some sectors may not be compressed, it can be determined only
-        // by comparing uncompressed and compressed size !!!
-        if(dwRawBytesInThisSector < dwBytesInThisSector)
-        {
-            int cbOutSector = dwBytesInThisSector;
-            int cbInSector = dwRawBytesInThisSector;
-            int nResult = 0;
-
-            // Is the file compressed by PKWARE Data Compression Library ?
-            if(pFileEntry->dwFlags & MPQ_FILE_IMPLODE)
-                nResult = SCompExplode((char *)pbOutSector, &cbOutSector, (char *)pbInSector, cbInSector);
+    // Only the sectors before the first failed one count as read
+    for(dwSectorsDone = 0; dwSectorsDone < dwSectorsToRead; dwSectorsDone++)
+    {
+        TMPQSector * pSector = &pSectors[dwSectorsDone];
 
-            // Is the file compressed by Blizzard's multiple compression ?
-            if(pFileEntry->dwFlags & MPQ_FILE_COMPRESS)
-            {
-                hf->PreviousCompression = pbInSector[0];
-                nResult = SCompDecompress((char *)pbOutSector, &cbOutSector, (char *)pbInSector, cbInSector);
-            }
+        if((pFileEntry->dwFlags & MPQ_FILE_COMPRESS) && pSector->dwRawBytes < pSector->dwBytes)
+            hf->PreviousCompression = pSector->pbInSector[0];
 
-            // Did the decompression fail ?
-            if(nResult == 0)
-            {
-                nError = ERROR_FILE_CORRUPT;
-                break;
-            }
-        }
-        else
+        if(pSector->nError != ERROR_SUCCESS)
         {
-            if(pbOutSector != pbInSector)
-                memcpy(pbOutSector, pbInSector, dwBytesInThisSector);
+            nError = pSector->nError;
+            break;
         }
 
-        // Move pointers
-        dwBytesToRead -= dwBytesInThisSector;
-        dwByteOffset += dwBytesInThisSector;
-        dwBytesRead += dwBytesInThisSector;
-        pbOutSector += dwBytesInThisSector;
-        pbInSector += dwRawBytesInThisSector;
-        dwSectorsDone++;
+        dwBytesRead += pSector->dwBytes;
     }
 
     // Free all used buffers
+    if(pSectors != NULL)
+        STORM_FREE(pSectors);
     if(pbRawSector != NULL)
         STORM_FREE(pbRawSector);
     
@@ -736,6 +835,16 @@ bool WINAPI SFileReadFile(HANDLE hFile, void * pvBuffer, DWORD dwToRead, LPDWORD
     return (nError == ERROR_SUCCESS);
 }
 
+//-----------------------------------------------------------------------------
+// SFileSetParallelCallback
+
+bool WINAPI SFileSetParallelCallback(SFILE_PARALLEL_CALLBACK ParallelCB, DWORD dwMinSectors)
+{
+    ParallelCallback = ParallelCB;
+    dwParallelMinSectors = (dwMinSectors != 0) ? dwMinSectors : 1;
+    return true;
+}
+
 //-----------------------------------------------------------------------------
 // SFileGetFileSize
 
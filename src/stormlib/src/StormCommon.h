@@ -106,6 +106,16 @@ __inline void DebugFree(void * ptr)
 
 #endif
 
+// Sets the pointer to newval if it still is oldval, as one atomic operation.
+// True if it was set.
+#ifdef PLATFORM_WINDOWS
+#define STORM_CAS_POINTER(target, oldval, newval) \
+    (InterlockedCompareExchangePointer((PVOID volatile *)&(target), (PVOID)(newval), (PVOID)(oldval)) == (PVOID)(oldval))
+#else
+#define STORM_CAS_POINTER(target, oldval, newval) \
+    __sync_bool_compare_and_swap(&(target), (oldval), (newval))
+#endif
+
 //-----------------------------------------------------------------------------
 // StormLib internal global variables
 
@@ -443,6 +443,12 @@ Original/Official Version
 typedef void (WINAPI * SFILE_ADDFILE_CALLBACK)(void * pvUserData, DWORD dwBytesWritten, DWORD dwTotalBytes, bool bFinalCall);
 typedef void (WINAPI * SFILE_COMPACT_CALLBACK)(void * pvUserData, DWORD dwWorkType, ULONGLONG BytesProcessed, ULONGLONG TotalBytes);
 
+// Parallel sector decompression. StormLib hands a work function and the number of items to
+// the parallel callback, which must call pfnWork once for every index in [0, dwCount),
+// from any threads, and return only after all calls have finished.
+typedef void (WINAPI * SFILE_WORK_CALLBACK)(void * pvWorkContext, DWORD dwIndex);
+typedef void (WINAPI * SFILE_PARALLEL_CALLBACK)(SFILE_WORK_CALLBACK pfnWork, void * pvWorkContext, DWORD dwCount);
+
 //-----------------------------------------------------------------------------
 // Stream support - structures
 
@@ -806,6 +812,8 @@ struct TMPQArchive
 
     TMPQArchive  * haPatch;             // Pointer to patch archive, if any
     TMPQArchive  * haBase;              // Pointer to base ("previous version") archive, if any
+    TMPQArchive  * haShared;            // Archive whose stream and tables this patch uses (see SFileAddPatchArchive)
+    DWORD          dwShareCount;        // Number of patch chains that use this archive's stream and tables
     char szPatchPrefix[MPQ_PATCH_PREFIX_LEN]; // Prefix for file names in patch MPQs
     size_t         cchPatchPrefix;      // Length of the patch prefix, in characters
 
@@ -954,6 +962,7 @@ bool   WINAPI SFileUpdateFileAttributes(HANDLE hMpq, const char * szFileName);
 // Functions for manipulation with patch archives
 
 bool   WINAPI SFileOpenPatchArchive(HANDLE hMpq, const TCHAR * szPatchMpqName, const char * szPatchPathPrefix, DWORD dwFlags);
+bool   WINAPI SFileAddPatchArchive(HANDLE hMpq, HANDLE hPatchMpq, const char * szPatchPathPrefix, DWORD dwFlags);
 bool   WINAPI SFileIsPatchedArchive(HANDLE hMpq);
 
 //-----------------------------------------------------------------------------
@@ -966,6 +975,10 @@ DWORD  WINAPI SFileSetFilePointer(HANDLE hFile, LONG lFilePos, LONG * plFilePosH
 bool   WINAPI SFileReadFile(HANDLE hFile, void * lpBuffer, DWORD dwToRead, LPDWORD pdwRead = NULL, LPOVERLAPPED lpOverlapped = NULL);
 bool   WINAPI SFileCloseFile(HANDLE hFile);
 
+// Reads of compressed files spanning at least dwMinSectors sectors are decompressed
+// through the parallel callback. NULL turns it off (the default).
+bool   WINAPI SFileSetParallelCallback(SFILE_PARALLEL_CALLBACK ParallelCB, DWORD dwMinSectors);
+
 // Retrieving info about the file
 bool   WINAPI SFileHasFile(HANDLE hMpq, const char * szFileName);
 bool   WINAPI SFileGetFileName(HANDLE hFile, char * szFileName);
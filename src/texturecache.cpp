@@ -0,0 +1,282 @@
+#include "texturecache.h"
+#include "video.h"
+#include "profiler.h"
+#include "util.h"
+
+#include <wx/dir.h>
+#include <wx/filename.h>
+#include <wx/filefn.h>
+#include <wx/log.h>
+
+// STL
+#include <vector>
+#include <algorithm>
+
+#include <stdio.h>
+#include <string.h>
+
+TextureCache textureCache;
+
+// Largest mip level accepted from a cache file, anything bigger is a corrupt entry.
+#define TEXTURECACHE_MAX_LEVEL	(64*1024*1024)
+
+static const char cacheMagic[4] = { 'W', 'M', 'V', 'T' };
+
+static bool ReadUInt(FILE *f, unsigned int &v)
+{
+	return fread(&v, sizeof(v), 1, f) == 1;
+}
+
+static bool WriteUInt(FILE *f, unsigned int v)
+{
+	return fwrite(&v, sizeof(v), 1, f) == 1;
+}
+
+TextureCache::TextureCache() : maxBytes(0), totalBytes(0), scanned(false)
+{
+}
+
+void TextureCache::Init(const wxString &dir, int maxSize)
+{
+	this->dir = dir;
+	entries.clear();
+	totalBytes = 0;
+	scanned = false;
+	SetMaxSize(maxSize);
+}
+
+void TextureCache::SetMaxSize(int maxSize)
+{
+	maxBytes = (wxUint64)(maxSize > 0 ? maxSize : 0) * 1024 * 1024;
+	if (scanned)
+		Prune();
+}
+
+// The file name is a 64bit FNV-1a hash of the key, the key itself is stored in the file
+// and compared on load so a collision is just a miss.
+wxString TextureCache::FileName(const wxString &key) const
+{
+	const wxCharBuffer buf = key.mb_str(wxConvUTF8);
+	wxUint64 hash = wxULL(14695981039346656037);
+	for (const char *c = buf.data(); c && *c; c++) {
+		hash ^= (unsigned char)*c;
+		hash *= wxULL(1099511628211);
+	}
+
+	return dir + SLASH + wxString::Format(wxT("%08x%08x.tex"), (unsigned int)(hash >> 32), (unsigned int)(hash & 0xFFFFFFFF));
+}
+
+void TextureCache::ScanDir()
+{
+	scanned = true;
+	entries.clear();
+	totalBytes = 0;
+
+	if (dir.IsEmpty())
+		return;
+	if (!wxDir::Exists(dir)) {
+		wxFileName::Mkdir(dir, 0777, wxPATH_MKDIR_FULL);
+		return;
+	}
+
+	wxArrayString files;
+	wxDir::GetAllFiles(dir, &files, wxT("*.tex"), wxDIR_FILES);
+	for (size_t i=0; i<files.GetCount(); i++) {
+		wxULongLong size = wxFileName(files[i]).GetSize();
+		if (size == wxInvalidSize)
+			continue;
+		Entry e;
+		e.size = size.GetValue();
+		e.lastUse = wxFileModificationTime(files[i]);
+		entries[files[i]] = e;
+		totalBytes += e.size;
+	}
+
+	// left over from an interrupted Store()
+	files.Clear();
+	wxDir::GetAllFiles(dir, &files, wxT("*.tmp"), wxDIR_FILES);
+	for (size_t i=0; i<files.GetCount(); i++)
+		wxRemoveFile(files[i]);
+
+	wxLogMessage(wxT("Texture cache: %u files, %s bytes in %s"), (unsigned int)entries.size(), wxULongLong(totalBytes).ToString().c_str(), dir.c_str());
+	Prune();
+}
+
+void TextureCache::Remove(const wxString &file)
+{
+	EntryMap::iterator it = entries.find(file);
+	if (it != entries.end()) {
+		totalBytes -= it->second.size;
+		entries.erase(it);
+	}
+	if (wxFileExists(file))
+		wxRemoveFile(file);
+}
+
+bool TextureCache::Load(const wxString &key, BLPImage &image)
+{
+	if (key.IsEmpty() || dir.IsEmpty())
+		return false;
+
+	PROFILE_SCOPE("TextureCache::Load");
+
+	if (!scanned)
+		ScanDir();
+
+	wxString file = FileName(key);
+	EntryMap::iterator it = entries.find(file);
+	if (it == entries.end())
+		return false;
+
+	FILE *f = fopen(file.mb_str(), "rb");
+	if (!f) {
+		Remove(file);
+		return false;
+	}
+
+	const wxCharBuffer keyBuf = key.mb_str(wxConvUTF8);
+	size_t keyLen = keyBuf.data() ? strlen(keyBuf.data()) : 0;
+
+	bool ok = false;
+	char magic[4];
+	unsigned int version, storedLen, w, h, format, compressed, levels;
+	if (fread(magic, 4, 1, f) == 1 && memcmp(magic, cacheMagic, 4) == 0 &&
+		ReadUInt(f, version) && version == TEXTURECACHE_VERSION &&
+		ReadUInt(f, storedLen) && storedLen == keyLen) {
+		std::vector<char> storedKey(storedLen + 1, 0);
+		if ((storedLen == 0 || fread(&storedKey[0], storedLen, 1, f) == 1) &&
+			memcmp(&storedKey[0], keyBuf.data(), keyLen) == 0 &&
+			ReadUInt(f, w) && ReadUInt(f, h) && ReadUInt(f, format) &&
+			ReadUInt(f, compressed) && ReadUInt(f, levels) && levels > 0 && levels <= 16) {
+			image.w = w;
+			image.h = h;
+			image.format = format;
+			image.compressed = (compressed != 0);
+			image.mips.resize(levels);
+
+			ok = true;
+			for (unsigned int i=0; i<levels && ok; i++) {
+				BLPMipLevel &mip = image.mips[i];
+				unsigned int mw, mh, size;
+				ok = ReadUInt(f, mw) && ReadUInt(f, mh) && ReadUInt(f, size) && size <= TEXTURECACHE_MAX_LEVEL;
+				if (!ok)
+					break;
+				mip.w = mw;
+				mip.h = mh;
+				mip.data.resize(size);
+				ok = (size == 0 || fread(&mip.data[0], size, 1, f) == 1);
+			}
+		}
+	}
+	fclose(f);
+
+	if (!ok) {
+		wxLogMessage(wxT("Texture cache: removing invalid entry %s"), file.c_str());
+		image = BLPImage();
+		Remove(file);
+		return false;
+	}
+
+	// mark it as recently used
+	wxFileName(file).Touch();
+	it->second.lastUse = time(NULL);
+	return true;
+}
+
+void TextureCache::Store(const wxString &key, const BLPImage &image)
+{
+	if (key.IsEmpty() || dir.IsEmpty() || image.mips.empty())
+		return;
+
+	PROFILE_SCOPE("TextureCache::Store");
+
+	if (!scanned)
+		ScanDir();
+
+	wxString file = FileName(key);
+	wxString tmpFile = file + wxT(".tmp");
+
+	FILE *f = fopen(tmpFile.mb_str(), "wb");
+	if (!f) {
+		wxLogMessage(wxT("Texture cache: could not create %s"), tmpFile.c_str());
+		return;
+	}
+
+	const wxCharBuffer keyBuf = key.mb_str(wxConvUTF8);
+	unsigned int keyLen = keyBuf.data() ? (unsigned int)strlen(keyBuf.data()) : 0;
+
+	bool ok = fwrite(cacheMagic, 4, 1, f) == 1 &&
+		WriteUInt(f, TEXTURECACHE_VERSION) &&
+		WriteUInt(f, keyLen) && (keyLen == 0 || fwrite(keyBuf.data(), keyLen, 1, f) == 1) &&
+		WriteUInt(f, image.w) && WriteUInt(f, image.h) && WriteUInt(f, image.format) &&
+		WriteUInt(f, image.compressed ? 1 : 0) && WriteUInt(f, (unsigned int)image.mips.size());
+	for (size_t i=0; i<image.mips.size() && ok; i++) {
+		const BLPMipLevel &mip = image.mips[i];
+		unsigned int size = (unsigned int)mip.data.size();
+		ok = WriteUInt(f, mip.w) && WriteUInt(f, mip.h) && WriteUInt(f, size) &&
+			(size == 0 || fwrite(&mip.data[0], size, 1, f) == 1);
+	}
+	if (fclose(f) != 0)
+		ok = false;
+
+	// written under a temporary name first, so a crash can't leave a truncated entry behind
+	if (!ok || !wxRenameFile(tmpFile, file, true)) {
+		wxLogMessage(wxT("Texture cache: could not write %s"), file.c_str());
+		wxRemoveFile(tmpFile);
+		return;
+	}
+
+	EntryMap::iterator it = entries.find(file);
+	if (it != entries.end())
+		totalBytes -= it->second.size;
+
+	Entry &e = entries[file];
+	e.size = wxFileName(file).GetSize().GetValue();
+	e.lastUse = time(NULL);
+	totalBytes += e.size;
+
+	if (maxBytes > 0 && totalBytes > maxBytes)
+		Prune();
+}
+
+struct TextureCacheLRU {
+	wxString file;
+	time_t lastUse;
+
+	bool operator<(const TextureCacheLRU &e) const {
+		return lastUse < e.lastUse;
+	}
+};
+
+void TextureCache::Prune()
+{
+	if (maxBytes == 0 || totalBytes <= maxBytes)
+		return;
+
+	std::vector<TextureCacheLRU> files;
+	files.reserve(entries.size());
+	for (EntryMap::iterator it=entries.begin(); it!=entries.end(); ++it) {
+		TextureCacheLRU e;
+		e.file = it->first;
+		e.lastUse = it->second.lastUse;
+		files.push_back(e);
+	}
+	std::sort(files.begin(), files.end());
+
+	// go a bit under the limit so it isn't pruned again on the next few stores
+	wxUint64 target = maxBytes / 10 * 9;
+	size_t removed = 0;
+	for (size_t i=0; i<files.size() && totalBytes > target; i++, removed++)
+		Remove(files[i].file);
+
+	wxLogMessage(wxT("Texture cache: removed %u least recently used files, %s bytes left"), (unsigned int)removed, wxULongLong(totalBytes).ToString().c_str());
+}
+
+void TextureCache::Clear()
+{
+	if (!scanned)
+		ScanDir();
+
+	while (!entries.empty())
+		Remove(entries.begin()->first);
+}
@@ -0,0 +1,62 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+// wxWidgets
+#include <wx/string.h>
+
+// STL
+#include <map>
+
+#include <time.h>
+
+class BLPImage;
+
+// Bump whenever the file layout or what BLPImage::decode produces changes.
+#define TEXTURECACHE_VERSION	1
+
+// TextureCache
+// Keeps decoded textures (every mip level, ready for BLPImage::upload) on disk so the next
+// time a model is opened its textures don't have to be read out of the MPQs and decoded again.
+//
+// Entries are looked up by the key MPQFile::getEntryKey() gives for the texture, which changes
+// whenever the file the name resolves to does (another archive, a patch, a game update), so a
+// stale entry is simply never asked for again and ages out. Local override files aren't cached.
+//
+// The total size is kept under a limit by removing the least recently used files, the file
+// modification time is the last use so it survives restarts. Only used from the main thread.
+class TextureCache {
+public:
+	TextureCache();
+
+	// maxSize in MB, 0 disables the limit
+	void Init(const wxString &dir, int maxSize);
+	void SetMaxSize(int maxSize);
+
+	// Fills image from the cache, false if there's no (valid) entry for the key.
+	bool Load(const wxString &key, BLPImage &image);
+	void Store(const wxString &key, const BLPImage &image);
+
+	// Removes the least recently used entries until the cache is under its limit again.
+	void Prune();
+	void Clear();
+
+private:
+	struct Entry {
+		wxUint64 size;
+		time_t lastUse;
+	};
+	typedef std::map<wxString, Entry> EntryMap;
+
+	wxString FileName(const wxString &key) const;
+	void ScanDir();
+	void Remove(const wxString &file);
+
+	wxString dir;
+	wxUint64 maxBytes, totalBytes;
+	EntryMap entries;
+	bool scanned;
+};
+
+extern TextureCache textureCache;
+
+#endif
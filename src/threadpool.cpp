@@ -0,0 +1,110 @@
+#include "threadpool.h"
+
+ThreadPool *ThreadPool::shared = NULL;
+
+ThreadPool::ThreadPool(size_t numThreads) :
+	jobAvailable(mutex),
+	allDone(mutex),
+	busy(0),
+	stopping(false)
+{
+	if (numThreads == 0) {
+		int cpus = wxThread::GetCPUCount();
+		numThreads = (cpus > 0) ? (size_t)cpus : 1;
+	}
+
+	for (size_t i=0; i<numThreads; i++) {
+		Worker *w = new Worker(this);
+		if (w->Create() != wxTHREAD_NO_ERROR || w->Run() != wxTHREAD_NO_ERROR) {
+			wxDELETE(w);
+			break;
+		}
+		threads.push_back(w);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	Wait();
+
+	{
+		wxMutexLocker lock(mutex);
+		stopping = true;
+		jobAvailable.Broadcast();
+	}
+
+	for (size_t i=0; i<threads.size(); i++) {
+		threads[i]->Wait();
+		delete threads[i];
+	}
+	threads.clear();
+}
+
+ThreadPool &ThreadPool::Get()
+{
+	if (!shared)
+		shared = new ThreadPool();
+	return *shared;
+}
+
+void ThreadPool::CleanUp()
+{
+	wxDELETE(shared);
+}
+
+void ThreadPool::Add(ThreadJob *job)
+{
+	if (!job)
+		return;
+
+	// no threads could be started, just do the work here
+	if (threads.empty()) {
+		job->Run();
+		delete job;
+		return;
+	}
+
+	wxMutexLocker lock(mutex);
+	jobs.push_back(job);
+	jobAvailable.Signal();
+}
+
+void ThreadPool::Wait()
+{
+	wxMutexLocker lock(mutex);
+	while (!jobs.empty() || busy > 0)
+		allDone.Wait();
+}
+
+ThreadJob *ThreadPool::NextJob()
+{
+	wxMutexLocker lock(mutex);
+	while (jobs.empty() && !stopping)
+		jobAvailable.Wait();
+	if (jobs.empty())
+		return NULL;
+
+	ThreadJob *job = jobs.front();
+	jobs.pop_front();
+	busy++;
+	return job;
+}
+
+void ThreadPool::JobDone()
+{
+	wxMutexLocker lock(mutex);
+	busy--;
+	if (jobs.empty() && busy == 0)
+		allDone.Broadcast();
+}
+
+wxThread::ExitCode ThreadPool::Worker::Entry()
+{
+	ThreadJob *job;
+	while ((job = pool->NextJob()) != NULL) {
+		job->Run();
+		delete job;
+		pool->JobDone();
+	}
+	return 0;
+}
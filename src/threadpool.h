@@ -0,0 +1,68 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+// wxWidgets
+#include <wx/thread.h>
+
+// STL
+#include <deque>
+#include <vector>
+
+// A unit of work for a ThreadPool. Run() is called on one of the pool's threads,
+// then the job is deleted by the pool.
+class ThreadJob {
+public:
+	virtual ~ThreadJob() {}
+	virtual void Run() = 0;
+};
+
+// Fixed set of worker threads draining a queue of ThreadJobs.
+// Jobs must not touch OpenGL or wx GUI classes. They may open and read MPQFiles,
+// but not use MPQFile's other static helpers.
+class ThreadPool {
+public:
+	// numThreads == 0 uses one thread per CPU
+	ThreadPool(size_t numThreads = 0);
+	~ThreadPool();
+
+	// Queue a job. The pool takes ownership of it.
+	void Add(ThreadJob *job);
+	// Block until every queued job has finished.
+	void Wait();
+
+	size_t GetThreadCount() const { return threads.size(); }
+
+	// Shared pool for short background jobs (texture export, quantizing, ...)
+	static ThreadPool &Get();
+	// Stops the shared pool's threads, called on application exit.
+	static void CleanUp();
+
+private:
+	class Worker : public wxThread {
+	public:
+		Worker(ThreadPool *pool) : wxThread(wxTHREAD_JOINABLE), pool(pool) {}
+		virtual ExitCode Entry();
+	private:
+		ThreadPool *pool;
+	};
+	friend class Worker;
+
+	// disable copying
+	ThreadPool(const ThreadPool &);
+	void operator=(const ThreadPool &);
+
+	ThreadJob *NextJob();
+	void JobDone();
+
+	static ThreadPool *shared;
+
+	wxMutex mutex;
+	wxCondition jobAvailable;
+	wxCondition allDone;
+	std::deque<ThreadJob*> jobs;
+	std::vector<Worker*> threads;
+	size_t busy;
+	bool stopping;
+};
+
+#endif
@@ -28,6 +28,8 @@ bool bHideHelmet = false;
 bool bShowParticle = true;
 bool bZeroParticle = true;
 bool bAlternate = false; // for zhCN alternate.MPQ
+bool useTextureCache = false;
+int textureCacheSize = 256; // MB
 
 // Model Export Options
 // General Options
@@ -66,6 +66,8 @@ extern bool bHideHelmet;
 extern bool bShowParticle;
 extern bool bZeroParticle;
 extern bool bAlternate;
+extern bool useTextureCache;
+extern int textureCacheSize;
 
 extern int Perfered_Exporter;
 extern bool modelExportInitOnly;
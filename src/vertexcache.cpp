@@ -0,0 +1,193 @@
+#include "vertexcache.h"
+
+#include <math.h>
+
+// Scoring from the paper, tuned for a cache of VERTEXCACHE_SIZE.
+#define CACHE_DECAY_POWER	1.5f
+#define LAST_TRI_SCORE		0.75f
+#define VALENCE_BOOST_SCALE	2.0f
+#define VALENCE_BOOST_POWER	0.5f
+
+static float VertexScore(int cachePos, int remaining)
+{
+	// no triangles left to use it
+	if (remaining == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+	if (cachePos >= 0) {
+		// the triangle just added, it doesn't matter which of its vertices comes first
+		if (cachePos < 3) {
+			score = LAST_TRI_SCORE;
+		} else {
+			float s = 1.0f - (cachePos - 3) / (float)(VERTEXCACHE_SIZE - 3);
+			score = powf(s, CACHE_DECAY_POWER);
+		}
+	}
+
+	// vertices with few triangles left are worth finishing off
+	score += VALENCE_BOOST_SCALE * powf((float)remaining, -VALENCE_BOOST_POWER);
+	return score;
+}
+
+void OptimizeVertexCache(const unsigned short *indices, size_t nIndices, unsigned short *out)
+{
+	size_t nTris = nIndices / 3;
+	if (nTris == 0) {
+		for (size_t i=0; i<nIndices; i++)
+			out[i] = indices[i];
+		return;
+	}
+
+	size_t nVerts = 0;
+	for (size_t i=0; i<nTris*3; i++) {
+		if (indices[i] >= nVerts)
+			nVerts = indices[i] + 1;
+	}
+
+	// triangles using each vertex, the ones not added yet are kept at the front
+	std::vector<int> remaining(nVerts, 0);
+	for (size_t i=0; i<nTris*3; i++)
+		remaining[indices[i]]++;
+
+	std::vector<size_t> triStart(nVerts + 1, 0);
+	for (size_t v=0; v<nVerts; v++)
+		triStart[v+1] = triStart[v] + remaining[v];
+
+	std::vector<size_t> triList(nTris*3);
+	std::vector<size_t> fill(triStart.begin(), triStart.end() - 1);
+	for (size_t t=0; t<nTris; t++) {
+		for (size_t k=0; k<3; k++)
+			triList[fill[indices[t*3+k]]++] = t;
+	}
+
+	std::vector<int> cachePos(nVerts, -1);
+	std::vector<float> vertexScore(nVerts);
+	for (size_t v=0; v<nVerts; v++)
+		vertexScore[v] = VertexScore(-1, remaining[v]);
+
+	std::vector<float> triScore(nTris);
+	std::vector<bool> added(nTris, false);
+	int best = 0;
+	for (size_t t=0; t<nTris; t++) {
+		triScore[t] = vertexScore[indices[t*3]] + vertexScore[indices[t*3+1]] + vertexScore[indices[t*3+2]];
+		if (triScore[t] > triScore[best])
+			best = (int)t;
+	}
+
+	std::vector<unsigned short> result;
+	result.reserve(nTris*3);
+	std::vector<unsigned short> cache, newCache;
+	size_t next = 0;
+
+	while (result.size() < nTris*3) {
+		if (best < 0) {
+			// nothing left that shares a vertex with the cache, take the next one in file order
+			while (added[next])
+				next++;
+			best = (int)next;
+		}
+
+		const unsigned short *tri = &indices[best*3];
+		added[best] = true;
+		newCache.clear();
+		for (size_t k=0; k<3; k++) {
+			unsigned short v = tri[k];
+			result.push_back(v);
+			newCache.push_back(v);
+
+			// take the triangle off the vertex's list
+			size_t *list = &triList[triStart[v]];
+			for (int i=0; i<remaining[v]; i++) {
+				if (list[i] == (size_t)best) {
+					list[i] = list[remaining[v]-1];
+					list[remaining[v]-1] = best;
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		// the triangle's vertices move to the front of the cache
+		for (size_t i=0; i<cache.size(); i++) {
+			if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+				newCache.push_back(cache[i]);
+		}
+
+		for (size_t i=0; i<newCache.size(); i++) {
+			unsigned short v = newCache[i];
+			cachePos[v] = (i < VERTEXCACHE_SIZE) ? (int)i : -1;
+			vertexScore[v] = VertexScore(cachePos[v], remaining[v]);
+		}
+
+		// only triangles around the cache changed their score, the best one is among them
+		best = -1;
+		float bestScore = -1.0f;
+		for (size_t i=0; i<newCache.size(); i++) {
+			unsigned short v = newCache[i];
+			const size_t *list = &triList[triStart[v]];
+			for (int j=0; j<remaining[v]; j++) {
+				size_t t = list[j];
+				triScore[t] = vertexScore[indices[t*3]] + vertexScore[indices[t*3+1]] + vertexScore[indices[t*3+2]];
+				if (triScore[t] > bestScore) {
+					bestScore = triScore[t];
+					best = (int)t;
+				}
+			}
+		}
+
+		if (newCache.size() > VERTEXCACHE_SIZE)
+			newCache.resize(VERTEXCACHE_SIZE);
+		cache.swap(newCache);
+	}
+
+	for (size_t i=0; i<result.size(); i++)
+		out[i] = result[i];
+	for (size_t i=result.size(); i<nIndices; i++)
+		out[i] = indices[i];
+}
+
+float VertexCacheACMR(const unsigned short *indices, size_t nIndices, size_t cacheSize)
+{
+	size_t nTris = nIndices / 3;
+	if (nTris == 0)
+		return 0.0f;
+
+	size_t nVerts = 0;
+	for (size_t i=0; i<nTris*3; i++) {
+		if (indices[i] >= nVerts)
+			nVerts = indices[i] + 1;
+	}
+
+	// FIFO: a vertex is still cached until cacheSize misses have come after its own
+	std::vector<int> missAt(nVerts, -1);
+	int misses = 0;
+	for (size_t i=0; i<nTris*3; i++) {
+		int m = missAt[indices[i]];
+		if (m < 0 || misses - m > (int)cacheSize) {
+			missAt[indices[i]] = misses;
+			misses++;
+		}
+	}
+
+	return (float)misses / nTris;
+}
+
+void StripToTriangles(const short *strip, size_t len, std::vector<unsigned short> &out)
+{
+	out.clear();
+	for (size_t i=2; i<len; i++) {
+		unsigned short a = strip[i-2], b = strip[i-1], c = strip[i];
+		if (a == b || b == c || a == c)
+			continue;
+
+		if (i % 2 == 0) {
+			out.push_back(a);
+			out.push_back(b);
+		} else {
+			out.push_back(b);
+			out.push_back(a);
+		}
+		out.push_back(c);
+	}
+}
@@ -0,0 +1,29 @@
+#ifndef VERTEXCACHE_H
+#define VERTEXCACHE_H
+
+// STL
+#include <vector>
+
+#include <stddef.h>
+
+// Size of the cache the triangle order is optimised for, a bit bigger than most hardware
+// has, which is what the scoring is tuned for.
+#define VERTEXCACHE_SIZE		32
+// Cache size ACMR is measured with by default, a common FIFO size on actual cards.
+#define VERTEXCACHE_FIFO_SIZE	16
+
+// Reorders the triangles of a triangle list so vertices are reused while they are still in
+// the post-transform cache (Tom Forsyth's "Linear-Speed Vertex Cache Optimisation").
+// Only the order of the triangles changes, each keeps its own vertex order and so its winding.
+// indices and out may be the same buffer. No GL calls in here.
+void OptimizeVertexCache(const unsigned short *indices, size_t nIndices, unsigned short *out);
+
+// Average cache miss ratio, vertices transformed per triangle with a FIFO cache of the given
+// size. 0.5 is the best a regular grid can get, 3 means no reuse at all.
+float VertexCacheACMR(const unsigned short *indices, size_t nIndices, size_t cacheSize = VERTEXCACHE_FIFO_SIZE);
+
+// Turns a triangle strip into a list with the same triangles GL would draw from it,
+// degenerate ones left out and every other one flipped back to the strip's winding.
+void StripToTriangles(const short *strip, size_t len, std::vector<unsigned short> &out);
+
+#endif
@@ -1,6 +1,8 @@
 #include "modelviewer.h"
 #include "video.h"
 #include "mpq.h"
+#include "profiler.h"
+#include "texturecache.h"
 #include "CxImage/ximage.h"
 
 // wx
@@ -709,6 +711,8 @@ void VideoSettings::SetCurrent()
 
 GLuint TextureManager::add(wxString name)
 {
+	PROFILE_SCOPE_DETAIL("TextureManager::add", name);
+
 	GLuint id = 0;
 
 	// if the item already exists, return the existing ID
@@ -762,35 +766,28 @@ bool TryLoadLocalTexture(const wxString& texName, int type, CxImage **imgptr)
 
 void TextureManager::LoadBLP(GLuint id, Texture *tex)
 {
-	// Vars
-	int offsets[16], sizes[16], w=0, h=0, type=0;
-	GLint format = 0;
-	char attr[4];
+	BLPImage blp;
 
 	if (useLocalFiles) {
 		wxString texName(tex->name.c_str(), wxConvUTF8);
-		BYTE *buffer = NULL;
 		CxImage *image = NULL;
 
 		if ((TryLoadLocalTexture(texName, CXIMAGE_FORMAT_PNG, &image) || 
 			 TryLoadLocalTexture(texName, CXIMAGE_FORMAT_TGA, &image)) 
 			 && image) {
-			long size = image->GetWidth() * image->GetHeight() * 4;
-			if (image->Encode2RGBA(buffer, size, true)) {
-				tex->w = image->GetWidth();
-				tex->h = image->GetHeight();
+			bool ok = blp.decodeImage(image, true);
+			wxDELETE(image);
+			if (ok) {
+				tex->w = blp.w;
+				tex->h = blp.h;
 				tex->compressed = true;
 
 				GLuint texFormat = GL_TEXTURE_2D;
 				glBindTexture(texFormat, id);
-
-				glTexImage2D(texFormat, 0, GL_RGBA8, image->GetWidth(), image->GetHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
+				blp.upload();
 
 				glTexParameteri(texFormat, GL_TEXTURE_MIN_FILTER, GL_LINEAR);	// Linear Filtering
 				glTexParameteri(texFormat, GL_TEXTURE_MAG_FILTER, GL_LINEAR);	// Linear Filtering
-
-				wxDELETE(image);
-				wxDELETE(buffer);
 				return;
 			}
 		}
@@ -799,34 +796,119 @@ void TextureManager::LoadBLP(GLuint id, Texture *tex)
 
 	// bind the texture
 	glBindTexture(GL_TEXTURE_2D, id);
-	
-	MPQFile f(tex->name);
+
 	if (g_modelViewer) {
 		g_modelViewer->modelOpened->Add(wxString(tex->name.c_str(), wxConvUTF8));
 	}
-	if (f.isEof()) {
-		tex->id = 0;
-		wxLogMessage(wxT("Error: Could not load the texture '%s'"), wxString(tex->name.c_str(), wxConvUTF8).c_str());
-		f.close();
-		return;
+
+	// the cached levels are what decode() gave for this setting, DXT or expanded to RGBA
+	wxString cacheKey;
+	if (useTextureCache) {
+		cacheKey = MPQFile::getEntryKey(tex->name);
+		if (!cacheKey.IsEmpty())
+			cacheKey += video.supportCompression ? wxT("|dxt") : wxT("|rgba");
+	}
+
+	if (textureCache.Load(cacheKey, blp)) {
+		wxLogMessage(wxT("Loading texture: %s (cached)"), wxString(tex->name.c_str(), wxConvUTF8).c_str());
 	} else {
-		//tex->id = id; // I don't see the id being set anywhere,  should I set it now?
-		wxLogMessage(wxT("Loading texture: %s"), wxString(tex->name.c_str(), wxConvUTF8).c_str());
+		MPQFile f(tex->name);
+		if (f.isEof()) {
+			tex->id = 0;
+			wxLogMessage(wxT("Error: Could not load the texture '%s'"), wxString(tex->name.c_str(), wxConvUTF8).c_str());
+			f.close();
+			return;
+		} else {
+			//tex->id = id; // I don't see the id being set anywhere,  should I set it now?
+			wxLogMessage(wxT("Loading texture: %s"), wxString(tex->name.c_str(), wxConvUTF8).c_str());
+		}
+
+		bool decoded = blp.decode(f.getBuffer(), f.getSize(), video.supportCompression);
+		f.close();
+
+		if (decoded)
+			textureCache.Store(cacheKey, blp);
+		else if (!blp.error.empty())
+			wxLogMessage(wxT("Error: Could not decode the texture '%s': %s"), wxString(tex->name.c_str(), wxConvUTF8).c_str(), wxString(blp.error.c_str(), wxConvUTF8).c_str());
 	}
 
-	f.seek(4);
-	f.read(&type,4);
-	f.read(attr,4);
-	f.read(&w,4);
-	f.read(&h,4);
-	f.read(offsets,4*16);
-	f.read(sizes,4*16);
+	tex->w = blp.w;
+	tex->h = blp.h;
+	tex->compressed = blp.compressed;
+	blp.upload();
 
-	tex->w = w;
-	tex->h = h;
+	/*
+	// TODO: Add proper support for mipmaps
+	if (hasmipmaps) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	} else {
+	*/
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	//}
+}
+
+bool BLPImage::isDXT(GLint format)
+{
+	return (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT ||
+		format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT ||
+		format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+}
+
+bool BLPImage::decodeImage(CxImage *image, bool flipY)
+{
+	mips.clear();
+	if (!image || !image->IsValid())
+		return false;
+
+	BYTE *buffer = NULL;
+	long size = image->GetWidth() * image->GetHeight() * 4;
+	if (!image->Encode2RGBA(buffer, size, flipY))
+		return false;
+
+	w = image->GetWidth();
+	h = image->GetHeight();
+	format = GL_RGBA;
+
+	BLPMipLevel level;
+	level.w = w;
+	level.h = h;
+	level.data.assign(buffer, buffer + w*h*4);
+	mips.push_back(level);
+
+	image->FreeMemory(buffer);
+	return true;
+}
+
+bool BLPImage::decode(const unsigned char *buffer, size_t size, bool keepCompressed, size_t maxLevels)
+{
+	// Vars
+	int offsets[16], sizes[16], type=0;
+	char attr[4];
+
+	mips.clear();
+	error.clear();
+	format = GL_RGBA;
+	compressed = false;
+	w = h = 0;
+
+	if (!buffer || size < 148)
+		return false;
+
+	memcpy(&type, buffer+4, 4);
+	memcpy(attr, buffer+8, 4);
+	memcpy(&w, buffer+12, 4);
+	memcpy(&h, buffer+16, 4);
+	memcpy(offsets, buffer+20, 4*16);
+	memcpy(sizes, buffer+84, 4*16);
 
 	bool hasmipmaps = (attr[3]>0);
-	int mipmax = hasmipmaps ? 16 : 1;
+	size_t mipmax = hasmipmaps ? 16 : 1;
+	if (mipmax > maxLevels)
+		mipmax = maxLevels;
+
+	int mw = w, mh = h;
 
 	/*
 	reference: http://en.wikipedia.org/wiki/.BLP
@@ -841,27 +923,19 @@ void TextureManager::LoadBLP(GLuint id, Texture *tex)
 		 *     BYTE[???] JpegData;
 		 * }
 		 */
-		wxLogMessage(wxT("Error: %s:%s#%d type=%d"), __FILE__, __FUNCTION__, __LINE__, type);
-
-		BYTE *buffer = NULL;
-		CxImage *image = NULL;
-		unsigned char *buf = new unsigned char[sizes[0]];
-
-		f.seek(offsets[0]);
-		f.read(buf,sizes[0]);
-		image = new CxImage(buf, sizes[0], CXIMAGE_FORMAT_JPG);
-
-		if (image == NULL)
-			return;
-
-		long size = image->GetWidth() * image->GetHeight() * 4;
-		image->Encode2RGBA(buffer, size);
-
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image->GetWidth(), image->GetHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
+		if (offsets[0] <= 0 || sizes[0] <= 0 || (size_t)offsets[0] + sizes[0] > size) {
+			error = "JPEG data is out of range";
+			return false;
+		}
 
-		wxDELETE(image);
-		wxDELETE(buffer);
-		wxDELETE(buf);
+		CxImage image((BYTE *)buffer + offsets[0], sizes[0], CXIMAGE_FORMAT_JPG);
+		int bw = w, bh = h;
+		bool ok = decodeImage(&image, false);
+		w = bw;
+		h = bh;
+		if (!ok)
+			error = "JPEG data could not be decoded";
+		return ok;
 	} else if (type == 1) {
 		if (attr[0] == 2) {
 			/*
@@ -878,56 +952,53 @@ void TextureManager::LoadBLP(GLuint id, Texture *tex)
 			The image data are formatted using DXT5 compression.
 			*/
 			// encoding 2, directx compressed
-			unsigned char *ucbuf = NULL;
-			if (!video.supportCompression) 
-				ucbuf = new unsigned char[w*h*4];
-		
-			format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+			GLint dxtFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
 			int blocksize = 8;
 			
 			// guesswork here :(
 			// new alpha bit depth == 4 for DXT3, alfred 2008/10/11
 			if (attr[1]==8 || attr[1]==4) {
-				format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+				dxtFormat = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
 				blocksize = 16;
 			}
 
 			// Fix to the BLP2 format required in WoW 2.0 thanks to Linghuye (creator of MyWarCraftStudio)
 			if (attr[1]==8 && attr[2]==7) {
-				format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+				dxtFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
 				blocksize = 16;
 			}
 
-			tex->compressed = true;
-
-			unsigned char *buf = new unsigned char[sizes[0]];
+			compressed = true;
+			format = keepCompressed ? dxtFormat : GL_RGBA;
 
 			// do every mipmap level
 			for (size_t i=0; i<mipmax; i++) {
-				if (w==0) w = 1;
-				if (h==0) h = 1;
+				if (mw==0) mw = 1;
+				if (mh==0) mh = 1;
 				if (offsets[i] && sizes[i]) {
-					f.seek(offsets[i]);
-					f.read(buf,sizes[i]);
-
-					int size = ((w+3)/4) * ((h+3)/4) * blocksize;
-
-					if (video.supportCompression) {
-						glCompressedTexImage2DARB(GL_TEXTURE_2D, (GLint)i, format, w, h, 0, size, buf);
+					int blocks = ((mw+3)/4) * ((mh+3)/4) * blocksize;
+					if (offsets[i] < 0 || (size_t)offsets[i] + blocks > size)
+						break;
+
+					const unsigned char *src = buffer + offsets[i];
+
+					mips.push_back(BLPMipLevel());
+					BLPMipLevel &level = mips.back();
+					level.w = mw;
+					level.h = mh;
+					if (keepCompressed) {
+						level.data.assign(src, src + blocks);
 					} else {
-						decompressDXTC(format, w, h, size, buf, ucbuf);					
-						glTexImage2D(GL_TEXTURE_2D, (GLint)i, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, ucbuf);
+						// the decoders always write whole 4x4 blocks
+						level.data.resize(((mw+3)&~3) * ((mh+3)&~3) * 4);
+						decompressDXTC(dxtFormat, mw, mh, blocks, (unsigned char *)src, &level.data[0]);
+						level.data.resize(mw*mh*4);
 					}
-					
 				} else break;
-				w >>= 1;
-				h >>= 1;
+				mw >>= 1;
+				mh >>= 1;
 			}
 
-			wxDELETEA(buf);
-			if (!video.supportCompression) 
-				wxDELETEA(ucbuf);
-
 		} else if (attr[0]==1) {
 			/*
 			Type 1 Encoding 0 AlphaDepth 0 (uncompressed paletted image with no alpha)
@@ -942,33 +1013,38 @@ void TextureManager::LoadBLP(GLuint id, Texture *tex)
 
 			// encoding 1, uncompressed
 			unsigned int pal[256];
-			f.read(pal, 1024);
-
-			unsigned char *buf = new unsigned char[sizes[0]];
-			unsigned int *buf2 = new unsigned int[w*h];
-			unsigned int *p = NULL;
-			unsigned char *c = NULL, *a = NULL;
+			if (size < 148 + 1024)
+				return false;
+			memcpy(pal, buffer+148, 1024);
 
 			int alphabits = attr[1];
 			bool hasalpha = (alphabits!=0);
 
-			tex->compressed = false;
-
 			for (size_t i=0; i<mipmax; i++) {
-				if (w==0) w = 1;
-				if (h==0) h = 1;
+				if (mw==0) mw = 1;
+				if (mh==0) mh = 1;
 				if (offsets[i] && sizes[i]) {
-					f.seek(offsets[i]);
-					f.read(buf,sizes[i]);
+					if (offsets[i] < 0 || sizes[i] < 0 || (size_t)offsets[i] + sizes[i] > size)
+						break;
+
+					// the level's indices and alpha bits, padded in case the level is truncated
+					std::vector<unsigned char> buf(buffer + offsets[i], buffer + offsets[i] + sizes[i]);
+					buf.resize(mw*mh*2 + 1, 0);
+
+					mips.push_back(BLPMipLevel());
+					BLPMipLevel &level = mips.back();
+					level.w = mw;
+					level.h = mh;
+					level.data.resize(mw*mh*4);
 
 					int cnt = 0;
 					int alpha = 0;
 
-					p = buf2;
-					c = buf;
-					a = buf + w*h;
-					for (size_t y=0; y<h; y++) {
-						for (size_t x=0; x<w; x++) {
+					unsigned int *p = (unsigned int *)&level.data[0];
+					unsigned char *c = &buf[0];
+					unsigned char *a = c + mw*mh;
+					for (size_t y=0; y<(size_t)mh; y++) {
+						for (size_t x=0; x<(size_t)mw; x++) {
 							unsigned int k = pal[*c++];
 
 							k = ((k&0x00FF0000)>>16) | ((k&0x0000FF00)) | ((k& 0x000000FF)<<16);
@@ -996,34 +1072,149 @@ void TextureManager::LoadBLP(GLuint id, Texture *tex)
 							*p++ = k;
 						}
 					}
-
-					glTexImage2D(GL_TEXTURE_2D, (GLint)i, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, buf2);
-					
 				} else break;
 
-				w >>= 1;
-				h >>= 1;
+				mw >>= 1;
+				mh >>= 1;
 			}
-
-			wxDELETEA(buf2);
-			wxDELETEA(buf);
 		} else {
-			wxLogMessage(wxT("Error: %s:%s#%d type=%d, attr[0]=%d"), __FILE__, __FUNCTION__, __LINE__, type, attr[0]);
+			char msg[64];
+			sprintf(msg, "unsupported encoding %d", attr[0]);
+			error = msg;
 		}
+	} else {
+		char msg[64];
+		sprintf(msg, "unsupported type %d", type);
+		error = msg;
 	}
 
-	f.close();
+	return !mips.empty();
+}
 
-	/*
-	// TODO: Add proper support for mipmaps
-	if (hasmipmaps) {
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+void BLPImage::upload() const
+{
+	for (size_t i=0; i<mips.size(); i++) {
+		const BLPMipLevel &level = mips[i];
+		if (isDXT(format))
+			glCompressedTexImage2DARB(GL_TEXTURE_2D, (GLint)i, format, level.w, level.h, 0, (GLsizei)level.data.size(), &level.data[0]);
+		else
+			glTexImage2D(GL_TEXTURE_2D, (GLint)i, GL_RGBA8, level.w, level.h, 0, GL_RGBA, GL_UNSIGNED_BYTE, &level.data[0]);
+	}
+}
+
+bool BLPImage::getPixels(unsigned char *dest, bool bgra) const
+{
+	if (mips.empty())
+		return false;
+
+	const BLPMipLevel &level = mips[0];
+	size_t pixels = level.w * level.h;
+
+	if (isDXT(format)) {
+		std::vector<unsigned char> tmp(((level.w+3)&~3) * ((level.h+3)&~3) * 4);
+		decompressDXTC(format, level.w, level.h, level.data.size(), (unsigned char *)&level.data[0], &tmp[0]);
+		memcpy(dest, &tmp[0], pixels*4);
 	} else {
-	*/
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	//}
+		memcpy(dest, &level.data[0], pixels*4);
+	}
+
+	if (bgra) {
+		for (size_t i=0; i<pixels; i++, dest+=4) {
+			unsigned char t = dest[0];
+			dest[0] = dest[2];
+			dest[2] = t;
+		}
+	}
+	return true;
+}
+
+// size of the fixed BLP2 header, up to the palette
+#define BLP_HEADER_SIZE		148
+
+bool BLPInfo::parse(const unsigned char *header, size_t size)
+{
+	if (size < BLP_HEADER_SIZE || memcmp(header, "BLP2", 4) != 0)
+		return false;
+
+	int offsets[16], sizes[16];
+	memcpy(&type, header+4, 4);
+	encoding = header[8];
+	alphaDepth = header[9];
+	alphaEncoding = header[10];
+	memcpy(&w, header+12, 4);
+	memcpy(&h, header+16, 4);
+	memcpy(offsets, header+20, 4*16);
+	memcpy(sizes, header+84, 4*16);
+	if (w <= 0 || h <= 0)
+		return false;
+
+	// same levels BLPImage::decode() would go through
+	bool hasmipmaps = (header[11] > 0);
+	mipCount = 0;
+	for (size_t i=0; i<(hasmipmaps ? 16u : 1u); i++) {
+		if (offsets[i] > 0 && sizes[i] > 0)
+			mipCount++;
+	}
+	return true;
+}
+
+wxString BLPInfo::describe() const
+{
+	wxString format;
+	if (type == 0)
+		format = wxT("JPEG");
+	else if (encoding == 1)
+		format = wxT("Palette");
+	else if (encoding == 2) {
+		// picked the same way as in BLPImage::decode()
+		if (alphaDepth == 8 && alphaEncoding == 7)
+			format = wxT("DXT5");
+		else if (alphaDepth == 8 || alphaDepth == 4)
+			format = wxT("DXT3");
+		else
+			format = wxT("DXT1");
+	} else
+		format = wxT("BGRA");
+
+	return wxString::Format(wxT("%dx%d %s, alpha %d bit, %d mips"), w, h, format.c_str(), alphaDepth, mipCount);
+}
+
+struct BLPProbe {
+	bool ok;
+	BLPInfo info;
+};
+typedef std::map<std::string, BLPProbe> BLPProbeCache;
+static BLPProbeCache gBLPProbes;
+static wxMutex gBLPProbesMutex;
+
+bool BLPInfo::probe(const wxString &filename, BLPInfo &info)
+{
+	std::string key(filename.Lower().mb_str());
+	{
+		wxMutexLocker lock(gBLPProbesMutex);
+		BLPProbeCache::iterator it = gBLPProbes.find(key);
+		if (it != gBLPProbes.end()) {
+			info = it->second.info;
+			return it->second.ok;
+		}
+	}
+
+	unsigned char header[BLP_HEADER_SIZE];
+	size_t read = MPQFile::readRange(filename, 0, header, sizeof(header));
+
+	BLPProbe result;
+	result.ok = result.info.parse(header, read);
+
+	wxMutexLocker lock(gBLPProbesMutex);
+	gBLPProbes[key] = result;
+	info = result.info;
+	return result.ok;
+}
+
+void BLPInfo::clearCache()
+{
+	wxMutexLocker lock(gBLPProbesMutex);
+	gBLPProbes.clear();
 }
 
 void TextureManager::doDelete(GLuint id)
@@ -10,6 +10,69 @@
 
 typedef GLuint TextureID;
 
+class CxImage;
+
+// One level of a decoded BLP mip chain.
+struct BLPMipLevel {
+	int w, h;
+	std::vector<unsigned char> data;
+};
+
+// BLPImage
+// CPU side decoding of BLP textures, without any OpenGL calls. Used by TextureManager::LoadBLP
+// to build what it uploads, and by the exporters to get at the pixels without a GL readback.
+class BLPImage {
+public:
+	int w, h;
+	// GL_RGBA when the levels hold 32bit RGBA pixels, otherwise the S3TC format of the raw DXT blocks
+	GLint format;
+	// source data was DXT compressed
+	bool compressed;
+	std::vector<BLPMipLevel> mips;
+	// Why the last decode() failed, empty if it didn't say. decode() may run on
+	// worker threads, so it never logs, the caller does.
+	std::string error;
+
+	BLPImage() : w(0), h(0), format(GL_RGBA), compressed(false) {}
+
+	// Decode a whole BLP file. keepCompressed leaves DXT data as is for glCompressedTexImage2DARB,
+	// otherwise everything is expanded to RGBA. maxLevels limits how many mip levels are decoded.
+	bool decode(const unsigned char *buffer, size_t size, bool keepCompressed, size_t maxLevels = 16);
+	// Load an image with CxImage (local PNG/TGA overrides) as a single RGBA level.
+	bool decodeImage(CxImage *image, bool flipY);
+	// Upload every decoded level into the currently bound GL_TEXTURE_2D.
+	void upload() const;
+	// Level 0 as 32bit pixels, in BGRA order when bgra is true (what CxImage expects).
+	bool getPixels(unsigned char *dest, bool bgra) const;
+
+	static bool isDXT(GLint format);
+};
+
+// BLPInfo
+// What the 148 byte header of a BLP2 file says about the texture. probe() reads only that
+// header, for the texture browsers that look at many BLPs without showing them.
+struct BLPInfo {
+	int w, h;
+	int type;			// 0 = JPEG, 1 = everything else
+	int encoding;		// with type 1: 1 = palette, 2 = DXT, 3 = plain BGRA
+	int alphaDepth;		// 0, 1, 4 or 8 bits
+	int alphaEncoding;	// 7 = DXT5 with encoding 2
+	int mipCount;		// levels the file has data for
+
+	BLPInfo() : w(0), h(0), type(0), encoding(0), alphaDepth(0), alphaEncoding(0), mipCount(0) {}
+
+	// false if it isn't a BLP2 header
+	bool parse(const unsigned char *header, size_t size);
+	// for the file browser, "512x512 DXT5, 10 mips"
+	wxString describe() const;
+
+	// The header of a BLP, read with MPQFile::readRange. Kept by file name, so each file is
+	// only read once, also when it isn't a valid BLP. clearCache() when the archives or the
+	// local files change.
+	static bool probe(const wxString &filename, BLPInfo &info);
+	static void clearCache();
+};
+
 
 class Texture : public ManagedItem {
 public:
@@ -132,6 +195,7 @@ public:
 };
 
 void getTextureData(GLuint tex, unsigned char *buf);
+bool TryLoadLocalTexture(const wxString& texName, int type, CxImage **imgptr);
 
 extern VideoSettings video;
 extern TextureManager texturemanager;
@@ -1,5 +1,6 @@
 #include "wmo.h"
 #include "util.h"
+#include "profiler.h"
 //#include "world.h"
 //#include "liquid.h"
 
@@ -29,6 +30,7 @@ WMO::WMO(wxString name): ManagedItem(name)
 	mat = 0;
 	doodadset = -1;
 	includeDefaultDoodads = true;
+	doodadDistance = WMO_DOODAD_DISTANCE;
 
 	char *texbuf=0;
 
@@ -336,26 +338,29 @@ void WMOGroup::updateModels(bool load)
 	for (size_t i=0; i<nDoodads; i++) {
 		short dd = ddr[i];
 
-		bool inSet;
-
-		if (wmo->doodadset==-1) {
-			inSet = false;
-		} else {
-			inSet = ( ((dd >= wmo->doodadsets[wmo->doodadset].start) && (dd < (wmo->doodadsets[wmo->doodadset].start+(int)wmo->doodadsets[wmo->doodadset].size)))
-			|| ( wmo->includeDefaultDoodads && (dd >= wmo->doodadsets[0].start) && ((dd < (wmo->doodadsets[0].start+(int)wmo->doodadsets[0].size) )) ) );
-		}
-
-		if (inSet) {
+		if (isDoodadInSet(dd, wmo->doodadset)) {
 			WMOModelInstance &mi = wmo->modelis[dd];
 
-			if (load && !mi.model) 
+			if (load && !mi.model) {
 				mi.loadModel(wmo->loadedModels);
-			else if (!load && mi.model) 
+				doodadsDirty = true;
+			} else if (!load && mi.model) {
 				mi.unloadModel(wmo->loadedModels);
+				doodadsDirty = true;
+			}
 		}
 	}
 }
 
+bool WMOGroup::isDoodadInSet(short dd, int doodadset)
+{
+	if (doodadset==-1)
+		return false;
+
+	return ( ((dd >= wmo->doodadsets[doodadset].start) && (dd < (wmo->doodadsets[doodadset].start+(int)wmo->doodadsets[doodadset].size)))
+		|| ( wmo->includeDefaultDoodads && (dd >= wmo->doodadsets[0].start) && ((dd < (wmo->doodadsets[0].start+(int)wmo->doodadsets[0].size) )) ) );
+}
+
 void WMO::draw()
 {
 	if (!ok) return;
@@ -366,16 +371,21 @@ void WMO::draw()
 	glTranslatef(-100,0,0);
 	glTranslatef(viewpos.x, viewpos.y, viewpos.z);
 
+	cullGroups();
+
 	for (size_t i=0; i<nGroups; i++) {
-		groups[i].draw();
+		if (!groups[i].culled)
+			groups[i].draw();
 	}
 
 	for (size_t i=0; i<nGroups; i++) {
-		groups[i].drawDoodads(doodadset);
+		if (!groups[i].culled)
+			groups[i].drawDoodads(doodadset);
 	}
 
 	for (size_t i=0; i<nGroups; i++) {
-		groups[i].drawLiquid();
+		if (!groups[i].culled)
+			groups[i].drawLiquid();
 	}
 
 	/*
@@ -456,6 +466,120 @@ void WMO::draw()
 	drawPortals();
 }
 
+// Works out which groups can be seen this frame. With the camera inside the WMO, or outside
+// of it looking at the outdoor groups, only groups reached through portals that are in view are
+// drawn, each portal narrowing down what can be seen behind it. Everything else falls back to
+// testing the group boxes against the view frustum.
+void WMO::cullGroups()
+{
+	PROFILE_SCOPE("WMO::cullGroups");
+
+	// the WMO transforms are already applied, so this is in the same space as the groups
+	frustum.retrieve();
+	const Vec3D &eye = frustum.eye;
+
+	std::vector<int> start;
+	bool indoorStart = false;
+	if (!prs.empty()) {
+		// prefer the indoor groups, the box of an outdoor one often covers the whole building
+		for (size_t i=0; i<nGroups; i++) {
+			WMOGroup &g = groups[i];
+			if (!g.ok || !g.contains(eye))
+				continue;
+			if (g.indoor && !indoorStart) {
+				start.clear();
+				indoorStart = true;
+			}
+			if (g.indoor == indoorStart)
+				start.push_back((int)i);
+		}
+
+		// outside, or in an outdoor area, start from all outdoor groups, they aren't separated by portals
+		if (!indoorStart) {
+			start.clear();
+			for (size_t i=0; i<nGroups; i++) {
+				if (groups[i].ok && groups[i].isOutdoor())
+					start.push_back((int)i);
+			}
+		}
+	}
+
+	if (start.empty()) {
+		for (size_t i=0; i<nGroups; i++)
+			groups[i].culled = !frustum.intersectsBox(groups[i].boxMin, groups[i].boxMax);
+		return;
+	}
+
+	for (size_t i=0; i<nGroups; i++)
+		groups[i].culled = true;
+
+	std::vector<int> path;
+	int steps = WMO_PORTAL_STEPS;
+	for (size_t i=0; i<start.size(); i++) {
+		WMOGroup &g = groups[start[i]];
+		if (!indoorStart && !frustum.intersectsBox(g.boxMin, g.boxMax))
+			continue;
+		cullPortals(start[i], frustum, path, steps);
+	}
+
+	// gave up on a maze of portals, better draw too much than leave holes
+	if (steps <= 0) {
+		for (size_t i=0; i<nGroups; i++) {
+			if (groups[i].culled)
+				groups[i].culled = !frustum.intersectsBox(groups[i].boxMin, groups[i].boxMax);
+		}
+	}
+}
+
+void WMO::cullPortals(int group, const Frustum &view, std::vector<int> &path, int &steps)
+{
+	WMOGroup &g = groups[group];
+	g.culled = false;
+
+	if (--steps <= 0 || path.size() >= WMO_PORTAL_DEPTH)
+		return;
+
+	const Vec3D &eye = frustum.eye;
+	for (int i=g.portalStart; i<g.portalStart+g.portalCount && i<(int)prs.size(); i++) {
+		WMOPR &pr = prs[i];
+		if (pr.portal < 0 || pr.portal >= (int)pvs.size() || pr.group < 0 || pr.group >= (int)nGroups)
+			continue;
+		// don't go back the way we came
+		if (std::find(path.begin(), path.end(), (int)pr.portal) != path.end())
+			continue;
+
+		WMOPV &pv = pvs[pr.portal];
+		Vec3D poly[4] = { pv.a, pv.b, pv.c, pv.d };
+		if (!view.intersectsPolygon(poly, 4))
+			continue;
+
+		// standing in the portal, everything the current view sees is still in view behind it
+		Frustum behind = view;
+		Vec3D normal = (pv.b - pv.a) % (pv.c - pv.a);
+		float len = normal.length();
+		if (len > 0 && fabsf(normal * (eye - pv.a)) / len > 1.0f)
+			behind.clip(eye, poly, 4);
+
+		path.push_back(pr.portal);
+		cullPortals(pr.group, behind, path, steps);
+		path.pop_back();
+	}
+}
+
+bool WMOGroup::contains(const Vec3D &v) const
+{
+	return v.x >= boxMin.x && v.y >= boxMin.y && v.z >= boxMin.z &&
+		v.x <= boxMax.x && v.y <= boxMax.y && v.z <= boxMax.z;
+}
+
+float WMOGroup::distanceTo(const Vec3D &v) const
+{
+	Vec3D d(max(max(boxMin.x - v.x, v.x - boxMax.x), 0.0f),
+			max(max(boxMin.y - v.y, v.y - boxMax.y), 0.0f),
+			max(max(boxMin.z - v.z, v.z - boxMax.z), 0.0f));
+	return d.length();
+}
+
 void WMO::drawSkybox()
 {
 	if (skybox) {
@@ -709,6 +833,9 @@ void WMOGroup::initDisplayList()
 	b1 = Vec3D(gh.box1[0], gh.box1[2], -gh.box1[1]);
 	b2 = Vec3D(gh.box2[0], gh.box2[2], -gh.box2[1]);
 
+	portalStart = gh.portalStart;
+	portalCount = gh.portalCount;
+
 	gf.seek(0x58); // first chunk
 	char fourcc[5];
 	uint32 size;
@@ -967,6 +1094,9 @@ void WMOGroup::initDisplayList()
  		gf.seek(nextpos);
 	}
 
+	boxMin = Vec3D(min(min(b1.x, b2.x), vmin.x), min(min(b1.y, b2.y), vmin.y), min(min(b1.z, b2.z), vmin.z));
+	boxMax = Vec3D(max(max(b1.x, b2.x), vmax.x), max(max(b1.y, b2.y), vmax.y), max(max(b1.z, b2.z), vmax.z));
+
 	// ok, make a display list
 
 	indoor = (flags&8192)!=0;
@@ -1150,38 +1280,141 @@ void WMOGroup::drawDoodads(int doodadset)
 	glColor4f(xr,xg,xb,1);
 	*/
 
+	if (doodadsDirty || doodadsSet != doodadset || doodadsDefault != wmo->includeDefaultDoodads)
+		initDoodadBatches(doodadset);
+
 	// draw doodads
+	// the merged ones are small models, they go with the whole group once it is far enough away
 	glColor4f(1,1,1,1);
-	for (size_t i=0; i<nDoodads; i++) {
-		short dd = ddr[i];
-		
-		bool inSet;
-		if (doodadset==-1) {
-			inSet = false;
+	const Frustum &frustum = wmo->frustum;
+	if (dlDoodads && distanceTo(frustum.eye) < wmo->doodadDistance)
+		glCallList(dlDoodads);
+
+	for (size_t i=0; i<doodadsUnbatched.size(); i++) {
+		WMOModelInstance &mi = wmo->modelis[doodadsUnbatched[i]];
+		if (!mi.model)
+			continue;
+
+		// animated doodads and particles can reach well past the radius of the bind pose
+		float r = mi.model->rad * mi.sc * 2.0f;
+		if ((mi.pos - frustum.eye).length() - r > wmo->doodadDistance || !frustum.intersectsSphere(mi.pos, r))
+			continue;
+
+		if (!outdoorLights) {
+			glDisable(GL_LIGHT0);
+			WMOLight::setupOnce(GL_LIGHT2, mi.ldir, mi.lcol);
 		} else {
-			inSet = ( ((dd >= wmo->doodadsets[doodadset].start) && (dd < (wmo->doodadsets[doodadset].start+(int)wmo->doodadsets[doodadset].size))) 
-			|| ( wmo->includeDefaultDoodads && (dd >= wmo->doodadsets[0].start) && ((dd < (wmo->doodadsets[0].start+(int)wmo->doodadsets[0].size) )) ) );
+			glEnable(GL_LIGHT0);
 		}
 
-		if (inSet) {
+		mi.draw();
+	}
 
-			WMOModelInstance &mi = wmo->modelis[dd];
+	glDisable(GL_LIGHT2);
 
-			if (!outdoorLights) {
-				glDisable(GL_LIGHT0);
-				WMOLight::setupOnce(GL_LIGHT2, mi.ldir, mi.lcol);
-			} else {
-				glEnable(GL_LIGHT0);
-			}
+	glColor4f(1,1,1,1);
 
-			wmo->modelis[dd].draw();
-		}
+}
+
+// Static doodads are merged into one display list, so a set with hundreds of copies of the
+// same few models costs a state setup per model and render pass rather than per doodad.
+// Their vertices are transformed on the CPU, outdoors all copies of a pass go into a single
+// glBegin/glEnd, indoors each one still needs its own light set up in between.
+// Animated doodads and big models are drawn one by one like before.
+void WMOGroup::initDoodadBatches(int doodadset)
+{
+	if (dlDoodads)
+		glDeleteLists(dlDoodads, 1);
+	dlDoodads = 0;
+	doodadsUnbatched.clear();
+
+	doodadsDirty = false;
+	doodadsSet = doodadset;
+	doodadsDefault = wmo->includeDefaultDoodads;
+
+	if (!ddr || nDoodads==0 || doodadset<0)
+		return;
+
+	std::vector<short> dds;
+	std::vector<const void*> models;
+	for (size_t i=0; i<nDoodads; i++) {
+		short dd = ddr[i];
+		if (!isDoodadInSet(dd, doodadset))
+			continue;
+
+		Model *m = wmo->modelis[dd].model;
+		bool batch = m && m->ok && !m->animated && m->showModel && m->origVertices && m->indices &&
+					 m->nIndices <= WMO_BATCH_MAX_INDICES;
+		dds.push_back(dd);
+		models.push_back(batch ? m : NULL);
 	}
 
-	glDisable(GL_LIGHT2);
+	std::vector<WMODoodadBatch> doodadBatches;
+	std::vector<size_t> singles;
+	WMOBatchDoodads(models, doodadBatches, singles);
 
-	glColor4f(1,1,1,1);
+	for (size_t i=0; i<singles.size(); i++)
+		doodadsUnbatched.push_back(dds[singles[i]]);
 
+	if (doodadBatches.empty())
+		return;
+
+	dlDoodads = glGenLists(1);
+	glNewList(dlDoodads, GL_COMPILE);
+
+	if (outdoorLights)
+		glEnable(GL_LIGHT0);
+	else
+		glDisable(GL_LIGHT0);
+
+	std::vector<Vec3D> verts, norms;
+	for (size_t b=0; b<doodadBatches.size(); b++) {
+		WMODoodadBatch &batch = doodadBatches[b];
+		Model *m = (Model*)batch.model;
+		size_t nv = m->header.nVertices;
+
+		// every copy of the model, already in place
+		verts.resize(nv * batch.doodads.size());
+		norms.resize(nv * batch.doodads.size());
+		for (size_t d=0; d<batch.doodads.size(); d++) {
+			WMOModelInstance &mi = wmo->modelis[dds[batch.doodads[d]]];
+			WMODoodadTransform t(mi.pos, mi.dir, mi.w, mi.sc);
+			for (size_t v=0; v<nv; v++) {
+				verts[d*nv + v] = t.vertex(m->origVertices[v].pos);
+				norms[d*nv + v] = t.normal(m->origVertices[v].normal);
+			}
+		}
+
+		for (size_t i=0; i<m->passes.size(); i++) {
+			ModelRenderPass &p = m->passes[i];
+			if (!p.init(m))
+				continue;
+
+			if (outdoorLights)
+				glBegin(GL_TRIANGLES);
+			for (size_t d=0; d<batch.doodads.size(); d++) {
+				if (!outdoorLights) {
+					WMOModelInstance &mi = wmo->modelis[dds[batch.doodads[d]]];
+					WMOLight::setupOnce(GL_LIGHT2, mi.ldir, mi.lcol);
+					glBegin(GL_TRIANGLES);
+				}
+				for (size_t k=0, ind=p.indexStart; k<p.indexCount; k++,ind++) {
+					uint16 a = m->indices[ind];
+					glNormal3fv(norms[d*nv + a]);
+					glTexCoord2fv(m->origVertices[a].texcoords);
+					glVertex3fv(verts[d*nv + a]);
+				}
+				if (!outdoorLights)
+					glEnd();
+			}
+			if (outdoorLights)
+				glEnd();
+
+			p.deinit();
+		}
+	}
+
+	glEndList();
 }
 
 void WMOGroup::drawLiquid()
@@ -1237,6 +1470,9 @@ void WMOGroup::cleanup()
 {
 	if (dl) glDeleteLists(dl, 1);
 	dl = 0;
+	if (dlDoodads) glDeleteLists(dlDoodads, 1);
+	dlDoodads = 0;
+	doodadsUnbatched.clear();
 	if (dl_light) glDeleteLists(dl_light, 1);
 	dl_light = 0;
 	//if (lq) delete lq; lq = 0;
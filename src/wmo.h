@@ -13,6 +13,8 @@
 #include "model.h"
 #include "video.h"
 #include "displayable.h"
+#include "wmobatch.h"
+#include "frustum.h"
 
 class WMO;
 class WMOGroup;
@@ -35,6 +37,13 @@ class WMOGroup {
 	WMO *wmo;
 	int flags;
 	GLuint dl,dl_light;
+	// Static doodads of the current doodad set, merged per model, and the ones drawn on their own
+	GLuint dlDoodads;
+	std::vector<short> doodadsUnbatched;
+	bool doodadsDirty, doodadsDefault;
+	int doodadsSet;
+	// MOPR entries of the portals leading out of this group
+	short portalStart, portalCount;
 	Vec3D center;
 	float rad;
 	int num;
@@ -56,12 +65,16 @@ public:
 	Vec3D v1,v2;
 	Vec3D b1,b2;
 	Vec3D vmin, vmax;
+	// box used for culling, header box and geometry together
+	Vec3D boxMin, boxMax;
 	bool indoor, hascv, visible, ok;
+	// outside the view this frame, unlike visible this doesn't unload the doodads
+	bool culled;
 
 	bool outdoorLights;
 	wxString name, desc;
 
-	WMOGroup() : dl(0), ddr(0), vertices(NULL), normals(NULL), texcoords(NULL), indices(NULL), materials(NULL), batches(NULL) {}
+	WMOGroup() : dl(0), dlDoodads(0), doodadsDirty(true), doodadsDefault(false), doodadsSet(-1), portalStart(0), portalCount(0), ddr(0), vertices(NULL), normals(NULL), texcoords(NULL), indices(NULL), materials(NULL), batches(NULL), culled(false) {}
 	~WMOGroup();
 	void init(WMO *wmo, MPQFile &f, int num, char *names);
 	void initDisplayList();
@@ -69,12 +82,25 @@ public:
 	void draw();
 	void drawLiquid();
 	void drawDoodads(int doodadset);
+	void initDoodadBatches(int doodadset);
+	bool isDoodadInSet(short dd, int doodadset);
 	void setupFog();
 	void cleanup();
 
 	void updateModels(bool load);
+
+	bool isOutdoor() const { return (flags & 0x8) != 0; }
+	bool contains(const Vec3D &v) const;
+	float distanceTo(const Vec3D &v) const;
 };
 
+// How far from the camera doodads are still drawn, on top of their radius.
+#define WMO_DOODAD_DISTANCE	800.0f
+// Limits for following portals, a lot of small rooms seen through each other can otherwise
+// take longer to walk through than to draw.
+#define WMO_PORTAL_DEPTH	16
+#define WMO_PORTAL_STEPS	2048
+
 #define	WMO_MATERIAL_CULL	0x04	// Remove the back-facing polygons
 #define WMO_MATERIAL_LUM	0x10	// Bright at Night
 struct WMOMaterial {
@@ -238,6 +264,10 @@ public:
 
 	std::vector<WMODoodadSet> doodadsets;
 
+	// view frustum in WMO space, set up by draw()
+	Frustum frustum;
+	float doodadDistance;
+
 	Model *skybox;
 	int sbid;
 
@@ -256,6 +286,9 @@ public:
 	void loadGroup(int id);
 	void showDoodadSet(int id);
 	void updateModels();
+
+	void cullGroups();
+	void cullPortals(int group, const Frustum &view, std::vector<int> &path, int &steps);
 };
 
 /*
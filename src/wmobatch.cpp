@@ -0,0 +1,52 @@
+#include "wmobatch.h"
+#include "quaternion.h"
+
+// STL
+#include <map>
+
+void WMOBatchDoodads(const std::vector<const void*> &models, std::vector<WMODoodadBatch> &batches, std::vector<size_t> &singles)
+{
+	batches.clear();
+	singles.clear();
+
+	std::map<const void*, size_t> batchOf;
+	for (size_t i=0; i<models.size(); i++) {
+		if (!models[i]) {
+			singles.push_back(i);
+			continue;
+		}
+
+		std::map<const void*, size_t>::iterator it = batchOf.find(models[i]);
+		if (it == batchOf.end()) {
+			it = batchOf.insert(std::make_pair(models[i], batches.size())).first;
+			batches.push_back(WMODoodadBatch());
+			batches.back().model = models[i];
+		}
+		batches[it->second].doodads.push_back(i);
+	}
+}
+
+WMODoodadTransform::WMODoodadTransform(const Vec3D &pos, const Vec3D &dir, float w, float sc) : pos(pos), sc(sc)
+{
+	// same as glQuaternionRotate() in wmo.cpp
+	Vec3D vdir(-dir.z, dir.x, dir.y);
+	rot.quaternionRotate(Quaternion(vdir, w));
+}
+
+// The matrix is handed to glMultMatrixf as it is, which reads it column by column,
+// so it is applied transposed here.
+Vec3D WMODoodadTransform::vertex(const Vec3D &v) const
+{
+	Vec3D s(v.x * sc, -v.y * sc, -v.z * sc);
+	return Vec3D(rot.m[0][0]*s.x + rot.m[1][0]*s.y + rot.m[2][0]*s.z + pos.x,
+				 rot.m[0][1]*s.x + rot.m[1][1]*s.y + rot.m[2][1]*s.z + pos.y,
+				 rot.m[0][2]*s.x + rot.m[1][2]*s.y + rot.m[2][2]*s.z + pos.z);
+}
+
+Vec3D WMODoodadTransform::normal(const Vec3D &n) const
+{
+	Vec3D s(n.x, -n.y, -n.z);
+	return Vec3D(rot.m[0][0]*s.x + rot.m[1][0]*s.y + rot.m[2][0]*s.z,
+				 rot.m[0][1]*s.x + rot.m[1][1]*s.y + rot.m[2][1]*s.z,
+				 rot.m[0][2]*s.x + rot.m[1][2]*s.y + rot.m[2][2]*s.z);
+}
@@ -0,0 +1,44 @@
+#ifndef WMOBATCH_H
+#define WMOBATCH_H
+
+// STL
+#include <vector>
+
+#include "vec3d.h"
+#include "matrix.h"
+
+// Static doodads with more indices than this are still drawn one by one, merging their
+// pre-transformed copies would cost more memory than the draw calls it saves.
+#define WMO_BATCH_MAX_INDICES	3000
+
+// Doodads that use the same model, drawn together.
+struct WMODoodadBatch {
+	const void *model;
+	std::vector<size_t> doodads;	// positions in the list given to WMOBatchDoodads(), in their original order
+};
+
+// Groups doodads by model. models[i] is the model used by doodad i, or NULL if that doodad
+// can't be batched (animated, too big or not loaded) and has to be drawn on its own, those
+// end up in singles. Batches are in the order of their first doodad so the draw order stays
+// close to the one in the file.
+// No GL calls in here, WMOGroup builds its display list from the result.
+void WMOBatchDoodads(const std::vector<const void*> &models, std::vector<WMODoodadBatch> &batches, std::vector<size_t> &singles);
+
+// WMODoodadTransform
+// The placement WMOModelInstance::draw() sets up with glTranslate, glQuaternionRotate and
+// glScale, done on the CPU so the vertices of batched doodads can be merged.
+class WMODoodadTransform {
+public:
+	WMODoodadTransform(const Vec3D &pos, const Vec3D &dir, float w, float sc);
+
+	Vec3D vertex(const Vec3D &v) const;
+	// not normalised, GL_NORMALIZE is on while the scene is drawn
+	Vec3D normal(const Vec3D &n) const;
+
+private:
+	Matrix rot;
+	Vec3D pos;
+	float sc;
+};
+
+#endif
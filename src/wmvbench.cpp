@@ -0,0 +1,1305 @@
+/*
+	wmvbench - timing harness for the CPU side of the viewer.
+
+	Builds a small MPQ archive in the temp directory filled with synthetic data
+	(plain files, an AnimationData.dbc and a blob with bone and particle keyframes),
+	then times the same code the viewer uses: archive open and file reads, DBC lookups,
+	BLP/DXT decoding, Animated<> evaluation, bone matrices and skinning from
+	Model::animate, ParticleSystem::update and the character texture compositing.
+
+	Nothing here touches OpenGL or opens a window, so it runs on build machines.
+	Results go to stdout (or --output) as JSON, or CSV with --csv.
+	Cases that can tell whether their code did the right thing check that before they are
+	timed, --check runs only those checks and fails if any of them does.
+
+	Usage: wmvbench [--filter text] [--min-time seconds] [--samples n] [--csv] [--output file] [--list] [--check]
+*/
+
+#include <wx/wx.h>
+#include <wx/app.h>
+#include <wx/init.h>
+#include <wx/filename.h>
+#include <wx/ffile.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WINDOWS
+	#include <windows.h>
+#else
+	#include <sys/time.h>
+#endif
+
+#include "util.h"
+#include "enums.h"
+#include "mpq.h"
+#include "dbcfile.h"
+#include "database.h"
+#include "video.h"
+#include "model.h"
+#include "particle.h"
+#include "charcontrol.h"
+#include "maptile.h"
+#include "vertexcache.h"
+#include "wmobatch.h"
+#include "alphaatlas.h"
+#include "CxImage/ximage.h"
+
+#ifndef WotLK
+	#error wmvbench expects the WotLK animation block layout (build with -DWotLK)
+#endif
+
+// Synthetic data set sizes.
+#define BENCH_MPQ_FILES			48
+#define BENCH_MPQ_FILE_SIZE		(192*1024)
+#define BENCH_DBC_RECORDS		4000
+#define BENCH_DBC_LOOKUPS		256
+#define BENCH_TEXTURE_SIZE		512
+#define BENCH_BONES				96
+#define BENCH_BONE_KEYS			48
+#define BENCH_ANIM_LENGTH		4000
+#define BENCH_VERTICES			12000
+#define BENCH_ANIMATED_EVALS	4096
+#define BENCH_PARTICLE_FRAMES	60
+#define BENCH_WMO_DOODADS		2000
+#define BENCH_WMO_MODELS		40
+
+static const char *benchArchiveData = "Bench\\Data%02d.bin";
+static const char *benchArchiveAnim = "Bench\\Animation.bin";
+static const char *benchArchiveDBC = "DBFilesClient\\AnimationData.dbc";
+
+// High resolution wall clock in seconds.
+static double BenchTime()
+{
+#ifdef _WINDOWS
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec + t.tv_usec / 1000000.0;
+#endif
+}
+
+// Deterministic pseudo random numbers, so every run decodes the same data.
+class BenchRandom
+{
+public:
+	BenchRandom(uint32 seed) : state(seed) {}
+
+	uint32 Next()
+	{
+		state = state * 1664525 + 1013904223;
+		return state;
+	}
+
+	// [0, 1)
+	float NextFloat()
+	{
+		return (Next() >> 8) / 16777216.0f;
+	}
+
+	float NextFloat(float lower, float upper)
+	{
+		return lower + (upper - lower) * NextFloat();
+	}
+
+private:
+	uint32 state;
+};
+
+// Builds a file image with 4 byte aligned sections, and returns the offset of each.
+class BenchBlob
+{
+public:
+	uint32 Add(const void *src, size_t len)
+	{
+		while (data.size() & 3)
+			data.push_back(0);
+		uint32 ofs = (uint32)data.size();
+		const unsigned char *p = (const unsigned char *)src;
+		data.insert(data.end(), p, p + len);
+		return ofs;
+	}
+
+	// A single animation block (animation 0) with the given keyframes.
+	template <class D>
+	AnimationBlock AddBlock(int16 type, const std::vector<uint32> &times, const std::vector<D> &keys)
+	{
+		AnimationBlock b;
+		memset(&b, 0, sizeof(b));
+		b.type = type;
+		b.seq = -1;
+
+		AnimationBlockHeader ht, hk;
+		ht.nEntrys = (uint32)times.size();
+		ht.ofsEntrys = Add(&times[0], times.size() * sizeof(uint32));
+		hk.nEntrys = (uint32)keys.size();
+		hk.ofsEntrys = Add(&keys[0], keys.size() * sizeof(D));
+
+		b.nTimes = 1;
+		b.ofsTimes = Add(&ht, sizeof(ht));
+		b.nKeys = 1;
+		b.ofsKeys = Add(&hk, sizeof(hk));
+		return b;
+	}
+
+	// Two keyframe linear block, going from a to b over the animation.
+	AnimationBlock AddRamp(float a, float b)
+	{
+		std::vector<uint32> times;
+		std::vector<float> keys;
+		times.push_back(0);
+		times.push_back(BENCH_ANIM_LENGTH);
+		keys.push_back(a);
+		keys.push_back(b);
+		return AddBlock(INTERPOLATION_LINEAR, times, keys);
+	}
+
+	std::vector<unsigned char> data;
+};
+
+static AnimationBlock EmptyBlock()
+{
+	AnimationBlock b;
+	memset(&b, 0, sizeof(b));
+	b.seq = -1;
+	return b;
+}
+
+// Inverse of Quat16ToQuat32.
+static int16 PackQuatComponent(float v)
+{
+	if (v > 0)
+		return (int16)(v * 32767.0f - 32768.0f);
+	return (int16)(v * 32767.0f + 32767.0f);
+}
+
+// --
+
+struct BenchResult {
+	std::string name;
+	std::string unit;
+	double items;			// work items per iteration
+	size_t iterations;		// iterations per sample
+	size_t samples;
+	double best;			// seconds per iteration
+	double median;
+	double mean;
+};
+
+class BenchCase
+{
+public:
+	virtual ~BenchCase() {}
+	virtual const char *Name() const = 0;
+	virtual const char *Unit() const = 0;
+	// Work done by one Run(), in Unit()s.
+	virtual double Items() const = 0;
+	virtual void Run() = 0;
+	// Checks the results of the code being timed, false and a reason if they are wrong.
+	virtual bool Check(std::string &error) { return true; }
+};
+
+// Every case gets its own small fixture, set up once before timing starts.
+
+class MPQOpenBench : public BenchCase
+{
+public:
+	MPQOpenBench(wxString archive) : archive(archive) {}
+	const char *Name() const { return "mpq_open"; }
+	const char *Unit() const { return "archives"; }
+	double Items() const { return 1; }
+	void Run()
+	{
+		MPQArchive *mpq = new MPQArchive(archive);
+		mpq->close();
+		delete mpq;
+	}
+private:
+	wxString archive;
+};
+
+class MPQReadBench : public BenchCase
+{
+public:
+	MPQReadBench()
+	{
+		for (size_t i=0; i<BENCH_MPQ_FILES; i++)
+			names.push_back(wxString::Format(wxString(benchArchiveData, wxConvUTF8), (int)i));
+	}
+	const char *Name() const { return "mpq_read"; }
+	const char *Unit() const { return "bytes"; }
+	double Items() const { return (double)BENCH_MPQ_FILES * BENCH_MPQ_FILE_SIZE; }
+	void Run()
+	{
+		for (size_t i=0; i<names.size(); i++) {
+			MPQFile f(names[i]);
+			f.close();
+		}
+	}
+private:
+	wxArrayString names;
+};
+
+// What a texture or model header probe reads, through MPQFile::readRange
+#define BENCH_HEADER_SIZE		148
+
+class MPQHeaderBench : public BenchCase
+{
+public:
+	MPQHeaderBench()
+	{
+		for (size_t i=0; i<BENCH_MPQ_FILES; i++)
+			names.push_back(wxString::Format(wxString(benchArchiveData, wxConvUTF8), (int)i));
+	}
+	const char *Name() const { return "mpq_read_header"; }
+	const char *Unit() const { return "files"; }
+	double Items() const { return BENCH_MPQ_FILES; }
+	void Run()
+	{
+		unsigned char header[BENCH_HEADER_SIZE];
+		for (size_t i=0; i<names.size(); i++)
+			MPQFile::readRange(names[i], 0, header, sizeof(header));
+	}
+private:
+	wxArrayString names;
+};
+
+class DBCOpenBench : public BenchCase
+{
+public:
+	const char *Name() const { return "dbc_open"; }
+	const char *Unit() const { return "records"; }
+	double Items() const { return BENCH_DBC_RECORDS; }
+	void Run()
+	{
+		AnimDB db;
+		db.open();
+	}
+};
+
+class DBCLookupBench : public BenchCase
+{
+public:
+	DBCLookupBench() : found(0)
+	{
+		db.open();
+		BenchRandom rnd(7);
+		for (size_t i=0; i<BENCH_DBC_LOOKUPS; i++)
+			ids.push_back(rnd.Next() % BENCH_DBC_RECORDS);
+	}
+	const char *Name() const { return "dbc_lookup"; }
+	const char *Unit() const { return "lookups"; }
+	double Items() const { return BENCH_DBC_LOOKUPS; }
+	void Run()
+	{
+		for (size_t i=0; i<ids.size(); i++) {
+			try {
+				AnimDB::Record r = db.getByAnimID(ids[i]);
+				found += r.getUInt(AnimDB::AnimID);
+			} catch (DBCFile::NotFound &) {
+			}
+		}
+	}
+private:
+	AnimDB db;
+	std::vector<unsigned int> ids;
+	size_t found;
+};
+
+class BLPDecodeBench : public BenchCase
+{
+public:
+	enum Encoding {
+		BLP_PALETTE,
+		BLP_DXT1,
+		BLP_DXT3,
+		BLP_DXT5
+	};
+
+	BLPDecodeBench(Encoding enc) : enc(enc), pixels(0)
+	{
+		static const char *names[] = { "blp_palette", "blp_dxt1", "blp_dxt3", "blp_dxt5" };
+		name = names[enc];
+
+		unsigned char attr[4] = { 2, 0, 0, 1 };
+		int blocksize = 16;
+		if (enc == BLP_PALETTE) {
+			attr[0] = 1;
+			attr[1] = 8;
+		} else if (enc == BLP_DXT1) {
+			blocksize = 8;
+		} else if (enc == BLP_DXT3) {
+			attr[1] = 8;
+			attr[2] = 1;
+		} else {
+			attr[1] = 8;
+			attr[2] = 7;
+		}
+
+		int type = 1;
+		int w = BENCH_TEXTURE_SIZE, h = BENCH_TEXTURE_SIZE;
+		int offsets[16], sizes[16];
+		memset(offsets, 0, sizeof(offsets));
+		memset(sizes, 0, sizeof(sizes));
+
+		// header, palette, then the mip levels
+		data.resize(148 + 1024, 0);
+		memcpy(&data[0], "BLP2", 4);
+		memcpy(&data[4], &type, 4);
+		memcpy(&data[8], attr, 4);
+		memcpy(&data[12], &w, 4);
+		memcpy(&data[16], &h, 4);
+
+		BenchRandom rnd(enc + 1);
+		for (size_t i=0; i<1024; i++)
+			data[148 + i] = (unsigned char)rnd.Next();
+
+		int mw = w, mh = h;
+		for (size_t i=0; i<16 && (mw || mh); i++) {
+			if (mw == 0) mw = 1;
+			if (mh == 0) mh = 1;
+			int len = (enc == BLP_PALETTE) ? mw*mh*2 : ((mw+3)/4) * ((mh+3)/4) * blocksize;
+			offsets[i] = (int)data.size();
+			sizes[i] = len;
+			for (int j=0; j<len; j++)
+				data.push_back((unsigned char)(rnd.Next() >> 16));
+			pixels += mw*mh;
+			mw >>= 1;
+			mh >>= 1;
+		}
+		memcpy(&data[20], offsets, sizeof(offsets));
+		memcpy(&data[84], sizes, sizeof(sizes));
+	}
+	const char *Name() const { return name; }
+	const char *Unit() const { return "pixels"; }
+	double Items() const { return pixels; }
+	void Run()
+	{
+		BLPImage blp;
+		blp.decode(&data[0], data.size(), false);
+	}
+private:
+	Encoding enc;
+	const char *name;
+	std::vector<unsigned char> data;
+	double pixels;
+};
+
+// Bones and particle keyframes, read back through MPQFile and the regular init() code.
+class AnimationFixture
+{
+public:
+	static void Build(BenchBlob &blob, std::vector<ModelBoneDef> &bones, ModelParticleEmitterDef &emitter)
+	{
+		BenchRandom rnd(42);
+
+		std::vector<uint32> times;
+		for (size_t i=0; i<BENCH_BONE_KEYS; i++)
+			times.push_back((uint32)(i * BENCH_ANIM_LENGTH / (BENCH_BONE_KEYS-1)));
+
+		bones.resize(BENCH_BONES);
+		for (size_t b=0; b<BENCH_BONES; b++) {
+			ModelBoneDef &def = bones[b];
+			memset(&def, 0, sizeof(def));
+			// a few chains hanging off a root, like a skeleton
+			def.parent = (b == 0) ? -1 : (int16)((b % 8 == 1) ? 0 : b - 1);
+			def.pivot = Vec3D(rnd.NextFloat(-1, 1), rnd.NextFloat(-1, 1), rnd.NextFloat(0, 2));
+
+			std::vector<Vec3D> tkeys, skeys;
+			std::vector<PACK_QUATERNION> rkeys;
+			for (size_t i=0; i<BENCH_BONE_KEYS; i++) {
+				tkeys.push_back(Vec3D(rnd.NextFloat(-0.1f, 0.1f), rnd.NextFloat(-0.1f, 0.1f), rnd.NextFloat(-0.1f, 0.1f)));
+				skeys.push_back(Vec3D(1, 1, 1) * rnd.NextFloat(0.9f, 1.1f));
+
+				Quaternion q(rnd.NextFloat(-1, 1), rnd.NextFloat(-1, 1), rnd.NextFloat(-1, 1), rnd.NextFloat(0.5f, 1));
+				float len = sqrtf(q.x*q.x + q.y*q.y + q.z*q.z + q.w*q.w);
+				PACK_QUATERNION pq;
+				pq.x = PackQuatComponent(q.x / len);
+				pq.y = PackQuatComponent(q.y / len);
+				pq.z = PackQuatComponent(q.z / len);
+				pq.w = PackQuatComponent(q.w / len);
+				rkeys.push_back(pq);
+			}
+			def.translation = blob.AddBlock(INTERPOLATION_LINEAR, times, tkeys);
+			def.rotation = blob.AddBlock(INTERPOLATION_LINEAR, times, rkeys);
+			def.scaling = blob.AddBlock(INTERPOLATION_LINEAR, times, skeys);
+		}
+
+		memset(&emitter, 0, sizeof(emitter));
+		emitter.flags = 0;
+		emitter.EmitterType = MODELPARTICLE_EMITTER_PLANE;
+		emitter.cols = 4;
+		emitter.rows = 4;
+		emitter.EmissionSpeed = blob.AddRamp(1.0f, 2.0f);
+		emitter.SpeedVariation = blob.AddRamp(0.2f, 0.4f);
+		emitter.VerticalRange = blob.AddRamp(0.5f, 1.0f);
+		emitter.HorizontalRange = blob.AddRamp(3.0f, 6.0f);
+		emitter.Gravity = blob.AddRamp(0.5f, 1.0f);
+		emitter.Lifespan = blob.AddRamp(2.0f, 2.5f);
+		emitter.EmissionRate = blob.AddRamp(1500.0f, 2000.0f);
+		emitter.EmissionAreaLength = blob.AddRamp(1.0f, 2.0f);
+		emitter.EmissionAreaWidth = blob.AddRamp(1.0f, 2.0f);
+		emitter.Gravity2 = blob.AddRamp(0.0f, 0.1f);
+		emitter.en = EmptyBlock();
+
+		Vec3D colors[3] = { Vec3D(255, 200, 100), Vec3D(200, 100, 50), Vec3D(50, 20, 10) };
+		short opacity[3] = { 32767, 16000, 0 };
+		Vec2D sizes[3] = { Vec2D(0.2f, 0.2f), Vec2D(0.5f, 0.5f), Vec2D(0.1f, 0.1f) };
+		emitter.p.colors.ofsKeys = blob.Add(colors, sizeof(colors));
+		emitter.p.opacity.ofsKeys = blob.Add(opacity, sizeof(opacity));
+		emitter.p.sizes.ofsKeys = blob.Add(sizes, sizeof(sizes));
+		emitter.p.scales = Vec3D(1, 1, 1);
+	}
+};
+
+class AnimatedBench : public BenchCase
+{
+public:
+	AnimatedBench(Bone *bones) : bones(bones), sum(0) {}
+	const char *Name() const { return "animated_eval"; }
+	const char *Unit() const { return "evaluations"; }
+	double Items() const { return BENCH_ANIMATED_EVALS * 3; }
+	void Run()
+	{
+		for (size_t i=0; i<BENCH_ANIMATED_EVALS; i++) {
+			Bone &b = bones[i % BENCH_BONES];
+			size_t t = (i * 997) % BENCH_ANIM_LENGTH;
+			Vec3D tr = b.trans.getValue(0, t);
+			Quaternion q = b.rot.getValue(0, t);
+			Vec3D sc = b.scale.getValue(0, t);
+			sum += tr.x + q.w + sc.z;
+		}
+	}
+private:
+	Bone *bones;
+	float sum;
+};
+
+class BoneMatrixBench : public BenchCase
+{
+public:
+	BoneMatrixBench(Bone *bones) : bones(bones), frame(0) {}
+	const char *Name() const { return "bone_matrices"; }
+	const char *Unit() const { return "bones"; }
+	double Items() const { return BENCH_BONES; }
+	void Run()
+	{
+		// same steps as Model::calcBones for a non character model
+		size_t t = (frame++ * 33) % BENCH_ANIM_LENGTH;
+		for (size_t i=0; i<BENCH_BONES; i++)
+			bones[i].calc = false;
+		for (size_t i=0; i<BENCH_BONES; i++)
+			bones[i].calcMatrix(bones, 0, t);
+	}
+private:
+	Bone *bones;
+	size_t frame;
+};
+
+class SkinningBench : public BenchCase
+{
+public:
+	SkinningBench(Bone *bones) : bones(bones)
+	{
+		BenchRandom rnd(99);
+		verts.resize(BENCH_VERTICES);
+		for (size_t i=0; i<BENCH_VERTICES; i++) {
+			ModelVertex &v = verts[i];
+			memset(&v, 0, sizeof(v));
+			v.pos = Vec3D(rnd.NextFloat(-1, 1), rnd.NextFloat(-1, 1), rnd.NextFloat(0, 2));
+			v.normal = Vec3D(rnd.NextFloat(-1, 1), rnd.NextFloat(-1, 1), rnd.NextFloat(-1, 1)).normalize();
+			// most vertices in game models use two or three bones
+			int w0 = 128 + (rnd.Next() % 100);
+			int w1 = 255 - w0;
+			v.bones[0] = (uint8)(rnd.Next() % BENCH_BONES);
+			v.bones[1] = (uint8)(rnd.Next() % BENCH_BONES);
+			v.weights[0] = (uint8)w0;
+			v.weights[1] = (uint8)w1;
+		}
+		outVertices.resize(BENCH_VERTICES);
+		outNormals.resize(BENCH_VERTICES);
+
+		for (size_t i=0; i<BENCH_BONES; i++)
+			bones[i].calc = false;
+		for (size_t i=0; i<BENCH_BONES; i++)
+			bones[i].calcMatrix(bones, 0, BENCH_ANIM_LENGTH/3);
+	}
+	const char *Name() const { return "skinning"; }
+	const char *Unit() const { return "vertices"; }
+	double Items() const { return BENCH_VERTICES; }
+	void Run()
+	{
+		Model::skinVertices(&verts[0], verts.size(), bones, &outVertices[0], &outNormals[0], true);
+	}
+private:
+	Bone *bones;
+	std::vector<ModelVertex> verts;
+	std::vector<Vec3D> outVertices, outNormals;
+};
+
+class ParticleBench : public BenchCase
+{
+public:
+	ParticleBench(MPQFile &f, ModelParticleEmitterDef &def, Bone *bones)
+	{
+		ps.init(f, def, NULL, bones, 0);
+		// warm up until the particle count is steady
+		for (size_t i=0; i<BENCH_PARTICLE_FRAMES*3; i++)
+			Step(i);
+		frame = 0;
+	}
+	const char *Name() const { return "particle_update"; }
+	const char *Unit() const { return "frames"; }
+	double Items() const { return BENCH_PARTICLE_FRAMES; }
+	void Run()
+	{
+		for (size_t i=0; i<BENCH_PARTICLE_FRAMES; i++)
+			Step(frame++);
+	}
+private:
+	void Step(size_t i)
+	{
+		ps.setup(0, (i * 16) % BENCH_ANIM_LENGTH);
+		ps.update(1.0f / 60.0f);
+	}
+	ParticleSystem ps;
+	size_t frame;
+};
+
+class CharComposeBench : public BenchCase
+{
+public:
+	CharComposeBench() : dest(REGION_PX_WIDTH*REGION_PX_HEIGHT*4, 0)
+	{
+		BenchRandom rnd(5);
+		for (size_t r=0; r<NUM_REGIONS; r++) {
+			std::vector<unsigned char> px(regions[r].xsize * regions[r].ysize * 4);
+			for (size_t i=0; i<px.size(); i++)
+				px[i] = (unsigned char)(rnd.Next() >> 24);
+			layers.push_back(px);
+		}
+	}
+	const char *Name() const { return "char_compose"; }
+	const char *Unit() const { return "pixels"; }
+	double Items() const
+	{
+		double n = 0;
+		for (size_t r=0; r<NUM_REGIONS; r++)
+			n += regions[r].xsize * regions[r].ysize;
+		return n;
+	}
+	void Run()
+	{
+		for (size_t r=0; r<NUM_REGIONS; r++)
+			CharTexture::blendRegion(&dest[0], REGION_PX_WIDTH, regions[r], &layers[r][0]);
+	}
+private:
+	std::vector<unsigned char> dest;
+	std::vector< std::vector<unsigned char> > layers;
+};
+
+// Components that don't match their region are scaled with CxImage first (see CharTexture::compose).
+class CharResampleBench : public BenchCase
+{
+public:
+	CharResampleBench() : src(256*128*4)
+	{
+		BenchRandom rnd(6);
+		for (size_t i=0; i<src.size(); i++)
+			src[i] = (unsigned char)(rnd.Next() >> 24);
+	}
+	const char *Name() const { return "char_resample"; }
+	const char *Unit() const { return "pixels"; }
+	double Items() const { return regions[1].xsize * regions[1].ysize; }
+	void Run()
+	{
+		CxImage *image = new CxImage(0);
+		image->AlphaCreate();
+		image->IncreaseBpp(32);
+		image->CreateFromArray(&src[0], 256, 128, 32, 256*4, false);
+		image->Resample(regions[1].xsize, regions[1].ysize, 0);
+		BYTE *out = NULL;
+		long size = 0;
+		image->Encode2RGBA(out, size, false);
+		image->FreeMemory(out);
+		delete image;
+	}
+private:
+	std::vector<unsigned char> src;
+};
+
+// Triangle order for the vertex cache, checked by the miss ratio going down.
+class VertexCacheBench : public BenchCase
+{
+public:
+	// The strip every terrain chunk is drawn with, as MapTile::initDisplay builds it.
+	static VertexCacheBench *TerrainChunk()
+	{
+		short defstrip[stripsize2], strip[stripsize2];
+		for (size_t i=0; i<stripsize2; i++)
+			defstrip[i] = (short)i;
+		stripify2<short>(defstrip, strip);
+
+		std::vector<unsigned short> tris;
+		StripToTriangles(strip, stripsize2, tris);
+		return new VertexCacheBench("vertexcache_terrain", tris);
+	}
+
+	// A grid the size of a character geoset, its triangles in no particular order
+	// like the ones in a .skin file can be.
+	static VertexCacheBench *Geoset()
+	{
+		const size_t size = 40;
+		std::vector<unsigned short> tris;
+		for (size_t y=0; y<size; y++) {
+			for (size_t x=0; x<size; x++) {
+				unsigned short a = (unsigned short)(y*(size+1) + x), b = a + 1;
+				unsigned short c = (unsigned short)(a + size + 1), d = c + 1;
+				tris.push_back(a); tris.push_back(c); tris.push_back(b);
+				tris.push_back(b); tris.push_back(c); tris.push_back(d);
+			}
+		}
+
+		BenchRandom rnd(11);
+		size_t nTris = tris.size() / 3;
+		for (size_t i=nTris-1; i>0; i--) {
+			size_t j = rnd.Next() % (i+1);
+			for (size_t k=0; k<3; k++)
+				std::swap(tris[i*3+k], tris[j*3+k]);
+		}
+		return new VertexCacheBench("vertexcache_model", tris);
+	}
+
+	const char *Name() const { return name; }
+	const char *Unit() const { return "triangles"; }
+	double Items() const { return (double)(indices.size() / 3); }
+	void Run()
+	{
+		OptimizeVertexCache(&indices[0], indices.size(), &out[0]);
+	}
+	bool Check(std::string &error)
+	{
+		Run();
+		float before = VertexCacheACMR(&indices[0], indices.size());
+		float after = VertexCacheACMR(&out[0], out.size());
+		if (after >= before) {
+			char buf[128];
+			sprintf(buf, "ACMR %.3f before optimising, %.3f after", before, after);
+			error = buf;
+			return false;
+		}
+
+		// same triangles, each with its own winding
+		std::vector<TriangleKey> a, b;
+		for (size_t i=0; i+2<indices.size(); i+=3) {
+			a.push_back(Key(&indices[i]));
+			b.push_back(Key(&out[i]));
+		}
+		std::sort(a.begin(), a.end());
+		std::sort(b.begin(), b.end());
+		if (a != b) {
+			error = "the optimised list doesn't have the same triangles";
+			return false;
+		}
+		return true;
+	}
+private:
+	VertexCacheBench(const char *name, const std::vector<unsigned short> &tris) : name(name), indices(tris), out(tris.size()) {}
+
+	typedef std::pair<unsigned int, unsigned short> TriangleKey;
+
+	// The same for every rotation of a triangle, but not for its mirror image.
+	static TriangleKey Key(const unsigned short *t)
+	{
+		size_t first = 0;
+		for (size_t k=1; k<3; k++) {
+			if (t[k] < t[first])
+				first = k;
+		}
+		return TriangleKey(((unsigned int)t[first] << 16) | t[(first+1)%3], t[(first+2)%3]);
+	}
+
+	const char *name;
+	std::vector<unsigned short> indices, out;
+};
+
+// The modelview matrix the way GL builds it, column major like glMultMatrixf takes it.
+class BenchGLMatrix
+{
+public:
+	BenchGLMatrix()
+	{
+		for (size_t i=0; i<16; i++)
+			m[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+	}
+
+	void Mult(const float *b)
+	{
+		float r[16];
+		for (size_t col=0; col<4; col++) {
+			for (size_t row=0; row<4; row++) {
+				r[col*4+row] = 0;
+				for (size_t k=0; k<4; k++)
+					r[col*4+row] += m[k*4+row] * b[col*4+k];
+			}
+		}
+		memcpy(m, r, sizeof(m));
+	}
+
+	void Translate(float x, float y, float z)
+	{
+		float t[16] = { 1,0,0,0, 0,1,0,0, 0,0,1,0, x,y,z,1 };
+		Mult(t);
+	}
+
+	void Scale(float x, float y, float z)
+	{
+		float s[16] = { x,0,0,0, 0,y,0,0, 0,0,z,0, 0,0,0,1 };
+		Mult(s);
+	}
+
+	Vec3D Vertex(const Vec3D &v) const
+	{
+		return Vec3D(m[0]*v.x + m[4]*v.y + m[8]*v.z + m[12],
+					 m[1]*v.x + m[5]*v.y + m[9]*v.z + m[13],
+					 m[2]*v.x + m[6]*v.y + m[10]*v.z + m[14]);
+	}
+
+	// GL transforms normals by the inverse transpose, the cofactors are that times the
+	// determinant, which only changes the length.
+	Vec3D Normal(const Vec3D &n) const
+	{
+		#define A(r,c) m[(c)*4+(r)]
+		float c[3][3];
+		for (size_t r=0; r<3; r++) {
+			for (size_t k=0; k<3; k++) {
+				size_t r1 = (r+1)%3, r2 = (r+2)%3, k1 = (k+1)%3, k2 = (k+2)%3;
+				c[r][k] = A(r1,k1)*A(r2,k2) - A(r1,k2)*A(r2,k1);
+			}
+		}
+		#undef A
+		return Vec3D(c[0][0]*n.x + c[0][1]*n.y + c[0][2]*n.z,
+					 c[1][0]*n.x + c[1][1]*n.y + c[1][2]*n.z,
+					 c[2][0]*n.x + c[2][1]*n.y + c[2][2]*n.z);
+	}
+
+private:
+	float m[16];
+};
+
+// WMO doodad placement done on the CPU for batching, checked against the
+// glTranslate, glQuaternionRotate, glScale order WMOModelInstance::draw() uses.
+class WMODoodadTransformBench : public BenchCase
+{
+public:
+	WMODoodadTransformBench() : out(BENCH_VERTICES)
+	{
+		BenchRandom rnd(21);
+		for (size_t i=0; i<BENCH_VERTICES; i++)
+			verts.push_back(Vec3D(rnd.NextFloat(-2, 2), rnd.NextFloat(-2, 2), rnd.NextFloat(0, 4)));
+	}
+	const char *Name() const { return "wmo_doodad_transform"; }
+	const char *Unit() const { return "vertices"; }
+	double Items() const { return BENCH_VERTICES; }
+	void Run()
+	{
+		WMODoodadTransform t(Vec3D(120.0f, -35.5f, 12.25f), Vec3D(0.1f, 0.7f, 0.1f), 0.7f, 1.25f);
+		for (size_t i=0; i<verts.size(); i++)
+			out[i] = t.vertex(verts[i]);
+	}
+	bool Check(std::string &error)
+	{
+		BenchRandom rnd(22);
+		for (size_t i=0; i<64; i++) {
+			Vec3D pos(rnd.NextFloat(-500, 500), rnd.NextFloat(-500, 500), rnd.NextFloat(-100, 100));
+			Vec3D dir(rnd.NextFloat(-1, 1), rnd.NextFloat(-1, 1), rnd.NextFloat(-1, 1));
+			float w = rnd.NextFloat(-1, 1);
+			float len = sqrtf(dir.lengthSquared() + w*w);
+			dir *= 1.0f / len;
+			w /= len;
+			float sc = rnd.NextFloat(0.25f, 3.0f);
+
+			BenchGLMatrix gl;
+			gl.Translate(pos.x, pos.y, pos.z);
+			Matrix rot;
+			rot.quaternionRotate(Quaternion(Vec3D(-dir.z, dir.x, dir.y), w));
+			gl.Mult(rot);
+			gl.Scale(sc, -sc, -sc);
+
+			WMODoodadTransform t(pos, dir, w, sc);
+			Vec3D v(rnd.NextFloat(-5, 5), rnd.NextFloat(-5, 5), rnd.NextFloat(-5, 5));
+			if ((t.vertex(v) - gl.Vertex(v)).length() > 1e-3f) {
+				error = "a vertex ends up somewhere else than with the GL matrices";
+				return false;
+			}
+
+			Vec3D n = Vec3D(rnd.NextFloat(-1, 1), rnd.NextFloat(-1, 1), rnd.NextFloat(-1, 1)).normalize();
+			Vec3D a = t.normal(n), b = gl.Normal(n);
+			if (a.normalize() * b.normalize() < 0.9999f) {
+				error = "a normal points somewhere else than with the GL matrices";
+				return false;
+			}
+		}
+		return true;
+	}
+private:
+	std::vector<Vec3D> verts, out;
+};
+
+class WMODoodadBatchBench : public BenchCase
+{
+public:
+	WMODoodadBatchBench()
+	{
+		// any distinct pointers do for models, every tenth doodad can't be batched
+		BenchRandom rnd(23);
+		for (size_t i=0; i<BENCH_WMO_DOODADS; i++)
+			models.push_back((i % 10 == 9) ? NULL : &modelIds[rnd.Next() % BENCH_WMO_MODELS]);
+	}
+	const char *Name() const { return "wmo_doodad_batch"; }
+	const char *Unit() const { return "doodads"; }
+	double Items() const { return BENCH_WMO_DOODADS; }
+	void Run()
+	{
+		WMOBatchDoodads(models, batches, singles);
+	}
+	bool Check(std::string &error)
+	{
+		// A B - A C B -
+		int ids[3];
+		const void *small[] = { &ids[0], &ids[1], NULL, &ids[0], &ids[2], &ids[1], NULL };
+		std::vector<const void*> list(small, small + 7);
+		WMOBatchDoodads(list, batches, singles);
+		if (batches.size() != 3 || singles.size() != 2 || singles[0] != 2 || singles[1] != 6 ||
+			batches[0].model != &ids[0] || batches[0].doodads.size() != 2 || batches[0].doodads[0] != 0 || batches[0].doodads[1] != 3 ||
+			batches[1].model != &ids[1] || batches[1].doodads.size() != 2 || batches[1].doodads[0] != 1 || batches[1].doodads[1] != 5 ||
+			batches[2].model != &ids[2] || batches[2].doodads.size() != 1 || batches[2].doodads[0] != 4) {
+			error = "wrong batches for A B - A C B -";
+			return false;
+		}
+
+		// every doodad once, batches in the order of their first doodad, one per model
+		Run();
+		std::vector<int> seen(models.size(), 0);
+		std::set<const void*> batched;
+		for (size_t i=0; i<singles.size(); i++) {
+			seen[singles[i]]++;
+			if (models[singles[i]] != NULL) {
+				error = "a doodad that can be batched was left on its own";
+				return false;
+			}
+		}
+		for (size_t b=0; b<batches.size(); b++) {
+			const std::vector<size_t> &d = batches[b].doodads;
+			if (!batched.insert(batches[b].model).second || (b > 0 && d[0] < batches[b-1].doodads[0])) {
+				error = "batches are repeated or out of order";
+				return false;
+			}
+			for (size_t i=0; i<d.size(); i++) {
+				seen[d[i]]++;
+				if (models[d[i]] != batches[b].model || (i > 0 && d[i] <= d[i-1])) {
+					error = "a batch has another model's doodad, or its doodads out of order";
+					return false;
+				}
+			}
+		}
+		for (size_t i=0; i<seen.size(); i++) {
+			if (seen[i] != 1) {
+				error = "a doodad is missing or drawn twice";
+				return false;
+			}
+		}
+		return true;
+	}
+private:
+	int modelIds[BENCH_WMO_MODELS];
+	std::vector<const void*> models;
+	std::vector<WMODoodadBatch> batches;
+	std::vector<size_t> singles;
+};
+
+// Alpha and shadow maps of a whole map tile packed into one texture.
+class AlphaAtlasBench : public BenchCase
+{
+public:
+	AlphaAtlasBench() : maps(ALPHAATLAS_CELLS*ALPHAATLAS_CELLS*ALPHAATLAS_CHANNELS*ALPHAMAP_SIZE*ALPHAMAP_SIZE)
+	{
+		BenchRandom rnd(31);
+		for (size_t i=0; i<maps.size(); i++)
+			maps[i] = (unsigned char)(rnd.Next() >> 24);
+	}
+	const char *Name() const { return "alpha_atlas_pack"; }
+	const char *Unit() const { return "chunks"; }
+	double Items() const { return ALPHAATLAS_CELLS*ALPHAATLAS_CELLS; }
+	void Run()
+	{
+		atlas.clear();
+		for (int y=0; y<ALPHAATLAS_CELLS; y++) {
+			for (int x=0; x<ALPHAATLAS_CELLS; x++) {
+				for (int c=0; c<ALPHAATLAS_CHANNELS; c++)
+					atlas.put(x, y, c, Map(x, y, c));
+			}
+		}
+	}
+	bool Check(std::string &error)
+	{
+		// every texel of every map in its own cell and channel
+		Run();
+		std::vector<unsigned char> channel;
+		for (int c=0; c<ALPHAATLAS_CHANNELS; c++) {
+			atlas.extract(c, channel);
+			for (int y=0; y<ALPHAATLAS_CELLS; y++) {
+				for (int x=0; x<ALPHAATLAS_CELLS; x++) {
+					const unsigned char *map = Map(x, y, c);
+					for (int t=0; t<ALPHAMAP_SIZE; t++) {
+						for (int s=0; s<ALPHAMAP_SIZE; s++) {
+							unsigned char v = map[t*ALPHAMAP_SIZE + s];
+							if (atlas.get(x, y, c, s, t) != v || channel[(y*ALPHAMAP_SIZE + t)*ALPHAATLAS_SIZE + x*ALPHAMAP_SIZE + s] != v) {
+								error = "a map texel isn't where its cell and channel are";
+								return false;
+							}
+						}
+					}
+				}
+			}
+		}
+
+		// a single map touches nothing else, one outside the tile isn't written at all
+		std::vector<unsigned char> full(ALPHAMAP_SIZE*ALPHAMAP_SIZE, 255);
+		atlas.clear();
+		atlas.put(5, 9, 2, &full[0]);
+		atlas.put(ALPHAATLAS_CELLS, 0, 0, &full[0]);
+		atlas.put(0, 0, ALPHAATLAS_CHANNELS, &full[0]);
+		const unsigned char *data = atlas.data();
+		for (int t=0; t<ALPHAATLAS_SIZE; t++) {
+			for (int s=0; s<ALPHAATLAS_SIZE; s++) {
+				for (int c=0; c<ALPHAATLAS_CHANNELS; c++) {
+					bool inside = c == 2 && s/ALPHAMAP_SIZE == 5 && t/ALPHAMAP_SIZE == 9;
+					if (data[(t*ALPHAATLAS_SIZE + s)*ALPHAATLAS_CHANNELS + c] != (inside ? 255 : 0)) {
+						error = "a map was written outside its cell";
+						return false;
+					}
+				}
+			}
+		}
+
+		// linear filtering reads half a texel either side, that has to stay in the cell
+		for (int y=0; y<ALPHAATLAS_CELLS; y++) {
+			for (int x=0; x<ALPHAATLAS_CELLS; x++) {
+				float offsetS, offsetT, scale;
+				AlphaAtlas::cellTransform(x, y, offsetS, offsetT, scale);
+				for (int i=0; i<=8; i++) {
+					float u = i / 8.0f;
+					float s = (offsetS + u*scale) * ALPHAATLAS_SIZE;
+					float t = (offsetT + u*scale) * ALPHAATLAS_SIZE;
+					if (s - 0.5f < x*ALPHAMAP_SIZE - 1e-3f || s + 0.5f > (x+1)*ALPHAMAP_SIZE + 1e-3f ||
+						t - 0.5f < y*ALPHAMAP_SIZE - 1e-3f || t + 0.5f > (y+1)*ALPHAMAP_SIZE + 1e-3f) {
+						error = "a chunk's texture coordinates reach outside its cell";
+						return false;
+					}
+				}
+			}
+		}
+		return true;
+	}
+private:
+	const unsigned char *Map(int x, int y, int c) const
+	{
+		return &maps[((y*ALPHAATLAS_CELLS + x)*ALPHAATLAS_CHANNELS + c) * ALPHAMAP_SIZE*ALPHAMAP_SIZE];
+	}
+
+	AlphaAtlas atlas;
+	std::vector<unsigned char> maps;
+};
+
+// --
+
+static bool WriteArchiveFile(HANDLE mpq, const char *name, const void *data, size_t size)
+{
+	HANDLE fh;
+	if (!SFileCreateFile(mpq, name, 0, (DWORD)size, 0, MPQ_FILE_COMPRESS|MPQ_FILE_REPLACEEXISTING, &fh))
+		return false;
+	bool ok = SFileWriteFile(fh, data, (DWORD)size, MPQ_COMPRESSION_ZLIB);
+	return SFileFinishFile(fh) && ok;
+}
+
+static bool CreateBenchArchive(const wxString &fn, const BenchBlob &anim)
+{
+	HANDLE mpq;
+#ifndef _MINGW
+	if (!SFileCreateArchive(fn.fn_str(), MPQ_CREATE_ARCHIVE_V1, 1024, &mpq))
+#else
+	if (!SFileCreateArchive(fn.char_str(), MPQ_CREATE_ARCHIVE_V1, 1024, &mpq))
+#endif
+		return false;
+
+	bool ok = true;
+	BenchRandom rnd(1);
+
+	// model-like data: runs of small floats and zeros, compresses about as well as the real thing
+	std::vector<unsigned char> buf(BENCH_MPQ_FILE_SIZE);
+	for (size_t i=0; i<BENCH_MPQ_FILES && ok; i++) {
+		float *p = (float *)&buf[0];
+		for (size_t j=0; j<BENCH_MPQ_FILE_SIZE/sizeof(float); j++)
+			p[j] = (rnd.Next() & 3) ? (float)(int)rnd.NextFloat(-64, 64) * 0.25f : 0.0f;
+		char name[64];
+		sprintf(name, benchArchiveData, (int)i);
+		ok = WriteArchiveFile(mpq, name, &buf[0], buf.size());
+	}
+
+	// AnimationData.dbc: id, name, then filler fields
+	if (ok) {
+		const unsigned int fields = 8;
+		std::vector<unsigned int> records(BENCH_DBC_RECORDS * fields, 0);
+		std::string strings(1, '\0');
+		for (size_t i=0; i<BENCH_DBC_RECORDS; i++) {
+			unsigned int *r = &records[i * fields];
+			r[AnimDB::AnimID] = (unsigned int)i;
+			r[AnimDB::Name] = (unsigned int)strings.size();
+			char name[32];
+			sprintf(name, "Anim%u", (unsigned int)i);
+			strings.append(name);
+			strings.push_back('\0');
+			for (size_t j=2; j<fields; j++)
+				r[j] = rnd.Next() & 0xFF;
+		}
+		unsigned int header[5];
+		memcpy(&header[0], "WDBC", 4);
+		header[1] = BENCH_DBC_RECORDS;
+		header[2] = fields;
+		header[3] = fields * 4;
+		header[4] = (unsigned int)strings.size();
+
+		std::vector<unsigned char> dbc((unsigned char *)header, (unsigned char *)header + sizeof(header));
+		dbc.insert(dbc.end(), (unsigned char *)&records[0], (unsigned char *)&records[0] + records.size()*4);
+		dbc.insert(dbc.end(), strings.begin(), strings.end());
+		ok = WriteArchiveFile(mpq, benchArchiveDBC, &dbc[0], dbc.size());
+	}
+
+	if (ok)
+		ok = WriteArchiveFile(mpq, benchArchiveAnim, &anim.data[0], anim.data.size());
+
+	return SFileCloseArchive(mpq) && ok;
+}
+
+static BenchResult Measure(BenchCase &bench, double minTime, size_t samples)
+{
+	// find an iteration count that takes at least minTime
+	size_t iterations = 1;
+	for (;;) {
+		double start = BenchTime();
+		for (size_t i=0; i<iterations; i++)
+			bench.Run();
+		double elapsed = BenchTime() - start;
+		if (elapsed >= minTime || iterations >= (1u << 24))
+			break;
+		if (elapsed <= 0)
+			iterations *= 16;
+		else
+			iterations = (size_t)(iterations * (minTime * 1.2 / elapsed)) + 1;
+	}
+
+	std::vector<double> times;
+	for (size_t s=0; s<samples; s++) {
+		double start = BenchTime();
+		for (size_t i=0; i<iterations; i++)
+			bench.Run();
+		times.push_back((BenchTime() - start) / iterations);
+	}
+	std::sort(times.begin(), times.end());
+
+	BenchResult r;
+	r.name = bench.Name();
+	r.unit = bench.Unit();
+	r.items = bench.Items();
+	r.iterations = iterations;
+	r.samples = samples;
+	r.best = times[0];
+	r.median = times[times.size() / 2];
+	r.mean = 0;
+	for (size_t i=0; i<times.size(); i++)
+		r.mean += times[i];
+	r.mean /= times.size();
+	return r;
+}
+
+static void WriteResults(FILE *out, const std::vector<BenchResult> &results, bool csv)
+{
+	if (csv) {
+		fprintf(out, "name,unit,items,iterations,samples,best_ns,median_ns,mean_ns,items_per_sec\n");
+		for (size_t i=0; i<results.size(); i++) {
+			const BenchResult &r = results[i];
+			fprintf(out, "%s,%s,%.0f,%u,%u,%.1f,%.1f,%.1f,%.1f\n", r.name.c_str(), r.unit.c_str(), r.items,
+				(unsigned int)r.iterations, (unsigned int)r.samples, r.best*1e9, r.median*1e9, r.mean*1e9, r.items / r.median);
+		}
+		return;
+	}
+
+	fprintf(out, "{\n\t\"benchmark\": \"wmvbench\",\n\t\"results\": [\n");
+	for (size_t i=0; i<results.size(); i++) {
+		const BenchResult &r = results[i];
+		fprintf(out, "\t\t{\"name\": \"%s\", \"unit\": \"%s\", \"items\": %.0f, \"iterations\": %u, \"samples\": %u, "
+			"\"best_ns\": %.1f, \"median_ns\": %.1f, \"mean_ns\": %.1f, \"items_per_sec\": %.1f}%s\n",
+			r.name.c_str(), r.unit.c_str(), r.items, (unsigned int)r.iterations, (unsigned int)r.samples,
+			r.best*1e9, r.median*1e9, r.mean*1e9, r.items / r.median, (i+1 < results.size()) ? "," : "");
+	}
+	fprintf(out, "\t]\n}\n");
+}
+
+static void Usage()
+{
+	fprintf(stderr, "usage: wmvbench [--filter text] [--min-time seconds] [--samples n] [--csv] [--output file] [--list] [--check]\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *filter = NULL;
+	const char *output = NULL;
+	double minTime = 0.2;
+	size_t samples = 5;
+	bool csv = false;
+	bool list = false;
+	bool checkOnly = false;
+
+	for (int i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "--filter") && i+1 < argc)
+			filter = argv[++i];
+		else if (!strcmp(argv[i], "--output") && i+1 < argc)
+			output = argv[++i];
+		else if (!strcmp(argv[i], "--min-time") && i+1 < argc)
+			minTime = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--samples") && i+1 < argc)
+			samples = (size_t)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--csv"))
+			csv = true;
+		else if (!strcmp(argv[i], "--list"))
+			list = true;
+		else if (!strcmp(argv[i], "--check"))
+			checkOnly = true;
+		else {
+			Usage();
+			return 1;
+		}
+	}
+	if (samples < 1)
+		samples = 1;
+
+	wxInitializer initializer;
+	if (!initializer) {
+		fprintf(stderr, "wmvbench: failed to initialise wxWidgets\n");
+		return 1;
+	}
+	// the loaders log a lot, none of it matters here
+	wxLogNull noLog;
+
+	gameVersion = VERSION_WOTLK;
+	srand(1);
+
+	BenchBlob anim;
+	std::vector<ModelBoneDef> boneDefs;
+	ModelParticleEmitterDef emitterDef;
+	AnimationFixture::Build(anim, boneDefs, emitterDef);
+
+	wxString archive = wxFileName::CreateTempFileName(wxT("wmvbench"));
+	wxRemoveFile(archive);
+	archive += wxT(".mpq");
+	if (!CreateBenchArchive(archive, anim)) {
+		fprintf(stderr, "wmvbench: could not create %s\n", (const char *)archive.mb_str());
+		return 1;
+	}
+
+	MPQArchive *mpq = new MPQArchive(archive);
+
+	MPQFile f(wxString(benchArchiveAnim, wxConvUTF8));
+	Bone *bones = new Bone[BENCH_BONES];
+	for (size_t i=0; i<BENCH_BONES; i++) {
+		ModelBoneDef &def = boneDefs[i];
+		bones[i].calc = false;
+		bones[i].parent = def.parent;
+		bones[i].pivot = def.pivot;
+		bones[i].billboard = false;
+		bones[i].model = NULL;
+		bones[i].boneDef = def;
+		bones[i].trans.init(def.translation, f, NULL);
+		bones[i].rot.init(def.rotation, f, NULL);
+		bones[i].scale.init(def.scaling, f, NULL);
+	}
+
+	std::vector<BenchCase *> cases;
+	cases.push_back(new MPQOpenBench(archive));
+	cases.push_back(new MPQReadBench());
+	cases.push_back(new MPQHeaderBench());
+	cases.push_back(new DBCOpenBench());
+	cases.push_back(new DBCLookupBench());
+	cases.push_back(new BLPDecodeBench(BLPDecodeBench::BLP_PALETTE));
+	cases.push_back(new BLPDecodeBench(BLPDecodeBench::BLP_DXT1));
+	cases.push_back(new BLPDecodeBench(BLPDecodeBench::BLP_DXT3));
+	cases.push_back(new BLPDecodeBench(BLPDecodeBench::BLP_DXT5));
+	cases.push_back(new AnimatedBench(bones));
+	cases.push_back(new BoneMatrixBench(bones));
+	cases.push_back(new SkinningBench(bones));
+	cases.push_back(new ParticleBench(f, emitterDef, bones));
+	cases.push_back(new CharComposeBench());
+	cases.push_back(new CharResampleBench());
+	cases.push_back(VertexCacheBench::TerrainChunk());
+	cases.push_back(VertexCacheBench::Geoset());
+	cases.push_back(new WMODoodadTransformBench());
+	cases.push_back(new WMODoodadBatchBench());
+	cases.push_back(new AlphaAtlasBench());
+	f.close();
+
+	std::vector<BenchResult> results;
+	size_t failed = 0;
+	for (size_t i=0; i<cases.size(); i++) {
+		if (filter && !strstr(cases[i]->Name(), filter))
+			continue;
+		if (list) {
+			printf("%s\n", cases[i]->Name());
+			continue;
+		}
+
+		std::string error;
+		if (!cases[i]->Check(error)) {
+			fprintf(stderr, "wmvbench: %s failed: %s\n", cases[i]->Name(), error.c_str());
+			failed++;
+			continue;
+		}
+		if (checkOnly)
+			continue;
+
+		fprintf(stderr, "running %s...\n", cases[i]->Name());
+		results.push_back(Measure(*cases[i], minTime, samples));
+	}
+
+	for (size_t i=0; i<cases.size(); i++)
+		delete cases[i];
+	delete [] bones;
+	mpq->close();
+	delete mpq;
+	wxRemoveFile(archive);
+
+	if (list)
+		return 0;
+	if (checkOnly)
+		return failed ? 1 : 0;
+
+	FILE *out = stdout;
+	if (output) {
+		out = fopen(output, "w");
+		if (!out) {
+			fprintf(stderr, "wmvbench: could not write %s\n", output);
+			return 1;
+		}
+	}
+	WriteResults(out, results, csv);
+	if (out != stdout)
+		fclose(out);
+
+	return failed ? 1 : 0;
+}